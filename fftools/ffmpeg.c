@@ -502,6 +502,7 @@ static void ffmpeg_cleanup(int ret)
 
     for (i = 0; i < nb_filtergraphs; i++) {
         FilterGraph *fg = filtergraphs[i];
+        fg_thread_free(fg);
         avfilter_graph_free(&fg->graph);
         for (j = 0; j < fg->nb_inputs; j++) {
             InputFilter *ifilter = fg->inputs[j];
@@ -798,6 +799,72 @@ static void update_video_stats(OutputStream *ost, const AVPacket *pkt, int write
     fprintf(vstats_file, "type= %c\n", av_get_picture_type_char(ost->pict_type));
 }
 
+/* post-process a packet received from the encoder and send it to the muxer */
+static void output_encoded_packet(OutputFile *of, OutputStream *ost, AVPacket *pkt)
+{
+    AVCodecContext   *enc = ost->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
+               "duration:%s duration_time:%s\n",
+               type_desc,
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+    }
+
+    av_packet_rescale_ts(pkt, enc->time_base, ost->mux_timebase);
+
+    if (debug_ts) {
+        av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
+               "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
+               "duration:%s duration_time:%s\n",
+               type_desc,
+               av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
+               av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
+               av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+    }
+
+    ost->data_size_enc += pkt->size;
+
+    if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
+        update_video_stats(ost, pkt, !!vstats_filename);
+
+    ost->packets_encoded++;
+
+    of_output_packet(of, pkt, ost, 0);
+}
+
+/*
+ * Send the packets produced by the encoder thread to the muxer. With all set,
+ * wait for everything submitted so far, otherwise only until another frame
+ * can be submitted. The muxer puts the packets back in order with the other
+ * streams of the file, see setup_sync_queues().
+ */
+static int receive_encoded_packets(OutputFile *of, OutputStream *ost, int all)
+{
+    AVPacket *pkt = ost->pkt;
+    int ret;
+
+    while (all ? enc_pending(ost) : enc_full(ost)) {
+        ret = enc_receive(ost, pkt);
+        if (ret == AVERROR(EAGAIN)) {
+            continue;
+        } else if (ret == AVERROR_EOF) {
+            of_output_packet(of, pkt, ost, 1);
+            return ret;
+        } else if (ret < 0) {
+            return ret;
+        }
+
+        output_encoded_packet(of, ost, pkt);
+    }
+
+    return 0;
+}
+
 static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
 {
     AVCodecContext   *enc = ost->enc_ctx;
@@ -819,6 +886,24 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
         }
     }
 
+    if (ost->encoder) {
+        /* bound the number of frames in flight */
+        ret = receive_encoded_packets(of, ost, 0);
+        if (ret < 0)
+            return ret;
+
+        ret = enc_send(ost, frame);
+        if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
+                   type_desc);
+            return ret;
+        }
+
+        /* the packets for a frame are collected when the encoder thread is
+         * full, all the remaining ones when flushing */
+        return frame ? 0 : receive_encoded_packets(of, ost, 1);
+    }
+
     update_benchmark(NULL);
 
     ret = avcodec_send_frame(enc, frame);
@@ -840,44 +925,17 @@ static int encode_frame(OutputFile *of, OutputStream *ost, AVFrame *frame)
         if (ret == AVERROR(EAGAIN)) {
             av_assert0(frame); // should never happen during flushing
             return 0;
-        } else if (ret == AVERROR_EOF) {
-            of_output_packet(of, pkt, ost, 1);
-            return ret;
-        } else if (ret < 0) {
+        } else if (ret < 0 && ret != AVERROR_EOF) {
             av_log(NULL, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
             return ret;
         }
 
-        if (debug_ts) {
-            av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
-                   "duration:%s duration_time:%s\n",
-                   type_desc,
-                   av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
-                   av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
-                   av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
-        }
-
-        av_packet_rescale_ts(pkt, enc->time_base, ost->mux_timebase);
-
-        if (debug_ts) {
-            av_log(NULL, AV_LOG_INFO, "encoder -> type:%s "
-                   "pkt_pts:%s pkt_pts_time:%s pkt_dts:%s pkt_dts_time:%s "
-                   "duration:%s duration_time:%s\n",
-                   type_desc,
-                   av_ts2str(pkt->pts), av_ts2timestr(pkt->pts, &enc->time_base),
-                   av_ts2str(pkt->dts), av_ts2timestr(pkt->dts, &enc->time_base),
-                   av_ts2str(pkt->duration), av_ts2timestr(pkt->duration, &enc->time_base));
+        if (ret == AVERROR_EOF) {
+            of_output_packet(of, pkt, ost, 1);
+            return ret;
         }
 
-        ost->data_size_enc += pkt->size;
-
-        if (enc->codec_type == AVMEDIA_TYPE_VIDEO)
-            update_video_stats(ost, pkt, !!vstats_filename);
-
-        ost->packets_encoded++;
-
-        of_output_packet(of, pkt, ost, 0);
+        output_encoded_packet(of, ost, pkt);
     }
 
     av_assert0(0);
@@ -1026,6 +1084,7 @@ static void do_subtitle_out(OutputFile *of,
                 pkt->pts += av_rescale_q(sub->end_display_time, (AVRational){ 1, 1000 }, ost->mux_timebase);
         }
         pkt->dts = pkt->pts;
+
         of_output_packet(of, pkt, ost, 0);
     }
 }
@@ -1309,8 +1368,19 @@ static int reap_filters(int flush)
 
             switch (av_buffersink_get_type(filter)) {
             case AVMEDIA_TYPE_VIDEO:
-                if (!ost->frame_aspect_ratio.num)
+                if (!ost->frame_aspect_ratio.num &&
+                    (enc->sample_aspect_ratio.num != filtered_frame->sample_aspect_ratio.num ||
+                     enc->sample_aspect_ratio.den != filtered_frame->sample_aspect_ratio.den)) {
+                    // the encoder thread may be reading the context
+                    if (ost->encoder) {
+                        ret = receive_encoded_packets(of, ost, 1);
+                        if (ret < 0) {
+                            av_frame_unref(filtered_frame);
+                            return ret;
+                        }
+                    }
                     enc->sample_aspect_ratio = filtered_frame->sample_aspect_ratio;
+                }
 
                 do_video_out(of, ost, filtered_frame);
                 break;
@@ -1852,17 +1922,13 @@ static int ifilter_has_all_input_formats(FilterGraph *fg)
     return 1;
 }
 
-static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+/* determine if the parameters for this input changed */
+static int ifilter_need_reinit(InputFilter *ifilter, const AVFrame *frame)
 {
     FilterGraph *fg = ifilter->graph;
-    AVFrameSideData *sd;
-    int need_reinit, ret;
-    int buffersrc_flags = AV_BUFFERSRC_FLAG_PUSH;
-
-    if (keep_reference)
-        buffersrc_flags |= AV_BUFFERSRC_FLAG_KEEP_REF;
+    const AVFrameSideData *sd;
+    int need_reinit;
 
-    /* determine if the parameters for this input changed */
     need_reinit = ifilter->format != frame->format;
 
     switch (ifilter->ist->par->codec_type) {
@@ -1889,6 +1955,19 @@ static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_ref
     } else if (ifilter->displaymatrix)
         need_reinit = 1;
 
+    return need_reinit;
+}
+
+static int ifilter_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+{
+    FilterGraph *fg = ifilter->graph;
+    int need_reinit, ret;
+    int buffersrc_flags = AV_BUFFERSRC_FLAG_PUSH;
+
+    if (keep_reference)
+        buffersrc_flags |= AV_BUFFERSRC_FLAG_KEEP_REF;
+
+    need_reinit = ifilter_need_reinit(ifilter, frame);
     if (need_reinit) {
         ret = ifilter_parameters_from_frame(ifilter, frame);
         if (ret < 0)
@@ -1958,31 +2037,70 @@ static int ifilter_send_eof(InputFilter *ifilter, int64_t pts)
     return 0;
 }
 
-// This does not quite work like avcodec_decode_audio4/avcodec_decode_video2.
-// There is the following difference: if you got a frame, you must call
-// it again with pkt=NULL. pkt==NULL is treated differently from pkt->size==0
-// (pkt==NULL means get more output, pkt->size==0 is a flush/drain packet)
-static int decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, AVPacket *pkt)
+/*
+ * Decoding itself happens on the decoder thread of the stream, see
+ * ffmpeg_dec.c. When pkt is non-NULL, it is submitted for decoding (unless
+ * process_input_packet() already did so), otherwise the next output of the
+ * previously submitted packet is returned.
+ * eof is set when flushing the decoder, then at most one frame is returned for
+ * the packet.
+ */
+static int decode(InputStream *ist, AVFrame *frame, int *got_frame, AVPacket *pkt,
+                  int eof)
 {
-    int ret;
+    if (pkt && !ist->decode_deferred) {
+        int ret = dec_send(ist, pkt, eof);
+        if (ret < 0)
+            return ret;
+    }
 
-    *got_frame = 0;
+    return dec_receive(ist, frame, got_frame);
+}
 
-    if (pkt) {
-        ret = avcodec_send_packet(avctx, pkt);
-        // In particular, we don't expect AVERROR(EAGAIN), because we read all
-        // decoded frames with avcodec_receive_frame() until done.
-        if (ret < 0 && ret != AVERROR_EOF)
-            return ret;
+/*
+ * When a frame goes to several filtergraphs that are all configured for it,
+ * push it through those graphs in parallel on the filtergraph threads.
+ * Nothing else accesses the graphs until all of them are done, so the result
+ * is the same as pushing the frame to each graph in turn.
+ *
+ * @return 1 when the frame was sent to the filtergraph threads, 0 when it has
+ *         to be sent synchronously, a negative error code on failure
+ */
+static int send_frame_to_filters_threaded(InputStream *ist, AVFrame *decoded_frame)
+{
+    int ret = 0;
+
+    if (ist->nb_filters < 2)
+        return 0;
+
+    for (int i = 0; i < ist->nb_filters; i++) {
+        InputFilter *ifilter = ist->filters[i];
+
+        if (!ifilter->graph->graph || !ifilter->filter ||
+            ifilter_need_reinit(ifilter, decoded_frame))
+            return 0;
     }
 
-    ret = avcodec_receive_frame(avctx, frame);
-    if (ret < 0 && ret != AVERROR(EAGAIN))
+    for (int i = 0; i < ist->nb_filters; i++) {
+        ret = fg_thread_send_frame(ist->filters[i], decoded_frame,
+                                   i < ist->nb_filters - 1);
+        if (ret < 0)
+            break;
+    }
+
+    for (int i = 0; i < ist->nb_filters; i++) {
+        int err = fg_thread_wait(ist->filters[i]->graph);
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_ERROR,
+               "Failed to inject frame into filter network: %s\n", av_err2str(ret));
         return ret;
-    if (ret >= 0)
-        *got_frame = 1;
+    }
 
-    return 0;
+    return 1;
 }
 
 static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
@@ -1990,6 +2108,10 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
     int i, ret;
 
     av_assert1(ist->nb_filters > 0); /* ensure ret is initialized */
+
+    ret = send_frame_to_filters_threaded(ist, decoded_frame);
+    if (ret)
+        return FFMIN(ret, 0);
     for (i = 0; i < ist->nb_filters; i++) {
         ret = ifilter_send_frame(ist->filters[i], decoded_frame, i < ist->nb_filters - 1);
         if (ret == AVERROR_EOF)
@@ -2003,22 +2125,24 @@ static int send_frame_to_filters(InputStream *ist, AVFrame *decoded_frame)
     return ret;
 }
 
-static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
+static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output, int eof,
                         int *decode_failed)
 {
     AVFrame *decoded_frame = ist->decoded_frame;
     AVCodecContext *avctx = ist->dec_ctx;
+    int sample_rate;
     int ret, err = 0;
     AVRational decoded_frame_tb;
 
     update_benchmark(NULL);
-    ret = decode(avctx, decoded_frame, got_output, pkt);
+    ret = decode(ist, decoded_frame, got_output, pkt, eof);
     update_benchmark("decode_audio %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
 
-    if (ret >= 0 && avctx->sample_rate <= 0) {
-        av_log(avctx, AV_LOG_ERROR, "Sample rate %d invalid\n", avctx->sample_rate);
+    sample_rate = ist->dec_state.sample_rate;
+    if (ret >= 0 && sample_rate <= 0) {
+        av_log(avctx, AV_LOG_ERROR, "Sample rate %d invalid\n", sample_rate);
         ret = AVERROR_INVALIDDATA;
     }
 
@@ -2034,9 +2158,9 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
     /* increment next_dts to use for the case where the input stream does not
        have timestamps or there are multiple frames in the packet */
     ist->next_pts += ((int64_t)AV_TIME_BASE * decoded_frame->nb_samples) /
-                     avctx->sample_rate;
+                     sample_rate;
     ist->next_dts += ((int64_t)AV_TIME_BASE * decoded_frame->nb_samples) /
-                     avctx->sample_rate;
+                     sample_rate;
 
     if (decoded_frame->pts != AV_NOPTS_VALUE) {
         decoded_frame_tb   = ist->st->time_base;
@@ -2054,8 +2178,8 @@ static int decode_audio(InputStream *ist, AVPacket *pkt, int *got_output,
         ist->prev_pkt_pts = pkt->pts;
     if (decoded_frame->pts != AV_NOPTS_VALUE)
         decoded_frame->pts = av_rescale_delta(decoded_frame_tb, decoded_frame->pts,
-                                              (AVRational){1, avctx->sample_rate}, decoded_frame->nb_samples, &ist->filter_in_rescale_delta_last,
-                                              (AVRational){1, avctx->sample_rate});
+                                              (AVRational){1, sample_rate}, decoded_frame->nb_samples, &ist->filter_in_rescale_delta_last,
+                                              (AVRational){1, sample_rate});
     ist->nb_samples = decoded_frame->nb_samples;
     err = send_frame_to_filters(ist, decoded_frame);
 
@@ -2094,23 +2218,23 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
     }
 
     update_benchmark(NULL);
-    ret = decode(ist->dec_ctx, decoded_frame, got_output, pkt);
+    ret = decode(ist, decoded_frame, got_output, pkt, eof);
     update_benchmark("decode_video %d.%d", ist->file_index, ist->st->index);
     if (ret < 0)
         *decode_failed = 1;
 
     // The following line may be required in some cases where there is no parser
     // or the parser does not has_b_frames correctly
-    if (ist->par->video_delay < ist->dec_ctx->has_b_frames) {
+    if (ist->par->video_delay < ist->dec_state.has_b_frames) {
         if (ist->dec_ctx->codec_id == AV_CODEC_ID_H264) {
-            ist->par->video_delay = ist->dec_ctx->has_b_frames;
+            ist->par->video_delay = ist->dec_state.has_b_frames;
         } else
             av_log(ist->dec_ctx, AV_LOG_WARNING,
                    "video_delay is larger in decoder than demuxer %d > %d.\n"
                    "If you want to help, upload a sample "
                    "of this file to https://streams.videolan.org/upload/ "
                    "and contact the ffmpeg-devel mailing list. (ffmpeg-devel@ffmpeg.org)\n",
-                   ist->dec_ctx->has_b_frames,
+                   ist->dec_state.has_b_frames,
                    ist->par->video_delay);
     }
 
@@ -2118,16 +2242,16 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
         check_decode_result(ist, got_output, ret);
 
     if (*got_output && ret >= 0) {
-        if (ist->dec_ctx->width  != decoded_frame->width ||
-            ist->dec_ctx->height != decoded_frame->height ||
-            ist->dec_ctx->pix_fmt != decoded_frame->format) {
+        if (ist->dec_state.width   != decoded_frame->width ||
+            ist->dec_state.height  != decoded_frame->height ||
+            ist->dec_state.pix_fmt != decoded_frame->format) {
             av_log(NULL, AV_LOG_DEBUG, "Frame parameters mismatch context %d,%d,%d != %d,%d,%d\n",
                 decoded_frame->width,
                 decoded_frame->height,
                 decoded_frame->format,
-                ist->dec_ctx->width,
-                ist->dec_ctx->height,
-                ist->dec_ctx->pix_fmt);
+                ist->dec_state.width,
+                ist->dec_state.height,
+                ist->dec_state.pix_fmt);
         }
     }
 
@@ -2139,10 +2263,10 @@ static int decode_video(InputStream *ist, AVPacket *pkt, int *got_output, int64_
 
     ist->frames_decoded++;
 
-    if (ist->hwaccel_retrieve_data && decoded_frame->format == ist->hwaccel_pix_fmt) {
-        err = ist->hwaccel_retrieve_data(ist->dec_ctx, decoded_frame);
-        if (err < 0)
-            goto fail;
+    /* hwaccel frames were already downloaded by the decoder thread */
+    if (ist->dec_state.hwaccel_ret < 0) {
+        err = ist->dec_state.hwaccel_ret;
+        goto fail;
     }
 
     best_effort_timestamp= decoded_frame->best_effort_timestamp;
@@ -2275,8 +2399,13 @@ static int send_filter_eof(InputStream *ist)
     return 0;
 }
 
-/* pkt = NULL means EOF (needed to flush decoder buffers) */
-static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
+/*
+ * Decode the packet in ist->pkt, pass the output on to the filters and handle
+ * stream copy. pkt is the packet as read from the demuxer, NULL means EOF.
+ * When ist->decode_deferred is set, the packet has already been submitted to
+ * the decoder thread.
+ */
+static int process_packet_output(InputStream *ist, const AVPacket *pkt, int no_eof)
 {
     const AVCodecParameters *par = ist->par;
     int ret = 0;
@@ -2285,36 +2414,6 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
 
     AVPacket *avpkt = ist->pkt;
 
-    if (!ist->saw_first_ts) {
-        ist->first_dts =
-        ist->dts = ist->st->avg_frame_rate.num ? - ist->dec_ctx->has_b_frames * AV_TIME_BASE / av_q2d(ist->st->avg_frame_rate) : 0;
-        ist->pts = 0;
-        if (pkt && pkt->pts != AV_NOPTS_VALUE && !ist->decoding_needed) {
-            ist->first_dts =
-            ist->dts += av_rescale_q(pkt->pts, ist->st->time_base, AV_TIME_BASE_Q);
-            ist->pts = ist->dts; //unused but better to set it to a value thats not totally wrong
-        }
-        ist->saw_first_ts = 1;
-    }
-
-    if (ist->next_dts == AV_NOPTS_VALUE)
-        ist->next_dts = ist->dts;
-    if (ist->next_pts == AV_NOPTS_VALUE)
-        ist->next_pts = ist->pts;
-
-    if (pkt) {
-        av_packet_unref(avpkt);
-        ret = av_packet_ref(avpkt, pkt);
-        if (ret < 0)
-            return ret;
-    }
-
-    if (pkt && pkt->dts != AV_NOPTS_VALUE) {
-        ist->next_dts = ist->dts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
-        if (par->codec_type != AVMEDIA_TYPE_VIDEO || !ist->decoding_needed)
-            ist->next_pts = ist->pts = ist->dts;
-    }
-
     // while we have more to decode or while the decoder did output something on EOF
     while (ist->decoding_needed) {
         int64_t duration_dts = 0;
@@ -2327,7 +2426,7 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
 
         switch (par->codec_type) {
         case AVMEDIA_TYPE_AUDIO:
-            ret = decode_audio    (ist, repeating ? NULL : avpkt, &got_output,
+            ret = decode_audio    (ist, repeating ? NULL : avpkt, &got_output, !pkt,
                                    &decode_failed);
             av_packet_unref(avpkt);
             break;
@@ -2337,13 +2436,13 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
             if (!repeating || !pkt || got_output) {
                 if (pkt && pkt->duration) {
                     duration_dts = av_rescale_q(pkt->duration, ist->st->time_base, AV_TIME_BASE_Q);
-                } else if(ist->dec_ctx->framerate.num != 0 && ist->dec_ctx->framerate.den != 0) {
+                } else if(ist->dec_state.framerate.num != 0 && ist->dec_state.framerate.den != 0) {
                     int ticks = ist->last_pkt_repeat_pict >= 0 ?
                                 ist->last_pkt_repeat_pict + 1  :
-                                ist->dec_ctx->ticks_per_frame;
+                                ist->dec_state.ticks_per_frame;
                     duration_dts = ((int64_t)AV_TIME_BASE *
-                                    ist->dec_ctx->framerate.den * ticks) /
-                                    ist->dec_ctx->framerate.num / ist->dec_ctx->ticks_per_frame;
+                                    ist->dec_state.framerate.den * ticks) /
+                                    ist->dec_state.framerate.num / ist->dec_state.ticks_per_frame;
                 }
 
                 if(ist->dts != AV_NOPTS_VALUE && duration_dts) {
@@ -2411,6 +2510,15 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
         repeating = 1;
     }
 
+    /* make sure the decoder thread is done with this packet */
+    ret = dec_wait(ist);
+    ist->decode_deferred = 0;
+    if (ret < 0) {
+        av_log(NULL, AV_LOG_FATAL, "Decoder for stream #%d:%d terminated: %s\n",
+               ist->file_index, ist->st->index, av_err2str(ret));
+        exit_program(1);
+    }
+
     /* after flushing, send an EOF on all the filter inputs attached to the stream */
     /* except when looping we need to flush but not to send an EOF */
     if (!pkt && ist->decoding_needed && eof_reached && !no_eof) {
@@ -2468,6 +2576,96 @@ static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eo
     return !eof_reached;
 }
 
+/*
+ * Process the output of a packet submitted by process_input_packet() without
+ * waiting for it. Must be called before anything else is done with the stream.
+ */
+static int finish_deferred_packet(InputStream *ist)
+{
+    int ret;
+
+    if (!ist->decode_deferred)
+        return 0;
+
+    ret = process_packet_output(ist, ist->deferred_pkt, 0);
+    av_packet_unref(ist->deferred_pkt);
+
+    return ret;
+}
+
+/* pkt = NULL means EOF (needed to flush decoder buffers) */
+static int process_input_packet(InputStream *ist, const AVPacket *pkt, int no_eof)
+{
+    const AVCodecParameters *par = ist->par;
+    AVPacket *avpkt = ist->pkt;
+    int ret;
+
+    ret = finish_deferred_packet(ist);
+    if (ret < 0)
+        return ret;
+
+    if (!ist->saw_first_ts) {
+        ist->first_dts =
+        ist->dts = ist->st->avg_frame_rate.num ? - ist->dec_ctx->has_b_frames * AV_TIME_BASE / av_q2d(ist->st->avg_frame_rate) : 0;
+        ist->pts = 0;
+        if (pkt && pkt->pts != AV_NOPTS_VALUE && !ist->decoding_needed) {
+            ist->first_dts =
+            ist->dts += av_rescale_q(pkt->pts, ist->st->time_base, AV_TIME_BASE_Q);
+            ist->pts = ist->dts; //unused but better to set it to a value thats not totally wrong
+        }
+        ist->saw_first_ts = 1;
+    }
+
+    if (ist->next_dts == AV_NOPTS_VALUE)
+        ist->next_dts = ist->dts;
+    if (ist->next_pts == AV_NOPTS_VALUE)
+        ist->next_pts = ist->pts;
+
+    if (pkt) {
+        av_packet_unref(avpkt);
+        ret = av_packet_ref(avpkt, pkt);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (pkt && pkt->dts != AV_NOPTS_VALUE) {
+        ist->next_dts = ist->dts = av_rescale_q(pkt->dts, ist->st->time_base, AV_TIME_BASE_Q);
+        if (par->codec_type != AVMEDIA_TYPE_VIDEO || !ist->decoding_needed)
+            ist->next_pts = ist->pts = ist->dts;
+    }
+
+    /* Only submit audio and video packets to the decoder thread here and
+     * return to the main loop, so that decoding overlaps with the processing
+     * of other streams. The output is processed when the next packet for this
+     * stream is read or when the decoder is flushed. */
+    if (pkt && ist->decoding_needed &&
+        (par->codec_type == AVMEDIA_TYPE_AUDIO ||
+         (par->codec_type == AVMEDIA_TYPE_VIDEO && pkt->size))) {
+        ret = av_packet_ref(ist->deferred_pkt, pkt);
+        if (ret < 0)
+            return ret;
+
+        ist->pts = ist->next_pts;
+        ist->dts = ist->next_dts;
+
+        // same as done by decode_video() when submitting the packet
+        if (par->codec_type == AVMEDIA_TYPE_VIDEO)
+            avpkt->dts = ist->dts != AV_NOPTS_VALUE ?
+                         av_rescale_q(ist->dts, AV_TIME_BASE_Q, ist->st->time_base) :
+                         AV_NOPTS_VALUE;
+
+        ret = dec_send(ist, avpkt, 0);
+        if (ret >= 0) {
+            ist->decode_deferred = 1;
+            return 1;
+        }
+        // let process_packet_output() retry and report the failure
+        av_packet_unref(ist->deferred_pkt);
+    }
+
+    return process_packet_output(ist, pkt, no_eof);
+}
+
 static enum AVPixelFormat get_format(AVCodecContext *s, const enum AVPixelFormat *pix_fmts)
 {
     InputStream *ist = s->opaque;
@@ -2573,6 +2771,18 @@ static int init_input_stream(InputStream *ist, char *error, int error_len)
             return ret;
         }
         assert_avoptions(ist->decoder_opts);
+
+        if (ist->dec_ctx->codec_type == AVMEDIA_TYPE_AUDIO ||
+            ist->dec_ctx->codec_type == AVMEDIA_TYPE_VIDEO) {
+            ret = dec_open(ist);
+            if (ret < 0) {
+                snprintf(error, error_len,
+                         "Error starting decoder thread for input stream "
+                         "#%d:%d : %s",
+                         ist->file_index, ist->st->index, av_err2str(ret));
+                return ret;
+            }
+        }
     }
 
     ist->next_pts = AV_NOPTS_VALUE;
@@ -2812,7 +3022,7 @@ static int init_output_stream_encode(OutputStream *ost, AVFrame *frame)
         if (ost->bits_per_raw_sample)
             enc_ctx->bits_per_raw_sample = ost->bits_per_raw_sample;
         else if (dec_ctx && ost->filter->graph->is_meta)
-            enc_ctx->bits_per_raw_sample = FFMIN(dec_ctx->bits_per_raw_sample,
+            enc_ctx->bits_per_raw_sample = FFMIN(ist->dec_state.bits_per_raw_sample,
                                                  av_get_bytes_per_sample(enc_ctx->sample_fmt) << 3);
 
         init_encoder_time_base(ost, av_make_q(1, enc_ctx->sample_rate));
@@ -2843,7 +3053,7 @@ static int init_output_stream_encode(OutputStream *ost, AVFrame *frame)
         if (ost->bits_per_raw_sample)
             enc_ctx->bits_per_raw_sample = ost->bits_per_raw_sample;
         else if (dec_ctx && ost->filter->graph->is_meta)
-            enc_ctx->bits_per_raw_sample = FFMIN(dec_ctx->bits_per_raw_sample,
+            enc_ctx->bits_per_raw_sample = FFMIN(ist->dec_state.bits_per_raw_sample,
                                                  av_pix_fmt_desc_get(enc_ctx->pix_fmt)->comp[0].depth);
 
         if (frame) {
@@ -3027,6 +3237,17 @@ static int init_output_stream(OutputStream *ost, AVFrame *frame,
         // copy estimated duration as a hint to the muxer
         if (ost->st->duration <= 0 && ist && ist->st->duration > 0)
             ost->st->duration = av_rescale_q(ist->st->duration, ist->st->time_base, ost->st->time_base);
+
+        // run encoders that cannot use more than one thread on their own
+        // thread, so that they run in parallel with the rest of the pipeline
+        if (enc_threaded(codec)) {
+            ret = enc_open(ost);
+            if (ret < 0) {
+                snprintf(error, error_len, "Error starting the encoder thread "
+                         "for output stream #%d:%d", ost->file_index, ost->index);
+                return ret;
+            }
+        }
     } else if (ost->ist) {
         ret = init_output_stream_streamcopy(ost);
         if (ret < 0)
@@ -3304,7 +3525,7 @@ static int check_keyboard_interaction(int64_t cur_time)
             InputStream *ist = ist_iter(NULL);
 
             if (ist)
-                debug = ist->dec_ctx->debug << 1;
+                debug = dec_get_debug(ist) << 1;
 
             if(!debug) debug = 1;
             while (debug & FF_DEBUG_DCT_COEFF) //unsupported, would just crash
@@ -3323,11 +3544,16 @@ static int check_keyboard_interaction(int64_t cur_time)
             if (k <= 0 || sscanf(buf, "%d", &debug)!=1)
                 fprintf(stderr,"error parsing debug value\n");
         }
-        for (InputStream *ist = ist_iter(NULL); ist; ist = ist_iter(ist))
-            ist->dec_ctx->debug = debug;
+        for (InputStream *ist = ist_iter(NULL); ist; ist = ist_iter(ist)) {
+            int ret = dec_set_debug(ist, debug);
+            if (ret < 0)
+                av_log(NULL, AV_LOG_ERROR, "Error setting the decoder debug "
+                       "flags for stream #%d:%d: %s\n", ist->file_index,
+                       ist->st->index, av_err2str(ret));
+        }
         for (OutputStream *ost = ost_iter(NULL); ost; ost = ost_iter(ost)) {
             if (ost->enc_ctx)
-                ost->enc_ctx->debug = debug;
+                enc_set_debug(ost, debug);
         }
         if(debug) av_log_set_level(AV_LOG_DEBUG);
         fprintf(stderr,"debug=%d\n", debug);
@@ -3566,6 +3792,11 @@ static int process_input(int file_index)
         }
     }
 
+    // the output of the previous packet updates the predicted timestamps
+    ret = finish_deferred_packet(ist);
+    if (ret < 0)
+        goto discard_packet;
+
     // detect and try to correct for timestamp discontinuities
     ts_discontinuity_process(ifile, ist, pkt);
 
@@ -3660,6 +3891,17 @@ static int transcode_step(void)
         return AVERROR_EOF;
     }
 
+    /* filters combining several inputs depend on the order in which these
+     * get their data, so process the deferred output of all of them before
+     * choosing the input to read from */
+    if (ost->filter && ost->filter->graph->nb_inputs > 1) {
+        for (int i = 0; i < ost->filter->graph->nb_inputs; i++) {
+            ret = finish_deferred_packet(ost->filter->graph->inputs[i]->ist);
+            if (ret < 0)
+                return ret;
+        }
+    }
+
     if (ost->filter && !ost->filter->graph->graph) {
         if (ifilter_has_all_input_formats(ost->filter->graph)) {
             ret = configure_filtergraph(ost->filter->graph);
@@ -302,11 +302,15 @@ typedef struct OutputFilter {
     const int *sample_rates;
 } OutputFilter;
 
+typedef struct FilterGraphThread FilterGraphThread;
+
 typedef struct FilterGraph {
     int            index;
     const char    *graph_desc;
 
     AVFilterGraph *graph;
+    /* runs the graph when a frame is sent to several graphs at once */
+    FilterGraphThread *thread;
     int reconfiguration;
     // true when the filtergraph contains only meta filters
     // that do not modify the frame data
@@ -318,6 +322,8 @@ typedef struct FilterGraph {
     int         nb_outputs;
 } FilterGraph;
 
+typedef struct Decoder Decoder;
+
 typedef struct InputStream {
     int file_index;
     AVStream *st;
@@ -339,6 +345,30 @@ typedef struct InputStream {
     AVFrame *decoded_frame;
     AVPacket *pkt;
 
+    /* audio/video decoding runs on a separate thread, see ffmpeg_dec.c */
+    Decoder *decoder;
+    /* set when ist->pkt was submitted to the decoder thread and its output
+     * has not been processed yet, deferred_pkt is the packet as demuxed */
+    int decode_deferred;
+    AVPacket *deferred_pkt;
+    /**
+     * Decoder context state captured on the decoder thread together with the
+     * output most recently returned by dec_receive(). dec_ctx fields that the
+     * decoder updates should be read from here while a packet is in flight.
+     */
+    struct {
+        int        has_b_frames;
+        AVRational framerate;
+        int        ticks_per_frame;
+        int        sample_rate;
+        int        width;
+        int        height;
+        int        pix_fmt;
+        int        bits_per_raw_sample;
+        /* return value of hwaccel_retrieve_data() for the returned frame */
+        int        hwaccel_ret;
+    } dec_state;
+
     AVRational framerate_guessed;
 
     int64_t       prev_pkt_pts;
@@ -508,6 +538,8 @@ typedef struct KeyframeForceCtx {
     int          dropped_keyframe;
 } KeyframeForceCtx;
 
+typedef struct Encoder Encoder;
+
 typedef struct OutputStream {
     int file_index;          /* file index */
     int index;               /* stream index in the output file */
@@ -538,6 +570,9 @@ typedef struct OutputStream {
     AVRational enc_timebase;
 
     AVCodecContext *enc_ctx;
+    /* encoders without internal threading run on a separate thread,
+     * see ffmpeg_enc.c; NULL otherwise */
+    Encoder *encoder;
     AVFrame *filtered_frame;
     AVFrame *last_frame;
     AVFrame *sq_frame;
@@ -726,6 +761,24 @@ void sub2video_update(InputStream *ist, int64_t heartbeat_pts, AVSubtitle *sub);
 
 int ifilter_parameters_from_frame(InputFilter *ifilter, const AVFrame *frame);
 
+/**
+ * Send a frame to an input of a configured filtergraph, the frame is pushed
+ * through the graph on the filtergraph thread. The graph must not be accessed
+ * otherwise until fg_thread_wait() is called.
+ *
+ * @param keep_reference when zero, the frame reference is moved to the
+ *                       filtergraph thread, otherwise a new one is created
+ */
+int  fg_thread_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference);
+/**
+ * Wait until the filtergraph thread has pushed all the frames sent to it.
+ *
+ * @return the first error other than AVERROR_EOF returned while pushing the
+ *         frames into the graph, 0 otherwise
+ */
+int  fg_thread_wait(FilterGraph *fg);
+void fg_thread_free(FilterGraph *fg);
+
 int ffmpeg_parse_options(int argc, char **argv);
 
 HWDevice *hw_device_get_by_name(const char *name);
@@ -778,6 +831,108 @@ void ifile_close(InputFile **f);
  */
 int ifile_get_packet(InputFile *f, AVPacket **pkt);
 
+/**
+ * Start the decoder thread for an input stream with an opened decoder.
+ */
+int  dec_open(InputStream *ist);
+void dec_free(Decoder **pdec);
+
+/**
+ * Submit a packet to the decoder thread. All the output for the previously
+ * submitted packet must have been retrieved with dec_receive() or dec_wait().
+ *
+ * @param pkt the packet to decode, an empty packet drains the decoder
+ * @param single when non-zero, at most one frame is returned for this packet;
+ *               otherwise frames are returned until the decoder needs more
+ *               input
+ */
+int dec_send(InputStream *ist, const AVPacket *pkt, int single);
+
+/**
+ * Retrieve the output of the next decode call performed by the decoder thread
+ * for the last submitted packet. The frame is moved from the decoder thread
+ * without copying the data. ist->dec_state is updated to match it.
+ *
+ * @param got_frame set to 1 when a frame was written to frame, 0 otherwise
+ * @return 0 or a negative error code returned by the decoder
+ */
+int dec_receive(InputStream *ist, AVFrame *frame, int *got_frame);
+
+/**
+ * Set AVCodecContext.debug of the decoder. With a running decoder thread, the
+ * value is passed along with the next submitted packet and applies from that
+ * packet on.
+ */
+int dec_set_debug(InputStream *ist, int debug);
+/**
+ * @return the value last set with dec_set_debug() or the initial one
+ */
+int dec_get_debug(const InputStream *ist);
+
+/**
+ * Wait until the decoder thread has finished processing the last submitted
+ * packet, discarding any output that was not retrieved. The codec context
+ * may be accessed by the caller afterwards, until the next dec_send().
+ *
+ * @return 0, or a negative error code if the decoder thread terminated;
+ *         decoding errors for the discarded output are not returned
+ */
+int dec_wait(InputStream *ist);
+
+/**
+ * Start the encoder thread for an output stream with an opened encoder.
+ */
+int  enc_open(OutputStream *ost);
+void enc_free(Encoder **penc);
+
+/**
+ * @return non-zero when the encoder should run on its own thread, i.e. it is
+ *         an audio or video encoder without internal threading; slice threading
+ *         of audio encoders does not count
+ */
+int enc_threaded(const AVCodec *codec);
+
+/**
+ * @return non-zero when no more frames can be sent to the encoder thread
+ *         before the output for the previous ones is retrieved with
+ *         enc_receive()
+ */
+int enc_full(OutputStream *ost);
+
+/**
+ * @return non-zero while enc_receive() may still return packets or AVERROR_EOF
+ *         for the frames and flush requests submitted so far
+ */
+int enc_pending(OutputStream *ost);
+
+/**
+ * Set AVCodecContext.debug of the encoder. With a running encoder thread, the
+ * value is passed along with the next submitted frame and applies from that
+ * frame on.
+ */
+void enc_set_debug(OutputStream *ost, int debug);
+
+/**
+ * Submit a frame to the encoder thread, without waiting for it to be encoded.
+ *
+ * @param frame the frame to encode, NULL flushes the encoder
+ */
+int enc_send(OutputStream *ost, const AVFrame *frame);
+
+/**
+ * Retrieve the next packet produced by the encoder thread for the frames
+ * submitted so far, waiting for it if necessary.
+ *
+ * @return
+ * - 0 when a packet was written to pkt
+ * - AVERROR(EAGAIN) when all the packets for the oldest submitted frame were
+ *   returned, or no frames are pending
+ * - AVERROR_EOF once for every flush request, after the encoder was fully
+ *   flushed
+ * - another negative error code on failure
+ */
+int enc_receive(OutputStream *ost, AVPacket *pkt);
+
 /* iterate over all input streams in all input files;
  * pass NULL to start iteration */
 InputStream *ist_iter(InputStream *prev);
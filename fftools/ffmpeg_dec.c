@@ -0,0 +1,484 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
+
+#include "libavutil/avassert.h"
+#include "libavutil/buffer.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "libavcodec/avcodec.h"
+#include "libavcodec/packet.h"
+
+/* passed in AVPacket.opaque: return at most one frame for this packet */
+#define DEC_PKT_SINGLE ((void*)(intptr_t)1)
+
+/* the output of a single decode call made on the decoder thread */
+typedef struct DecodeResult {
+    AVFrame *frame;
+    int      ret;
+    int      got_frame;
+    /* no more results will be produced for the current packet */
+    int      last;
+
+    int        has_b_frames;
+    AVRational framerate;
+    int        ticks_per_frame;
+    int        sample_rate;
+    int        width;
+    int        height;
+    int        pix_fmt;
+    int        hwaccel_ret;
+    int        bits_per_raw_sample;
+} DecodeResult;
+
+struct Decoder {
+    pthread_t    thread;
+
+    /* packets sent from the main thread to the decoder thread */
+    ThreadQueue *queue_in;
+    /* decode results sent from the decoder thread to the main thread */
+    ThreadQueue *queue_out;
+
+    /* main-thread-owned objects used for communication with the queues */
+    AVPacket     *pkt;
+    DecodeResult *res;
+
+    /* a packet has been sent and its last result was not received yet */
+    int pending;
+
+    /* the value last set by dec_set_debug() */
+    int debug;
+    /* debug was changed and must be passed along with the next packet */
+    int debug_changed;
+
+    /* the error the decoder thread terminated with; written by the decoder
+     * thread before it closes queue_out, read on the main thread after */
+    int thread_ret;
+    /* the decoder thread terminated, set on the main thread */
+    int finished;
+};
+
+static void *result_alloc(void)
+{
+    DecodeResult *res = av_mallocz(sizeof(*res));
+
+    if (!res)
+        return NULL;
+
+    res->frame = av_frame_alloc();
+    if (!res->frame)
+        av_freep(&res);
+
+    return res;
+}
+
+static void result_reset(void *obj)
+{
+    DecodeResult *res = obj;
+    AVFrame    *frame = res->frame;
+
+    av_frame_unref(frame);
+    memset(res, 0, sizeof(*res));
+    res->frame = frame;
+}
+
+static void result_free(void **obj)
+{
+    DecodeResult *res = *obj;
+
+    if (res)
+        av_frame_free(&res->frame);
+    av_freep(obj);
+}
+
+static void result_move(void *dst, void *src)
+{
+    DecodeResult *d = dst;
+    DecodeResult *s = src;
+    AVFrame  *frame = d->frame;
+
+    av_frame_unref(frame);
+    av_frame_move_ref(frame, s->frame);
+
+    *d = *s;
+    d->frame = frame;
+
+    result_reset(s);
+}
+
+static void pkt_move(void *dst, void *src)
+{
+    av_packet_move_ref(dst, src);
+}
+
+// This does not quite work like avcodec_decode_audio4/avcodec_decode_video2.
+// There is the following difference: if you got a frame, you must call
+// it again with pkt=NULL. pkt==NULL is treated differently from pkt->size==0
+// (pkt==NULL means get more output, pkt->size==0 is a flush/drain packet)
+static int decode(AVCodecContext *avctx, AVFrame *frame, int *got_frame, AVPacket *pkt)
+{
+    int ret;
+
+    *got_frame = 0;
+
+    if (pkt) {
+        ret = avcodec_send_packet(avctx, pkt);
+        // In particular, we don't expect AVERROR(EAGAIN), because we read all
+        // decoded frames with avcodec_receive_frame() until done.
+        if (ret < 0 && ret != AVERROR_EOF)
+            return ret;
+    }
+
+    ret = avcodec_receive_frame(avctx, frame);
+    if (ret < 0 && ret != AVERROR(EAGAIN))
+        return ret;
+    if (ret >= 0)
+        *got_frame = 1;
+
+    return 0;
+}
+
+static int decode_packet(InputStream *ist, AVPacket *pkt, DecodeResult *res)
+{
+    Decoder        *d = ist->decoder;
+    AVCodecContext *avctx = ist->dec_ctx;
+    int single = pkt->opaque == DEC_PKT_SINGLE;
+    int ret, last;
+
+    pkt->opaque = NULL;
+
+    /* keep decoding until the decoder asks for more input, the same way
+     * process_input_packet() consumes the results */
+    while (1) {
+        res->ret = decode(avctx, res->frame, &res->got_frame, pkt);
+        pkt = NULL;
+
+        if (res->got_frame && res->ret >= 0 &&
+            ist->hwaccel_retrieve_data && res->frame->format == ist->hwaccel_pix_fmt)
+            res->hwaccel_ret = ist->hwaccel_retrieve_data(avctx, res->frame);
+
+        res->has_b_frames    = avctx->has_b_frames;
+        res->framerate       = avctx->framerate;
+        res->ticks_per_frame = avctx->ticks_per_frame;
+        res->sample_rate     = avctx->sample_rate;
+        res->width           = avctx->width;
+        res->height          = avctx->height;
+        res->pix_fmt         = avctx->pix_fmt;
+        res->bits_per_raw_sample = avctx->bits_per_raw_sample;
+
+        last = res->ret < 0 || !res->got_frame || res->hwaccel_ret < 0 || single;
+        res->last = last;
+
+        ret = tq_send(d->queue_out, 0, res);
+        if (ret < 0)
+            return ret;
+
+        if (last)
+            return 0;
+    }
+}
+
+static void thread_set_name(InputStream *ist)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "dec%d:%d:%s", ist->file_index, ist->st->index,
+             ist->dec->name);
+    ff_thread_setname(name);
+}
+
+static void *decoder_thread(void *arg)
+{
+    InputStream  *ist = arg;
+    Decoder        *d = ist->decoder;
+    AVPacket     *pkt = NULL;
+    DecodeResult *res = NULL;
+    int           ret = 0;
+
+    pkt = av_packet_alloc();
+    res = result_alloc();
+    if (!pkt || !res) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    thread_set_name(ist);
+
+    while (1) {
+        int dummy;
+
+        ret = tq_receive(d->queue_in, &dummy, pkt);
+        if (ret < 0) {
+            ret = 0;
+            break;
+        }
+
+        // a new AVCodecContext.debug value set by dec_set_debug()
+        if (pkt->opaque_ref) {
+            memcpy(&ist->dec_ctx->debug, pkt->opaque_ref->data,
+                   sizeof(ist->dec_ctx->debug));
+            av_buffer_unref(&pkt->opaque_ref);
+        }
+
+        ret = decode_packet(ist, pkt, res);
+        av_packet_unref(pkt);
+        if (ret < 0)
+            break;
+    }
+
+finish:
+    av_packet_free(&pkt);
+    result_free((void**)&res);
+
+    d->thread_ret = ret;
+
+    tq_receive_finish(d->queue_in, 0);
+    tq_send_finish(d->queue_out, 0);
+
+    av_log(NULL, AV_LOG_VERBOSE, "Terminating decoder thread %d:%d\n",
+           ist->file_index, ist->st->index);
+
+    return (void*)(intptr_t)ret;
+}
+
+int dec_send(InputStream *ist, const AVPacket *pkt, int single)
+{
+    Decoder *d = ist->decoder;
+    int ret;
+
+    av_assert0(!d->pending);
+
+    // av_packet_ref() would allocate data for an empty packet, which then
+    // would not be treated as a drain request by the decoder
+    ret = pkt->size ? av_packet_ref(d->pkt, pkt) : av_packet_copy_props(d->pkt, pkt);
+    if (ret < 0) {
+        av_packet_unref(d->pkt);
+        return ret;
+    }
+    d->pkt->opaque = single ? DEC_PKT_SINGLE : NULL;
+
+    // the codec context belongs to the decoder thread, which applies the
+    // value before decoding this packet
+    av_buffer_unref(&d->pkt->opaque_ref);
+    if (d->debug_changed) {
+        d->pkt->opaque_ref = av_buffer_alloc(sizeof(d->debug));
+        if (!d->pkt->opaque_ref) {
+            av_packet_unref(d->pkt);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(d->pkt->opaque_ref->data, &d->debug, sizeof(d->debug));
+    }
+
+    ret = tq_send(d->queue_in, 0, d->pkt);
+    av_packet_unref(d->pkt);
+    if (ret < 0)
+        return ret;
+
+    d->pending       = 1;
+    d->debug_changed = 0;
+
+    return 0;
+}
+
+int dec_receive(InputStream *ist, AVFrame *frame, int *got_frame)
+{
+    Decoder       *d = ist->decoder;
+    DecodeResult *res = d->res;
+    int ret, dummy;
+
+    *got_frame = 0;
+
+    // nothing more to output for the last packet
+    if (!d->pending)
+        return 0;
+
+    ret = tq_receive(d->queue_out, &dummy, res);
+    if (ret < 0) {
+        // the decoder thread terminated
+        d->pending  = 0;
+        d->finished = 1;
+        if (ret == AVERROR_EOF)
+            ret = d->thread_ret < 0 ? d->thread_ret : AVERROR_EXTERNAL;
+        return ret;
+    }
+
+    d->pending = !res->last;
+
+    ist->dec_state.has_b_frames    = res->has_b_frames;
+    ist->dec_state.framerate       = res->framerate;
+    ist->dec_state.ticks_per_frame = res->ticks_per_frame;
+    ist->dec_state.sample_rate     = res->sample_rate;
+    ist->dec_state.width           = res->width;
+    ist->dec_state.height          = res->height;
+    ist->dec_state.pix_fmt         = res->pix_fmt;
+    ist->dec_state.hwaccel_ret     = res->hwaccel_ret;
+    ist->dec_state.bits_per_raw_sample = res->bits_per_raw_sample;
+
+    if (res->got_frame) {
+        av_frame_move_ref(frame, res->frame);
+        *got_frame = 1;
+    }
+
+    ret = res->ret;
+    result_reset(res);
+
+    return ret;
+}
+
+int dec_set_debug(InputStream *ist, int debug)
+{
+    Decoder *d = ist->decoder;
+
+    if (!d) {
+        ist->dec_ctx->debug = debug;
+        return 0;
+    }
+
+    // sent to the decoder thread together with the next packet, so this never
+    // blocks on a packet still being decoded
+    d->debug         = debug;
+    d->debug_changed = 1;
+
+    return 0;
+}
+
+int dec_get_debug(const InputStream *ist)
+{
+    return ist->decoder ? ist->decoder->debug : ist->dec_ctx->debug;
+}
+
+int dec_wait(InputStream *ist)
+{
+    Decoder *d = ist->decoder;
+    int ret, got_frame;
+
+    while (d && d->pending) {
+        AVFrame *frame = ist->decoded_frame;
+
+        ret = dec_receive(ist, frame, &got_frame);
+        av_frame_unref(frame);
+        // decoding errors only concern the discarded output, but a
+        // terminated decoder thread cannot decode anything further
+        if (ret < 0 && d->finished)
+            return ret;
+    }
+
+    return 0;
+}
+
+static void thread_stop(Decoder *d)
+{
+    if (!d->queue_in)
+        return;
+
+    tq_send_finish(d->queue_in, 0);
+    tq_receive_finish(d->queue_out, 0);
+
+    pthread_join(d->thread, NULL);
+
+    tq_free(&d->queue_in);
+    tq_free(&d->queue_out);
+}
+
+void dec_free(Decoder **pdec)
+{
+    Decoder *d = *pdec;
+
+    if (!d)
+        return;
+
+    thread_stop(d);
+
+    av_packet_free(&d->pkt);
+    result_free((void**)&d->res);
+
+    av_freep(pdec);
+}
+
+int dec_open(InputStream *ist)
+{
+    Decoder *d;
+    ObjPool *op;
+    int ret;
+
+    d = av_mallocz(sizeof(*d));
+    if (!d)
+        return AVERROR(ENOMEM);
+    ist->decoder = d;
+
+    ist->dec_state.has_b_frames    = ist->dec_ctx->has_b_frames;
+    ist->dec_state.framerate       = ist->dec_ctx->framerate;
+    ist->dec_state.ticks_per_frame = ist->dec_ctx->ticks_per_frame;
+    ist->dec_state.sample_rate     = ist->dec_ctx->sample_rate;
+    ist->dec_state.width           = ist->dec_ctx->width;
+    ist->dec_state.height          = ist->dec_ctx->height;
+    ist->dec_state.pix_fmt         = ist->dec_ctx->pix_fmt;
+    ist->dec_state.bits_per_raw_sample = ist->dec_ctx->bits_per_raw_sample;
+
+    d->debug = ist->dec_ctx->debug;
+
+    d->pkt = av_packet_alloc();
+    d->res = result_alloc();
+    if (!d->pkt || !d->res)
+        return AVERROR(ENOMEM);
+
+    /* packets are sent one at a time, the main thread always waits for all
+     * the output of a packet before sending the next one */
+    op = objpool_alloc_packets();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    d->queue_in = tq_alloc(1, 1, op, pkt_move);
+    if (!d->queue_in) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc(result_alloc, result_reset, result_free);
+    if (!op) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    d->queue_out = tq_alloc(1, 8, op, result_move);
+    if (!d->queue_out) {
+        objpool_free(&op);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = pthread_create(&d->thread, NULL, decoder_thread, ist);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    tq_free(&d->queue_in);
+    tq_free(&d->queue_out);
+    return ret;
+}
@@ -463,6 +463,7 @@ static void ist_free(InputStream **pist)
 
     av_frame_free(&ist->decoded_frame);
     av_packet_free(&ist->pkt);
+    av_packet_free(&ist->deferred_pkt);
     av_dict_free(&ist->decoder_opts);
     avsubtitle_free(&ist->prev_sub.subtitle);
     av_frame_free(&ist->sub2video.frame);
@@ -470,6 +471,7 @@ static void ist_free(InputStream **pist)
     av_freep(&ist->hwaccel_device);
     av_freep(&ist->dts_buffer);
 
+    dec_free(&ist->decoder);
     avcodec_free_context(&ist->dec_ctx);
     avcodec_parameters_free(&ist->par);
 
@@ -745,8 +747,9 @@ static void add_input_streams(const OptionsContext *o, Demuxer *d)
         if (!ist->decoded_frame)
             report_and_exit(AVERROR(ENOMEM));
 
-        ist->pkt = av_packet_alloc();
-        if (!ist->pkt)
+        ist->pkt          = av_packet_alloc();
+        ist->deferred_pkt = av_packet_alloc();
+        if (!ist->pkt || !ist->deferred_pkt)
             report_and_exit(AVERROR(ENOMEM));
 
         if (o->bitexact)
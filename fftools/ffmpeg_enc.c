@@ -0,0 +1,433 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
+
+#include "libavutil/avassert.h"
+#include "libavutil/buffer.h"
+#include "libavutil/error.h"
+#include "libavutil/frame.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+
+#include "libavcodec/avcodec.h"
+#include "libavcodec/packet.h"
+
+/* the main thread never has more frames in flight than this, so that sending
+ * a frame never blocks */
+#define ENC_MAX_PENDING 8
+
+/* a single output of the encoder thread */
+typedef struct EncodeResult {
+    AVPacket *pkt;
+    /* 0 when pkt contains a packet, AVERROR(EAGAIN) when all the packets for
+     * a frame were returned, a negative error code on failure */
+    int       ret;
+} EncodeResult;
+
+struct Encoder {
+    pthread_t     thread;
+
+    /* frames sent from the main thread to the encoder thread */
+    ThreadQueue  *queue_in;
+    /* encode results sent from the encoder thread to the main thread */
+    ThreadQueue  *queue_out;
+
+    /* main-thread-owned objects used for communication with the queues */
+    AVFrame      *frame;
+    EncodeResult *res;
+
+    /* number of frames sent whose last result was not received yet */
+    int nb_pending;
+    /* a flush was requested and AVERROR_EOF was not returned for it yet */
+    int flushing;
+    /* the encoder was fully flushed */
+    int finished;
+
+    /* the value last set by enc_set_debug() */
+    int debug;
+    /* debug was changed and must be passed along with the next frame */
+    int debug_changed;
+};
+
+static void *result_alloc(void)
+{
+    EncodeResult *res = av_mallocz(sizeof(*res));
+
+    if (!res)
+        return NULL;
+
+    res->pkt = av_packet_alloc();
+    if (!res->pkt)
+        av_freep(&res);
+
+    return res;
+}
+
+static void result_reset(void *obj)
+{
+    EncodeResult *res = obj;
+
+    av_packet_unref(res->pkt);
+    res->ret = 0;
+}
+
+static void result_free(void **obj)
+{
+    EncodeResult *res = *obj;
+
+    if (res)
+        av_packet_free(&res->pkt);
+    av_freep(obj);
+}
+
+static void result_move(void *dst, void *src)
+{
+    EncodeResult *d = dst;
+    EncodeResult *s = src;
+
+    av_packet_unref(d->pkt);
+    av_packet_move_ref(d->pkt, s->pkt);
+    d->ret = s->ret;
+
+    result_reset(s);
+}
+
+static void frame_move(void *dst, void *src)
+{
+    av_frame_move_ref(dst, src);
+}
+
+static int send_result(Encoder *e, EncodeResult *res, int ret)
+{
+    res->ret = ret;
+    return tq_send(e->queue_out, 0, res);
+}
+
+/* encode a single frame, or flush the encoder when frame is NULL */
+static int encode_frame(OutputStream *ost, AVFrame *frame, EncodeResult *res)
+{
+    Encoder          *e = ost->encoder;
+    AVCodecContext *enc = ost->enc_ctx;
+    const char *type_desc = av_get_media_type_string(enc->codec_type);
+    int ret;
+
+    ret = avcodec_send_frame(enc, frame);
+    if (ret < 0 && !(ret == AVERROR_EOF && !frame)) {
+        av_log(NULL, AV_LOG_ERROR, "Error submitting %s frame to the encoder\n",
+               type_desc);
+        send_result(e, res, ret);
+        return ret;
+    }
+
+    while (1) {
+        ret = avcodec_receive_packet(enc, res->pkt);
+
+        /* if two pass, output log on success and EOF */
+        if ((ret >= 0 || ret == AVERROR_EOF) && ost->logfile && enc->stats_out)
+            fprintf(ost->logfile, "%s", enc->stats_out);
+
+        if (ret == AVERROR(EAGAIN)) {
+            av_assert0(frame); // should never happen during flushing
+            return send_result(e, res, ret);
+        } else if (ret == AVERROR_EOF) {
+            return ret;
+        } else if (ret < 0) {
+            av_log(NULL, AV_LOG_ERROR, "%s encoding failed\n", type_desc);
+            send_result(e, res, ret);
+            return ret;
+        }
+
+        ret = send_result(e, res, 0);
+        if (ret < 0)
+            return ret;
+    }
+}
+
+static void thread_set_name(OutputStream *ost)
+{
+    char name[16];
+    snprintf(name, sizeof(name), "enc%d:%d:%s", ost->file_index, ost->index,
+             ost->enc_ctx->codec->name);
+    ff_thread_setname(name);
+}
+
+static void *encoder_thread(void *arg)
+{
+    OutputStream *ost = arg;
+    Encoder        *e = ost->encoder;
+    AVFrame    *frame = NULL;
+    EncodeResult *res = NULL;
+    int           ret = 0;
+
+    frame = av_frame_alloc();
+    res   = result_alloc();
+    if (!frame || !res) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    thread_set_name(ost);
+
+    while (1) {
+        int dummy;
+
+        // the main thread finishing the queue means flushing
+        ret = tq_receive(e->queue_in, &dummy, frame);
+
+        // a new AVCodecContext.debug value set by enc_set_debug()
+        if (ret >= 0 && frame->opaque_ref) {
+            memcpy(&ost->enc_ctx->debug, frame->opaque_ref->data,
+                   sizeof(ost->enc_ctx->debug));
+            av_buffer_unref(&frame->opaque_ref);
+        }
+
+        ret = encode_frame(ost, ret < 0 ? NULL : frame, res);
+        av_frame_unref(frame);
+        if (ret < 0) {
+            if (ret == AVERROR_EOF)
+                ret = 0;
+            break;
+        }
+    }
+
+finish:
+    av_frame_free(&frame);
+    result_free((void**)&res);
+
+    tq_receive_finish(e->queue_in, 0);
+    tq_send_finish(e->queue_out, 0);
+
+    av_log(NULL, AV_LOG_VERBOSE, "Terminating encoder thread %d:%d\n",
+           ost->file_index, ost->index);
+
+    return (void*)(intptr_t)ret;
+}
+
+int enc_threaded(const AVCodec *codec)
+{
+    int internal = AV_CODEC_CAP_FRAME_THREADS | AV_CODEC_CAP_OTHER_THREADS;
+
+    // audio encoders only split a frame's channels between slice threads,
+    // which may not be used at all depending on the channel layout
+    if (codec->type == AVMEDIA_TYPE_VIDEO)
+        internal |= AV_CODEC_CAP_SLICE_THREADS;
+
+    return (codec->type == AVMEDIA_TYPE_VIDEO || codec->type == AVMEDIA_TYPE_AUDIO) &&
+           !(codec->capabilities & internal) && !do_benchmark_all;
+}
+
+int enc_full(OutputStream *ost)
+{
+    Encoder *e = ost->encoder;
+    return e->nb_pending >= ENC_MAX_PENDING;
+}
+
+int enc_send(OutputStream *ost, const AVFrame *frame)
+{
+    Encoder *e = ost->encoder;
+    int ret;
+
+    if (!frame) {
+        if (!e->finished && !e->flushing)
+            tq_send_finish(e->queue_in, 0);
+        e->flushing = 1;
+        return 0;
+    }
+
+    if (e->flushing || e->finished)
+        return AVERROR_EOF;
+
+    av_assert0(e->nb_pending < ENC_MAX_PENDING);
+
+    ret = av_frame_ref(e->frame, frame);
+    if (ret < 0)
+        return ret;
+
+    // the codec context belongs to the encoder thread, which applies the
+    // value before encoding this frame
+    av_buffer_unref(&e->frame->opaque_ref);
+    if (e->debug_changed) {
+        e->frame->opaque_ref = av_buffer_alloc(sizeof(e->debug));
+        if (!e->frame->opaque_ref) {
+            av_frame_unref(e->frame);
+            return AVERROR(ENOMEM);
+        }
+        memcpy(e->frame->opaque_ref->data, &e->debug, sizeof(e->debug));
+    }
+
+    ret = tq_send(e->queue_in, 0, e->frame);
+    av_frame_unref(e->frame);
+    if (ret < 0)
+        return ret == AVERROR_EOF ? AVERROR_EXTERNAL : ret;
+
+    e->nb_pending++;
+    e->debug_changed = 0;
+
+    return 0;
+}
+
+int enc_pending(OutputStream *ost)
+{
+    Encoder *e = ost->encoder;
+    return e->nb_pending || e->flushing;
+}
+
+int enc_receive(OutputStream *ost, AVPacket *pkt)
+{
+    Encoder       *e = ost->encoder;
+    EncodeResult *res = e->res;
+    int ret, dummy;
+
+    while (e->nb_pending || (e->flushing && !e->finished)) {
+        ret = tq_receive(e->queue_out, &dummy, res);
+        if (ret < 0) {
+            // the encoder thread terminated, which is expected only after
+            // flushing
+            e->finished = 1;
+            if (e->nb_pending || !e->flushing) {
+                e->nb_pending = 0;
+                return AVERROR_EXTERNAL;
+            }
+            break;
+        }
+
+        ret = res->ret;
+        if (ret == AVERROR(EAGAIN)) {
+            e->nb_pending--;
+            return ret;
+        } else if (ret < 0) {
+            result_reset(res);
+            return ret;
+        }
+
+        av_packet_move_ref(pkt, res->pkt);
+        result_reset(res);
+        return 0;
+    }
+
+    if (e->flushing) {
+        e->flushing = 0;
+        return AVERROR_EOF;
+    }
+
+    return AVERROR(EAGAIN);
+}
+
+void enc_set_debug(OutputStream *ost, int debug)
+{
+    Encoder *e = ost->encoder;
+
+    if (!e) {
+        ost->enc_ctx->debug = debug;
+        return;
+    }
+
+    // sent to the encoder thread together with the next frame
+    e->debug         = debug;
+    e->debug_changed = 1;
+}
+
+static void thread_stop(Encoder *e)
+{
+    if (!e->queue_in)
+        return;
+
+    tq_send_finish(e->queue_in, 0);
+    tq_receive_finish(e->queue_out, 0);
+
+    pthread_join(e->thread, NULL);
+
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+}
+
+void enc_free(Encoder **penc)
+{
+    Encoder *e = *penc;
+
+    if (!e)
+        return;
+
+    thread_stop(e);
+
+    av_frame_free(&e->frame);
+    result_free((void**)&e->res);
+
+    av_freep(penc);
+}
+
+int enc_open(OutputStream *ost)
+{
+    Encoder *e;
+    ObjPool *op;
+    int ret;
+
+    e = av_mallocz(sizeof(*e));
+    if (!e)
+        return AVERROR(ENOMEM);
+    ost->encoder = e;
+
+    e->debug = ost->enc_ctx->debug;
+
+    e->frame = av_frame_alloc();
+    e->res   = result_alloc();
+    if (!e->frame || !e->res)
+        return AVERROR(ENOMEM);
+
+    op = objpool_alloc_frames();
+    if (!op)
+        return AVERROR(ENOMEM);
+
+    e->queue_in = tq_alloc(1, ENC_MAX_PENDING, op, frame_move);
+    if (!e->queue_in) {
+        objpool_free(&op);
+        return AVERROR(ENOMEM);
+    }
+
+    op = objpool_alloc(result_alloc, result_reset, result_free);
+    if (!op) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    e->queue_out = tq_alloc(1, 2 * ENC_MAX_PENDING, op, result_move);
+    if (!e->queue_out) {
+        objpool_free(&op);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = pthread_create(&e->thread, NULL, encoder_thread, ost);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    tq_free(&e->queue_in);
+    tq_free(&e->queue_out);
+    return ret;
+}
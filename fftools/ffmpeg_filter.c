@@ -21,6 +21,8 @@
 #include <stdint.h>
 
 #include "ffmpeg.h"
+#include "objpool.h"
+#include "thread_queue.h"
 
 #include "libavfilter/avfilter.h"
 #include "libavfilter/buffersink.h"
@@ -36,6 +38,8 @@
 #include "libavutil/pixfmt.h"
 #include "libavutil/imgutils.h"
 #include "libavutil/samplefmt.h"
+#include "libavutil/thread.h"
+#include "libavutil/threadmessage.h"
 
 // FIXME: YUV420P etc. are actually supported with full color range,
 // yet the latter information isn't available here.
@@ -1164,3 +1168,203 @@ int filtergraph_is_simple(FilterGraph *fg)
 {
     return !fg->graph_desc;
 }
+
+struct FilterGraphThread {
+    pthread_t thread;
+
+    /* frames sent to the graph inputs, the stream index is the input index */
+    ThreadQueue          *queue_in;
+    /* return codes of av_buffersrc_add_frame_flags(), one per frame */
+    AVThreadMessageQueue *queue_out;
+
+    /* used by the main thread for sending referenced frames */
+    AVFrame *frame;
+    /* number of frames sent whose result has not been received yet */
+    int nb_pending;
+};
+
+static void frame_move(void *dst, void *src)
+{
+    av_frame_move_ref(dst, src);
+}
+
+static void *filtergraph_thread(void *arg)
+{
+    FilterGraph       *fg = arg;
+    FilterGraphThread *ft = fg->thread;
+    AVFrame        *frame;
+    char name[16];
+    int ret = 0;
+
+    snprintf(name, sizeof(name), "filt%d", fg->index);
+    ff_thread_setname(name);
+
+    frame = av_frame_alloc();
+    if (!frame) {
+        ret = AVERROR(ENOMEM);
+        goto finish;
+    }
+
+    while (1) {
+        int input_idx;
+
+        ret = tq_receive(ft->queue_in, &input_idx, frame);
+        if (input_idx < 0) {
+            ret = 0;
+            break;
+        } else if (ret < 0)
+            continue;
+
+        ret = av_buffersrc_add_frame_flags(fg->inputs[input_idx]->filter, frame,
+                                           AV_BUFFERSRC_FLAG_PUSH);
+        av_frame_unref(frame);
+
+        ret = av_thread_message_queue_send(ft->queue_out, &ret, 0);
+        if (ret < 0)
+            break;
+    }
+
+finish:
+    av_frame_free(&frame);
+
+    for (int i = 0; i < fg->nb_inputs; i++)
+        tq_receive_finish(ft->queue_in, i);
+    av_thread_message_queue_set_err_recv(ft->queue_out, AVERROR_EOF);
+
+    return (void*)(intptr_t)ret;
+}
+
+void fg_thread_free(FilterGraph *fg)
+{
+    FilterGraphThread *ft = fg->thread;
+
+    if (!ft)
+        return;
+
+    for (int i = 0; i < fg->nb_inputs; i++)
+        tq_send_finish(ft->queue_in, i);
+    av_thread_message_queue_set_err_send(ft->queue_out, AVERROR_EOF);
+
+    pthread_join(ft->thread, NULL);
+
+    tq_free(&ft->queue_in);
+    av_thread_message_queue_free(&ft->queue_out);
+    av_frame_free(&ft->frame);
+
+    av_freep(&fg->thread);
+}
+
+static int fg_thread_start(FilterGraph *fg)
+{
+    FilterGraphThread *ft;
+    ObjPool *op;
+    int ret;
+
+    ft = av_mallocz(sizeof(*ft));
+    if (!ft)
+        return AVERROR(ENOMEM);
+
+    ft->frame = av_frame_alloc();
+    if (!ft->frame) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    op = objpool_alloc_frames();
+    if (!op) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ft->queue_in = tq_alloc(fg->nb_inputs, fg->nb_inputs, op, frame_move);
+    if (!ft->queue_in) {
+        objpool_free(&op);
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    /* at most one result per input is outstanding when the main thread
+     * starts waiting, so the thread never blocks on this queue */
+    ret = av_thread_message_queue_alloc(&ft->queue_out, fg->nb_inputs,
+                                        sizeof(int));
+    if (ret < 0)
+        goto fail;
+
+    /* the thread looks itself up through fg->thread */
+    fg->thread = ft;
+
+    ret = pthread_create(&ft->thread, NULL, filtergraph_thread, fg);
+    if (ret) {
+        fg->thread = NULL;
+        ret = AVERROR(ret);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    tq_free(&ft->queue_in);
+    av_thread_message_queue_free(&ft->queue_out);
+    av_frame_free(&ft->frame);
+    av_freep(&ft);
+    return ret;
+}
+
+int fg_thread_send_frame(InputFilter *ifilter, AVFrame *frame, int keep_reference)
+{
+    FilterGraph       *fg = ifilter->graph;
+    FilterGraphThread *ft;
+    int input_idx, ret;
+
+    if (!fg->thread) {
+        ret = fg_thread_start(fg);
+        if (ret < 0)
+            return ret;
+    }
+    ft = fg->thread;
+
+    for (input_idx = 0; input_idx < fg->nb_inputs; input_idx++)
+        if (fg->inputs[input_idx] == ifilter)
+            break;
+    av_assert0(input_idx < fg->nb_inputs);
+
+    if (keep_reference) {
+        ret = av_frame_ref(ft->frame, frame);
+        if (ret < 0)
+            return ret;
+        frame = ft->frame;
+    }
+
+    ret = tq_send(ft->queue_in, input_idx, frame);
+    if (ret < 0) {
+        av_frame_unref(ft->frame);
+        return ret;
+    }
+
+    ft->nb_pending++;
+
+    return 0;
+}
+
+int fg_thread_wait(FilterGraph *fg)
+{
+    FilterGraphThread *ft = fg->thread;
+    int err = 0;
+
+    while (ft && ft->nb_pending) {
+        int ret, res;
+
+        ret = av_thread_message_queue_recv(ft->queue_out, &res, 0);
+        if (ret < 0) {
+            // the filtergraph thread terminated
+            ft->nb_pending = 0;
+            return ret;
+        }
+        ft->nb_pending--;
+
+        /* EOF only means this graph input does not accept more frames */
+        if (res < 0 && res != AVERROR_EOF && !err)
+            err = res;
+    }
+
+    return err;
+}
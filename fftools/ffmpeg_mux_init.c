@@ -1155,11 +1155,26 @@ static void create_streams(Muxer *mux, const OptionsContext *o)
     }
 }
 
+/* whether the muxer may write packets without waiting for all the streams */
+static int mux_interleave_limited(Muxer *mux, AVFormatContext *oc)
+{
+    const AVDictionaryEntry *e = av_dict_get(mux->opts, "max_interleave_delta", NULL, 0);
+    int64_t delta;
+
+    // the options are applied to the muxer only when writing the header
+    if (!e || av_opt_set(oc, e->key, e->value, 0) < 0 ||
+        av_opt_get_int(oc, e->key, 0, &delta) < 0)
+        return 0;
+
+    return delta > 0;
+}
+
 static int setup_sync_queues(Muxer *mux, AVFormatContext *oc, int64_t buf_size_us)
 {
     OutputFile *of = &mux->of;
-    int nb_av_enc = 0, nb_interleaved = 0;
+    int nb_av_enc = 0, nb_interleaved = 0, nb_enc_thread = 0;
     int limit_frames = 0, limit_frames_av_enc = 0;
+    int sync, sync_mux, interleave;
 
 #define IS_AV_ENC(ost, type)  \
     (ost->enc_ctx && (type == AVMEDIA_TYPE_VIDEO || type == AVMEDIA_TYPE_AUDIO))
@@ -1175,20 +1190,32 @@ static int setup_sync_queues(Muxer *mux, AVFormatContext *oc, int64_t buf_size_u
 
         nb_interleaved += IS_INTERLEAVED(type);
         nb_av_enc      += IS_AV_ENC(ost, type);
+        nb_enc_thread  += ost->enc_ctx && enc_threaded(ost->enc_ctx->codec);
 
         limit_frames        |=  ms->max_frames < INT64_MAX;
         limit_frames_av_enc |= (ms->max_frames < INT64_MAX) && IS_AV_ENC(ost, type);
     }
 
-    if (!((nb_interleaved > 1 && of->shortest) ||
-          (nb_interleaved > 0 && limit_frames)))
+    sync = (nb_interleaved > 1 && of->shortest) ||
+           (nb_interleaved > 0 && limit_frames);
+    /* if there are any additional interleaved streams, then ALL the streams
+     * are also synchronized before sending them to the muxer */
+    sync_mux = sync && nb_interleaved > nb_av_enc;
+    /* packets from encoder threads reach the muxer later than the packets of
+     * the other streams; the muxer's own interleaving absorbs that unless the
+     * user lowered max_interleave_delta, in which case put them back in order
+     * before muxing */
+    interleave = nb_enc_thread > 0 && nb_interleaved > 1 &&
+                 mux_interleave_limited(mux, oc);
+
+    if (!sync && !interleave)
         return 0;
 
     /* if we have more than one encoded audio/video streams, or at least
      * one encoded audio/video stream is frame-limited, then we
      * synchronize them before encoding */
-    if ((of->shortest && nb_av_enc > 1) || limit_frames_av_enc) {
-        of->sq_encode = sq_alloc(SYNC_QUEUE_FRAMES, buf_size_us);
+    if (sync && ((of->shortest && nb_av_enc > 1) || limit_frames_av_enc)) {
+        of->sq_encode = sq_alloc(SYNC_QUEUE_FRAMES, buf_size_us, 0);
         if (!of->sq_encode)
             return AVERROR(ENOMEM);
 
@@ -1214,10 +1241,8 @@ static int setup_sync_queues(Muxer *mux, AVFormatContext *oc, int64_t buf_size_u
         }
     }
 
-    /* if there are any additional interleaved streams, then ALL the streams
-     * are also synchronized before sending them to the muxer */
-    if (nb_interleaved > nb_av_enc) {
-        mux->sq_mux = sq_alloc(SYNC_QUEUE_PACKETS, buf_size_us);
+    if (sync_mux || interleave) {
+        mux->sq_mux = sq_alloc(SYNC_QUEUE_PACKETS, buf_size_us, interleave);
         if (!mux->sq_mux)
             return AVERROR(ENOMEM);
 
@@ -1233,12 +1258,12 @@ static int setup_sync_queues(Muxer *mux, AVFormatContext *oc, int64_t buf_size_u
             if (!IS_INTERLEAVED(type))
                 continue;
 
-            ost->sq_idx_mux = sq_add_stream(mux->sq_mux,
-                                            of->shortest || ms->max_frames < INT64_MAX);
+            ost->sq_idx_mux = sq_add_stream(mux->sq_mux, sync_mux &&
+                                            (of->shortest || ms->max_frames < INT64_MAX));
             if (ost->sq_idx_mux < 0)
                 return ost->sq_idx_mux;
 
-            if (ms->max_frames != INT64_MAX)
+            if (sync_mux && ms->max_frames != INT64_MAX)
                 sq_limit_frames(mux->sq_mux, ost->sq_idx_mux, ms->max_frames);
         }
     }
@@ -24,12 +24,16 @@
 #include "libavutil/error.h"
 #include "libavutil/frame.h"
 #include "libavutil/mem.h"
+#include "libavutil/ringqueue.h"
 
 #include "objpool.h"
 
+#define POOL_SIZE 32
+
+/* the pool is lock-free, so that objects may be taken out of it and returned
+ * to it from different threads */
 struct ObjPool {
-    void        *pool[32];
-    unsigned int pool_count;
+    AVRingQueue *pool;
 
     ObjPoolCBAlloc alloc;
     ObjPoolCBReset reset;
@@ -44,6 +48,12 @@ ObjPool *objpool_alloc(ObjPoolCBAlloc cb_alloc, ObjPoolCBReset cb_reset,
     if (!op)
         return NULL;
 
+    op->pool = av_ring_queue_alloc(POOL_SIZE, sizeof(void*), 0);
+    if (!op->pool) {
+        av_freep(&op);
+        return NULL;
+    }
+
     op->alloc = cb_alloc;
     op->reset = cb_reset;
     op->free  = cb_free;
@@ -54,22 +64,21 @@ ObjPool *objpool_alloc(ObjPoolCBAlloc cb_alloc, ObjPoolCBReset cb_reset,
 void objpool_free(ObjPool **pop)
 {
     ObjPool *op = *pop;
+    void *obj;
 
     if (!op)
         return;
 
-    for (unsigned int i = 0; i < op->pool_count; i++)
-        op->free(&op->pool[i]);
+    while (av_ring_queue_read(op->pool, &obj, 1, AV_RING_QUEUE_FLAG_NONBLOCK) > 0)
+        op->free(&obj);
+    av_ring_queue_freep(&op->pool);
 
     av_freep(pop);
 }
 
 int  objpool_get(ObjPool *op, void **obj)
 {
-    if (op->pool_count) {
-        *obj = op->pool[--op->pool_count];
-        op->pool[op->pool_count] = NULL;
-    } else
+    if (av_ring_queue_read(op->pool, obj, 1, AV_RING_QUEUE_FLAG_NONBLOCK) <= 0)
         *obj = op->alloc();
 
     return *obj ? 0 : AVERROR(ENOMEM);
@@ -82,9 +91,7 @@ void objpool_release(ObjPool *op, void **obj)
 
     op->reset(*obj);
 
-    if (op->pool_count < FF_ARRAY_ELEMS(op->pool))
-        op->pool[op->pool_count++] = *obj;
-    else
+    if (av_ring_queue_write(op->pool, obj, 1, AV_RING_QUEUE_FLAG_NONBLOCK) <= 0)
         op->free(obj);
 
     *obj = NULL;
@@ -47,6 +47,9 @@ struct SyncQueue {
 
     /* no more frames will be sent for any stream */
     int finished;
+    /* all the unfinished streams hold back the output of the others, not
+     * only the limiting ones */
+    int interleave;
     /* sync head: the stream with the _smallest_ head timestamp
      * this stream determines which frames can be output */
     int head_stream;
@@ -84,6 +87,14 @@ static int frame_null(const SyncQueue *sq, SyncQueueFrame frame)
     return (sq->type == SYNC_QUEUE_PACKETS) ? (frame.p == NULL) : (frame.f == NULL);
 }
 
+static void queue_head_update(SyncQueue *sq);
+
+/* whether the stream's head timestamp limits the output of the other streams */
+static int stream_holds_queue(const SyncQueue *sq, const SyncQueueStream *st)
+{
+    return st->limiting || (sq->interleave && !st->finished);
+}
+
 static void finish_stream(SyncQueue *sq, unsigned int stream_idx)
 {
     SyncQueueStream *st = &sq->streams[stream_idx];
@@ -110,6 +121,10 @@ static void finish_stream(SyncQueue *sq, unsigned int stream_idx)
         }
     }
 
+    /* a finished stream no longer holds back the others */
+    if (sq->interleave)
+        queue_head_update(sq);
+
     /* mark the whole queue as finished if all streams are finished */
     for (unsigned int i = 0; i < sq->nb_streams; i++) {
         if (!sq->streams[i].finished)
@@ -120,6 +135,28 @@ static void finish_stream(SyncQueue *sq, unsigned int stream_idx)
 
 static void queue_head_update(SyncQueue *sq)
 {
+    if (sq->interleave) {
+        /* the head is the least advanced stream holding back the others,
+         * there is none until all of them have a timestamp */
+        sq->head_stream = -1;
+        for (unsigned int i = 0; i < sq->nb_streams; i++) {
+            SyncQueueStream *st = &sq->streams[i];
+
+            if (!stream_holds_queue(sq, st))
+                continue;
+            if (st->head_ts == AV_NOPTS_VALUE) {
+                sq->head_stream = -1;
+                return;
+            }
+            if (sq->head_stream < 0 ||
+                av_compare_ts(st->head_ts, st->tb,
+                              sq->streams[sq->head_stream].head_ts,
+                              sq->streams[sq->head_stream].tb) < 0)
+                sq->head_stream = i;
+        }
+        return;
+    }
+
     if (sq->head_stream < 0) {
         /* wait for one timestamp in each stream before determining
          * the queue head */
@@ -163,7 +200,7 @@ static void stream_update_ts(SyncQueue *sq, unsigned int stream_idx, int64_t ts)
         finish_stream(sq, stream_idx);
 
     /* update the overall head timestamp if it could have changed */
-    if (st->limiting &&
+    if (stream_holds_queue(sq, st) &&
         (sq->head_stream < 0 || sq->head_stream == stream_idx))
         queue_head_update(sq);
 }
@@ -297,6 +334,11 @@ static int receive_for_stream(SyncQueue *sq, unsigned int stream_idx,
         if (ts != AV_NOPTS_VALUE && st_head)
             cmp = av_compare_ts(ts, st->tb, st_head->head_ts, st_head->tb);
 
+        /* When interleaving, everything is released once all the streams
+         * are finished */
+        if (!st_head && sq->interleave && sq->finished)
+            cmp = 0;
+
         /* We can release frames that do not end after the queue head.
          * Frames with no timestamps are just passed through with no conditions.
          */
@@ -402,7 +444,8 @@ void sq_limit_frames(SyncQueue *sq, unsigned int stream_idx, uint64_t frames)
         finish_stream(sq, stream_idx);
 }
 
-SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us)
+SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us,
+                    int interleave)
 {
     SyncQueue *sq = av_mallocz(sizeof(*sq));
 
@@ -411,6 +454,7 @@ SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us)
 
     sq->type                 = type;
     sq->buf_size_us          = buf_size_us;
+    sq->interleave           = interleave;
 
     sq->head_stream          = -1;
     sq->head_finished_stream = -1;
@@ -44,8 +44,13 @@ typedef struct SyncQueue SyncQueue;
  * Allocate a sync queue of the given type.
  *
  * @param buf_size_us maximum duration that will be buffered in microseconds
+ * @param interleave when non-zero, every stream that is not finished holds
+ *                   back the output of the others, so that frames are returned
+ *                   in timestamp order across all the streams; otherwise only
+ *                   the limiting streams do
  */
-SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us);
+SyncQueue *sq_alloc(enum SyncQueueType type, int64_t buf_size_us,
+                    int interleave);
 void       sq_free(SyncQueue **sq);
 
 /**
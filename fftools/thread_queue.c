@@ -16,40 +16,51 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdatomic.h>
 #include <stdint.h>
 #include <string.h>
 
 #include "libavutil/avassert.h"
 #include "libavutil/error.h"
-#include "libavutil/fifo.h"
-#include "libavutil/intreadwrite.h"
 #include "libavutil/mem.h"
+#include "libavutil/ringqueue.h"
 #include "libavutil/thread.h"
 
 #include "objpool.h"
 #include "thread_queue.h"
 
+/* number of times a blocked sender or receiver polls the queue before it goes
+ * to sleep */
+#define SPIN_COUNT 100
+
 enum {
     FINISHED_SEND = (1 << 0),
     FINISHED_RECV = (1 << 1),
 };
 
+/* an element with obj == NULL carries no data, it only wakes up the receiver
+ * after a stream was finished from the sending side */
 typedef struct FifoElem {
     void        *obj;
     unsigned int stream_idx;
 } FifoElem;
 
 struct ThreadQueue {
-    int              *finished;
+    atomic_int       *finished;
     unsigned int    nb_streams;
+    atomic_uint     nb_recv_finished;
 
-    AVFifo  *fifo;
+    AVRingQueue *queue;
 
     ObjPool *obj_pool;
     void   (*obj_move)(void *dst, void *src);
 
+    /* Senders blocked on a full queue sleep on cond_send rather than inside
+     * the ring queue, so that tq_receive_finish() can release the sender of
+     * a single stream. */
+    atomic_int      nb_blocked;
     pthread_mutex_t lock;
-    pthread_cond_t  cond;
+    pthread_cond_t  cond_send;
 };
 
 void tq_free(ThreadQueue **ptq)
@@ -59,18 +70,18 @@ void tq_free(ThreadQueue **ptq)
     if (!tq)
         return;
 
-    if (tq->fifo) {
+    if (tq->queue) {
         FifoElem elem;
-        while (av_fifo_read(tq->fifo, &elem, 1) >= 0)
+        while (av_ring_queue_read(tq->queue, &elem, 1, AV_RING_QUEUE_FLAG_NONBLOCK) > 0)
             objpool_release(tq->obj_pool, &elem.obj);
     }
-    av_fifo_freep2(&tq->fifo);
+    av_ring_queue_freep(&tq->queue);
 
     objpool_free(&tq->obj_pool);
 
     av_freep(&tq->finished);
 
-    pthread_cond_destroy(&tq->cond);
+    pthread_cond_destroy(&tq->cond_send);
     pthread_mutex_destroy(&tq->lock);
 
     av_freep(ptq);
@@ -80,32 +91,33 @@ ThreadQueue *tq_alloc(unsigned int nb_streams, size_t queue_size,
                       ObjPool *obj_pool, void (*obj_move)(void *dst, void *src))
 {
     ThreadQueue *tq;
-    int ret;
 
     tq = av_mallocz(sizeof(*tq));
     if (!tq)
         return NULL;
 
-    ret = pthread_cond_init(&tq->cond, NULL);
-    if (ret) {
+    if (pthread_cond_init(&tq->cond_send, NULL)) {
         av_freep(&tq);
         return NULL;
     }
 
-    ret = pthread_mutex_init(&tq->lock, NULL);
-    if (ret) {
-        pthread_cond_destroy(&tq->cond);
+    if (pthread_mutex_init(&tq->lock, NULL)) {
+        pthread_cond_destroy(&tq->cond_send);
         av_freep(&tq);
         return NULL;
     }
+    atomic_init(&tq->nb_blocked, 0);
 
     tq->finished = av_calloc(nb_streams, sizeof(*tq->finished));
     if (!tq->finished)
         goto fail;
+    for (unsigned int i = 0; i < nb_streams; i++)
+        atomic_init(&tq->finished[i], 0);
     tq->nb_streams = nb_streams;
+    atomic_init(&tq->nb_recv_finished, 0);
 
-    tq->fifo = av_fifo_alloc2(queue_size, sizeof(FifoElem), 0);
-    if (!tq->fifo)
+    tq->queue = av_ring_queue_alloc(queue_size, sizeof(FifoElem), SPIN_COUNT);
+    if (!tq->queue)
         goto fail;
 
     tq->obj_pool = obj_pool;
@@ -117,129 +129,189 @@ fail:
     return NULL;
 }
 
+static int send_blocked(ThreadQueue *tq, unsigned int stream_idx)
+{
+    return !av_ring_queue_can_write(tq->queue) &&
+           !(atomic_load(&tq->finished[stream_idx]) & FINISHED_RECV);
+}
+
+/* wait until the queue is likely writable or the stream is finished by the
+ * receiver, spurious returns are harmless */
+static void wait_send(ThreadQueue *tq, unsigned int stream_idx)
+{
+    for (int i = 0; i < SPIN_COUNT; i++)
+        if (!send_blocked(tq, stream_idx))
+            return;
+
+    pthread_mutex_lock(&tq->lock);
+    /* pairs with the fence in wake_senders(), so either we see the change or
+     * the other side sees us waiting */
+    atomic_fetch_add(&tq->nb_blocked, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (send_blocked(tq, stream_idx))
+        pthread_cond_wait(&tq->cond_send, &tq->lock);
+    atomic_fetch_sub(&tq->nb_blocked, 1);
+    pthread_mutex_unlock(&tq->lock);
+}
+
+static void wake_senders(ThreadQueue *tq)
+{
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(&tq->nb_blocked, memory_order_relaxed)) {
+        pthread_mutex_lock(&tq->lock);
+        pthread_cond_broadcast(&tq->cond_send);
+        pthread_mutex_unlock(&tq->lock);
+    }
+}
+
 int tq_send(ThreadQueue *tq, unsigned int stream_idx, void *data)
 {
-    int *finished;
+    FifoElem elem = { .stream_idx = stream_idx };
+    int finished;
     int ret;
 
     av_assert0(stream_idx < tq->nb_streams);
-    finished = &tq->finished[stream_idx];
+    finished = atomic_load(&tq->finished[stream_idx]);
 
-    pthread_mutex_lock(&tq->lock);
+    if (finished & FINISHED_SEND)
+        return AVERROR(EINVAL);
 
-    if (*finished & FINISHED_SEND) {
-        ret = AVERROR(EINVAL);
-        goto finish;
+    if (finished & FINISHED_RECV) {
+        tq_send_finish(tq, stream_idx);
+        return AVERROR_EOF;
     }
 
-    while (!(*finished & FINISHED_RECV) && !av_fifo_can_write(tq->fifo))
-        pthread_cond_wait(&tq->cond, &tq->lock);
+    ret = objpool_get(tq->obj_pool, &elem.obj);
+    if (ret < 0)
+        return ret;
 
-    if (*finished & FINISHED_RECV) {
-        ret = AVERROR_EOF;
-        *finished |= FINISHED_SEND;
-    } else {
-        FifoElem elem = { .stream_idx = stream_idx };
+    tq->obj_move(elem.obj, data);
 
-        ret = objpool_get(tq->obj_pool, &elem.obj);
-        if (ret < 0)
-            goto finish;
+    while ((ret = av_ring_queue_write(tq->queue, &elem, 1,
+                                      AV_RING_QUEUE_FLAG_NONBLOCK)) == AVERROR(EAGAIN)) {
+        wait_send(tq, stream_idx);
+        if (atomic_load(&tq->finished[stream_idx]) & FINISHED_RECV) {
+            ret = AVERROR_EOF;
+            break;
+        }
+    }
+    if (ret < 0) {
+        // the receiving side finished this stream, leave the item untouched
+        tq->obj_move(data, elem.obj);
+        objpool_release(tq->obj_pool, &elem.obj);
+        tq_send_finish(tq, stream_idx);
+        return AVERROR_EOF;
+    }
 
-        tq->obj_move(elem.obj, data);
+    return 0;
+}
 
-        ret = av_fifo_write(tq->fifo, &elem, 1);
-        av_assert0(ret >= 0);
-        pthread_cond_broadcast(&tq->cond);
-    }
+static void receive_finish(ThreadQueue *tq, unsigned int stream_idx)
+{
+    if (atomic_fetch_or(&tq->finished[stream_idx], FINISHED_RECV) & FINISHED_RECV)
+        return;
 
-finish:
-    pthread_mutex_unlock(&tq->lock);
+    /* release the senders blocked on this stream */
+    wake_senders(tq);
 
-    return ret;
+    /* nothing will be received anymore, fail any further writes */
+    if (atomic_fetch_add(&tq->nb_recv_finished, 1) + 1 == tq->nb_streams)
+        av_ring_queue_set_err_write(tq->queue, AVERROR_EOF);
 }
 
-static int receive_locked(ThreadQueue *tq, int *stream_idx,
-                          void *data)
+static int receive_eof(ThreadQueue *tq, int *stream_idx)
 {
-    FifoElem elem;
     unsigned int nb_finished = 0;
 
-    if (av_fifo_read(tq->fifo, &elem, 1) >= 0) {
-        tq->obj_move(data, elem.obj);
-        objpool_release(tq->obj_pool, &elem.obj);
-        *stream_idx = elem.stream_idx;
-        return 0;
-    }
-
     for (unsigned int i = 0; i < tq->nb_streams; i++) {
-        if (!(tq->finished[i] & FINISHED_SEND))
-            continue;
+        int finished = atomic_load(&tq->finished[i]);
 
         /* return EOF to the consumer at most once for each stream */
-        if (!(tq->finished[i] & FINISHED_RECV)) {
-            tq->finished[i] |= FINISHED_RECV;
-            *stream_idx   = i;
+        if ((finished & FINISHED_SEND) && !(finished & FINISHED_RECV)) {
+            receive_finish(tq, i);
+            *stream_idx = i;
             return AVERROR_EOF;
         }
 
-        nb_finished++;
+        nb_finished += !!(finished & FINISHED_RECV);
     }
 
     return nb_finished == tq->nb_streams ? AVERROR_EOF : AVERROR(EAGAIN);
 }
 
+static int pending_eof(ThreadQueue *tq)
+{
+    for (unsigned int i = 0; i < tq->nb_streams; i++) {
+        int finished = atomic_load(&tq->finished[i]);
+        if ((finished & FINISHED_SEND) && !(finished & FINISHED_RECV))
+            return 1;
+    }
+    return 0;
+}
+
 int tq_receive(ThreadQueue *tq, int *stream_idx, void *data)
 {
+    FifoElem elem;
     int ret;
 
     *stream_idx = -1;
 
-    pthread_mutex_lock(&tq->lock);
-
     while (1) {
-        ret = receive_locked(tq, stream_idx, data);
+        ret = av_ring_queue_read(tq->queue, &elem, 1, AV_RING_QUEUE_FLAG_NONBLOCK);
+
         if (ret == AVERROR(EAGAIN)) {
-            pthread_cond_wait(&tq->cond, &tq->lock);
-            continue;
+            /* The queue was empty. A stream's data is written before it is
+             * marked as finished, so once we see the mark, look at the queue
+             * again before reporting EOF. */
+            if (pending_eof(tq))
+                ret = av_ring_queue_read(tq->queue, &elem, 1,
+                                         AV_RING_QUEUE_FLAG_NONBLOCK);
+            if (ret == AVERROR(EAGAIN)) {
+                ret = receive_eof(tq, stream_idx);
+                if (ret != AVERROR(EAGAIN))
+                    return ret;
+
+                ret = av_ring_queue_read(tq->queue, &elem, 1, 0);
+            }
         }
+        if (ret < 0)
+            return ret;
 
-        break;
-    }
+        wake_senders(tq);
 
-    if (ret == 0)
-        pthread_cond_broadcast(&tq->cond);
+        if (elem.obj)
+            break;
+    }
 
-    pthread_mutex_unlock(&tq->lock);
+    tq->obj_move(data, elem.obj);
+    objpool_release(tq->obj_pool, &elem.obj);
+    *stream_idx = elem.stream_idx;
 
-    return ret;
+    return 0;
 }
 
 void tq_send_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
-    av_assert0(stream_idx < tq->nb_streams);
+    FifoElem elem = { .stream_idx = stream_idx };
 
-    pthread_mutex_lock(&tq->lock);
+    av_assert0(stream_idx < tq->nb_streams);
 
     /* mark the stream as send-finished;
      * next time the consumer thread tries to read this stream it will get
      * an EOF and recv-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_SEND;
-    pthread_cond_broadcast(&tq->cond);
+    if (atomic_fetch_or(&tq->finished[stream_idx], FINISHED_SEND) & FINISHED_SEND)
+        return;
 
-    pthread_mutex_unlock(&tq->lock);
+    /* wake up the consumer; if the queue is full, it is not waiting anyway */
+    av_ring_queue_write(tq->queue, &elem, 1, AV_RING_QUEUE_FLAG_NONBLOCK);
 }
 
 void tq_receive_finish(ThreadQueue *tq, unsigned int stream_idx)
 {
     av_assert0(stream_idx < tq->nb_streams);
 
-    pthread_mutex_lock(&tq->lock);
-
     /* mark the stream as recv-finished;
      * next time the producer thread tries to send for this stream, it will
      * get an EOF and send-finished flag will be set */
-    tq->finished[stream_idx] |= FINISHED_RECV;
-    pthread_cond_broadcast(&tq->cond);
-
-    pthread_mutex_unlock(&tq->lock);
+    receive_finish(tq, stream_idx);
 }
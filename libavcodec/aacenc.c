@@ -827,6 +827,128 @@ static void copy_input_samples(AACEncContext *s, const AVFrame *frame)
     }
 }
 
+/**
+ * Per channel element state of the coefficient search, shared between the
+ * sequential parts of aac_encode_frame() and the slice threads.
+ */
+typedef struct AACElementSearch {
+    FFPsyWindowInfo *wi;        ///< window info of the first element channel
+    int start_ch;               ///< index of the first element channel
+    int bitres_alloc;           ///< per channel bit allocation from psy
+    int cutoff;                 ///< bandwidth chosen by the coder
+    int tns_mode, is_mode, pred_mode;
+} AACElementSearch;
+
+/**
+ * Search the quantizers and the coding tools for a single channel element.
+ * Each thread works on its own copy of the coder state, so the result does
+ * not depend on which thread runs the job.
+ */
+static int search_channel_element(AVCodecContext *avctx, void *arg,
+                                  int jobnr, int threadnr)
+{
+    AACEncContext *s     = avctx->priv_data;
+    AACEncContext *ctx   = s->slice_ctx ? &s->slice_ctx[threadnr] : s;
+    AACElementSearch *es = (AACElementSearch *)arg + jobnr;
+    FFPsyWindowInfo *wi  = es->wi;
+    ChannelElement *cpe  = &s->cpe[jobnr];
+    const int tag        = s->chan_map[jobnr + 1];
+    const int chans      = tag == TYPE_CPE ? 2 : 1;
+    const int start_ch   = es->start_ch;
+    SingleChannelElement *sce;
+    int ch, w;
+
+    if (ctx != s) {
+        ctx->lambda = s->lambda;
+        ctx->psy    = s->psy;
+    }
+    ctx->psy.bitres.alloc = es->bitres_alloc;
+    ctx->random_state     = s->element_random_state[jobnr];
+    ctx->cur_type         = tag;
+    es->tns_mode = es->is_mode = es->pred_mode = 0;
+
+    for (ch = 0; ch < chans; ch++) {
+        ctx->cur_channel = start_ch + ch;
+        if (ctx->options.pns && ctx->coder->mark_pns)
+            ctx->coder->mark_pns(ctx, avctx, &cpe->ch[ch]);
+        ctx->coder->search_for_quantizers(avctx, ctx, &cpe->ch[ch], ctx->lambda);
+    }
+    if (chans > 1
+        && wi[0].window_type[0] == wi[1].window_type[0]
+        && wi[0].window_shape   == wi[1].window_shape) {
+
+        cpe->common_window = 1;
+        for (w = 0; w < wi[0].num_windows; w++) {
+            if (wi[0].grouping[w] != wi[1].grouping[w]) {
+                cpe->common_window = 0;
+                break;
+            }
+        }
+    }
+    for (ch = 0; ch < chans; ch++) { /* TNS and PNS */
+        sce = &cpe->ch[ch];
+        ctx->cur_channel = start_ch + ch;
+        if (ctx->options.tns && ctx->coder->search_for_tns)
+            ctx->coder->search_for_tns(ctx, sce);
+        if (ctx->options.tns && ctx->coder->apply_tns_filt)
+            ctx->coder->apply_tns_filt(ctx, sce);
+        if (sce->tns.present)
+            es->tns_mode = 1;
+        if (ctx->options.pns && ctx->coder->search_for_pns)
+            ctx->coder->search_for_pns(ctx, avctx, sce);
+    }
+    ctx->cur_channel = start_ch;
+    if (ctx->options.intensity_stereo) { /* Intensity Stereo */
+        if (ctx->coder->search_for_is)
+            ctx->coder->search_for_is(ctx, avctx, cpe);
+        if (cpe->is_mode) es->is_mode = 1;
+        apply_intensity_stereo(cpe);
+    }
+    if (ctx->options.pred) { /* Prediction */
+        for (ch = 0; ch < chans; ch++) {
+            sce = &cpe->ch[ch];
+            ctx->cur_channel = start_ch + ch;
+            if (ctx->options.pred && ctx->coder->search_for_pred)
+                ctx->coder->search_for_pred(ctx, sce);
+            if (cpe->ch[ch].ics.predictor_present) es->pred_mode = 1;
+        }
+        if (ctx->coder->adjust_common_pred)
+            ctx->coder->adjust_common_pred(ctx, cpe);
+        for (ch = 0; ch < chans; ch++) {
+            sce = &cpe->ch[ch];
+            ctx->cur_channel = start_ch + ch;
+            if (ctx->options.pred && ctx->coder->apply_main_pred)
+                ctx->coder->apply_main_pred(ctx, sce);
+        }
+        ctx->cur_channel = start_ch;
+    }
+    if (ctx->options.mid_side) { /* Mid/Side stereo */
+        if (ctx->options.mid_side == -1 && ctx->coder->search_for_ms)
+            ctx->coder->search_for_ms(ctx, cpe);
+        else if (cpe->common_window)
+            memset(cpe->ms_mask, 1, sizeof(cpe->ms_mask));
+        apply_mid_side_stereo(cpe);
+    }
+    adjust_frame_information(cpe, chans);
+    if (ctx->options.ltp) { /* LTP */
+        for (ch = 0; ch < chans; ch++) {
+            sce = &cpe->ch[ch];
+            ctx->cur_channel = start_ch + ch;
+            if (ctx->coder->search_for_ltp)
+                ctx->coder->search_for_ltp(ctx, sce, cpe->common_window);
+            if (sce->ics.ltp.present) es->pred_mode = 1;
+        }
+        ctx->cur_channel = start_ch;
+        if (ctx->coder->adjust_common_ltp)
+            ctx->coder->adjust_common_ltp(ctx, cpe);
+    }
+
+    s->element_random_state[jobnr] = ctx->random_state;
+    es->cutoff = ctx->psy.cutoff;
+
+    return 0;
+}
+
 static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                             const AVFrame *frame, int *got_packet_ptr)
 {
@@ -840,6 +962,7 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     int ms_mode = 0, is_mode = 0, tns_mode = 0, pred_mode = 0;
     int chan_el_counter[4];
     FFPsyWindowInfo windows[AAC_MAX_CHANNELS];
+    AACElementSearch search[AAC_MAX_CHANNELS];
 
     /* add current frame to queue */
     if (frame) {
@@ -962,7 +1085,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             put_bitstream_info(s, LIBAVCODEC_IDENT);
         start_ch = 0;
         target_bits = 0;
-        memset(chan_el_counter, 0, sizeof(chan_el_counter));
         for (i = 0; i < s->chan_map[0]; i++) {
             FFPsyWindowInfo* wi = windows + start_ch;
             const float *coeffs[2];
@@ -972,8 +1094,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
             cpe->common_window = 0;
             memset(cpe->is_mask, 0, sizeof(cpe->is_mask));
             memset(cpe->ms_mask, 0, sizeof(cpe->ms_mask));
-            put_bits(&s->pb, 3, tag);
-            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             for (ch = 0; ch < chans; ch++) {
                 sce = &cpe->ch[ch];
                 coeffs[ch] = sce->coeffs;
@@ -986,6 +1106,8 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     if (sce->band_type[w] > RESERVED_BT)
                         sce->band_type[w] = 0;
             }
+            /* The psy model keeps a bit reservoir shared by all the channels,
+             * so the analysis has to run in bitstream order. */
             s->psy.bitres.alloc = -1;
             s->psy.bitres.bits = s->last_frame_pb_count / s->channels;
             s->psy.model->analyze(&s->psy, start_ch, coeffs, wi);
@@ -995,82 +1117,26 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                     * (s->lambda / (avctx->global_quality ? avctx->global_quality : 120));
                 s->psy.bitres.alloc /= chans;
             }
-            s->cur_type = tag;
-            for (ch = 0; ch < chans; ch++) {
-                s->cur_channel = start_ch + ch;
-                if (s->options.pns && s->coder->mark_pns)
-                    s->coder->mark_pns(s, avctx, &cpe->ch[ch]);
-                s->coder->search_for_quantizers(avctx, s, &cpe->ch[ch], s->lambda);
-            }
-            if (chans > 1
-                && wi[0].window_type[0] == wi[1].window_type[0]
-                && wi[0].window_shape   == wi[1].window_shape) {
-
-                cpe->common_window = 1;
-                for (w = 0; w < wi[0].num_windows; w++) {
-                    if (wi[0].grouping[w] != wi[1].grouping[w]) {
-                        cpe->common_window = 0;
-                        break;
-                    }
-                }
-            }
-            for (ch = 0; ch < chans; ch++) { /* TNS and PNS */
-                sce = &cpe->ch[ch];
-                s->cur_channel = start_ch + ch;
-                if (s->options.tns && s->coder->search_for_tns)
-                    s->coder->search_for_tns(s, sce);
-                if (s->options.tns && s->coder->apply_tns_filt)
-                    s->coder->apply_tns_filt(s, sce);
-                if (sce->tns.present)
-                    tns_mode = 1;
-                if (s->options.pns && s->coder->search_for_pns)
-                    s->coder->search_for_pns(s, avctx, sce);
-            }
-            s->cur_channel = start_ch;
-            if (s->options.intensity_stereo) { /* Intensity Stereo */
-                if (s->coder->search_for_is)
-                    s->coder->search_for_is(s, avctx, cpe);
-                if (cpe->is_mode) is_mode = 1;
-                apply_intensity_stereo(cpe);
-            }
-            if (s->options.pred) { /* Prediction */
-                for (ch = 0; ch < chans; ch++) {
-                    sce = &cpe->ch[ch];
-                    s->cur_channel = start_ch + ch;
-                    if (s->options.pred && s->coder->search_for_pred)
-                        s->coder->search_for_pred(s, sce);
-                    if (cpe->ch[ch].ics.predictor_present) pred_mode = 1;
-                }
-                if (s->coder->adjust_common_pred)
-                    s->coder->adjust_common_pred(s, cpe);
-                for (ch = 0; ch < chans; ch++) {
-                    sce = &cpe->ch[ch];
-                    s->cur_channel = start_ch + ch;
-                    if (s->options.pred && s->coder->apply_main_pred)
-                        s->coder->apply_main_pred(s, sce);
-                }
-                s->cur_channel = start_ch;
-            }
-            if (s->options.mid_side) { /* Mid/Side stereo */
-                if (s->options.mid_side == -1 && s->coder->search_for_ms)
-                    s->coder->search_for_ms(s, cpe);
-                else if (cpe->common_window)
-                    memset(cpe->ms_mask, 1, sizeof(cpe->ms_mask));
-                apply_mid_side_stereo(cpe);
-            }
-            adjust_frame_information(cpe, chans);
-            if (s->options.ltp) { /* LTP */
-                for (ch = 0; ch < chans; ch++) {
-                    sce = &cpe->ch[ch];
-                    s->cur_channel = start_ch + ch;
-                    if (s->coder->search_for_ltp)
-                        s->coder->search_for_ltp(s, sce, cpe->common_window);
-                    if (sce->ics.ltp.present) pred_mode = 1;
-                }
-                s->cur_channel = start_ch;
-                if (s->coder->adjust_common_ltp)
-                    s->coder->adjust_common_ltp(s, cpe);
-            }
+            search[i].wi           = wi;
+            search[i].start_ch     = start_ch;
+            search[i].bitres_alloc = s->psy.bitres.alloc;
+            start_ch += chans;
+        }
+
+        avctx->execute2(avctx, search_channel_element, search, NULL, s->chan_map[0]);
+        s->psy.cutoff = search[s->chan_map[0] - 1].cutoff;
+
+        memset(chan_el_counter, 0, sizeof(chan_el_counter));
+        for (i = 0; i < s->chan_map[0]; i++) {
+            tag      = s->chan_map[i+1];
+            chans    = tag == TYPE_CPE ? 2 : 1;
+            cpe      = &s->cpe[i];
+            start_ch = search[i].start_ch;
+            tns_mode  |= search[i].tns_mode;
+            is_mode   |= search[i].is_mode;
+            pred_mode |= search[i].pred_mode;
+            put_bits(&s->pb, 3, tag);
+            put_bits(&s->pb, 4, chan_el_counter[tag]++);
             if (chans == 2) {
                 put_bits(&s->pb, 1, cpe->common_window);
                 if (cpe->common_window) {
@@ -1087,7 +1153,6 @@ static int aac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                 s->cur_channel = start_ch + ch;
                 encode_individual_channel(avctx, s, &cpe->ch[ch], cpe->common_window);
             }
-            start_ch += chans;
         }
 
         if (avctx->flags & AV_CODEC_FLAG_QSCALE) {
@@ -1180,10 +1245,14 @@ static av_cold int aac_encode_end(AVCodecContext *avctx)
     av_tx_uninit(&s->mdct128);
     ff_psy_end(&s->psy);
     ff_lpc_end(&s->lpc);
+    for (int i = 0; i < s->nb_slice_ctx; i++)
+        ff_lpc_end(&s->slice_ctx[i].lpc);
+    av_freep(&s->slice_ctx);
     if (s->psypp)
         ff_psy_preprocess_end(s->psypp);
     av_freep(&s->buffer.samples);
     av_freep(&s->cpe);
+    av_freep(&s->element_random_state);
     av_freep(&s->fdsp);
     ff_af_queue_close(&s->afq);
     return 0;
@@ -1215,7 +1284,8 @@ static av_cold int alloc_buffers(AVCodecContext *avctx, AACEncContext *s)
 {
     int ch;
     if (!FF_ALLOCZ_TYPED_ARRAY(s->buffer.samples, s->channels * 3 * 1024) ||
-        !FF_ALLOCZ_TYPED_ARRAY(s->cpe,            s->chan_map[0]))
+        !FF_ALLOCZ_TYPED_ARRAY(s->cpe,            s->chan_map[0]) ||
+        !FF_ALLOCZ_TYPED_ARRAY(s->element_random_state, s->chan_map[0]))
         return AVERROR(ENOMEM);
 
     for(ch = 0; ch < s->channels; ch++)
@@ -1224,6 +1294,35 @@ static av_cold int alloc_buffers(AVCodecContext *avctx, AACEncContext *s)
     return 0;
 }
 
+static av_cold int init_slice_contexts(AVCodecContext *avctx, AACEncContext *s)
+{
+    int i, ret;
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE) ||
+        avctx->thread_count <= 1 || s->chan_map[0] <= 1)
+        return 0;
+
+    s->slice_ctx = av_calloc(avctx->thread_count, sizeof(*s->slice_ctx));
+    if (!s->slice_ctx)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < avctx->thread_count; i++) {
+        AACEncContext *ctx = &s->slice_ctx[i];
+
+        *ctx = *s;
+        ctx->slice_ctx = NULL;
+        memset(&ctx->lpc, 0, sizeof(ctx->lpc));
+        s->nb_slice_ctx++;
+
+        ret = ff_lpc_init(&ctx->lpc, 2*avctx->frame_size, TNS_MAX_ORDER,
+                          FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
 static av_cold int aac_encode_init(AVCodecContext *avctx)
 {
     AACEncContext *s = avctx->priv_data;
@@ -1368,6 +1467,8 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
     s->psypp = ff_psy_preprocess_init(avctx);
     ff_lpc_init(&s->lpc, 2*avctx->frame_size, TNS_MAX_ORDER, FF_LPC_TYPE_LEVINSON);
     s->random_state = 0x1f2e3d4c;
+    for (i = 0; i < s->chan_map[0]; i++)
+        s->element_random_state[i] = s->random_state;
 
     s->abs_pow34   = abs_pow34_v;
     s->quant_bands = quantize_bands;
@@ -1383,6 +1484,9 @@ static av_cold int aac_encode_init(AVCodecContext *avctx)
     ff_af_queue_init(avctx, &s->afq);
     ff_aac_tableinit();
 
+    if ((ret = init_slice_contexts(avctx, s)) < 0)
+        return ret;
+
     return 0;
 }
 
@@ -1421,7 +1525,8 @@ const FFCodec ff_aac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_AAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(AACEncContext),
     .init           = aac_encode_init,
     FF_CODEC_ENCODE_CB(aac_encode_frame),
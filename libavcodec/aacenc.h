@@ -131,6 +131,7 @@ typedef struct AACEncContext {
     const AACCoefficientsEncoder *coder;
     int cur_channel;                             ///< current channel for coder context
     int random_state;
+    int *element_random_state;                   ///< PNS noise generator state of each channel element
     float lambda;
     int last_frame_pb_count;                     ///< number of bits for the previous frame
     float lambda_sum;                            ///< sum(lambda), for Qvg reporting
@@ -152,6 +153,9 @@ typedef struct AACEncContext {
     struct {
         float *samples;
     } buffer;
+
+    struct AACEncContext *slice_ctx;             ///< per-thread contexts for the channel element search
+    int nb_slice_ctx;
 } AACEncContext;
 
 void ff_aac_dsp_init_x86(AACEncContext *s);
@@ -567,8 +567,10 @@ static int get_pixel_format(AVCodecContext *avctx)
      * implemented in the future, need remove this check.
      */
     if (!avctx->hwaccel) {
-        av_log(avctx, AV_LOG_ERROR, "Your platform doesn't suppport"
+        av_log(avctx, AV_LOG_ERROR, "Your platform doesn't support"
                " hardware accelerated AV1 decoding.\n");
+        av_log(avctx, AV_LOG_ERROR, "This decoder only parses the bitstream;"
+               " use a software AV1 decoder such as libdav1d instead.\n");
         return AVERROR(ENOSYS);
     }
 
@@ -128,8 +128,21 @@ typedef struct FlacEncodeContext {
 
     int flushed;
     int64_t next_pts;
+
+    struct FlacEncodeJob *jobs;     ///< frames encoded in parallel, NULL without threading
+    int nb_jobs;
+    int nb_queued;                  ///< number of input frames waiting to be encoded
+    int nb_ready;                   ///< number of encoded packets
+    int next_ready;                 ///< index of the next packet to return
 } FlacEncodeContext;
 
+typedef struct FlacEncodeJob {
+    FlacEncodeContext *ctx;         ///< per-frame copy of the encoder state
+    AVFrame  *frame;
+    AVPacket *pkt;
+    int ret;                        ///< frame size or error code
+} FlacEncodeJob;
+
 
 /**
  * Write streaminfo metadata block to byte array.
@@ -266,6 +279,46 @@ static av_cold void dprint_compression_options(FlacEncodeContext *s)
 }
 
 
+/**
+ * With slice threading, keep up to thread_count frames in flight and encode
+ * them concurrently, each one in its own copy of the encoder state.
+ */
+static av_cold int init_frame_jobs(AVCodecContext *avctx, FlacEncodeContext *s)
+{
+    int i, ret;
+
+    if (!(avctx->active_thread_type & FF_THREAD_SLICE) || avctx->thread_count <= 1)
+        return 0;
+
+    s->jobs = av_calloc(avctx->thread_count, sizeof(*s->jobs));
+    if (!s->jobs)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < avctx->thread_count; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+
+        s->nb_jobs++;
+
+        job->ctx   = av_malloc(sizeof(*job->ctx));
+        job->frame = av_frame_alloc();
+        job->pkt   = av_packet_alloc();
+        if (!job->ctx || !job->frame || !job->pkt)
+            return AVERROR(ENOMEM);
+
+        *job->ctx = *s;
+        job->ctx->jobs = NULL;
+        memset(&job->ctx->lpc_ctx, 0, sizeof(job->ctx->lpc_ctx));
+
+        ret = ff_lpc_init(&job->ctx->lpc_ctx, avctx->frame_size,
+                          s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+
 static av_cold int flac_encode_init(AVCodecContext *avctx)
 {
     int freq = avctx->sample_rate;
@@ -453,13 +506,15 @@ static av_cold int flac_encode_init(AVCodecContext *avctx)
 
     ret = ff_lpc_init(&s->lpc_ctx, avctx->frame_size,
                       s->options.max_prediction_order, FF_LPC_TYPE_LEVINSON);
+    if (ret < 0)
+        return ret;
 
     ff_bswapdsp_init(&s->bdsp);
     ff_flacencdsp_init(&s->flac_dsp);
 
     dprint_compression_options(s);
 
-    return ret;
+    return init_frame_jobs(avctx, s);
 }
 
 
@@ -1316,10 +1371,10 @@ static int write_frame(FlacEncodeContext *s, AVPacket *avpkt)
 }
 
 
-static int update_md5_sum(FlacEncodeContext *s, const void *samples)
+static int update_md5_sum(FlacEncodeContext *s, const void *samples, int nb_samples)
 {
     const uint8_t *buf;
-    int buf_size = s->frame.blocksize * s->channels *
+    int buf_size = nb_samples * s->channels *
                    ((s->avctx->bits_per_raw_sample + 7) / 8);
 
     if (s->avctx->bits_per_raw_sample > 16 || HAVE_BIGENDIAN) {
@@ -1340,7 +1395,7 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
         const int32_t *samples0 = samples;
         uint8_t *tmp            = s->md5_buffer;
 
-        for (i = 0; i < s->frame.blocksize * s->channels; i++) {
+        for (i = 0; i < nb_samples * s->channels; i++) {
             int32_t v = samples0[i] >> 8;
             AV_WL24(tmp + 3*i, v);
         }
@@ -1352,6 +1407,144 @@ static int update_md5_sum(FlacEncodeContext *s, const void *samples)
 }
 
 
+static int compress_frame(FlacEncodeContext *s, const AVFrame *frame)
+{
+    int frame_bytes;
+
+    init_frame(s, frame->nb_samples);
+
+    copy_samples(s, frame->data[0]);
+
+    channel_decorrelation(s);
+
+    remove_wasted_bits(s);
+
+    frame_bytes = encode_frame(s);
+
+    /* Fall back on verbatim mode if the compressed frame is larger than it
+       would be if encoded uncompressed. */
+    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
+        s->frame.verbatim_only = 1;
+        frame_bytes = encode_frame(s);
+        if (frame_bytes < 0) {
+            av_log(s->avctx, AV_LOG_ERROR, "Bad frame count\n");
+            return frame_bytes;
+        }
+    }
+
+    return frame_bytes;
+}
+
+
+static void finish_packet(FlacEncodeContext *s, AVPacket *avpkt,
+                          const AVFrame *frame, int out_bytes)
+{
+    s->sample_count += frame->nb_samples;
+    if (out_bytes > s->max_encoded_framesize)
+        s->max_encoded_framesize = out_bytes;
+    if (out_bytes < s->min_framesize)
+        s->min_framesize = out_bytes;
+
+    avpkt->pts      = frame->pts;
+    avpkt->duration = ff_samples_to_time_base(s->avctx, frame->nb_samples);
+
+    s->next_pts = avpkt->pts + avpkt->duration;
+
+    av_shrink_packet(avpkt, out_bytes);
+}
+
+
+static int compress_frame_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    FlacEncodeJob *job = (FlacEncodeJob *)arg + jobnr;
+
+    job->ret = compress_frame(job->ctx, job->frame);
+
+    return 0;
+}
+
+
+static int write_frame_job(AVCodecContext *avctx, void *arg, int jobnr, int threadnr)
+{
+    FlacEncodeJob *job = (FlacEncodeJob *)arg + jobnr;
+
+    job->ret = write_frame(job->ctx, job->pkt);
+
+    return 0;
+}
+
+
+/**
+ * Encode all the queued frames in parallel. Every frame is compressed in its
+ * own copy of the encoder state, the frame number and the verbatim size limit
+ * are assigned when queuing, so the output does not depend on the number of
+ * threads.
+ */
+static int encode_queued_frames(AVCodecContext *avctx)
+{
+    FlacEncodeContext *s = avctx->priv_data;
+    int i, ret = 0;
+
+    avctx->execute2(avctx, compress_frame_job, s->jobs, NULL, s->nb_queued);
+
+    for (i = 0; i < s->nb_queued; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+
+        if (job->ret < 0) {
+            ret = job->ret;
+            goto end;
+        }
+        if ((ret = ff_get_encode_buffer(avctx, job->pkt, job->ret, 0)) < 0)
+            goto end;
+    }
+
+    avctx->execute2(avctx, write_frame_job, s->jobs, NULL, s->nb_queued);
+
+    for (i = 0; i < s->nb_queued; i++)
+        finish_packet(s, s->jobs[i].pkt, s->jobs[i].frame, s->jobs[i].ret);
+
+    s->nb_ready   = s->nb_queued;
+    s->next_ready = 0;
+end:
+    for (i = 0; i < s->nb_queued; i++) {
+        av_frame_unref(s->jobs[i].frame);
+        if (ret < 0)
+            av_packet_unref(s->jobs[i].pkt);
+    }
+    s->nb_queued = 0;
+
+    return ret;
+}
+
+
+static int queue_frame(FlacEncodeContext *s, const AVFrame *frame)
+{
+    FlacEncodeJob *job = &s->jobs[s->nb_queued];
+    int ret;
+
+    /* change max_framesize for small final frame */
+    if (s->frame_count && frame->nb_samples < s->max_blocksize) {
+        s->max_framesize = flac_get_max_frame_size(frame->nb_samples,
+                                                   s->channels,
+                                                   s->avctx->bits_per_raw_sample);
+    }
+
+    if ((ret = av_frame_ref(job->frame, frame)) < 0)
+        return ret;
+
+    job->ctx->max_framesize = s->max_framesize;
+    job->ctx->frame_count   = s->frame_count++;
+    s->nb_queued++;
+
+    if ((ret = update_md5_sum(s, frame->data[0], frame->nb_samples)) < 0) {
+        av_log(s->avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
+        return ret;
+    }
+
+    return 0;
+}
+
+
 static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                              const AVFrame *frame, int *got_packet_ptr)
 {
@@ -1360,6 +1553,26 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
 
     s = avctx->priv_data;
 
+    if (s->jobs) {
+        if (frame && (ret = queue_frame(s, frame)) < 0)
+            return ret;
+
+        if (s->next_ready == s->nb_ready &&
+            (s->nb_queued == s->nb_jobs || (!frame && s->nb_queued))) {
+            if ((ret = encode_queued_frames(avctx)) < 0)
+                return ret;
+        }
+
+        if (s->next_ready < s->nb_ready) {
+            av_packet_move_ref(avpkt, s->jobs[s->next_ready++].pkt);
+            *got_packet_ptr = 1;
+            return 0;
+        }
+
+        if (frame)
+            return 0;
+    }
+
     /* when the last block is reached, update the header in extradata */
     if (!frame) {
         s->max_framesize = s->max_encoded_framesize;
@@ -1389,26 +1602,9 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
                                                    avctx->bits_per_raw_sample);
     }
 
-    init_frame(s, frame->nb_samples);
-
-    copy_samples(s, frame->data[0]);
-
-    channel_decorrelation(s);
-
-    remove_wasted_bits(s);
-
-    frame_bytes = encode_frame(s);
-
-    /* Fall back on verbatim mode if the compressed frame is larger than it
-       would be if encoded uncompressed. */
-    if (frame_bytes < 0 || frame_bytes > s->max_framesize) {
-        s->frame.verbatim_only = 1;
-        frame_bytes = encode_frame(s);
-        if (frame_bytes < 0) {
-            av_log(avctx, AV_LOG_ERROR, "Bad frame count\n");
-            return frame_bytes;
-        }
-    }
+    frame_bytes = compress_frame(s, frame);
+    if (frame_bytes < 0)
+        return frame_bytes;
 
     if ((ret = ff_get_encode_buffer(avctx, avpkt, frame_bytes, 0)) < 0)
         return ret;
@@ -1416,22 +1612,12 @@ static int flac_encode_frame(AVCodecContext *avctx, AVPacket *avpkt,
     out_bytes = write_frame(s, avpkt);
 
     s->frame_count++;
-    s->sample_count += frame->nb_samples;
-    if ((ret = update_md5_sum(s, frame->data[0])) < 0) {
+    if ((ret = update_md5_sum(s, frame->data[0], frame->nb_samples)) < 0) {
         av_log(avctx, AV_LOG_ERROR, "Error updating MD5 checksum\n");
         return ret;
     }
-    if (out_bytes > s->max_encoded_framesize)
-        s->max_encoded_framesize = out_bytes;
-    if (out_bytes < s->min_framesize)
-        s->min_framesize = out_bytes;
 
-    avpkt->pts      = frame->pts;
-    avpkt->duration = ff_samples_to_time_base(avctx, frame->nb_samples);
-
-    s->next_pts = avpkt->pts + avpkt->duration;
-
-    av_shrink_packet(avpkt, out_bytes);
+    finish_packet(s, avpkt, frame, out_bytes);
 
     *got_packet_ptr = 1;
     return 0;
@@ -1442,6 +1628,17 @@ static av_cold int flac_encode_close(AVCodecContext *avctx)
 {
     FlacEncodeContext *s = avctx->priv_data;
 
+    for (int i = 0; i < s->nb_jobs; i++) {
+        FlacEncodeJob *job = &s->jobs[i];
+
+        if (job->ctx)
+            ff_lpc_end(&job->ctx->lpc_ctx);
+        av_freep(&job->ctx);
+        av_frame_free(&job->frame);
+        av_packet_free(&job->pkt);
+    }
+    av_freep(&s->jobs);
+
     av_freep(&s->md5ctx);
     av_freep(&s->md5_buffer);
     ff_lpc_end(&s->lpc_ctx);
@@ -1493,7 +1690,8 @@ const FFCodec ff_flac_encoder = {
     .p.type         = AVMEDIA_TYPE_AUDIO,
     .p.id           = AV_CODEC_ID_FLAC,
     .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_DELAY |
-                      AV_CODEC_CAP_SMALL_LAST_FRAME,
+                      AV_CODEC_CAP_SMALL_LAST_FRAME |
+                      AV_CODEC_CAP_SLICE_THREADS,
     .priv_data_size = sizeof(FlacEncodeContext),
     .init           = flac_encode_init,
     FF_CODEC_ENCODE_CB(flac_encode_frame),
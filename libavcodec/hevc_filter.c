@@ -26,6 +26,7 @@
 #include "libavutil/internal.h"
 
 #include "hevcdec.h"
+#include "thread.h"
 #include "threadframe.h"
 
 #define LUMA 0
@@ -656,13 +657,14 @@ static void deblocking_filter_CTB(const HEVCContext *s, int x0, int y0)
     }
 }
 
-static int boundary_strength(const HEVCContext *s, const MvField *curr, const MvField *neigh,
+static int boundary_strength(const MvField *curr, const MvField *neigh,
+                             const RefPicList *curr_refPicList,
                              const RefPicList *neigh_refPicList)
 {
     if (curr->pred_flag == PF_BI &&  neigh->pred_flag == PF_BI) {
         // same L0 and L1
-        if (s->ref->refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
-            s->ref->refPicList[0].list[curr->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]] &&
+        if (curr_refPicList[0].list[curr->ref_idx[0]] == neigh_refPicList[0].list[neigh->ref_idx[0]]  &&
+            curr_refPicList[0].list[curr->ref_idx[0]] == curr_refPicList[1].list[curr->ref_idx[1]] &&
             neigh_refPicList[0].list[neigh->ref_idx[0]] == neigh_refPicList[1].list[neigh->ref_idx[1]]) {
             if ((FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
                  FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4) &&
@@ -671,15 +673,15 @@ static int boundary_strength(const HEVCContext *s, const MvField *curr, const Mv
                 return 1;
             else
                 return 0;
-        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[0].list[neigh->ref_idx[0]] == curr_refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[1].list[neigh->ref_idx[1]] == curr_refPicList[1].list[curr->ref_idx[1]]) {
             if (FFABS(neigh->mv[0].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[0].y) >= 4 ||
                 FFABS(neigh->mv[1].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[1].y) >= 4)
                 return 1;
             else
                 return 0;
-        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == s->ref->refPicList[0].list[curr->ref_idx[0]] &&
-                   neigh_refPicList[0].list[neigh->ref_idx[0]] == s->ref->refPicList[1].list[curr->ref_idx[1]]) {
+        } else if (neigh_refPicList[1].list[neigh->ref_idx[1]] == curr_refPicList[0].list[curr->ref_idx[0]] &&
+                   neigh_refPicList[0].list[neigh->ref_idx[0]] == curr_refPicList[1].list[curr->ref_idx[1]]) {
             if (FFABS(neigh->mv[1].x - curr->mv[0].x) >= 4 || FFABS(neigh->mv[1].y - curr->mv[0].y) >= 4 ||
                 FFABS(neigh->mv[0].x - curr->mv[1].x) >= 4 || FFABS(neigh->mv[0].y - curr->mv[1].y) >= 4)
                 return 1;
@@ -694,10 +696,10 @@ static int boundary_strength(const HEVCContext *s, const MvField *curr, const Mv
 
         if (curr->pred_flag & 1) {
             A     = curr->mv[0];
-            ref_A = s->ref->refPicList[0].list[curr->ref_idx[0]];
+            ref_A = curr_refPicList[0].list[curr->ref_idx[0]];
         } else {
             A     = curr->mv[1];
-            ref_A = s->ref->refPicList[1].list[curr->ref_idx[1]];
+            ref_A = curr_refPicList[1].list[curr->ref_idx[1]];
         }
 
         if (neigh->pred_flag & 1) {
@@ -734,12 +736,14 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
     int boundary_upper, boundary_left;
     int i, j, bs;
 
+    /* with parallel tiles, the neighbouring tile may not be decoded yet;
+     * tile edges are then handled by tile_edge_boundary_strengths() */
     boundary_upper = y0 > 0 && !(y0 & 7);
     if (boundary_upper &&
         ((!s->sh.slice_loop_filter_across_slices_enabled_flag &&
           lc->boundary_flags & BOUNDARY_UPPER_SLICE &&
           (y0 % (1 << s->ps.sps->log2_ctb_size)) == 0) ||
-         (!s->ps.pps->loop_filter_across_tiles_enabled_flag &&
+         ((!s->ps.pps->loop_filter_across_tiles_enabled_flag || s->enable_parallel_tiles) &&
           lc->boundary_flags & BOUNDARY_UPPER_TILE &&
           (y0 % (1 << s->ps.sps->log2_ctb_size)) == 0)))
         boundary_upper = 0;
@@ -766,7 +770,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 else if (curr_cbf_luma || top_cbf_luma)
                     bs = 1;
                 else
-                    bs = boundary_strength(s, curr, top, rpl_top);
+                    bs = boundary_strength(curr, top, s->ref->refPicList, rpl_top);
                 s->horizontal_bs[((x0 + i) + y0 * s->bs_width) >> 2] = bs;
             }
     }
@@ -777,7 +781,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
         ((!s->sh.slice_loop_filter_across_slices_enabled_flag &&
           lc->boundary_flags & BOUNDARY_LEFT_SLICE &&
           (x0 % (1 << s->ps.sps->log2_ctb_size)) == 0) ||
-         (!s->ps.pps->loop_filter_across_tiles_enabled_flag &&
+         ((!s->ps.pps->loop_filter_across_tiles_enabled_flag || s->enable_parallel_tiles) &&
           lc->boundary_flags & BOUNDARY_LEFT_TILE &&
           (x0 % (1 << s->ps.sps->log2_ctb_size)) == 0)))
         boundary_left = 0;
@@ -804,7 +808,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 else if (curr_cbf_luma || left_cbf_luma)
                     bs = 1;
                 else
-                    bs = boundary_strength(s, curr, left, rpl_left);
+                    bs = boundary_strength(curr, left, s->ref->refPicList, rpl_left);
                 s->vertical_bs[(x0 + (y0 + i) * s->bs_width) >> 2] = bs;
             }
     }
@@ -822,7 +826,7 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 const MvField *top  = &tab_mvf[yp_pu * min_pu_width + x_pu];
                 const MvField *curr = &tab_mvf[yq_pu * min_pu_width + x_pu];
 
-                bs = boundary_strength(s, curr, top, rpl);
+                bs = boundary_strength(curr, top, rpl, rpl);
                 s->horizontal_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
             }
         }
@@ -837,13 +841,98 @@ void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
                 const MvField *left = &tab_mvf[y_pu * min_pu_width + xp_pu];
                 const MvField *curr = &tab_mvf[y_pu * min_pu_width + xq_pu];
 
-                bs = boundary_strength(s, curr, left, rpl);
+                bs = boundary_strength(curr, left, rpl, rpl);
                 s->vertical_bs[((x0 + i) + (y0 + j) * s->bs_width) >> 2] = bs;
             }
         }
     }
 }
 
+/**
+ * Compute the boundary strengths of the edges of a CTB that are also tile
+ * edges, which ff_hevc_deblocking_boundary_strengths() skips when tiles are
+ * decoded in parallel.
+ */
+static void tile_edge_boundary_strengths(const HEVCContext *s, int x0, int y0)
+{
+    const MvField *tab_mvf = s->ref->tab_mvf;
+    const HEVCSPS *sps     = s->ps.sps;
+    const HEVCPPS *pps     = s->ps.pps;
+    int log2_min_pu_size   = sps->log2_min_pu_size;
+    int log2_min_tu_size   = sps->log2_min_tb_size;
+    int min_pu_width       = sps->min_pu_width;
+    int min_tu_width       = sps->min_tb_width;
+    int ctb_size           = 1 << sps->log2_ctb_size;
+    int ctb_addr_rs        = (y0 >> sps->log2_ctb_size) * sps->ctb_width +
+                             (x0 >> sps->log2_ctb_size);
+    int ctb_addr_ts        = pps->ctb_addr_rs_to_ts[ctb_addr_rs];
+    int x_end              = FFMIN(x0 + ctb_size, sps->width);
+    int y_end              = FFMIN(y0 + ctb_size, sps->height);
+    const RefPicList *rpl;
+    int i, bs;
+
+    if (!pps->loop_filter_across_tiles_enabled_flag ||
+        s->tab_slice_address[ctb_addr_rs] < 0 ||
+        s->disable_deblocking[ctb_addr_rs])
+        return;
+
+    rpl = ff_hevc_get_ref_list(s, s->ref, x0, y0);
+
+    if (y0 > 0 && s->tab_slice_address[ctb_addr_rs - sps->ctb_width] >= 0 &&
+        pps->tile_id[ctb_addr_ts] != pps->tile_id[pps->ctb_addr_rs_to_ts[ctb_addr_rs - sps->ctb_width]] &&
+        (s->filter_slice_edges[ctb_addr_rs] ||
+         s->tab_slice_address[ctb_addr_rs] == s->tab_slice_address[ctb_addr_rs - sps->ctb_width])) {
+        const RefPicList *rpl_top = ff_hevc_get_ref_list(s, s->ref, x0, y0 - 1);
+        int yp_pu = (y0 - 1) >> log2_min_pu_size;
+        int yq_pu =  y0      >> log2_min_pu_size;
+        int yp_tu = (y0 - 1) >> log2_min_tu_size;
+        int yq_tu =  y0      >> log2_min_tu_size;
+
+        for (i = x0; i < x_end; i += 4) {
+            int x_pu = i >> log2_min_pu_size;
+            int x_tu = i >> log2_min_tu_size;
+            const MvField *top  = &tab_mvf[yp_pu * min_pu_width + x_pu];
+            const MvField *curr = &tab_mvf[yq_pu * min_pu_width + x_pu];
+
+            if (curr->pred_flag == PF_INTRA || top->pred_flag == PF_INTRA)
+                bs = 2;
+            else if (s->cbf_luma[yq_tu * min_tu_width + x_tu] ||
+                     s->cbf_luma[yp_tu * min_tu_width + x_tu])
+                bs = 1;
+            else
+                bs = boundary_strength(curr, top, rpl, rpl_top);
+            s->horizontal_bs[(i + y0 * s->bs_width) >> 2] = bs;
+        }
+    }
+
+    if (x0 > 0 && s->tab_slice_address[ctb_addr_rs - 1] >= 0 &&
+        pps->tile_id[ctb_addr_ts] != pps->tile_id[pps->ctb_addr_rs_to_ts[ctb_addr_rs - 1]] &&
+        (s->filter_slice_edges[ctb_addr_rs] ||
+         s->tab_slice_address[ctb_addr_rs] == s->tab_slice_address[ctb_addr_rs - 1])) {
+        const RefPicList *rpl_left = ff_hevc_get_ref_list(s, s->ref, x0 - 1, y0);
+        int xp_pu = (x0 - 1) >> log2_min_pu_size;
+        int xq_pu =  x0      >> log2_min_pu_size;
+        int xp_tu = (x0 - 1) >> log2_min_tu_size;
+        int xq_tu =  x0      >> log2_min_tu_size;
+
+        for (i = y0; i < y_end; i += 4) {
+            int y_pu = i >> log2_min_pu_size;
+            int y_tu = i >> log2_min_tu_size;
+            const MvField *left = &tab_mvf[y_pu * min_pu_width + xp_pu];
+            const MvField *curr = &tab_mvf[y_pu * min_pu_width + xq_pu];
+
+            if (curr->pred_flag == PF_INTRA || left->pred_flag == PF_INTRA)
+                bs = 2;
+            else if (s->cbf_luma[y_tu * min_tu_width + xq_tu] ||
+                     s->cbf_luma[y_tu * min_tu_width + xp_tu])
+                bs = 1;
+            else
+                bs = boundary_strength(curr, left, rpl, rpl_left);
+            s->vertical_bs[(x0 + i * s->bs_width) >> 2] = bs;
+        }
+    }
+}
+
 #undef LUMA
 #undef CB
 #undef CR
@@ -853,14 +942,26 @@ void ff_hevc_hls_filter(HEVCLocalContext *lc, int x, int y, int ctb_size)
     const HEVCContext *const s = lc->parent;
     int x_end = x >= s->ps.sps->width  - ctb_size;
     int skip = 0;
+    int slice_type    = s->sh.slice_type;
+    int nal_unit_type = s->nal_unit_type;
+
+    /* the deferred frame pass may run after other NAL units were parsed,
+     * use the parameters stored for the CTB and the frame instead */
+    if (s->enable_parallel_tiles) {
+        slice_type    = CTB(s->tab_slice_type, x >> s->ps.sps->log2_ctb_size,
+                            y >> s->ps.sps->log2_ctb_size);
+        nal_unit_type = s->first_nal_type;
+    }
+
     if (s->avctx->skip_loop_filter >= AVDISCARD_ALL ||
-        (s->avctx->skip_loop_filter >= AVDISCARD_NONKEY && !IS_IDR(s)) ||
+        (s->avctx->skip_loop_filter >= AVDISCARD_NONKEY &&
+         nal_unit_type != HEVC_NAL_IDR_W_RADL && nal_unit_type != HEVC_NAL_IDR_N_LP) ||
         (s->avctx->skip_loop_filter >= AVDISCARD_NONINTRA &&
-         s->sh.slice_type != HEVC_SLICE_I) ||
+         slice_type != HEVC_SLICE_I) ||
         (s->avctx->skip_loop_filter >= AVDISCARD_BIDIR &&
-         s->sh.slice_type == HEVC_SLICE_B) ||
+         slice_type == HEVC_SLICE_B) ||
         (s->avctx->skip_loop_filter >= AVDISCARD_NONREF &&
-        ff_hevc_nal_is_nonref(s->nal_unit_type)))
+        ff_hevc_nal_is_nonref(nal_unit_type)))
         skip = 1;
 
     if (!skip)
@@ -896,3 +997,39 @@ void ff_hevc_hls_filters(HEVCLocalContext *lc, int x_ctb, int y_ctb, int ctb_siz
     if (x_ctb && y_end)
         ff_hevc_hls_filter(lc, x_ctb - ctb_size, y_ctb, ctb_size);
 }
+
+static int hls_filter_row(AVCodecContext *avctx, void *hevc_lclist,
+                          int job, int self_id)
+{
+    HEVCLocalContext *lc = ((HEVCLocalContext**)hevc_lclist)[self_id];
+    const HEVCContext *const s = lc->parent;
+    int ctb_size = 1 << s->ps.sps->log2_ctb_size;
+    int y        = job << s->ps.sps->log2_ctb_size;
+    int thread   = job % s->threads_number;
+    int x;
+
+    /* same dependencies as the filtering following WPP decoding: the row
+     * above must be SHIFT_CTB_WPP CTBs ahead */
+    for (x = 0; x < s->ps.sps->width; x += ctb_size) {
+        ff_thread_await_progress2(avctx, job, thread, SHIFT_CTB_WPP);
+        tile_edge_boundary_strengths(s, x, y);
+        ff_hevc_hls_filter(lc, x, y, ctb_size);
+        ff_thread_report_progress2(avctx, job, thread, 1);
+    }
+    ff_thread_report_progress2(avctx, job, thread, SHIFT_CTB_WPP);
+
+    return 0;
+}
+
+int ff_hevc_hls_filter_frame(HEVCContext *s)
+{
+    int ret = ff_slice_thread_allocz_entries(s->avctx, s->ps.sps->ctb_height);
+    if (ret < 0)
+        return ret;
+
+    s->filter_frame_pending = 0;
+
+    s->avctx->execute2(s->avctx, hls_filter_row, s->HEVClcList, NULL,
+                       s->ps.sps->ctb_height);
+    return 0;
+}
@@ -81,6 +81,8 @@ static void pic_arrays_free(HEVCContext *s)
     av_freep(&s->qp_y_tab);
     av_freep(&s->tab_slice_address);
     av_freep(&s->filter_slice_edges);
+    av_freep(&s->disable_deblocking);
+    av_freep(&s->tab_slice_type);
 
     av_freep(&s->horizontal_bs);
     av_freep(&s->vertical_bs);
@@ -124,11 +126,14 @@ static int pic_arrays_init(HEVCContext *s, const HEVCSPS *sps)
         goto fail;
 
     s->filter_slice_edges = av_mallocz(ctb_count);
+    s->disable_deblocking = av_mallocz(ctb_count);
+    s->tab_slice_type     = av_mallocz(ctb_count);
     s->tab_slice_address  = av_malloc_array(pic_size_in_ctb,
                                       sizeof(*s->tab_slice_address));
     s->qp_y_tab           = av_malloc_array(pic_size_in_ctb,
                                       sizeof(*s->qp_y_tab));
-    if (!s->qp_y_tab || !s->filter_slice_edges || !s->tab_slice_address)
+    if (!s->qp_y_tab || !s->filter_slice_edges || !s->tab_slice_address ||
+        !s->disable_deblocking || !s->tab_slice_type)
         goto fail;
 
     s->horizontal_bs = av_calloc(s->bs_width, s->bs_height);
@@ -941,13 +946,14 @@ static int hls_slice_header(HEVCContext *s)
                 unsigned val = get_bits_long(gb, offset_len);
                 sh->entry_point_offset[i] = val + 1; // +1; // +1 to get the size
             }
-            if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1)) {
-                s->enable_parallel_tiles = 0; // TODO: you can enable tiles in parallel here
+            /* tiles are decoded in parallel only without WPP, and without
+             * dependent slice segments, which continue the CABAC state of
+             * the previous segment */
+            if (s->threads_number > 1 && (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1) &&
+                (s->ps.pps->entropy_coding_sync_enabled_flag ||
+                 s->ps.pps->dependent_slice_segments_enabled_flag))
                 s->threads_number = 1;
-            } else
-                s->enable_parallel_tiles = 0;
-        } else
-            s->enable_parallel_tiles = 0;
+        }
     }
 
     if (s->ps.pps->slice_header_extension_present_flag) {
@@ -2437,8 +2443,6 @@ static void hls_decode_neighbour(HEVCLocalContext *lc, int x_ctb, int y_ctb,
     int ctb_addr_rs       = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
     int ctb_addr_in_slice = ctb_addr_rs - s->sh.slice_addr;
 
-    s->tab_slice_address[ctb_addr_rs] = s->sh.slice_addr;
-
     if (s->ps.pps->entropy_coding_sync_enabled_flag) {
         if (x_ctb == 0 && (y_ctb & (ctb_size - 1)) == 0)
             lc->first_qp_group = 1;
@@ -2478,17 +2482,8 @@ static void hls_decode_neighbour(HEVCLocalContext *lc, int x_ctb, int y_ctb,
     lc->ctb_up_left_flag = ((x_ctb > 0) && (y_ctb > 0)  && (ctb_addr_in_slice-1 >= s->ps.sps->ctb_width) && (s->ps.pps->tile_id[ctb_addr_ts] == s->ps.pps->tile_id[s->ps.pps->ctb_addr_rs_to_ts[ctb_addr_rs-1 - s->ps.sps->ctb_width]]));
 }
 
-static int hls_decode_entry(AVCodecContext *avctxt, void *isFilterThread)
+static int check_slice_segment_start(const HEVCContext *s, int ctb_addr_ts)
 {
-    HEVCContext *s  = avctxt->priv_data;
-    HEVCLocalContext *const lc = s->HEVClc;
-    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
-    int more_data   = 1;
-    int x_ctb       = 0;
-    int y_ctb       = 0;
-    int ctb_addr_ts = s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
-    int ret;
-
     if (!ctb_addr_ts && s->sh.dependent_slice_segment_flag) {
         av_log(s->avctx, AV_LOG_ERROR, "Impossible initial tile.\n");
         return AVERROR_INVALIDDATA;
@@ -2502,11 +2497,30 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *isFilterThread)
         }
     }
 
+    return 0;
+}
+
+static int hls_decode_entry(AVCodecContext *avctxt, void *isFilterThread)
+{
+    HEVCContext *s  = avctxt->priv_data;
+    HEVCLocalContext *const lc = s->HEVClc;
+    int ctb_size    = 1 << s->ps.sps->log2_ctb_size;
+    int more_data   = 1;
+    int x_ctb       = 0;
+    int y_ctb       = 0;
+    int ctb_addr_ts = s->ps.pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int ret;
+
+    ret = check_slice_segment_start(s, ctb_addr_ts);
+    if (ret < 0)
+        return ret;
+
     while (more_data && ctb_addr_ts < s->ps.sps->ctb_size) {
         int ctb_addr_rs = s->ps.pps->ctb_addr_ts_to_rs[ctb_addr_ts];
 
         x_ctb = (ctb_addr_rs % ((s->ps.sps->width + ctb_size - 1) >> s->ps.sps->log2_ctb_size)) << s->ps.sps->log2_ctb_size;
         y_ctb = (ctb_addr_rs / ((s->ps.sps->width + ctb_size - 1) >> s->ps.sps->log2_ctb_size)) << s->ps.sps->log2_ctb_size;
+        s->tab_slice_address[ctb_addr_rs] = s->sh.slice_addr;
         hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
 
         ret = ff_hevc_cabac_init(lc, ctb_addr_ts);
@@ -2520,6 +2534,8 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *isFilterThread)
         s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
         s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
         s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+        s->disable_deblocking[ctb_addr_rs]  = s->sh.disable_deblocking_filter_flag;
+        s->tab_slice_type[ctb_addr_rs]      = s->sh.slice_type;
 
         more_data = hls_coding_quadtree(lc, x_ctb, y_ctb, s->ps.sps->log2_ctb_size, 0);
         if (more_data < 0) {
@@ -2530,11 +2546,12 @@ static int hls_decode_entry(AVCodecContext *avctxt, void *isFilterThread)
 
         ctb_addr_ts++;
         ff_hevc_save_states(lc, ctb_addr_ts);
-        ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
+        if (!s->enable_parallel_tiles)
+            ff_hevc_hls_filters(lc, x_ctb, y_ctb, ctb_size);
     }
 
     if (x_ctb + ctb_size >= s->ps.sps->width &&
-        y_ctb + ctb_size >= s->ps.sps->height)
+        y_ctb + ctb_size >= s->ps.sps->height && !s->enable_parallel_tiles)
         ff_hevc_hls_filter(lc, x_ctb, y_ctb, ctb_size);
 
     return ctb_addr_ts;
@@ -2575,6 +2592,7 @@ static int hls_decode_entry_wpp(AVCodecContext *avctxt, void *hevc_lclist,
         int x_ctb = (ctb_addr_rs % s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
         int y_ctb = (ctb_addr_rs / s->ps.sps->ctb_width) << s->ps.sps->log2_ctb_size;
 
+        s->tab_slice_address[ctb_addr_rs] = s->sh.slice_addr;
         hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
 
         ff_thread_await_progress2(s->avctx, ctb_row, thread, SHIFT_CTB_WPP);
@@ -2634,25 +2652,9 @@ error:
     return ret;
 }
 
-static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
+static int alloc_local_contexts(HEVCContext *s)
 {
-    const uint8_t *data = nal->data;
-    int length          = nal->size;
-    HEVCLocalContext *lc = s->HEVClc;
-    int *ret;
-    int64_t offset;
-    int64_t startheader, cmpt = 0;
-    int i, j, res = 0;
-
-    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
-        av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
-            s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
-            s->ps.sps->ctb_width, s->ps.sps->ctb_height
-        );
-        return AVERROR_INVALIDDATA;
-    }
-
-    for (i = 1; i < s->threads_number; i++) {
+    for (int i = 1; i < s->threads_number; i++) {
         if (s->HEVClcList[i])
             continue;
         s->HEVClcList[i] = av_mallocz(sizeof(HEVCLocalContext));
@@ -2663,6 +2665,19 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
         s->HEVClcList[i]->common_cabac_state = &s->cabac;
     }
 
+    return 0;
+}
+
+/* locate the substreams following the first one in the slice segment data */
+static int set_entry_points(HEVCContext *s, const H2645NAL *nal)
+{
+    const uint8_t *data = nal->data;
+    int length          = nal->size;
+    HEVCLocalContext *lc = s->HEVClc;
+    int64_t offset;
+    int64_t startheader, cmpt = 0;
+    int i, j;
+
     offset = (lc->gb.index >> 3);
 
     for (j = 0, cmpt = 0, startheader = offset + s->sh.entry_point_offset[0]; j < nal->skipped_bytes; j++) {
@@ -2697,6 +2712,30 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     }
     s->data = data;
 
+    return 0;
+}
+
+static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
+{
+    int *ret;
+    int i, res = 0;
+
+    if (s->sh.slice_ctb_addr_rs + s->sh.num_entry_point_offsets * s->ps.sps->ctb_width >= s->ps.sps->ctb_width * s->ps.sps->ctb_height) {
+        av_log(s->avctx, AV_LOG_ERROR, "WPP ctb addresses are wrong (%d %d %d %d)\n",
+            s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets,
+            s->ps.sps->ctb_width, s->ps.sps->ctb_height
+        );
+        return AVERROR_INVALIDDATA;
+    }
+
+    res = alloc_local_contexts(s);
+    if (res < 0)
+        return res;
+
+    res = set_entry_points(s, nal);
+    if (res < 0)
+        return res;
+
     for (i = 1; i < s->threads_number; i++) {
         s->HEVClcList[i]->first_qp_group = 1;
         s->HEVClcList[i]->qp_y = s->HEVClc->qp_y;
@@ -2721,6 +2760,135 @@ static int hls_slice_data_wpp(HEVCContext *s, const H2645NAL *nal)
     return res;
 }
 
+/* first CTB of a tile, in tile scan */
+static int tile_start_ts(const HEVCContext *s, int tile_id)
+{
+    const HEVCPPS *pps = s->ps.pps;
+    int col = tile_id % pps->num_tile_columns;
+    int row = tile_id / pps->num_tile_columns;
+
+    return pps->ctb_addr_rs_to_ts[pps->row_bd[row] * s->ps.sps->ctb_width + pps->col_bd[col]];
+}
+
+static int hls_decode_entry_tile(AVCodecContext *avctxt, void *hevc_lclist,
+                                 int job, int self_id)
+{
+    HEVCLocalContext *lc = ((HEVCLocalContext**)hevc_lclist)[self_id];
+    const HEVCContext *const s = lc->parent;
+    const HEVCPPS *pps = s->ps.pps;
+    const HEVCSPS *sps = s->ps.sps;
+    int tile_id     = pps->tile_id[pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs]] + job;
+    int ctb_addr_ts = job ? tile_start_ts(s, tile_id) : pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int tile_end_ts = tile_id + 1 < pps->num_tile_columns * pps->num_tile_rows ?
+                      tile_start_ts(s, tile_id + 1) : sps->ctb_size;
+    int more_data   = 1;
+    int ret;
+
+    if (job) {
+        ret = init_get_bits8(&lc->gb, s->data + s->sh.offset[job - 1], s->sh.size[job - 1]);
+        if (ret < 0)
+            goto error;
+        lc->first_qp_group = 1;
+    } else {
+        lc->gb             = s->HEVClc->gb;
+        lc->first_qp_group = s->HEVClc->first_qp_group;
+    }
+    lc->qp_y              = s->HEVClc->qp_y;
+    lc->tu.cu_qp_offset_cb = 0;
+    lc->tu.cu_qp_offset_cr = 0;
+    lc->end_of_tiles_x    = (pps->col_bd[tile_id % pps->num_tile_columns] +
+                             pps->column_width[tile_id % pps->num_tile_columns]) << sps->log2_ctb_size;
+
+    while (more_data && ctb_addr_ts < tile_end_ts) {
+        int ctb_addr_rs = pps->ctb_addr_ts_to_rs[ctb_addr_ts];
+        int x_ctb = (ctb_addr_rs % sps->ctb_width) << sps->log2_ctb_size;
+        int y_ctb = (ctb_addr_rs / sps->ctb_width) << sps->log2_ctb_size;
+
+        hls_decode_neighbour(lc, x_ctb, y_ctb, ctb_addr_ts);
+
+        ret = ff_hevc_cabac_init(lc, ctb_addr_ts);
+        if (ret < 0)
+            goto error;
+
+        hls_sao_param(lc, x_ctb >> sps->log2_ctb_size, y_ctb >> sps->log2_ctb_size);
+
+        s->deblock[ctb_addr_rs].beta_offset = s->sh.beta_offset;
+        s->deblock[ctb_addr_rs].tc_offset   = s->sh.tc_offset;
+        s->filter_slice_edges[ctb_addr_rs]  = s->sh.slice_loop_filter_across_slices_enabled_flag;
+        s->disable_deblocking[ctb_addr_rs]  = s->sh.disable_deblocking_filter_flag;
+        s->tab_slice_type[ctb_addr_rs]      = s->sh.slice_type;
+
+        more_data = hls_coding_quadtree(lc, x_ctb, y_ctb, sps->log2_ctb_size, 0);
+        if (more_data < 0) {
+            ret = more_data;
+            goto error;
+        }
+
+        ctb_addr_ts++;
+    }
+
+    // only the last substream may end before the end of its tile
+    if (ctb_addr_ts < tile_end_ts && job != s->sh.num_entry_point_offsets) {
+        ret = AVERROR_INVALIDDATA;
+        goto error;
+    }
+
+    return ctb_addr_ts;
+error:
+    // the slice addresses were set in advance for the whole tile
+    for (; ctb_addr_ts < tile_end_ts; ctb_addr_ts++)
+        s->tab_slice_address[pps->ctb_addr_ts_to_rs[ctb_addr_ts]] = -1;
+    return ret;
+}
+
+static int hls_slice_data_tiles(HEVCContext *s, const H2645NAL *nal)
+{
+    const HEVCPPS *pps = s->ps.pps;
+    int start_ts = pps->ctb_addr_rs_to_ts[s->sh.slice_ctb_addr_rs];
+    int end_ts, i, res;
+    int *ret;
+
+    if (pps->tile_id[start_ts] + s->sh.num_entry_point_offsets >=
+        pps->num_tile_columns * pps->num_tile_rows ||
+        (start_ts && pps->tile_id[start_ts] == pps->tile_id[start_ts - 1])) {
+        av_log(s->avctx, AV_LOG_ERROR, "Tile entry points are wrong (%d %d)\n",
+               s->sh.slice_ctb_addr_rs, s->sh.num_entry_point_offsets);
+        return AVERROR_INVALIDDATA;
+    }
+
+    res = check_slice_segment_start(s, start_ts);
+    if (res < 0)
+        return res;
+
+    res = set_entry_points(s, nal);
+    if (res < 0)
+        return res;
+
+    /* the tiles of a slice segment are complete, so the CTBs it covers are
+     * known in advance; setting their slice address up front lets each
+     * tile check its neighbours without racing with the other tiles */
+    i      = pps->tile_id[start_ts] + s->sh.num_entry_point_offsets + 1;
+    end_ts = i < pps->num_tile_columns * pps->num_tile_rows ?
+             tile_start_ts(s, i) : s->ps.sps->ctb_size;
+    for (i = start_ts; i < end_ts; i++)
+        s->tab_slice_address[pps->ctb_addr_ts_to_rs[i]] = s->sh.slice_addr;
+
+    ret = av_calloc(s->sh.num_entry_point_offsets + 1, sizeof(*ret));
+    if (!ret)
+        return AVERROR(ENOMEM);
+
+    s->avctx->execute2(s->avctx, hls_decode_entry_tile, s->HEVClcList, ret,
+                       s->sh.num_entry_point_offsets + 1);
+
+    res = ret[s->sh.num_entry_point_offsets];
+    for (i = 0; i < s->sh.num_entry_point_offsets; i++)
+        if (ret[i] < 0)
+            res = ret[i];
+
+    av_free(ret);
+    return res;
+}
+
 static int set_side_data(HEVCContext *s)
 {
     AVFrame *out = s->ref->frame;
@@ -3017,9 +3185,21 @@ static int hevc_frame_start(HEVCContext *s)
     if (s->ps.pps->tiles_enabled_flag)
         lc->end_of_tiles_x = s->ps.pps->column_width[0] << s->ps.sps->log2_ctb_size;
 
+    s->enable_parallel_tiles = s->threads_number > 1 && !s->avctx->hwaccel &&
+                               !s->ps.pps->entropy_coding_sync_enabled_flag &&
+                               !s->ps.pps->dependent_slice_segments_enabled_flag &&
+                               (s->ps.pps->num_tile_rows > 1 || s->ps.pps->num_tile_columns > 1);
+    s->filter_frame_pending  = 0;
+    if (s->enable_parallel_tiles) {
+        ret = alloc_local_contexts(s);
+        if (ret < 0)
+            goto fail;
+    }
+
     ret = ff_hevc_set_new_ref(s, &s->frame, s->poc);
     if (ret < 0)
         goto fail;
+    s->filter_frame_pending = s->enable_parallel_tiles;
 
     ret = ff_hevc_frame_rps(s);
     if (ret < 0) {
@@ -3073,6 +3253,12 @@ static int hevc_frame_end(HEVCContext *s)
     const AVFrameSideData *sd;
     int ret;
 
+    if (s->filter_frame_pending) {
+        ret = ff_hevc_hls_filter_frame(s);
+        if (ret < 0)
+            return ret;
+    }
+
     if (out->needs_fg) {
         sd = av_frame_get_side_data(out->frame, AV_FRAME_DATA_FILM_GRAIN_PARAMS);
         av_assert0(out->frame_grain->buf[0] && sd);
@@ -3242,7 +3428,9 @@ static int decode_nal_unit(HEVCContext *s, const H2645NAL *nal)
             if (ret < 0)
                 goto fail;
         } else {
-            if (s->threads_number > 1 && s->sh.num_entry_point_offsets > 0)
+            if (s->enable_parallel_tiles && s->sh.num_entry_point_offsets > 0)
+                ctb_addr_ts = hls_slice_data_tiles(s, nal);
+            else if (s->threads_number > 1 && s->sh.num_entry_point_offsets > 0)
                 ctb_addr_ts = hls_slice_data_wpp(s, nal);
             else
                 ctb_addr_ts = hls_slice_data(s);
@@ -3363,6 +3551,13 @@ static int decode_nal_units(HEVCContext *s, const uint8_t *buf, int length)
     }
 
 fail:
+    /* filter what was decoded of a frame with missing or broken slices */
+    if (s->ref && s->filter_frame_pending) {
+        int err = ff_hevc_hls_filter_frame(s);
+        if (err < 0 && ret >= 0)
+            ret = err;
+    }
+
     if (s->ref && s->threads_type == FF_THREAD_FRAME)
         ff_thread_report_progress(&s->ref->tf, INT_MAX, 0);
 
@@ -560,6 +560,8 @@ typedef struct HEVCContext {
 
     // CTB-level flags affecting loop filter operation
     uint8_t *filter_slice_edges;
+    uint8_t *disable_deblocking; // disable_deblocking_filter_flag of the CTB's slice
+    uint8_t *tab_slice_type;     // slice_type of the CTB's slice
 
     /** used on BE to byteswap the lines for checksumming */
     uint8_t *checksum_buf;
@@ -575,7 +577,13 @@ typedef struct HEVCContext {
     /** The target for the common_cabac_state of the local contexts. */
     HEVCCABACState cabac;
 
+    /**
+     * The tiles of the current frame are decoded in parallel and the in-loop
+     * filters are applied after all of its slices are decoded.
+     */
     int enable_parallel_tiles;
+    /** The deferred in-loop filters have not been applied to s->ref yet. */
+    int filter_frame_pending;
     atomic_int wpp_err;
 
     const uint8_t *data;
@@ -696,6 +704,12 @@ void ff_hevc_luma_mv_mvp_mode(HEVCLocalContext *lc, int x0, int y0,
                               MvField *mv, int mvp_lx_flag, int LX);
 void ff_hevc_hls_filter(HEVCLocalContext *lc, int x, int y, int ctb_size);
 void ff_hevc_hls_filters(HEVCLocalContext *lc, int x_ctb, int y_ctb, int ctb_size);
+/**
+ * Apply the in-loop filters to the whole current frame, one CTB row per
+ * slice thread job. Used instead of filtering while decoding when tiles are
+ * decoded in parallel.
+ */
+int ff_hevc_hls_filter_frame(HEVCContext *s);
 void ff_hevc_set_qPy(HEVCLocalContext *lc, int xBase, int yBase,
                      int log2_cb_size);
 void ff_hevc_deblocking_boundary_strengths(HEVCLocalContext *lc, int x0, int y0,
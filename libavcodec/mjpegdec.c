@@ -1429,28 +1429,16 @@ static void shift_output(MJpegDecodeContext *s, uint8_t *ptr, int linesize)
     }
 }
 
-static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
-                             int Al, const uint8_t *mb_bitmask,
-                             int mb_bitmask_size,
-                             const AVFrame *reference)
+static int decode_mb_rows(MJpegDecodeContext *s, int nb_components, int Ah,
+                          int Al, GetBitContext *mb_bitmask_gb,
+                          const AVFrame *reference, int mb_y_start, int mb_y_end)
 {
     int i, mb_x, mb_y, chroma_h_shift, chroma_v_shift, chroma_width, chroma_height;
     uint8_t *data[MAX_COMPONENTS];
     const uint8_t *reference_data[MAX_COMPONENTS];
     int linesize[MAX_COMPONENTS];
-    GetBitContext mb_bitmask_gb = {0}; // initialize to silence gcc warning
     int bytes_per_pixel = 1 + (s->bits > 8);
 
-    if (mb_bitmask) {
-        if (mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
-            av_log(s->avctx, AV_LOG_ERROR, "mb_bitmask_size mismatches\n");
-            return AVERROR_INVALIDDATA;
-        }
-        init_get_bits(&mb_bitmask_gb, mb_bitmask, s->mb_width * s->mb_height);
-    }
-
-    s->restart_count = 0;
-
     av_pix_fmt_get_chroma_sub_sample(s->avctx->pix_fmt, &chroma_h_shift,
                                      &chroma_v_shift);
     chroma_width  = AV_CEIL_RSHIFT(s->width,  chroma_h_shift);
@@ -1461,12 +1449,11 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
         data[c] = s->picture_ptr->data[c];
         reference_data[c] = reference ? reference->data[c] : NULL;
         linesize[c] = s->linesize[c];
-        s->coefs_finished[c] |= 1;
     }
 
-    for (mb_y = 0; mb_y < s->mb_height; mb_y++) {
+    for (mb_y = mb_y_start; mb_y < mb_y_end; mb_y++) {
         for (mb_x = 0; mb_x < s->mb_width; mb_x++) {
-            const int copy_mb = mb_bitmask && !get_bits1(&mb_bitmask_gb);
+            const int copy_mb = mb_bitmask_gb && !get_bits1(mb_bitmask_gb);
 
             if (s->restart_interval && !s->restart_count)
                 s->restart_count = s->restart_interval;
@@ -1550,6 +1537,150 @@ static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
     return 0;
 }
 
+/**
+ * Find the start of every restart interval of the current scan in the
+ * unescaped scan data, by walking the escaped data the same way
+ * ff_mjpeg_find_marker() does while unescaping it.
+ *
+ * @return 0 if exactly nb_intervals intervals were found, <0 otherwise
+ */
+static int find_restart_intervals(MJpegDecodeContext *s, int nb_intervals)
+{
+    const uint8_t *ptr = s->raw_scan_buffer;
+    const uint8_t *end = s->raw_scan_buffer + s->raw_scan_buffer_size;
+    int start = get_bits_count(&s->gb) >> 3;
+    int pos = 0, n = 1;
+
+    av_fast_malloc(&s->slice_offsets, &s->slice_offsets_size,
+                   (nb_intervals + 1) * sizeof(*s->slice_offsets));
+    if (!s->slice_offsets)
+        return AVERROR(ENOMEM);
+
+    s->slice_offsets[0] = start;
+
+    while (ptr < end && n < nb_intervals) {
+        uint8_t x = *ptr++;
+
+        if (x != 0xff) {
+            pos++;
+            continue;
+        }
+        // fill bytes are not expected inside the scan, let the
+        // sequential code deal with them
+        if (ptr == end || *ptr == 0xff)
+            return AVERROR_INVALIDDATA;
+
+        x = *ptr++;
+        if (x >= RST0 && x <= RST7) {
+            pos += 2;
+            if (pos > start)
+                s->slice_offsets[n++] = pos;
+        } else if (!x) {
+            pos++;
+        } else
+            break;
+    }
+    s->slice_offsets[n] = s->gb.size_in_bits >> 3;
+
+    return n == nb_intervals ? 0 : AVERROR_INVALIDDATA;
+}
+
+static int decode_restart_interval(AVCodecContext *avctx, void *arg,
+                                   int jobnr, int threadnr)
+{
+    MJpegDecodeContext *s  = avctx->priv_data;
+    MJpegDecodeContext *sl = &s->slice_ctx[threadnr];
+    const int nb_components = *(int*)arg;
+    const int rows  = s->restart_interval / s->mb_width;
+    const int start = s->slice_offsets[jobnr];
+    const int size  = s->slice_offsets[jobnr + 1] - start;
+    int i, ret;
+
+    init_get_bits8(&sl->gb, s->gb.buffer + start, size);
+    for (i = 0; i < nb_components; i++)
+        sl->last_dc[i] = (4 << s->bits);
+    sl->restart_count = 0;
+
+    ret = decode_mb_rows(sl, nb_components, 0, 0, NULL, NULL, jobnr * rows,
+                         FFMIN((jobnr + 1) * rows, s->mb_height));
+
+    if (jobnr == s->nb_slices - 1)
+        s->slice_end = start * 8 + get_bits_count(&sl->gb);
+
+    return ret;
+}
+
+/* decode the restart intervals of a sequential scan in parallel */
+static int decode_scan_slices(MJpegDecodeContext *s, int nb_components)
+{
+    AVCodecContext *avctx = s->avctx;
+    int i, ret;
+
+    if (!s->slice_ctx) {
+        s->slice_ctx = av_calloc(avctx->thread_count, sizeof(*s->slice_ctx));
+        if (!s->slice_ctx)
+            return AVERROR(ENOMEM);
+    }
+    av_fast_malloc(&s->slice_ret, &s->slice_ret_size,
+                   s->nb_slices * sizeof(*s->slice_ret));
+    if (!s->slice_ret)
+        return AVERROR(ENOMEM);
+
+    for (i = 0; i < avctx->thread_count; i++)
+        s->slice_ctx[i] = *s;
+
+    avctx->execute2(avctx, decode_restart_interval, &nb_components,
+                    s->slice_ret, s->nb_slices);
+
+    skip_bits_long(&s->gb, s->slice_end - get_bits_count(&s->gb));
+
+    for (i = 0; i < s->nb_slices; i++) {
+        ret = s->slice_ret[i];
+        if (ret < 0)
+            return ret;
+    }
+
+    return 0;
+}
+
+static int mjpeg_decode_scan(MJpegDecodeContext *s, int nb_components, int Ah,
+                             int Al, const uint8_t *mb_bitmask,
+                             int mb_bitmask_size,
+                             const AVFrame *reference)
+{
+    GetBitContext mb_bitmask_gb = {0}; // initialize to silence gcc warning
+    int i;
+
+    if (mb_bitmask) {
+        if (mb_bitmask_size != (s->mb_width * s->mb_height + 7)>>3) {
+            av_log(s->avctx, AV_LOG_ERROR, "mb_bitmask_size mismatches\n");
+            return AVERROR_INVALIDDATA;
+        }
+        init_get_bits(&mb_bitmask_gb, mb_bitmask, s->mb_width * s->mb_height);
+    }
+
+    s->restart_count = 0;
+
+    for (i = 0; i < nb_components; i++)
+        s->coefs_finished[s->comp_index[i]] |= 1;
+
+    /* restart intervals made of whole MB rows can be decoded independently */
+    if (s->avctx->active_thread_type & FF_THREAD_SLICE &&
+        s->avctx->thread_count > 1 && !s->progressive && !mb_bitmask &&
+        s->raw_scan_buffer && s->avctx->codec_id != AV_CODEC_ID_THP &&
+        s->restart_interval && s->restart_interval % s->mb_width == 0 &&
+        s->restart_interval < s->mb_width * s->mb_height) {
+        s->nb_slices = (s->mb_height * s->mb_width + s->restart_interval - 1) /
+                       s->restart_interval;
+        if (find_restart_intervals(s, s->nb_slices) >= 0)
+            return decode_scan_slices(s, nb_components);
+    }
+
+    return decode_mb_rows(s, nb_components, Ah, Al,
+                          mb_bitmask ? &mb_bitmask_gb : NULL, reference,
+                          0, s->mb_height);
+}
+
 static int mjpeg_decode_scan_progressive_ac(MJpegDecodeContext *s, int ss,
                                             int se, int Ah, int Al)
 {
@@ -2982,6 +3113,10 @@ av_cold int ff_mjpeg_decode_end(AVCodecContext *avctx)
     av_freep(&s->hwaccel_picture_private);
     av_freep(&s->jls_state);
 
+    av_freep(&s->slice_ctx);
+    av_freep(&s->slice_offsets);
+    av_freep(&s->slice_ret);
+
     return 0;
 }
 
@@ -3020,7 +3155,7 @@ const FFCodec ff_mjpeg_decoder = {
     .close          = ff_mjpeg_decode_end,
     FF_CODEC_RECEIVE_FRAME_CB(ff_mjpeg_receive_frame),
     .flush          = decode_flush,
-    .p.capabilities = AV_CODEC_CAP_DR1,
+    .p.capabilities = AV_CODEC_CAP_DR1 | AV_CODEC_CAP_SLICE_THREADS,
     .p.max_lowres   = 3,
     .p.priv_class   = &mjpegdec_class,
     .p.profiles     = NULL_IF_CONFIG_SMALL(ff_mjpeg_profiles),
@@ -163,6 +163,15 @@ typedef struct MJpegDecodeContext {
     uint8_t raw_huffman_lengths[2][4][16];
     uint8_t raw_huffman_values[2][4][256];
 
+    // Slice threading over restart intervals.
+    struct MJpegDecodeContext *slice_ctx;   ///< per-thread copies of this context
+    int *slice_offsets;       ///< start of each restart interval in the unescaped scan
+    unsigned int slice_offsets_size;
+    int *slice_ret;
+    unsigned int slice_ret_size;
+    int nb_slices;
+    int slice_end;            ///< bit position where the last interval ended
+
     enum AVPixelFormat hwaccel_sw_pix_fmt;
     enum AVPixelFormat hwaccel_pix_fmt;
     void *hwaccel_picture_private;
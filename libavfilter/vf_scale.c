@@ -105,8 +105,10 @@ enum EvalMode {
 
 typedef struct ScaleContext {
     const AVClass *class;
-    struct SwsContext *sws;     ///< software scaler context
-    struct SwsContext *isws[2]; ///< software scaler context for interlaced material
+    struct SwsContext **sws;     ///< software scaler contexts, one per slice job
+    struct SwsContext **isws[2]; ///< software scaler contexts for interlaced material
+    int nb_slice_ctx;            ///< number of scaler contexts in each of the above
+    int *slice_ret;              ///< per-job return values of the slice jobs
     AVDictionary *opts;
 
     /**
@@ -153,6 +155,11 @@ typedef struct ScaleContext {
 
 } ScaleContext;
 
+typedef struct ThreadData {
+    AVFrame *in, *out;
+    struct SwsContext **sws;
+} ThreadData;
+
 const AVFilter ff_vf_scale2ref;
 
 static int config_props(AVFilterLink *outlink);
@@ -328,16 +335,28 @@ static av_cold int init_dict(AVFilterContext *ctx, AVDictionary **opts)
     return 0;
 }
 
+static void free_sws_contexts(ScaleContext *scale)
+{
+    struct SwsContext ***swscs[3] = { &scale->sws, &scale->isws[0], &scale->isws[1] };
+
+    for (int i = 0; i < 3; i++) {
+        if (!*swscs[i])
+            continue;
+        for (int j = 0; j < scale->nb_slice_ctx; j++)
+            sws_freeContext((*swscs[i])[j]);
+        av_freep(swscs[i]);
+    }
+    av_freep(&scale->slice_ret);
+    scale->nb_slice_ctx = 0;
+}
+
 static av_cold void uninit(AVFilterContext *ctx)
 {
     ScaleContext *scale = ctx->priv;
     av_expr_free(scale->w_pexpr);
     av_expr_free(scale->h_pexpr);
     scale->w_pexpr = scale->h_pexpr = NULL;
-    sws_freeContext(scale->sws);
-    sws_freeContext(scale->isws[0]);
-    sws_freeContext(scale->isws[1]);
-    scale->sws = NULL;
+    free_sws_contexts(scale);
     av_dict_free(&scale->opts);
 }
 
@@ -476,6 +495,19 @@ fail:
     return ret;
 }
 
+static int uses_error_diffusion(struct SwsContext *s)
+{
+    const AVOption *o = av_opt_find(s, "sws_dither", NULL, 0, 0);
+    int64_t dither;
+    int ed;
+
+    if (!o || av_opt_get_int(s, "sws_dither", 0, &dither) < 0 ||
+        av_opt_eval_int(s, o, "ed", &ed) < 0)
+        return 0;
+
+    return dither == ed;
+}
+
 static int config_props(AVFilterLink *outlink)
 {
     AVFilterContext *ctx = outlink->src;
@@ -510,13 +542,7 @@ static int config_props(AVFilterLink *outlink)
     if (outfmt == AV_PIX_FMT_PAL8) outfmt = AV_PIX_FMT_BGR8;
     scale->output_is_pal = av_pix_fmt_desc_get(outfmt)->flags & AV_PIX_FMT_FLAG_PAL;
 
-    if (scale->sws)
-        sws_freeContext(scale->sws);
-    if (scale->isws[0])
-        sws_freeContext(scale->isws[0]);
-    if (scale->isws[1])
-        sws_freeContext(scale->isws[1]);
-    scale->isws[0] = scale->isws[1] = scale->sws = NULL;
+    free_sws_contexts(scale);
     if (inlink0->w == outlink->w &&
         inlink0->h == outlink->h &&
         !scale->out_color_matrix &&
@@ -524,61 +550,84 @@ static int config_props(AVFilterLink *outlink)
         inlink0->format == outlink->format)
         ;
     else {
-        struct SwsContext **swscs[3] = {&scale->sws, &scale->isws[0], &scale->isws[1]};
-        int i;
+        struct SwsContext ***swscs[3] = {&scale->sws, &scale->isws[0], &scale->isws[1]};
+        int i, j;
+
+        /* Each slice job of ff_filter_execute() scales its share of the
+         * output rows with its own single-threaded context. */
+        scale->nb_slice_ctx = ff_filter_get_nb_threads(ctx);
+        scale->slice_ret    = av_calloc(scale->nb_slice_ctx, sizeof(*scale->slice_ret));
+        if (!scale->slice_ret)
+            return AVERROR(ENOMEM);
 
         for (i = 0; i < 3; i++) {
-            int in_v_chr_pos = scale->in_v_chr_pos, out_v_chr_pos = scale->out_v_chr_pos;
-            struct SwsContext *const s = sws_alloc_context();
-            if (!s)
+            *swscs[i] = av_calloc(scale->nb_slice_ctx, sizeof(**swscs[i]));
+            if (!*swscs[i])
                 return AVERROR(ENOMEM);
-            *swscs[i] = s;
-
-            av_opt_set_int(s, "srcw", inlink0 ->w, 0);
-            av_opt_set_int(s, "srch", inlink0 ->h >> !!i, 0);
-            av_opt_set_int(s, "src_format", inlink0->format, 0);
-            av_opt_set_int(s, "dstw", outlink->w, 0);
-            av_opt_set_int(s, "dsth", outlink->h >> !!i, 0);
-            av_opt_set_int(s, "dst_format", outfmt, 0);
-            av_opt_set_int(s, "sws_flags", scale->flags, 0);
-            av_opt_set_int(s, "param0", scale->param[0], 0);
-            av_opt_set_int(s, "param1", scale->param[1], 0);
-            av_opt_set_int(s, "threads", ff_filter_get_nb_threads(ctx), 0);
-            if (scale->in_range != AVCOL_RANGE_UNSPECIFIED)
-                av_opt_set_int(s, "src_range",
-                               scale->in_range == AVCOL_RANGE_JPEG, 0);
-            else if (scale->in_frame_range != AVCOL_RANGE_UNSPECIFIED)
-                av_opt_set_int(s, "src_range",
-                               scale->in_frame_range == AVCOL_RANGE_JPEG, 0);
-            if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
-                av_opt_set_int(s, "dst_range",
-                               scale->out_range == AVCOL_RANGE_JPEG, 0);
-
-            if (scale->opts) {
-                AVDictionaryEntry *e = NULL;
-                while ((e = av_dict_get(scale->opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
-                    if ((ret = av_opt_set(s, e->key, e->value, 0)) < 0)
-                        return ret;
+        }
+
+        for (i = 0; i < 3; i++) {
+            for (j = 0; j < scale->nb_slice_ctx; j++) {
+                int in_v_chr_pos = scale->in_v_chr_pos, out_v_chr_pos = scale->out_v_chr_pos;
+                struct SwsContext *const s = sws_alloc_context();
+                if (!s)
+                    return AVERROR(ENOMEM);
+                (*swscs[i])[j] = s;
+
+                av_opt_set_int(s, "srcw", inlink0 ->w, 0);
+                av_opt_set_int(s, "srch", inlink0 ->h >> !!i, 0);
+                av_opt_set_int(s, "src_format", inlink0->format, 0);
+                av_opt_set_int(s, "dstw", outlink->w, 0);
+                av_opt_set_int(s, "dsth", outlink->h >> !!i, 0);
+                av_opt_set_int(s, "dst_format", outfmt, 0);
+                av_opt_set_int(s, "sws_flags", scale->flags, 0);
+                av_opt_set_int(s, "param0", scale->param[0], 0);
+                av_opt_set_int(s, "param1", scale->param[1], 0);
+                av_opt_set_int(s, "threads", 1, 0);
+                if (scale->in_range != AVCOL_RANGE_UNSPECIFIED)
+                    av_opt_set_int(s, "src_range",
+                                   scale->in_range == AVCOL_RANGE_JPEG, 0);
+                else if (scale->in_frame_range != AVCOL_RANGE_UNSPECIFIED)
+                    av_opt_set_int(s, "src_range",
+                                   scale->in_frame_range == AVCOL_RANGE_JPEG, 0);
+                if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
+                    av_opt_set_int(s, "dst_range",
+                                   scale->out_range == AVCOL_RANGE_JPEG, 0);
+
+                if (scale->opts) {
+                    AVDictionaryEntry *e = NULL;
+                    while ((e = av_dict_get(scale->opts, "", e, AV_DICT_IGNORE_SUFFIX))) {
+                        if ((ret = av_opt_set(s, e->key, e->value, 0)) < 0)
+                            return ret;
+                    }
+                }
+                /* Override YUV420P default settings to have the correct (MPEG-2) chroma positions
+                 * MPEG-2 chroma positions are used by convention
+                 * XXX: support other 4:2:0 pixel formats */
+                if (inlink0->format == AV_PIX_FMT_YUV420P && scale->in_v_chr_pos == -513) {
+                    in_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
                 }
-            }
-            /* Override YUV420P default settings to have the correct (MPEG-2) chroma positions
-             * MPEG-2 chroma positions are used by convention
-             * XXX: support other 4:2:0 pixel formats */
-            if (inlink0->format == AV_PIX_FMT_YUV420P && scale->in_v_chr_pos == -513) {
-                in_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
-            }
 
-            if (outlink->format == AV_PIX_FMT_YUV420P && scale->out_v_chr_pos == -513) {
-                out_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
-            }
+                if (outlink->format == AV_PIX_FMT_YUV420P && scale->out_v_chr_pos == -513) {
+                    out_v_chr_pos = (i == 0) ? 128 : (i == 1) ? 64 : 192;
+                }
 
-            av_opt_set_int(s, "src_h_chr_pos", scale->in_h_chr_pos, 0);
-            av_opt_set_int(s, "src_v_chr_pos", in_v_chr_pos, 0);
-            av_opt_set_int(s, "dst_h_chr_pos", scale->out_h_chr_pos, 0);
-            av_opt_set_int(s, "dst_v_chr_pos", out_v_chr_pos, 0);
+                av_opt_set_int(s, "src_h_chr_pos", scale->in_h_chr_pos, 0);
+                av_opt_set_int(s, "src_v_chr_pos", in_v_chr_pos, 0);
+                av_opt_set_int(s, "dst_h_chr_pos", scale->out_h_chr_pos, 0);
+                av_opt_set_int(s, "dst_v_chr_pos", out_v_chr_pos, 0);
 
-            if ((ret = sws_init_context(s, NULL, NULL)) < 0)
-                return ret;
+                if ((ret = sws_init_context(s, NULL, NULL)) < 0)
+                    return ret;
+
+                // error diffusion carries state from line to line, so it cannot
+                // be split into slices
+                if (!i && !j && uses_error_diffusion(s)) {
+                    av_log(ctx, AV_LOG_VERBOSE,
+                           "Error-diffusion dither is in use, scaling will be single-threaded.\n");
+                    scale->nb_slice_ctx = 1;
+                }
+            }
             if (!scale->interlaced)
                 break;
         }
@@ -633,9 +682,53 @@ static void frame_offset(AVFrame *frame, int dir, int is_pal)
     }
 }
 
-static int scale_field(ScaleContext *scale, AVFrame *dst, AVFrame *src,
+static int scale_slice(AVFilterContext *ctx, void *arg, int jobnr, int nb_jobs)
+{
+    ThreadData *td = arg;
+    struct SwsContext *s = td->sws[jobnr];
+    const int align        = sws_receive_slice_alignment(s);
+    const int slice_height = FFALIGN(FFMAX((td->out->height + nb_jobs - 1) / nb_jobs, 1),
+                                     align);
+    const int slice_start  = jobnr * slice_height;
+    const int slice_end    = FFMIN(slice_start + slice_height, td->out->height);
+    int ret;
+
+    if (slice_end <= slice_start)
+        return 0;
+
+    ret = sws_frame_start(s, td->out, td->in);
+    if (ret < 0)
+        return ret;
+
+    ret = sws_send_slice(s, 0, td->in->height);
+    if (ret >= 0)
+        ret = sws_receive_slice(s, slice_start, slice_end - slice_start);
+
+    sws_frame_end(s);
+
+    return ret;
+}
+
+static int scale_sws(AVFilterContext *ctx, struct SwsContext **sws,
+                     AVFrame *dst, AVFrame *src)
+{
+    ScaleContext *scale = ctx->priv;
+    ThreadData td = { .in = src, .out = dst, .sws = sws };
+    int nb_jobs = FFMIN(scale->nb_slice_ctx, ff_filter_get_nb_threads(ctx));
+
+    ff_filter_execute(ctx, scale_slice, &td, scale->slice_ret, nb_jobs);
+
+    for (int i = 0; i < nb_jobs; i++)
+        if (scale->slice_ret[i] < 0)
+            return scale->slice_ret[i];
+
+    return 0;
+}
+
+static int scale_field(AVFilterContext *ctx, AVFrame *dst, AVFrame *src,
                        int field)
 {
+    ScaleContext *scale = ctx->priv;
     int orig_h_src = src->height;
     int orig_h_dst = dst->height;
     int ret;
@@ -654,7 +747,7 @@ static int scale_field(ScaleContext *scale, AVFrame *dst, AVFrame *src,
     src->height /= 2;
     dst->height /= 2;
 
-    ret = sws_scale_frame(scale->isws[field], dst, src);
+    ret = scale_sws(ctx, scale->isws[field], dst, src);
     if (ret < 0)
         return ret;
 
@@ -798,7 +891,7 @@ scale:
         int in_full, out_full, brightness, contrast, saturation;
         const int *inv_table, *table;
 
-        sws_getColorspaceDetails(scale->sws, (int **)&inv_table, &in_full,
+        sws_getColorspaceDetails(scale->sws[0], (int **)&inv_table, &in_full,
                                  (int **)&table, &out_full,
                                  &brightness, &contrast, &saturation);
 
@@ -816,17 +909,19 @@ scale:
         if (scale->out_range != AVCOL_RANGE_UNSPECIFIED)
             out_full = (scale->out_range == AVCOL_RANGE_JPEG);
 
-        sws_setColorspaceDetails(scale->sws, inv_table, in_full,
-                                 table, out_full,
-                                 brightness, contrast, saturation);
-        if (scale->isws[0])
-            sws_setColorspaceDetails(scale->isws[0], inv_table, in_full,
-                                     table, out_full,
-                                     brightness, contrast, saturation);
-        if (scale->isws[1])
-            sws_setColorspaceDetails(scale->isws[1], inv_table, in_full,
+        for (int i = 0; i < scale->nb_slice_ctx; i++) {
+            sws_setColorspaceDetails(scale->sws[i], inv_table, in_full,
                                      table, out_full,
                                      brightness, contrast, saturation);
+            if (scale->isws[0][i])
+                sws_setColorspaceDetails(scale->isws[0][i], inv_table, in_full,
+                                         table, out_full,
+                                         brightness, contrast, saturation);
+            if (scale->isws[1][i])
+                sws_setColorspaceDetails(scale->isws[1][i], inv_table, in_full,
+                                         table, out_full,
+                                         brightness, contrast, saturation);
+        }
 
         out->color_range = out_full ? AVCOL_RANGE_JPEG : AVCOL_RANGE_MPEG;
     }
@@ -837,11 +932,11 @@ scale:
               INT_MAX);
 
     if (scale->interlaced>0 || (scale->interlaced<0 && in->interlaced_frame)) {
-        ret = scale_field(scale, out, in, 0);
+        ret = scale_field(ctx, out, in, 0);
         if (ret >= 0)
-            ret = scale_field(scale, out, in, 1);
+            ret = scale_field(ctx, out, in, 1);
     } else {
-        ret = sws_scale_frame(scale->sws, out, in);
+        ret = scale_sws(ctx, scale->sws, out, in);
     }
 
     av_frame_free(&in);
@@ -1013,6 +1108,7 @@ const AVFilter ff_vf_scale = {
     FILTER_OUTPUTS(avfilter_vf_scale_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
 
 static const AVFilterPad avfilter_vf_scale2ref_inputs[] = {
@@ -1054,4 +1150,5 @@ const AVFilter ff_vf_scale2ref = {
     FILTER_OUTPUTS(avfilter_vf_scale2ref_outputs),
     FILTER_QUERY_FUNC(query_formats),
     .process_command = process_command,
+    .flags           = AVFILTER_FLAG_SLICE_THREADS,
 };
@@ -0,0 +1,505 @@
+/*
+ * Background writer for segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include "config.h"
+#include "config_components.h"
+
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#include "asyncwriter.h"
+#include "avio_internal.h"
+#include "http.h"
+#include "internal.h"
+#include "url.h"
+
+#if HAVE_THREADS
+
+#define RETRY_DELAY_MIN     250000
+#define RETRY_DELAY_MAX    8000000
+
+enum AsyncJobType {
+    JOB_WRITE,
+    JOB_RENAME,
+    JOB_DELETE,
+};
+
+typedef struct AsyncJob {
+    enum AsyncJobType type;
+    char *filename;
+    char *newname;
+    AVDictionary *options;
+    int has_options;
+    uint8_t *data;
+    int size;
+    struct AsyncJob *next;
+} AsyncJob;
+
+/* A buffer handed out by ff_async_writer_open() which is not yet closed. */
+typedef struct AsyncOutput {
+    AVIOContext *pb;
+    AVIOContext **owner;
+    char *filename;
+    AVDictionary *options;
+    struct AsyncOutput *next;
+} AsyncOutput;
+
+struct FFAsyncWriter {
+    AVFormatContext *s;
+    int max_queued;
+    int max_retries;
+    int persistent;
+
+    AsyncOutput *outputs;
+
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    AsyncJob *queue;
+    AsyncJob **queue_tail;
+    int nb_queued;
+    int finish;
+    int error;
+    int warned_full;
+
+    /* only accessed by the writer thread */
+    AVIOContext *conn;
+};
+
+static void free_job(AsyncJob *job)
+{
+    av_freep(&job->filename);
+    av_freep(&job->newname);
+    av_dict_free(&job->options);
+    av_freep(&job->data);
+    av_free(job);
+}
+
+/* Wait for the server to acknowledge an HTTP upload, so that failed requests
+ * are noticed and the connection is idle when it is reused or closed. */
+static int finish_request(AVIOContext *pb)
+{
+#if CONFIG_HTTP_PROTOCOL
+    URLContext *h = ffio_geturlcontext(pb);
+
+    if (h && (!strcmp(h->prot->name, "http") || !strcmp(h->prot->name, "https")))
+        return ff_http_read_response(h);
+#endif
+    return 0;
+}
+
+static int write_file(FFAsyncWriter *w, AsyncJob *job)
+{
+    AVFormatContext *s = w->s;
+    int keep = w->persistent && ff_is_http_proto(job->filename);
+    AVDictionary *options = NULL;
+    AVIOContext *pb = NULL;
+    int ret = AVERROR_MUXER_NOT_FOUND;
+
+#if CONFIG_HTTP_PROTOCOL
+    if (keep && w->conn) {
+        ret = ff_http_do_new_request(ffio_geturlcontext(w->conn), job->filename);
+        if (ret < 0)
+            ff_format_io_close(s, &w->conn);
+        else
+            pb = w->conn;
+    }
+#endif
+    if (!pb) {
+        av_dict_copy(&options, job->options, 0);
+        ret = s->io_open(s, &pb, job->filename, AVIO_FLAG_WRITE, &options);
+        av_dict_free(&options);
+        if (ret < 0)
+            return ret;
+    }
+
+    avio_write(pb, job->data, job->size);
+    avio_flush(pb);
+    ret = pb->error;
+    if (ret >= 0)
+        ret = finish_request(pb);
+
+    if (keep) {
+        w->conn = pb;
+        if (ret < 0)
+            ff_format_io_close(s, &w->conn);
+        return ret;
+    }
+    return FFMIN(ret, ff_format_io_close(s, &pb));
+}
+
+static int delete_file(FFAsyncWriter *w, AsyncJob *job)
+{
+    AVFormatContext *s = w->s;
+    AVDictionary *options = NULL;
+    AVIOContext *pb = NULL;
+    int ret;
+
+    if (!job->has_options)
+        return ffurl_delete(job->filename);
+
+    av_dict_copy(&options, job->options, 0);
+    ret = s->io_open(s, &pb, job->filename, AVIO_FLAG_WRITE, &options);
+    av_dict_free(&options);
+    if (ret < 0)
+        return ret;
+    ret = finish_request(pb);
+    return FFMIN(ret, ff_format_io_close(s, &pb));
+}
+
+static int run_job(FFAsyncWriter *w, AsyncJob *job)
+{
+    int64_t delay = RETRY_DELAY_MIN;
+    int attempt, ret;
+
+    for (attempt = 0; ; attempt++) {
+        switch (job->type) {
+        case JOB_WRITE:  ret = write_file(w, job);                              break;
+        case JOB_RENAME: ret = ff_rename(job->filename, job->newname, w->s);    break;
+        case JOB_DELETE: ret = delete_file(w, job);                             break;
+        }
+        if (ret >= 0)
+            return 0;
+        if (job->type == JOB_DELETE && ret == AVERROR(ENOENT))
+            break;
+        if (attempt >= w->max_retries || ff_check_interrupt(&w->s->interrupt_callback))
+            break;
+        av_log(w->s, AV_LOG_WARNING, "Failed to %s '%s': %s, retrying in %"PRId64" ms\n",
+               job->type == JOB_WRITE ? "write" : job->type == JOB_RENAME ? "rename" : "delete",
+               job->filename, av_err2str(ret), delay / 1000);
+        av_usleep(delay);
+        delay = FFMIN(2 * delay, RETRY_DELAY_MAX);
+    }
+
+    if (job->type == JOB_DELETE) {
+        av_log(w->s, ret == AVERROR(ENOENT) ? AV_LOG_WARNING : AV_LOG_ERROR,
+               "failed to delete %s: %s\n", job->filename, av_err2str(ret));
+        return 0;
+    }
+    av_log(w->s, AV_LOG_ERROR, "Failed to %s '%s': %s, giving up\n",
+           job->type == JOB_WRITE ? "write" : "rename", job->filename, av_err2str(ret));
+    return ret;
+}
+
+static void *writer_thread(void *arg)
+{
+    FFAsyncWriter *w = arg;
+
+    ff_thread_setname("async-writer");
+
+    pthread_mutex_lock(&w->mutex);
+    for (;;) {
+        AsyncJob *job;
+        int ret;
+
+        while (!w->queue && !w->finish)
+            pthread_cond_wait(&w->cond, &w->mutex);
+        if (!w->queue)
+            break;
+
+        /* The job stays queued while it runs so that flushing waits for it. */
+        job = w->queue;
+        pthread_mutex_unlock(&w->mutex);
+        ret = run_job(w, job);
+        pthread_mutex_lock(&w->mutex);
+
+        w->queue = job->next;
+        if (!w->queue)
+            w->queue_tail = &w->queue;
+        w->nb_queued--;
+        if (ret < 0 && !w->error)
+            w->error = ret;
+        pthread_cond_broadcast(&w->cond);
+        free_job(job);
+    }
+    pthread_mutex_unlock(&w->mutex);
+
+    ff_format_io_close(w->s, &w->conn);
+    return NULL;
+}
+
+static int submit(FFAsyncWriter *w, AsyncJob *job)
+{
+    pthread_mutex_lock(&w->mutex);
+    if (w->nb_queued >= w->max_queued && !w->warned_full) {
+        av_log(w->s, AV_LOG_WARNING, "Output queue is full, waiting for "
+               "pending writes to complete\n");
+        w->warned_full = 1;
+    }
+    while (w->nb_queued >= w->max_queued)
+        pthread_cond_wait(&w->cond, &w->mutex);
+    *w->queue_tail = job;
+    w->queue_tail  = &job->next;
+    w->nb_queued++;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    return 0;
+}
+
+static AsyncJob *alloc_job(enum AsyncJobType type, const char *filename)
+{
+    AsyncJob *job = av_mallocz(sizeof(*job));
+
+    if (!job)
+        return NULL;
+    job->type = type;
+    job->filename = av_strdup(filename);
+    if (!job->filename)
+        av_freep(&job);
+    return job;
+}
+
+int ff_async_writer_alloc(FFAsyncWriter **pw, AVFormatContext *s,
+                          int max_queued, int max_retries, int persistent)
+{
+    FFAsyncWriter *w;
+    int ret;
+
+    w = av_mallocz(sizeof(*w));
+    if (!w)
+        return AVERROR(ENOMEM);
+    w->s           = s;
+    w->max_queued  = FFMAX(max_queued, 1);
+    w->max_retries = FFMAX(max_retries, 0);
+    w->persistent  = persistent;
+    w->queue_tail  = &w->queue;
+
+    if ((ret = pthread_mutex_init(&w->mutex, NULL))) {
+        av_free(w);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&w->cond, NULL))) {
+        pthread_mutex_destroy(&w->mutex);
+        av_free(w);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_create(&w->thread, NULL, writer_thread, w))) {
+        pthread_cond_destroy(&w->cond);
+        pthread_mutex_destroy(&w->mutex);
+        av_free(w);
+        return AVERROR(ret);
+    }
+
+    *pw = w;
+    return 0;
+}
+
+void ff_async_writer_free(FFAsyncWriter **pw)
+{
+    FFAsyncWriter *w = *pw;
+
+    if (!w)
+        return;
+
+    while (w->outputs) {
+        AsyncOutput *out = w->outputs;
+        w->outputs = out->next;
+        if (*out->owner == out->pb)
+            ffio_free_dyn_buf(out->owner);
+        else
+            ffio_free_dyn_buf(&out->pb);
+        av_freep(&out->filename);
+        av_dict_free(&out->options);
+        av_free(out);
+    }
+
+    pthread_mutex_lock(&w->mutex);
+    w->finish = 1;
+    pthread_cond_broadcast(&w->cond);
+    pthread_mutex_unlock(&w->mutex);
+    pthread_join(w->thread, NULL);
+
+    pthread_cond_destroy(&w->cond);
+    pthread_mutex_destroy(&w->mutex);
+    av_freep(pw);
+}
+
+int ff_async_writer_open(FFAsyncWriter *w, AVIOContext **pb,
+                         const char *filename, AVDictionary **options)
+{
+    AsyncOutput *out;
+    int ret;
+
+    if (*pb && (ret = ff_async_writer_close(w, pb)) < 0)
+        return ret;
+
+    out = av_mallocz(sizeof(*out));
+    if (!out)
+        return AVERROR(ENOMEM);
+    out->filename = av_strdup(filename);
+    if (!out->filename ||
+        (options && (ret = av_dict_copy(&out->options, *options, 0)) < 0) ||
+        (ret = avio_open_dyn_buf(pb)) < 0) {
+        av_freep(&out->filename);
+        av_dict_free(&out->options);
+        av_free(out);
+        return ret < 0 ? ret : AVERROR(ENOMEM);
+    }
+    out->pb    = *pb;
+    out->owner = pb;
+    out->next  = w->outputs;
+    w->outputs = out;
+    return 0;
+}
+
+int ff_async_writer_close(FFAsyncWriter *w, AVIOContext **pb)
+{
+    AsyncOutput **p, *out;
+    AsyncJob *job;
+    int size;
+
+    if (!*pb)
+        return 0;
+
+    for (p = &w->outputs; *p && (*p)->pb != *pb; p = &(*p)->next)
+        ;
+    if (!(out = *p))
+        return AVERROR_BUG;
+    *p = out->next;
+
+    job = av_mallocz(sizeof(*job));
+    if (!job) {
+        ffio_free_dyn_buf(pb);
+        av_freep(&out->filename);
+        av_dict_free(&out->options);
+        av_free(out);
+        return AVERROR(ENOMEM);
+    }
+    size = avio_close_dyn_buf(*pb, &job->data);
+    *pb = NULL;
+
+    job->type     = JOB_WRITE;
+    job->filename = out->filename;
+    job->options  = out->options;
+    job->size     = size;
+    av_free(out);
+
+    if (!job->data) {
+        free_job(job);
+        return AVERROR(ENOMEM);
+    }
+    return submit(w, job);
+}
+
+int ff_async_writer_rename(FFAsyncWriter *w, const char *oldpath,
+                           const char *newpath)
+{
+    AsyncJob *job = alloc_job(JOB_RENAME, oldpath);
+
+    if (!job)
+        return AVERROR(ENOMEM);
+    job->newname = av_strdup(newpath);
+    if (!job->newname) {
+        free_job(job);
+        return AVERROR(ENOMEM);
+    }
+    return submit(w, job);
+}
+
+int ff_async_writer_delete(FFAsyncWriter *w, const char *filename,
+                           AVDictionary **options)
+{
+    AsyncJob *job = alloc_job(JOB_DELETE, filename);
+    int ret;
+
+    if (!job)
+        return AVERROR(ENOMEM);
+    if (options) {
+        job->has_options = 1;
+        if ((ret = av_dict_copy(&job->options, *options, 0)) < 0) {
+            free_job(job);
+            return ret;
+        }
+    }
+    return submit(w, job);
+}
+
+int ff_async_writer_flush(FFAsyncWriter *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->mutex);
+    while (w->queue)
+        pthread_cond_wait(&w->cond, &w->mutex);
+    ret = w->error;
+    pthread_mutex_unlock(&w->mutex);
+    return ret;
+}
+
+int ff_async_writer_error(FFAsyncWriter *w)
+{
+    int ret;
+
+    pthread_mutex_lock(&w->mutex);
+    ret = w->error;
+    pthread_mutex_unlock(&w->mutex);
+    return ret;
+}
+
+#else
+
+int ff_async_writer_alloc(FFAsyncWriter **pw, AVFormatContext *s,
+                          int max_queued, int max_retries, int persistent)
+{
+    return AVERROR(ENOSYS);
+}
+
+void ff_async_writer_free(FFAsyncWriter **pw)
+{
+}
+
+int ff_async_writer_open(FFAsyncWriter *w, AVIOContext **pb,
+                         const char *filename, AVDictionary **options)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_async_writer_close(FFAsyncWriter *w, AVIOContext **pb)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_async_writer_rename(FFAsyncWriter *w, const char *oldpath,
+                           const char *newpath)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_async_writer_delete(FFAsyncWriter *w, const char *filename,
+                           AVDictionary **options)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_async_writer_flush(FFAsyncWriter *w)
+{
+    return AVERROR(ENOSYS);
+}
+
+int ff_async_writer_error(FFAsyncWriter *w)
+{
+    return 0;
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,102 @@
+/*
+ * Background writer for segmenting muxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_ASYNCWRITER_H
+#define AVFORMAT_ASYNCWRITER_H
+
+#include "libavutil/dict.h"
+
+#include "avformat.h"
+#include "avio.h"
+
+/**
+ * A single background thread which performs the output operations of a
+ * segmenting muxer in submission order. Files are buffered in memory while
+ * the muxer writes them and only handed to the thread once complete, so a
+ * file always lands before anything submitted after it (e.g. the playlist
+ * referencing a segment).
+ */
+typedef struct FFAsyncWriter FFAsyncWriter;
+
+/**
+ * Allocate a writer and start its thread.
+ *
+ * @param s           muxer context; its io_open/io_close2 callbacks are used
+ *                    from the writer thread
+ * @param max_queued  maximum number of submitted operations waiting to be
+ *                    performed; submitting more blocks the caller
+ * @param max_retries number of times a failed operation is retried, with an
+ *                    exponentially growing delay
+ * @param persistent  keep HTTP connections open between requests
+ * @return 0 on success, AVERROR(ENOSYS) if built without thread support, a
+ *         negative error code on other failures
+ */
+int ff_async_writer_alloc(FFAsyncWriter **pw, AVFormatContext *s,
+                          int max_queued, int max_retries, int persistent);
+
+/**
+ * Perform all pending operations, stop the thread and free the writer.
+ * Buffers still open through ff_async_writer_open() are discarded and the
+ * pointers they were opened into are reset to NULL.
+ */
+void ff_async_writer_free(FFAsyncWriter **pw);
+
+/**
+ * Open *pb as a memory buffer which is written to filename once it is
+ * passed to ff_async_writer_close().
+ */
+int ff_async_writer_open(FFAsyncWriter *w, AVIOContext **pb,
+                         const char *filename, AVDictionary **options);
+
+/**
+ * Close a buffer opened with ff_async_writer_open() and queue it for writing.
+ * Does nothing if *pb is NULL.
+ */
+int ff_async_writer_close(FFAsyncWriter *w, AVIOContext **pb);
+
+/**
+ * Queue renaming oldpath to newpath.
+ */
+int ff_async_writer_rename(FFAsyncWriter *w, const char *oldpath,
+                           const char *newpath);
+
+/**
+ * Queue deleting filename. If options is not NULL the file is deleted by
+ * opening it for writing with these options (e.g. an HTTP DELETE request),
+ * otherwise with ffurl_delete(). Failing to delete a file is not an error.
+ */
+int ff_async_writer_delete(FFAsyncWriter *w, const char *filename,
+                           AVDictionary **options);
+
+/**
+ * Wait until all queued operations have been performed.
+ *
+ * @return the error of the first operation which failed after all retries,
+ *         or 0
+ */
+int ff_async_writer_flush(FFAsyncWriter *w);
+
+/**
+ * @return the error of the first operation which failed after all retries,
+ *         or 0; does not wait
+ */
+int ff_async_writer_error(FFAsyncWriter *w);
+
+#endif /* AVFORMAT_ASYNCWRITER_H */
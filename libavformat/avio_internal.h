@@ -22,6 +22,7 @@
 #include "avio.h"
 #include "url.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/log.h"
 
 extern const AVClass ff_avio_class;
@@ -77,6 +78,23 @@ typedef struct FFIOContext {
      * is updated each time a successful writeout ends up further position-wise
      */
     int64_t written_output_size;
+
+    /**
+     * Set once ffio_read_ref() handed out references to the buffer.
+     * The buffer is then owned by buffer_ref and taken from buffer_pool,
+     * and a new one is used instead of modifying it while it is referenced.
+     */
+    int buffer_refs;
+    AVBufferRef *buffer_ref;
+    AVBufferPool *buffer_pool;
+    int buffer_pool_size;
+
+    /**
+     * Set while buffer_ref is a read-only mapping of the whole resource,
+     * see ffurl_map(). orig_buffer_size is then the size of the regular
+     * buffer used once reading goes past the end of the mapping.
+     */
+    int mapped;
 } FFIOContext;
 
 static av_always_inline FFIOContext *ffiocontext(AVIOContext *ctx)
@@ -111,6 +129,23 @@ void ffio_init_context(FFIOContext *s,
  */
 int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsigned char **data);
 
+/**
+ * Read size bytes from AVIOContext as a reference to the underlying buffer.
+ *
+ * This only succeeds if the requested bytes are held in the buffer and
+ * followed by AV_INPUT_BUFFER_PADDING_SIZE zeroed bytes: either they end
+ * the buffered data, or the data after them is zero. Otherwise the data
+ * must be copied. The data must not be modified. Only contexts opened with
+ * ffio_fdopen() are supported.
+ *
+ * @param s IO context
+ * @param buf set to a new reference to the data on success
+ * @param size number of bytes requested
+ * @return size on success, 0 if nothing was read and the data must be
+ *         read with avio_read() instead, or AVERROR
+ */
+int ffio_read_ref(AVIOContext *s, AVBufferRef **buf, int size);
+
 void ffio_fill(AVIOContext *s, int b, int64_t count);
 
 static av_always_inline void ffio_wfourcc(AVIOContext *pb, const uint8_t *s)
@@ -537,6 +537,49 @@ static int read_packet_wrapper(AVIOContext *s, uint8_t *buf, int size)
     return ret;
 }
 
+/**
+ * Allocate a buffer of buf_size bytes to replace the current one with
+ * set_buffer(). For reference counted buffers, *ref is set to its owner.
+ */
+static uint8_t *alloc_buffer(AVIOContext *s, int buf_size, AVBufferRef **ref)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+
+    *ref = NULL;
+    if (!ctx->buffer_refs)
+        return av_malloc(buf_size);
+
+    if (ctx->buffer_pool_size != buf_size) {
+        av_buffer_pool_uninit(&ctx->buffer_pool);
+        ctx->buffer_pool = av_buffer_pool_init(buf_size + AV_INPUT_BUFFER_PADDING_SIZE,
+                                               av_buffer_allocz);
+        ctx->buffer_pool_size = ctx->buffer_pool ? buf_size : 0;
+    }
+    if (ctx->buffer_pool)
+        *ref = av_buffer_pool_get(ctx->buffer_pool);
+    return *ref ? (*ref)->data : NULL;
+}
+
+static void set_buffer(AVIOContext *s, uint8_t *buffer, AVBufferRef *ref)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+
+    if (ctx->buffer_ref)
+        av_buffer_unref(&ctx->buffer_ref);
+    else
+        av_free(s->buffer);
+    ctx->buffer_ref = ref;
+    ctx->mapped     = 0;
+    s->buffer       = buffer;
+}
+
+/* Check whether the buffer can be modified without affecting references to it */
+static int buffer_writable(AVIOContext *s)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    return !ctx->buffer_ref || av_buffer_is_writable(ctx->buffer_ref);
+}
+
 /* Input stream */
 
 static void fill_buffer(AVIOContext *s)
@@ -544,9 +587,10 @@ static void fill_buffer(AVIOContext *s)
     FFIOContext *const ctx = (FFIOContext *)s;
     int max_buffer_size = s->max_packet_size ?
                           s->max_packet_size : IO_BUFFER_SIZE;
-    uint8_t *dst        = s->buf_end - s->buffer + max_buffer_size <= s->buffer_size ?
-                          s->buf_end : s->buffer;
+    uint8_t *dst        = s->buf_end - s->buffer + max_buffer_size <= s->buffer_size &&
+                          buffer_writable(s) ? s->buf_end : s->buffer;
     int len             = s->buffer_size - (dst - s->buffer);
+    AVBufferRef *ref    = NULL;
 
     /* can't fill the buffer without read_packet, just set EOF if appropriate */
     if (!s->read_packet && s->buf_ptr >= s->buf_end)
@@ -564,7 +608,7 @@ static void fill_buffer(AVIOContext *s)
     }
 
     /* make buffer smaller in case it ended up large after probing */
-    if (s->read_packet && ctx->orig_buffer_size &&
+    if (s->read_packet && ctx->orig_buffer_size && !ctx->mapped &&
         s->buffer_size > ctx->orig_buffer_size  && len >= ctx->orig_buffer_size) {
         if (dst == s->buffer && s->buf_ptr != dst) {
             int ret = set_buf_size(s, ctx->orig_buffer_size);
@@ -576,15 +620,36 @@ static void fill_buffer(AVIOContext *s)
         len = ctx->orig_buffer_size;
     }
 
+    /* the buffer is still referenced, read into a new one */
+    if (!buffer_writable(s)) {
+        /* past the end of a mapping, continue with a regular buffer */
+        if (ctx->mapped)
+            len = ctx->orig_buffer_size;
+        dst = alloc_buffer(s, ctx->mapped ? len : s->buffer_size, &ref);
+        if (!dst) {
+            s->eof_reached = 1;
+            s->error = AVERROR(ENOMEM);
+            return;
+        }
+    }
+
     len = read_packet_wrapper(s, dst, len);
     if (len == AVERROR_EOF) {
         /* do not modify buffer if EOF reached so that a seek back can
            be done without rereading data */
         s->eof_reached = 1;
+        av_buffer_unref(&ref);
     } else if (len < 0) {
         s->eof_reached = 1;
         s->error= len;
+        av_buffer_unref(&ref);
     } else {
+        if (ref) {
+            if (ctx->mapped)
+                s->buffer_size = ctx->orig_buffer_size;
+            set_buffer(s, dst, ref);
+            s->checksum_ptr = s->buffer;
+        }
         s->pos += len;
         s->buf_ptr = dst;
         s->buf_end = dst + len;
@@ -712,6 +777,74 @@ int ffio_read_indirect(AVIOContext *s, unsigned char *buf, int size, const unsig
     }
 }
 
+/**
+ * Check that the AV_INPUT_BUFFER_PADDING_SIZE bytes at end, which must be
+ * within the buffer, can be used as zeroed packet padding. Buffered data is
+ * only checked, the bytes after it are not referenced and get zeroed.
+ */
+static int zero_padding(AVIOContext *s, uint8_t *end)
+{
+    uint8_t *pad_end  = end + AV_INPUT_BUFFER_PADDING_SIZE;
+    uint8_t *data_end = FFMIN(pad_end, s->buf_end);
+
+    for (; end < data_end; end++)
+        if (*end)
+            return 0;
+    if (pad_end > s->buf_end) {
+        /* mappings are read-only */
+        if (ffiocontext(s)->mapped)
+            return 0;
+        memset(s->buf_end, 0, pad_end - s->buf_end);
+    }
+    return 1;
+}
+
+int ffio_read_ref(AVIOContext *s, AVBufferRef **buf, int size)
+{
+    FFIOContext *const ctx = ffiocontext(s);
+    AVBufferRef *ref;
+    uint8_t *buffer;
+
+    if (size <= 0 || s->write_flag || s->buf_end - s->buf_ptr < size)
+        return 0;
+
+    if (!ctx->buffer_refs) {
+        ptrdiff_t filled = s->buf_end - s->buffer;
+
+        /* other contexts may be freed by their users with av_free() */
+        if (!ffio_geturlcontext(s))
+            return 0;
+
+        ctx->buffer_refs = 1;
+        buffer = alloc_buffer(s, s->buffer_size, &ref);
+        if (!buffer) {
+            ctx->buffer_refs = 0;
+            return 0;
+        }
+        memcpy(buffer, s->buffer, filled);
+        if (s->update_checksum)
+            s->checksum_ptr = buffer + (s->checksum_ptr - s->buffer);
+        s->buf_ptr     = buffer + (s->buf_ptr     - s->buffer);
+        s->buf_ptr_max = buffer + (s->buf_ptr_max - s->buffer);
+        s->buf_end     = buffer + filled;
+        set_buffer(s, buffer, ref);
+    }
+
+    /* copy the data unless it is followed by zeroed padding */
+    if (s->buf_ptr + size + AV_INPUT_BUFFER_PADDING_SIZE >
+        ctx->buffer_ref->data + ctx->buffer_ref->size ||
+        !zero_padding(s, s->buf_ptr + size))
+        return 0;
+
+    *buf = av_buffer_ref(ctx->buffer_ref);
+    if (!*buf)
+        return AVERROR(ENOMEM);
+    (*buf)->data = s->buf_ptr;
+    (*buf)->size = size;
+    s->buf_ptr += size;
+    return size;
+}
+
 int avio_read_partial(AVIOContext *s, unsigned char *buf, int size)
 {
     int len;
@@ -958,6 +1091,7 @@ uint64_t ffio_read_varlen(AVIOContext *bc){
 int ffio_fdopen(AVIOContext **s, URLContext *h)
 {
     uint8_t *buffer = NULL;
+    AVBufferRef *map = NULL;
     int buffer_size, max_packet_size;
 
     max_packet_size = h->max_packet_size;
@@ -971,18 +1105,38 @@ int ffio_fdopen(AVIOContext **s, URLContext *h)
             return AVERROR(EINVAL);
         buffer_size *= 2;
     }
-    buffer = av_malloc(buffer_size);
-    if (!buffer)
-        return AVERROR(ENOMEM);
+    if (!(h->flags & (AVIO_FLAG_WRITE | AVIO_FLAG_DIRECT)) &&
+        ffurl_map(h, &map) >= 0) {
+        buffer = map->data;
+    } else {
+        buffer = av_malloc(buffer_size);
+        if (!buffer)
+            return AVERROR(ENOMEM);
+    }
 
-    *s = avio_alloc_context(buffer, buffer_size, h->flags & AVIO_FLAG_WRITE, h,
+    *s = avio_alloc_context(buffer, map ? map->size : buffer_size,
+                            h->flags & AVIO_FLAG_WRITE, h,
                             (int (*)(void *, uint8_t *, int))  ffurl_read,
                             (int (*)(void *, uint8_t *, int))  ffurl_write,
                             (int64_t (*)(void *, int64_t, int))ffurl_seek);
     if (!*s) {
-        av_freep(&buffer);
+        if (map)
+            av_buffer_unref(&map);
+        else
+            av_freep(&buffer);
         return AVERROR(ENOMEM);
     }
+    if (map) {
+        /* the whole resource is in the buffer, reads and seeks within it
+         * are served without calling into the protocol */
+        FFIOContext *const ctx = ffiocontext(*s);
+        ctx->buffer_ref       = map;
+        ctx->buffer_refs      = 1;
+        ctx->mapped           = 1;
+        ctx->orig_buffer_size = buffer_size;
+        (*s)->buf_end         = (*s)->buffer + map->size;
+        (*s)->pos             = map->size;
+    }
     (*s)->protocol_whitelist = av_strdup(h->protocol_whitelist);
     if (!(*s)->protocol_whitelist && h->protocol_whitelist) {
         avio_closep(s);
@@ -1073,17 +1227,19 @@ int ffio_ensure_seekback(AVIOContext *s, int64_t buf_size)
         return 0;
     av_assert0(!s->write_flag);
 
-    if (buf_size <= s->buffer_size) {
+    if (buf_size <= s->buffer_size && buffer_writable(s)) {
         update_checksum(s);
         memmove(s->buffer, s->buf_ptr, filled);
     } else {
-        buffer = av_malloc(buf_size);
+        AVBufferRef *ref;
+
+        buf_size = FFMAX(buf_size, s->buffer_size);
+        buffer = alloc_buffer(s, buf_size, &ref);
         if (!buffer)
             return AVERROR(ENOMEM);
         update_checksum(s);
         memcpy(buffer, s->buf_ptr, filled);
-        av_free(s->buffer);
-        s->buffer = buffer;
+        set_buffer(s, buffer, ref);
         s->buffer_size = buf_size;
     }
     s->buf_ptr = s->buffer;
@@ -1120,13 +1276,13 @@ int ffio_limit(AVIOContext *s, int size)
 
 static int set_buf_size(AVIOContext *s, int buf_size)
 {
+    AVBufferRef *ref;
     uint8_t *buffer;
-    buffer = av_malloc(buf_size);
+    buffer = alloc_buffer(s, buf_size, &ref);
     if (!buffer)
         return AVERROR(ENOMEM);
 
-    av_free(s->buffer);
-    s->buffer = buffer;
+    set_buffer(s, buffer, ref);
     ffiocontext(s)->orig_buffer_size =
     s->buffer_size = buf_size;
     s->buf_ptr = s->buf_ptr_max = buffer;
@@ -1136,6 +1292,7 @@ static int set_buf_size(AVIOContext *s, int buf_size)
 
 int ffio_realloc_buf(AVIOContext *s, int buf_size)
 {
+    AVBufferRef *ref;
     uint8_t *buffer;
     int data_size;
 
@@ -1145,15 +1302,14 @@ int ffio_realloc_buf(AVIOContext *s, int buf_size)
     if (buf_size <= s->buffer_size)
         return 0;
 
-    buffer = av_malloc(buf_size);
+    buffer = alloc_buffer(s, buf_size, &ref);
     if (!buffer)
         return AVERROR(ENOMEM);
 
     data_size = s->write_flag ? (s->buf_ptr - s->buffer) : (s->buf_end - s->buf_ptr);
     if (data_size > 0)
         memcpy(buffer, s->write_flag ? s->buffer : s->buf_ptr, data_size);
-    av_free(s->buffer);
-    s->buffer = buffer;
+    set_buffer(s, buffer, ref);
     ffiocontext(s)->orig_buffer_size = buf_size;
     s->buffer_size = buf_size;
     s->buf_ptr = s->write_flag ? (s->buffer + data_size) : s->buffer;
@@ -1185,6 +1341,7 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
     int buffer_size;
     int overlap, new_size, alloc_size;
     uint8_t *buf = *bufp;
+    AVBufferRef *ref = NULL;
 
     if (s->write_flag) {
         av_freep(bufp);
@@ -1199,6 +1356,14 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
         return AVERROR(EINVAL);
     }
 
+    /* the probe data is still in the mapping, just rewind */
+    if (ffiocontext(s)->mapped && !buffer_start && buf_size <= buffer_size) {
+        av_freep(bufp);
+        s->buf_ptr     = s->buffer;
+        s->eof_reached = 0;
+        return 0;
+    }
+
     overlap = buf_size - buffer_start;
     new_size = buf_size + buffer_size - overlap;
 
@@ -1212,8 +1377,14 @@ int ffio_rewind_with_probe_data(AVIOContext *s, unsigned char **bufp, int buf_si
         buf_size = new_size;
     }
 
-    av_free(s->buffer);
-    s->buf_ptr = s->buffer = buf;
+    if (ffiocontext(s)->buffer_refs) {
+        if (!(ref = av_buffer_create(buf, buf_size, av_buffer_default_free, NULL, 0))) {
+            av_freep(bufp);
+            return AVERROR(ENOMEM);
+        }
+    }
+    set_buffer(s, buf, ref);
+    s->buf_ptr = buf;
     s->buffer_size = alloc_size;
     s->pos = buf_size;
     s->buf_end = s->buf_ptr + buf_size;
@@ -1267,7 +1438,8 @@ int avio_close(AVIOContext *s)
     h         = s->opaque;
     s->opaque = NULL;
 
-    av_freep(&s->buffer);
+    set_buffer(s, NULL, NULL);
+    av_buffer_pool_uninit(&ctx->buffer_pool);
     if (s->write_flag)
         av_log(s, AV_LOG_VERBOSE,
                "Statistics: %"PRId64" bytes written, %d seeks, %d writeouts\n",
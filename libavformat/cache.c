@@ -23,16 +23,18 @@
 
 /**
  * @TODO
- *      support keeping files
  *      support filling with a background thread
  */
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/file_open.h"
+#include "libavutil/intreadwrite.h"
 #include "libavutil/opt.h"
+#include "libavutil/sha.h"
 #include "libavutil/tree.h"
 #include "avio.h"
+#include "internal.h"
 #include <fcntl.h>
 #if HAVE_IO_H
 #include <io.h>
@@ -41,10 +43,27 @@
 #include <unistd.h>
 #endif
 #include <sys/stat.h>
+#if HAVE_FLOCK
+#include <sys/file.h>
+#endif
 #include <stdlib.h>
 #include "os_support.h"
 #include "url.h"
 
+/**
+ * A persistent cache entry is stored in cache_dir as <key>.data, holding the
+ * cached blocks at their offset in the resource, and <key>.map, holding a
+ * header followed by one byte per block, set once the block is complete.
+ * The key is a hash of the URL, the validator of the resource (ETag or
+ * Last-Modified), its size and the block size. Resources without validator
+ * are only cached with cache_unvalidated.
+ *
+ * Processes using an entry hold a shared lock on its map; an entry is only
+ * evicted by a process which got an exclusive lock on it.
+ */
+#define MAP_MAGIC       MKBETAG('F', 'F', 'c', 'm')
+#define MAP_HEADER_SIZE 32
+
 typedef struct CacheEntry {
     int64_t logical_pos;
     int64_t physical_pos;
@@ -64,6 +83,17 @@ typedef struct Context {
     URLContext *inner;
     int64_t cache_hit, cache_miss;
     int read_ahead_limit;
+
+    char *cache_dir;
+    int block_size;
+    int64_t max_size;
+    int unvalidated;
+    int persistent;
+    int map_fd;
+    char *map_path;
+    uint8_t *blocks;        ///< blocks known to be complete
+    uint8_t *block_buf;
+    int64_t buf_block;      ///< index of the block in block_buf, or -1
 } Context;
 
 static int cmp(const void *key, const void *node)
@@ -71,6 +101,194 @@ static int cmp(const void *key, const void *node)
     return FFDIFFSIGN(*(const int64_t *)key, ((const CacheEntry *) node)->logical_pos);
 }
 
+static int open_rw(const char *filename)
+{
+    int access = O_RDWR | O_CREAT;
+#ifdef O_BINARY
+    access |= O_BINARY;
+#endif
+    return avpriv_open(filename, access, 0666);
+}
+
+/**
+ * Take a shared lock on an opened map, which prevents its eviction.
+ * @return 0 on success, 1 if the entry was evicted before the lock was taken
+ *         and must be opened again, <0 on error
+ */
+static int lock_entry(int map_fd)
+{
+#if HAVE_FLOCK
+    struct stat st;
+
+    if (flock(map_fd, LOCK_SH) < 0 || fstat(map_fd, &st) < 0)
+        return AVERROR(errno);
+    return !st.st_nlink;
+#else
+    return 0;
+#endif
+}
+
+/* without flock(), in-use entries are only protected on systems which do
+ * not allow deleting open files */
+static int try_lock_entry_exclusive(int map_fd)
+{
+#if HAVE_FLOCK
+    return flock(map_fd, LOCK_EX | LOCK_NB) < 0 ? AVERROR(errno) : 0;
+#else
+    return 0;
+#endif
+}
+
+static int sync_data(int fd)
+{
+#if HAVE_FSYNC
+    return fsync(fd);
+#else
+    return 0;
+#endif
+}
+
+/* Get the ETag or Last-Modified of the resource, NULL if there is none. */
+static char *get_validator(Context *c)
+{
+    static const char *const names[] = { "etag", "last_modified" };
+    uint8_t *validator = NULL;
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(names) && !validator; i++) {
+        if (av_opt_get(c->inner, names[i], AV_OPT_SEARCH_CHILDREN, &validator) < 0)
+            validator = NULL;
+        else if (validator && !*validator)
+            av_freep(&validator);
+    }
+    return validator;
+}
+
+static char *entry_key(URLContext *h, const char *url, const char *validator,
+                       int64_t size)
+{
+    Context *c = h->priv_data;
+    uint8_t hash[32];
+    char *key, *id;
+    struct AVSHA *sha;
+
+    /* only reuse data cached for the same version of the resource */
+    id = av_asprintf("%s\n%s\n%"PRId64"\n%d", url,
+                     validator ? validator : "", size, c->block_size);
+    sha = av_sha_alloc();
+    key = av_malloc(2 * sizeof(hash) + 1);
+    if (!id || !sha || !key) {
+        av_free(id);
+        av_free(sha);
+        av_free(key);
+        return NULL;
+    }
+
+    av_sha_init(sha, 256);
+    av_sha_update(sha, (const uint8_t *)id, strlen(id));
+    av_sha_final(sha, hash);
+    ff_data_to_hex(key, hash, sizeof(hash), 1);
+    key[2 * sizeof(hash)] = 0;
+    av_free(id);
+    av_free(sha);
+    return key;
+}
+
+static int persistent_open(URLContext *h, const char *url)
+{
+    Context *c = h->priv_data;
+    uint8_t header[MAP_HEADER_SIZE] = { 0 };
+    char *key, *validator, *data_path = NULL;
+    int64_t size, nb_blocks;
+    int ret, fd = -1, map_fd = -1;
+
+    size = ffurl_size(c->inner);
+    if (size <= 0 || c->inner->is_streamed) {
+        av_log(h, AV_LOG_WARNING, "Resource size unknown or not seekable, "
+               "not using the persistent cache\n");
+        return 0;
+    }
+    nb_blocks = (size + c->block_size - 1) / c->block_size;
+    if (nb_blocks > SIZE_MAX - MAP_HEADER_SIZE)
+        return 0;
+
+    /* without a validator, a changed resource of the same size would be
+     * served from the data cached for the old one */
+    validator = get_validator(c);
+    if (!validator && !c->unvalidated) {
+        av_log(h, AV_LOG_WARNING, "Resource has no ETag or Last-Modified, "
+               "not using the persistent cache\n");
+        return 0;
+    }
+    key = entry_key(h, url, validator, size);
+    av_free(validator);
+    if (!key)
+        return AVERROR(ENOMEM);
+    data_path   = av_asprintf("%s/%s.data", c->cache_dir, key);
+    c->map_path = av_asprintf("%s/%s.map",  c->cache_dir, key);
+    av_free(key);
+    c->blocks    = av_mallocz(nb_blocks);
+    c->block_buf = av_malloc(c->block_size);
+    if (!data_path || !c->map_path || !c->blocks || !c->block_buf) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    /* the data file is opened once the entry is locked, so that it cannot
+     * belong to an entry being evicted */
+    while ((map_fd = open_rw(c->map_path)) >= 0 &&
+           (ret = lock_entry(map_fd)) > 0)
+        close(map_fd);
+    if (map_fd < 0 || ret < 0 || (fd = open_rw(data_path)) < 0) {
+        av_log(h, AV_LOG_WARNING, "Could not open cache entry %s: %s\n",
+               data_path, av_err2str(map_fd < 0 || ret >= 0 ? AVERROR(errno) : ret));
+        ret = 0;
+        goto fail;
+    }
+
+    ret = read(map_fd, header, sizeof(header));
+    if (ret == sizeof(header)) {
+        if (AV_RB32(header) != MAP_MAGIC || AV_RB32(header + 4) != c->block_size ||
+            AV_RB64(header + 8) != size) {
+            av_log(h, AV_LOG_WARNING, "Invalid cache entry %s\n", c->map_path);
+            ret = 0;
+            goto fail;
+        }
+        if (read(map_fd, c->blocks, nb_blocks) < 0)
+            memset(c->blocks, 0, nb_blocks);
+    } else {
+        AV_WB32(header,     MAP_MAGIC);
+        AV_WB32(header + 4, c->block_size);
+        AV_WB64(header + 8, size);
+    }
+    /* (re)writing the header also marks the entry as recently used */
+    if (lseek(map_fd, 0, SEEK_SET) < 0 ||
+        write(map_fd, header, sizeof(header)) != sizeof(header)) {
+        av_log(h, AV_LOG_WARNING, "Could not write cache entry %s\n", c->map_path);
+        ret = 0;
+        goto fail;
+    }
+
+    av_log(h, AV_LOG_VERBOSE, "Using cache entry %s\n", data_path);
+    av_free(data_path);
+    c->fd          = fd;
+    c->map_fd      = map_fd;
+    c->persistent  = 1;
+    c->buf_block   = -1;
+    c->end         = size;
+    c->is_true_eof = 1;
+    return 0;
+fail:
+    if (fd >= 0)
+        close(fd);
+    if (map_fd >= 0)
+        close(map_fd);
+    av_free(data_path);
+    av_freep(&c->map_path);
+    av_freep(&c->blocks);
+    av_freep(&c->block_buf);
+    return ret;
+}
+
 static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **options)
 {
     int ret;
@@ -79,9 +297,24 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
 
     av_strstart(arg, "cache:", &arg);
 
+    ret = ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
+                               options, h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0)
+        return ret;
+
+    if (c->cache_dir) {
+        if ((ret = persistent_open(h, arg)) < 0) {
+            ffurl_closep(&c->inner);
+            return ret;
+        }
+        if (c->persistent)
+            return 0;
+    }
+
     c->fd = avpriv_tempfile("ffcache", &buffername, 0, h);
     if (c->fd < 0){
         av_log(h, AV_LOG_ERROR, "Failed to create tempfile\n");
+        ffurl_closep(&c->inner);
         return c->fd;
     }
 
@@ -92,8 +325,7 @@ static int cache_open(URLContext *h, const char *arg, int flags, AVDictionary **
     else
         c->filename = buffername;
 
-    return ffurl_open_whitelist(&c->inner, arg, flags, &h->interrupt_callback,
-                                options, h->protocol_whitelist, h->protocol_blacklist, h);
+    return 0;
 }
 
 static int add_entry(URLContext *h, const unsigned char *buf, int size)
@@ -159,12 +391,98 @@ fail:
     return ret;
 }
 
+static int block_cached(Context *c, int64_t block)
+{
+    uint8_t flag;
+
+    /* another process may have fetched it in the meantime */
+    if (!c->blocks[block] &&
+        lseek(c->map_fd, MAP_HEADER_SIZE + block, SEEK_SET) >= 0 &&
+        read(c->map_fd, &flag, 1) == 1)
+        c->blocks[block] = flag;
+    return c->blocks[block];
+}
+
+static int fetch_block(URLContext *h, int64_t block, int size)
+{
+    Context *c = h->priv_data;
+    int64_t pos = block * c->block_size;
+    static const uint8_t flag = 1;
+    int ret;
+
+    if (c->inner_pos != pos) {
+        int64_t r = ffurl_seek(c->inner, pos, SEEK_SET);
+        if (r < 0) {
+            av_log(h, AV_LOG_ERROR, "Failed to perform internal seek\n");
+            return r;
+        }
+        c->inner_pos = r;
+    }
+
+    c->buf_block = -1;
+    ret = ffurl_read_complete(c->inner, c->block_buf, size);
+    if (ret > 0)
+        c->inner_pos += ret;
+    if (ret != size) {
+        av_log(h, AV_LOG_ERROR, "Short read of block %"PRId64"\n", block);
+        return ret < 0 ? ret : AVERROR(EIO);
+    }
+    c->buf_block = block;
+    c->cache_miss++;
+
+    /* the block is marked as complete only once all of its data is written
+     * and synced, so other processes never read partially written blocks,
+     * even after a crash */
+    if (lseek(c->fd, pos, SEEK_SET) < 0 ||
+        write(c->fd, c->block_buf, size) != size ||
+        sync_data(c->fd) < 0 ||
+        lseek(c->map_fd, MAP_HEADER_SIZE + block, SEEK_SET) < 0 ||
+        write(c->map_fd, &flag, 1) != 1) {
+        av_log(h, AV_LOG_WARNING, "Failed to write block %"PRId64" to the cache\n", block);
+        return 0;
+    }
+    c->blocks[block] = 1;
+    return 0;
+}
+
+static int persistent_read(URLContext *h, unsigned char *buf, int size)
+{
+    Context *c = h->priv_data;
+    int64_t block = c->logical_pos / c->block_size;
+    int64_t block_pos = block * c->block_size;
+    int block_size, ret;
+
+    if (c->logical_pos >= c->end)
+        return AVERROR_EOF;
+    block_size = FFMIN(c->block_size, c->end - block_pos);
+    size       = FFMIN(size, block_pos + block_size - c->logical_pos);
+
+    if (block != c->buf_block) {
+        if (block_cached(c, block) &&
+            lseek(c->fd, c->logical_pos, SEEK_SET) >= 0 &&
+            (ret = read(c->fd, buf, size)) > 0) {
+            c->logical_pos += ret;
+            c->cache_hit++;
+            return ret;
+        }
+        if ((ret = fetch_block(h, block, block_size)) < 0)
+            return ret;
+    }
+
+    memcpy(buf, c->block_buf + (c->logical_pos - block_pos), size);
+    c->logical_pos += size;
+    return size;
+}
+
 static int cache_read(URLContext *h, unsigned char *buf, int size)
 {
     Context *c= h->priv_data;
     CacheEntry *entry, *next[2] = {NULL, NULL};
     int64_t r;
 
+    if (c->persistent)
+        return persistent_read(h, buf, size);
+
     entry = av_tree_find(c->root, &c->logical_pos, cmp, (void**)next);
 
     if (!entry)
@@ -229,6 +547,9 @@ static int64_t cache_seek(URLContext *h, int64_t pos, int whence)
     Context *c= h->priv_data;
     int64_t ret;
 
+    if (whence == AVSEEK_SIZE && c->persistent)
+        return c->end;
+
     if (whence == AVSEEK_SIZE) {
         pos= ffurl_seek(c->inner, pos, whence);
         if(pos <= 0){
@@ -295,6 +616,96 @@ static int enu_free(void *opaque, void *elem)
     return 0;
 }
 
+typedef struct CacheFile {
+    char *map_path;
+    int64_t size;
+    int64_t mtime;
+} CacheFile;
+
+static int cmp_mtime(const void *a, const void *b)
+{
+    return FFDIFFSIGN(((const CacheFile *)a)->mtime, ((const CacheFile *)b)->mtime);
+}
+
+/* amount of data cached for an entry, from its block map */
+static int64_t entry_size(const char *map_path)
+{
+    uint8_t header[MAP_HEADER_SIZE], flags[4096];
+    int64_t size = 0;
+    int fd, n;
+
+    if ((fd = avpriv_open(map_path, O_RDONLY)) < 0)
+        return 0;
+    if (read(fd, header, sizeof(header)) == sizeof(header) &&
+        AV_RB32(header) == MAP_MAGIC) {
+        while ((n = read(fd, flags, sizeof(flags))) > 0)
+            for (int i = 0; i < n; i++)
+                size += flags[i] ? AV_RB32(header + 4) : 0;
+    }
+    close(fd);
+    return size;
+}
+
+/**
+ * Delete the least recently used entries until the cache fits in max_size.
+ */
+static void evict_entries(URLContext *h)
+{
+    Context *c = h->priv_data;
+    AVIODirContext *dir = NULL;
+    AVIODirEntry *entry = NULL;
+    CacheFile *files = NULL;
+    int nb_files = 0;
+    int64_t total = 0;
+    int ret;
+
+    if ((ret = avio_open_dir(&dir, c->cache_dir, NULL)) < 0) {
+        av_log(h, AV_LOG_WARNING, "Could not list %s: %s\n",
+               c->cache_dir, av_err2str(ret));
+        return;
+    }
+    while (avio_read_dir(dir, &entry) >= 0 && entry) {
+        size_t len = strlen(entry->name);
+        CacheFile file;
+
+        if (entry->type == AVIO_ENTRY_FILE && len > 4 &&
+            !strcmp(entry->name + len - 4, ".map") &&
+            (file.map_path = av_asprintf("%s/%s", c->cache_dir, entry->name))) {
+            file.size  = entry_size(file.map_path);
+            file.mtime = entry->modification_timestamp;
+            if (av_dynarray2_add((void **)&files, &nb_files, sizeof(file),
+                                 (uint8_t *)&file))
+                total += file.size;
+            else
+                av_free(file.map_path);
+        }
+        avio_free_directory_entry(&entry);
+    }
+    avio_close_dir(&dir);
+
+    qsort(files, nb_files, sizeof(*files), cmp_mtime);
+    for (int i = 0; i < nb_files; i++) {
+        const char *map_path = files[i].map_path;
+        char *data_path;
+        int fd;
+
+        /* entries open in other processes are skipped; the lock is held
+         * until both files are deleted, the data first so that an
+         * interrupted eviction leaves no data file without a map */
+        if (total > c->max_size && strcmp(map_path, c->map_path) &&
+            (fd = avpriv_open(map_path, O_RDONLY)) >= 0) {
+            data_path = av_asprintf("%.*s.data", (int)strlen(map_path) - 4, map_path);
+            if (data_path && try_lock_entry_exclusive(fd) >= 0 &&
+                (!unlink(data_path) || errno == ENOENT) && !unlink(map_path))
+                total -= files[i].size;
+            av_free(data_path);
+            close(fd);
+        }
+        av_free(files[i].map_path);
+    }
+    av_free(files);
+}
+
 static int cache_close(URLContext *h)
 {
     Context *c= h->priv_data;
@@ -303,6 +714,15 @@ static int cache_close(URLContext *h)
     av_log(h, AV_LOG_INFO, "Statistics, cache hits:%"PRId64" cache misses:%"PRId64"\n",
            c->cache_hit, c->cache_miss);
 
+    if (c->persistent) {
+        close(c->map_fd);
+        if (c->max_size > 0)
+            evict_entries(h);
+        av_freep(&c->map_path);
+        av_freep(&c->blocks);
+        av_freep(&c->block_buf);
+    }
+
     close(c->fd);
     if (c->filename) {
         ret = unlink(c->filename);
@@ -322,6 +742,10 @@ static int cache_close(URLContext *h)
 
 static const AVOption options[] = {
     { "read_ahead_limit", "Amount in bytes that may be read ahead when seeking isn't supported, -1 for unlimited", OFFSET(read_ahead_limit), AV_OPT_TYPE_INT, { .i64 = 65536 }, -1, INT_MAX, D },
+    { "cache_dir", "Directory in which to keep the cached data across runs", OFFSET(cache_dir), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
+    { "cache_block_size", "Size in bytes of the blocks fetched and kept in cache_dir", OFFSET(block_size), AV_OPT_TYPE_INT, { .i64 = 1 << 20 }, 4096, INT_MAX, D },
+    { "cache_unvalidated", "Also keep resources without ETag or Last-Modified in cache_dir", OFFSET(unvalidated), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D },
+    { "cache_max_size", "Maximum size in bytes of cache_dir, 0 for unlimited", OFFSET(max_size), AV_OPT_TYPE_INT64, { .i64 = 0 }, 0, INT64_MAX, D },
     {NULL},
 };
 
@@ -20,14 +20,19 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 #include <libxml/parser.h>
+#include "config_components.h"
+#include "libavutil/avassert.h"
 #include "libavutil/bprint.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 #include "internal.h"
 #include "avio_internal.h"
 #include "dash.h"
 #include "demux.h"
+#include "http.h"
+#include "segprefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -115,6 +120,10 @@ struct representation {
     uint32_t init_sec_buf_read_offset;
     int64_t cur_timestamp;
     int is_restart_needed;
+
+    /* Background downloads, see the prefetch_fragments option.
+     * prefetch.cur is the fragment being read instead of input, if any. */
+    SegmentPrefetch prefetch;
 };
 
 typedef struct DASHContext {
@@ -151,6 +160,9 @@ typedef struct DASHContext {
     AVDictionary *avio_opts;
     int max_url_size;
     char *cenc_decryption_key;
+    int prefetch_fragments;
+    int64_t prefetch_buffer_size;
+    int http_persistent;
 
     /* Flags for init section*/
     int is_init_section_common_video;
@@ -345,8 +357,18 @@ static void free_timelines_list(struct representation *pls)
     pls->n_timelines = 0;
 }
 
+#if HAVE_THREADS
+static void prefetch_stop(struct representation *pls)
+{
+    ff_segment_prefetch_stop(&pls->prefetch);
+}
+#else
+static void prefetch_stop(struct representation *pls) { }
+#endif
+
 static void free_representation(struct representation *pls)
 {
+    prefetch_stop(pls);
     free_fragment_list(pls);
     free_timelines_list(pls);
     free_fragment(&pls->cur_seg);
@@ -398,6 +420,24 @@ static void free_subtitle_list(DASHContext *c)
     c->n_subtitles = 0;
 }
 
+static int open_url_keepalive(AVFormatContext *s, AVIOContext **pb,
+                              const char *url, AVDictionary **options)
+{
+#if !CONFIG_HTTP_PROTOCOL
+    return AVERROR_PROTOCOL_NOT_FOUND;
+#else
+    int ret;
+    URLContext *uc = ffio_geturlcontext(*pb);
+    av_assert0(uc);
+    (*pb)->eof_reached = 0;
+    ret = ff_http_do_new_request2(uc, url, options);
+    if (ret < 0) {
+        ff_format_io_close(s, pb);
+    }
+    return ret;
+#endif
+}
+
 static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
                     AVDictionary **opts, AVDictionary *opts2, int *is_http)
 {
@@ -440,10 +480,26 @@ static int open_url(AVFormatContext *s, AVIOContext **pb, const char *url,
     else if (strcmp(proto_name, "file") || !strncmp(url, "file,", 5))
         return AVERROR_INVALIDDATA;
 
-    av_freep(pb);
     av_dict_copy(&tmp, *opts, 0);
     av_dict_copy(&tmp, opts2, 0);
-    ret = avio_open2(pb, url, AVIO_FLAG_READ, c->interrupt_callback, &tmp);
+    if (*pb && c->http_persistent && av_strstart(proto_name, "http", NULL)) {
+        ret = open_url_keepalive(s, pb, url, &tmp);
+        if (ret == AVERROR_EXIT) {
+            av_dict_free(&tmp);
+            return ret;
+        } else if (ret < 0) {
+            if (ret != AVERROR_EOF)
+                av_log(s, AV_LOG_WARNING,
+                    "keepalive request failed for '%s' with error: '%s' when opening url, retrying with new connection\n",
+                    url, av_err2str(ret));
+            av_dict_copy(&tmp, *opts, 0);
+            av_dict_copy(&tmp, opts2, 0);
+            ret = avio_open2(pb, url, AVIO_FLAG_READ, c->interrupt_callback, &tmp);
+        }
+    } else {
+        av_freep(pb);
+        ret = avio_open2(pb, url, AVIO_FLAG_READ, c->interrupt_callback, &tmp);
+    }
     if (ret >= 0) {
         // update cookies on http response with setcookies.
         char *new_cookies = NULL;
@@ -1579,6 +1635,26 @@ finish:
     return ret;
 }
 
+static char *get_template_url(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    char *tmpfilename, *url;
+
+    tmpfilename = av_mallocz(c->max_url_size);
+    if (!tmpfilename)
+        return NULL;
+    ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, seq_no, 0, get_segment_start_time_based_on_timeline(pls, seq_no));
+    url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
+    if (!url) {
+        av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
+        url = av_strdup(pls->url_template);
+        if (!url)
+            av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
+    }
+    av_free(tmpfilename);
+    return url;
+}
+
 static struct fragment *get_current_fragment(struct representation *pls)
 {
     int64_t min_seq_no = 0;
@@ -1632,30 +1708,16 @@ static struct fragment *get_current_fragment(struct representation *pls)
         }
     }
     if (seg) {
-        char *tmpfilename;
         if (!pls->url_template) {
             av_log(pls->parent, AV_LOG_ERROR, "Cannot get fragment, missing template URL\n");
             av_free(seg);
             return NULL;
         }
-        tmpfilename = av_mallocz(c->max_url_size);
-        if (!tmpfilename) {
+        seg->url = get_template_url(pls, pls->cur_seq_no);
+        if (!seg->url) {
             av_free(seg);
             return NULL;
         }
-        ff_dash_fill_tmpl_params(tmpfilename, c->max_url_size, pls->url_template, 0, pls->cur_seq_no, 0, get_segment_start_time_based_on_timeline(pls, pls->cur_seq_no));
-        seg->url = av_strireplace(pls->url_template, pls->url_template, tmpfilename);
-        if (!seg->url) {
-            av_log(pls->parent, AV_LOG_WARNING, "Unable to resolve template url '%s', try to use origin template\n", pls->url_template);
-            seg->url = av_strdup(pls->url_template);
-            if (!seg->url) {
-                av_log(pls->parent, AV_LOG_ERROR, "Cannot resolve template url '%s'\n", pls->url_template);
-                av_free(tmpfilename);
-                av_free(seg);
-                return NULL;
-            }
-        }
-        av_free(tmpfilename);
         seg->size = -1;
     }
 
@@ -1678,6 +1740,17 @@ static int read_from_url(struct representation *pls, struct fragment *seg,
     return ret;
 }
 
+static void set_fragment_request_opts(DASHContext *c, const struct fragment *seg,
+                                      AVDictionary **opts)
+{
+    if (seg->size >= 0) {
+        /* try to restrict the HTTP request to the part we want
+         * (if this is in fact a HTTP request) */
+        av_dict_set_int(opts, "offset", seg->url_offset, 0);
+        av_dict_set_int(opts, "end_offset", seg->url_offset + seg->size, 0);
+    }
+}
+
 static int open_input(DASHContext *c, struct representation *pls, struct fragment *seg)
 {
     AVDictionary *opts = NULL;
@@ -1690,12 +1763,7 @@ static int open_input(DASHContext *c, struct representation *pls, struct fragmen
         goto cleanup;
     }
 
-    if (seg->size >= 0) {
-        /* try to restrict the HTTP request to the part we want
-         * (if this is in fact a HTTP request) */
-        av_dict_set_int(&opts, "offset", seg->url_offset, 0);
-        av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
-    }
+    set_fragment_request_opts(c, seg, &opts);
 
     ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
     av_log(pls->parent, AV_LOG_VERBOSE, "DASH request for url '%s', offset %"PRId64"\n",
@@ -1766,6 +1834,170 @@ static int64_t seek_data(void *opaque, int64_t offset, int whence)
     return AVERROR(ENOSYS);
 }
 
+#if HAVE_THREADS
+/*
+ * Get the fragment seq_no of the representation from the manifest already
+ * loaded, without refreshing it. Returns NULL if it is not known yet.
+ */
+static struct fragment *get_fragment_at(struct representation *pls, int64_t seq_no)
+{
+    DASHContext *c = pls->parent->priv_data;
+    struct fragment *seg;
+
+    if (pls->n_fragments) {
+        if (seq_no < 0 || seq_no >= pls->n_fragments)
+            return NULL;
+    } else if (!pls->url_template ||
+               seq_no > (c->is_live ? calc_max_seg_no(pls, c) : pls->last_seq_no)) {
+        return NULL;
+    }
+
+    seg = av_mallocz(sizeof(struct fragment));
+    if (!seg)
+        return NULL;
+    if (pls->n_fragments) {
+        seg->url        = av_strdup(pls->fragments[seq_no]->url);
+        seg->size       = pls->fragments[seq_no]->size;
+        seg->url_offset = pls->fragments[seq_no]->url_offset;
+    } else {
+        seg->url        = get_template_url(pls, seq_no);
+        seg->size       = -1;
+    }
+    if (!seg->url)
+        av_freep(&seg);
+    return seg;
+}
+
+static int prefetch_matches(const PrefetchedSegment *pf, int64_t seq_no,
+                            const struct fragment *seg, const char *url)
+{
+    return pf->seq_no == seq_no && !strcmp(pf->url, url) &&
+           pf->url_offset == seg->url_offset &&
+           pf->size       == seg->size;
+}
+
+static int prefetch_open_fragment(void *opaque, AVIOContext **in,
+                                  const PrefetchedSegment *pf, AVDictionary **avio_opts)
+{
+    struct representation *pls = opaque;
+    AVFormatContext *s         = pls->parent;
+    DASHContext *c             = s->priv_data;
+    struct fragment frag       = { .url_offset = pf->url_offset,
+                                   .size       = pf->size,
+                                   .url        = pf->url };
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_log(s, AV_LOG_VERBOSE, "DASH prefetch for url '%s', offset %"PRId64"\n",
+           pf->url, pf->url_offset);
+    /* the thread reads the fragments one after the other, so it can
+     * reuse its connection */
+    if (c->http_persistent)
+        av_dict_set(&opts, "multiple_requests", "1", 0);
+    set_fragment_request_opts(c, &frag, &opts);
+    ret = open_url(s, in, pf->url, avio_opts, opts, NULL);
+    av_dict_free(&opts);
+    return ret;
+}
+
+/*
+ * Queue the current fragment and the following ones for download by the
+ * prefetch thread. Returns 1 if the current fragment is then read from memory.
+ */
+static int prefetch_open(DASHContext *c, struct representation *pls)
+{
+    SegmentPrefetch *p = &pls->prefetch;
+    char *url;
+    int i, ret = 0;
+
+    if (!c->prefetch_fragments)
+        return 0;
+    /* the fragment demuxer may seek in these, see seek_data() */
+    if (!c->is_live && pls->n_fragments && !pls->init_sec_data_len)
+        return 0;
+
+    if (!p->started) {
+        p->s           = pls->parent;
+        p->opaque      = pls;
+        p->thread_name = "dash-prefetch";
+        p->open        = prefetch_open_fragment;
+        p->buffer_size = c->prefetch_buffer_size;
+        p->keep_alive  = c->http_persistent;
+        ret = ff_segment_prefetch_start(p, c->avio_opts);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Unable to start prefetching, reading fragments on demand: %s\n",
+                   av_err2str(ret));
+            c->prefetch_fragments = 0;
+            return 0;
+        }
+    }
+
+    url = av_malloc(c->max_url_size);
+    if (!url)
+        return 0;
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->nb_segs && p->segs[0]->seq_no < pls->cur_seq_no)
+        ff_segment_prefetch_remove(p, 0);
+
+    for (i = 0; i <= c->prefetch_fragments; i++) {
+        int64_t seq_no = pls->cur_seq_no + i;
+        struct fragment *seg = i ? get_fragment_at(pls, seq_no) : pls->cur_seg;
+
+        if (!seg)
+            break;
+        ff_make_absolute_url(url, c->max_url_size, c->base_url, seg->url);
+        if (i < p->nb_segs && !prefetch_matches(p->segs[i], seq_no, seg, url)) {
+            while (p->nb_segs > i)
+                ff_segment_prefetch_remove(p, p->nb_segs - 1);
+        }
+        if (i >= p->nb_segs)
+            ret = ff_segment_prefetch_add(p, seq_no, url, seg->url_offset, seg->size);
+        if (i)
+            free_fragment(&seg);
+        if (ret < 0)
+            break;
+    }
+    while (p->nb_segs > i)
+        ff_segment_prefetch_remove(p, p->nb_segs - 1);
+
+    ret = ff_segment_prefetch_set_current(p, pls->cur_seq_no);
+    pthread_mutex_unlock(&p->mutex);
+    av_free(url);
+
+    return ret;
+}
+
+static int prefetch_read(struct representation *pls, uint8_t *buf, int buf_size)
+{
+    int ret = ff_segment_prefetch_read(&pls->prefetch, buf, buf_size);
+
+    if (ret > 0)
+        pls->cur_seg_offset += ret;
+    return ret;
+}
+
+/* Done with the current fragment */
+static void prefetch_release(struct representation *pls)
+{
+    ff_segment_prefetch_release(&pls->prefetch);
+}
+
+static void prefetch_flush(struct representation *pls)
+{
+    ff_segment_prefetch_flush(&pls->prefetch);
+}
+#else
+static int prefetch_open(DASHContext *c, struct representation *pls) { return 0; }
+static int prefetch_read(struct representation *pls, uint8_t *buf, int buf_size)
+{
+    return AVERROR_BUG;
+}
+static void prefetch_release(struct representation *pls) { }
+static void prefetch_flush(struct representation *pls) { }
+#endif
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     int ret = 0;
@@ -1773,7 +2005,7 @@ static int read_data(void *opaque, uint8_t *buf, int buf_size)
     DASHContext *c = v->parent->priv_data;
 
 restart:
-    if (!v->input) {
+    if (!v->input && !v->prefetch.cur) {
         free_fragment(&v->cur_seg);
         v->cur_seg = get_current_fragment(v);
         if (!v->cur_seg) {
@@ -1786,8 +2018,10 @@ restart:
         if (ret)
             goto end;
 
-        ret = open_input(c, v, v->cur_seg);
-        if (ret < 0) {
+        if (prefetch_open(c, v)) {
+            v->cur_seg_offset = 0;
+            v->cur_seg_size   = v->cur_seg->size;
+        } else if ((ret = open_input(c, v, v->cur_seg)) < 0) {
             if (ff_check_interrupt(c->interrupt_callback)) {
                 ret = AVERROR_EXIT;
                 goto end;
@@ -1815,7 +2049,10 @@ restart:
         ret = AVERROR_EOF;
         goto end;
     }
-    ret = read_from_url(v, v->cur_seg, buf, buf_size);
+    if (v->prefetch.cur)
+        ret = prefetch_read(v, buf, buf_size);
+    else
+        ret = read_from_url(v, v->cur_seg, buf, buf_size);
     if (ret > 0)
         goto end;
 
@@ -2156,6 +2393,7 @@ static void recheck_discard_flags(AVFormatContext *s, struct representation **p,
         } else if (!needed && pls->ctx) {
             close_demux_for_component(pls);
             ff_format_io_close(pls->parent, &pls->input);
+            prefetch_flush(pls);
             av_log(s, AV_LOG_INFO, "No longer receiving stream_index %d\n", pls->stream_index);
         }
     }
@@ -2217,6 +2455,7 @@ static int dash_read_packet(AVFormatContext *s, AVPacket *pkt)
             cur->cur_seg_offset = 0;
             cur->init_sec_buf_read_offset = 0;
             ff_format_io_close(cur->parent, &cur->input);
+            prefetch_release(cur);
             ret = reopen_demux_for_component(s, cur);
             cur->is_restart_needed = 0;
         }
@@ -2256,6 +2495,7 @@ static int dash_seek(AVFormatContext *s, struct representation *pls, int64_t see
     }
 
     ff_format_io_close(pls->parent, &pls->input);
+    prefetch_flush(pls);
 
     // find the nearest fragment
     if (pls->n_timelines > 0 && pls->fragment_timescale > 0) {
@@ -2354,6 +2594,12 @@ static const AVOption dash_options[] = {
         {.str = "aac,m4a,m4s,m4v,mov,mp4,webm,ts"},
         INT_MIN, INT_MAX, FLAGS},
     { "cenc_decryption_key", "Media decryption key (hex)", OFFSET(cenc_decryption_key), AV_OPT_TYPE_STRING, {.str = NULL}, INT_MIN, INT_MAX, .flags = FLAGS },
+    {"http_persistent", "Use persistent HTTP connections for prefetched fragments",
+        OFFSET(http_persistent), AV_OPT_TYPE_BOOL, {.i64 = 1}, 0, 1, FLAGS },
+    {"prefetch_fragments", "Number of fragments to download in the background ahead of the one being read",
+        OFFSET(prefetch_fragments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_buffer_size", "Maximum amount of prefetched data buffered per representation",
+        OFFSET(prefetch_buffer_size), AV_OPT_TYPE_INT64, {.i64 = 32 * 1024 * 1024}, 1, INT64_MAX, FLAGS},
     {NULL}
 };
 
@@ -40,6 +40,7 @@
 
 #include "libavcodec/avcodec.h"
 
+#include "asyncwriter.h"
 #include "av1.h"
 #include "avc.h"
 #include "avformat.h"
@@ -201,6 +202,10 @@ typedef struct DASHContext {
     AVRational min_playback_rate;
     AVRational max_playback_rate;
     int64_t update_period;
+    int async_io;
+    int async_io_queue_size;
+    int async_io_retries;
+    FFAsyncWriter *writer; /* performs all output in the background if async_io is set */
 } DASHContext;
 
 static struct codec_string {
@@ -230,6 +235,8 @@ static int dashenc_io_open(AVFormatContext *s, AVIOContext **pb, char *filename,
     DASHContext *c = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
+    if (c->writer)
+        return ff_async_writer_open(c->writer, pb, filename, options);
     if (!*pb || !http_base_proto || !c->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
@@ -251,6 +258,11 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
     if (!*pb)
         return;
 
+    if (c->writer) {
+        ff_async_writer_close(c->writer, pb);
+        return;
+    }
+
     if (!http_base_proto || !c->http_persistent) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
@@ -263,6 +275,16 @@ static void dashenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filenam
     }
 }
 
+static int dashenc_rename(AVFormatContext *s, const char *oldpath,
+                          const char *newpath, void *logctx)
+{
+    DASHContext *c = s->priv_data;
+
+    if (c->writer)
+        return ff_async_writer_rename(c->writer, oldpath, newpath);
+    return ff_rename(oldpath, newpath, logctx);
+}
+
 static const char *get_format_str(SegmentType segment_type) {
     int i;
     for (i = 0; i < SEGMENT_TYPE_NB; i++)
@@ -582,7 +604,7 @@ static void write_hls_media_playlist(OutputStream *os, AVFormatContext *s,
     dashenc_io_close(s, &c->m3u8_out, temp_filename_hls);
 
     if (use_rename)
-        ff_rename(temp_filename_hls, filename_hls, os->ctx);
+        dashenc_rename(s, temp_filename_hls, filename_hls, os->ctx);
 }
 
 static int flush_init_segment(AVFormatContext *s, OutputStream *os)
@@ -608,6 +630,8 @@ static void dash_free(AVFormatContext *s)
     DASHContext *c = s->priv_data;
     int i, j;
 
+    ff_async_writer_free(&c->writer);
+
     if (c->as) {
         for (i = 0; i < c->nb_as; i++) {
             av_dict_free(&c->as[i].metadata);
@@ -1245,7 +1269,7 @@ static int write_manifest(AVFormatContext *s, int final)
     dashenc_io_close(s, &c->mpd_out, temp_filename);
 
     if (use_rename) {
-        if ((ret = ff_rename(temp_filename, s->url, s)) < 0)
+        if ((ret = dashenc_rename(s, temp_filename, s->url, s)) < 0)
             return ret;
     }
 
@@ -1360,7 +1384,7 @@ static int write_manifest(AVFormatContext *s, int final)
 
         dashenc_io_close(s, &c->m3u8_out, temp_filename);
         if (use_rename)
-            if ((ret = ff_rename(temp_filename, filename_hls, s)) < 0)
+            if ((ret = dashenc_rename(s, temp_filename, filename_hls, s)) < 0)
                 return ret;
         c->master_playlist_created = 1;
     }
@@ -1487,6 +1511,21 @@ static int dash_init(AVFormatContext *s)
     if ((ret = init_segment_types(s)) < 0)
         return ret;
 
+    if (c->async_io) {
+        if (c->single_file || c->streaming) {
+            av_log(s, AV_LOG_WARNING, "async_io is not supported in single file "
+                   "or streaming mode, writing synchronously\n");
+        } else {
+            ret = ff_async_writer_alloc(&c->writer, s, c->async_io_queue_size,
+                                        c->async_io_retries, c->http_persistent);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "async_io requires thread support, "
+                       "writing synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     for (i = 0; i < s->nb_streams; i++) {
         OutputStream *os = &c->streams[i];
         AdaptationSet *as = &c->as[os->as_idx - 1];
@@ -1588,7 +1627,7 @@ static int dash_init(AVFormatContext *s)
         if (!c->single_file) {
             if ((ret = avio_open_dyn_buf(&ctx->pb)) < 0)
                 return ret;
-            ret = s->io_open(s, &os->out, filename, AVIO_FLAG_WRITE, &opts);
+            ret = dashenc_io_open(s, &os->out, filename, &opts);
         } else {
             ctx->url = av_strdup(filename);
             ret = avio_open2(&ctx->pb, filename, AVIO_FLAG_WRITE, NULL, &opts);
@@ -1861,12 +1900,20 @@ static void dashenc_delete_file(AVFormatContext *s, char *filename) {
         set_http_options(&http_opts, c);
         av_dict_set(&http_opts, "method", "DELETE", 0);
 
+        if (c->writer) {
+            ff_async_writer_delete(c->writer, filename, &http_opts);
+            av_dict_free(&http_opts);
+            return;
+        }
+
         if (dashenc_io_open(s, &out, filename, &http_opts) < 0) {
             av_log(s, AV_LOG_ERROR, "failed to delete %s\n", filename);
         }
 
         av_dict_free(&http_opts);
         ff_format_io_close(s, &out);
+    } else if (c->writer) {
+        ff_async_writer_delete(c->writer, filename, NULL);
     } else {
         int res = ffurl_delete(filename);
         if (res < 0) {
@@ -1972,7 +2019,7 @@ static int dash_flush(AVFormatContext *s, int final, int stream)
             dashenc_io_close(s, &os->out, os->temp_path);
 
             if (use_rename) {
-                ret = ff_rename(os->temp_path, os->full_path, os->ctx);
+                ret = dashenc_rename(s, os->temp_path, os->full_path, os->ctx);
                 if (ret < 0)
                     break;
             }
@@ -2079,6 +2126,10 @@ static int dash_write_packet(AVFormatContext *s, AVPacket *pkt)
     int64_t seg_end_duration, elapsed_duration;
     int ret;
 
+    if (c->writer && !c->ignore_io_errors &&
+        (ret = ff_async_writer_error(c->writer)) < 0)
+        return ret;
+
     ret = update_stream_extradata(s, os, pkt, &st->avg_frame_rate);
     if (ret < 0)
         return ret;
@@ -2335,6 +2386,12 @@ static int dash_write_trailer(AVFormatContext *s)
         }
     }
 
+    if (c->writer) {
+        int ret = ff_async_writer_flush(c->writer);
+        if (ret < 0 && !c->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2407,6 +2464,9 @@ static const AVOption options[] = {
     { "min_playback_rate", "Set desired minimum playback rate", OFFSET(min_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "max_playback_rate", "Set desired maximum playback rate", OFFSET(max_playback_rate), AV_OPT_TYPE_RATIONAL, { .dbl = 1.0 }, 0.5, 1.5, E },
     { "update_period", "Set the mpd update interval", OFFSET(update_period), AV_OPT_TYPE_INT64, {.i64 = 0}, 0, INT64_MAX, E},
+    { "async_io", "Write segments and manifests from a background thread", OFFSET(async_io), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    { "async_io_queue_size", "Maximum number of pending background writes", OFFSET(async_io_queue_size), AV_OPT_TYPE_INT, { .i64 = 32 }, 1, INT_MAX, E },
+    { "async_io_retries", "Number of times a failed background write is retried", OFFSET(async_io_retries), AV_OPT_TYPE_INT, { .i64 = 3 }, 0, INT_MAX, E },
     { NULL },
 };
 
@@ -232,6 +232,16 @@ int ff_generate_avci_extradata(AVStream *st);
  */
 int ff_get_extradata(void *logctx, AVCodecParameters *par, AVIOContext *pb, int size);
 
+/**
+ * Like av_get_packet(), but the packet may reference the data in the I/O
+ * buffer instead of holding a copy of it, see ffio_read_ref().
+ *
+ * This is only done for uncompressed and intra-only codecs, whose packets
+ * are large, and when the data is followed by zeroed padding. The packet
+ * data must not be modified in place.
+ */
+int ff_get_packet(AVIOContext *s, AVPacket *pkt, int size, enum AVCodecID codec_id);
+
 /**
  * Find stream index based on format-specific stream ID
  * @return stream index, or < 0 on error
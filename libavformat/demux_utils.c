@@ -368,6 +368,41 @@ int ff_get_extradata(void *logctx, AVCodecParameters *par, AVIOContext *pb, int
     return ret;
 }
 
+int ff_get_packet(AVIOContext *s, AVPacket *pkt, int size, enum AVCodecID codec_id)
+{
+    AVBufferRef *buf = NULL;
+    int64_t pos;
+    int ret;
+
+    switch (codec_id) {
+    case AV_CODEC_ID_PRORES:
+    case AV_CODEC_ID_DNXHD:
+    case AV_CODEC_ID_RAWVIDEO:
+    case AV_CODEC_ID_V210:
+    case AV_CODEC_ID_V210X:
+    case AV_CODEC_ID_V410:
+    case AV_CODEC_ID_R210:
+    case AV_CODEC_ID_R10K:
+        break;
+    default:
+        /* PCM */
+        if (codec_id < AV_CODEC_ID_FIRST_AUDIO || codec_id >= AV_CODEC_ID_ADPCM_IMA_QT)
+            return av_get_packet(s, pkt, size);
+    }
+
+    pos = avio_tell(s);
+    ret = ffio_read_ref(s, &buf, size);
+    if (ret <= 0)
+        return ret < 0 ? ret : av_get_packet(s, pkt, size);
+
+    av_packet_unref(pkt);
+    pkt->buf  = buf;
+    pkt->data = buf->data;
+    pkt->size = size;
+    pkt->pos  = pos;
+    return size;
+}
+
 int ff_find_stream_index(const AVFormatContext *s, int id)
 {
     for (unsigned i = 0; i < s->nb_streams; i++)
@@ -21,7 +21,9 @@
 
 #include "config_components.h"
 
+#include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/buffer.h"
 #include "libavutil/file_open.h"
 #include "libavutil/internal.h"
 #include "libavutil/opt.h"
@@ -38,6 +40,12 @@
 #endif
 #include <sys/stat.h>
 #include <stdlib.h>
+#if HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#if CONFIG_LIBURING
+#include <liburing.h>
+#endif
 #include "os_support.h"
 #include "url.h"
 
@@ -70,6 +78,29 @@
 
 /* standard file protocol */
 
+enum MmapAdvice {
+    MMAP_ADVICE_NORMAL,
+    MMAP_ADVICE_SEQUENTIAL,
+    MMAP_ADVICE_RANDOM,
+    MMAP_ADVICE_WILLNEED,
+};
+
+#if CONFIG_LIBURING
+enum URingBlockState {
+    BLOCK_FREE,
+    BLOCK_QUEUED,
+    BLOCK_READY,
+    BLOCK_STALE,    ///< queued but no longer wanted, freed on completion
+};
+
+typedef struct URingBlock {
+    uint8_t *data;
+    int64_t offset;
+    int size;       ///< bytes read or AVERROR, when ready
+    enum URingBlockState state;
+} URingBlock;
+#endif
+
 typedef struct FileContext {
     const AVClass *class;
     int fd;
@@ -79,6 +110,26 @@ typedef struct FileContext {
     int seekable;
 #if HAVE_DIRENT_H
     DIR *dir;
+#endif
+    int64_t pos;            ///< logical read position for mmap and io_uring reads
+#if HAVE_MMAP
+    int mmap;
+    int mmap_advice;
+    AVBufferRef *map;
+#endif
+#if CONFIG_LIBURING
+    int io_uring;
+    int io_uring_depth;
+    int io_uring_block_size;
+    int direct_io;
+    int ring_inited;
+    struct io_uring ring;
+    uint8_t *ring_mem;
+    URingBlock *blocks;
+    int nb_inflight;
+    int64_t next_offset;    ///< offset of the next block to read ahead
+    int64_t file_size;
+    int window;             ///< number of blocks to keep read ahead
 #endif
 } FileContext;
 
@@ -87,6 +138,20 @@ static const AVOption file_options[] = {
     { "blocksize", "set I/O operation maximum block size", offsetof(FileContext, blocksize), AV_OPT_TYPE_INT, { .i64 = INT_MAX }, 1, INT_MAX, AV_OPT_FLAG_ENCODING_PARAM },
     { "follow", "Follow a file as it is being written", offsetof(FileContext, follow), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
     { "seekable", "Sets if the file is seekable", offsetof(FileContext, seekable), AV_OPT_TYPE_INT, { .i64 = -1 }, -1, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_ENCODING_PARAM },
+#if HAVE_MMAP
+    { "mmap", "serve reads from a memory mapping of the file", offsetof(FileContext, mmap), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "mmap_advice", "set the expected access pattern of the mapping", offsetof(FileContext, mmap_advice), AV_OPT_TYPE_INT, { .i64 = MMAP_ADVICE_NORMAL }, 0, MMAP_ADVICE_WILLNEED, AV_OPT_FLAG_DECODING_PARAM, "mmap_advice" },
+        { "normal",     NULL, 0, AV_OPT_TYPE_CONST, { .i64 = MMAP_ADVICE_NORMAL     }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "mmap_advice" },
+        { "sequential", NULL, 0, AV_OPT_TYPE_CONST, { .i64 = MMAP_ADVICE_SEQUENTIAL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "mmap_advice" },
+        { "random",     NULL, 0, AV_OPT_TYPE_CONST, { .i64 = MMAP_ADVICE_RANDOM     }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "mmap_advice" },
+        { "willneed",   NULL, 0, AV_OPT_TYPE_CONST, { .i64 = MMAP_ADVICE_WILLNEED   }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "mmap_advice" },
+#endif
+#if CONFIG_LIBURING
+    { "io_uring", "read through io_uring with readahead", offsetof(FileContext, io_uring), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring_depth", "maximum number of blocks read ahead", offsetof(FileContext, io_uring_depth), AV_OPT_TYPE_INT, { .i64 = 8 }, 1, 256, AV_OPT_FLAG_DECODING_PARAM },
+    { "io_uring_block_size", "size of the blocks read ahead", offsetof(FileContext, io_uring_block_size), AV_OPT_TYPE_INT, { .i64 = 262144 }, 4096, INT_MAX / 256, AV_OPT_FLAG_DECODING_PARAM },
+    { "direct_io", "bypass the page cache (O_DIRECT) with io_uring", offsetof(FileContext, direct_io), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+#endif
     { NULL }
 };
 
@@ -109,12 +174,342 @@ static const AVClass pipe_class = {
     .version    = LIBAVUTIL_VERSION_INT,
 };
 
+#if CONFIG_LIBURING
+#define DIRECT_IO_ALIGN 4096
+
+static void uring_queue(FileContext *c, URingBlock *b, int64_t offset)
+{
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&c->ring);
+
+    /* the ring has an entry for every block, so this cannot fail */
+    av_assert0(sqe);
+    io_uring_prep_read(sqe, c->fd, b->data, c->io_uring_block_size, offset);
+    io_uring_sqe_set_data(sqe, b);
+    b->offset = offset;
+    b->state  = BLOCK_QUEUED;
+    c->nb_inflight++;
+}
+
+static int uring_reap(FileContext *c, int wait)
+{
+    struct io_uring_cqe *cqe;
+    URingBlock *b;
+    int ret;
+
+    while (c->nb_inflight) {
+        ret = wait ? io_uring_wait_cqe(&c->ring, &cqe)
+                   : io_uring_peek_cqe(&c->ring, &cqe);
+        if (ret == -EAGAIN && !wait)
+            break;
+        if (ret == -EINTR)
+            continue;
+        if (ret < 0)
+            return AVERROR(-ret);
+
+        b = io_uring_cqe_get_data(cqe);
+        if (b->state == BLOCK_STALE) {
+            b->state = BLOCK_FREE;
+        } else {
+            b->state = BLOCK_READY;
+            b->size  = cqe->res < 0 ? AVERROR(-cqe->res) : cqe->res;
+        }
+        io_uring_cqe_seen(&c->ring, cqe);
+        c->nb_inflight--;
+        wait = 0;
+    }
+    return 0;
+}
+
+/**
+ * Keep up to window blocks ahead of the read position in flight.
+ */
+static int uring_fill(FileContext *c)
+{
+    int i, ret, active = 0;
+
+    for (i = 0; i < c->io_uring_depth; i++)
+        active += c->blocks[i].state == BLOCK_QUEUED ||
+                  c->blocks[i].state == BLOCK_READY;
+
+    while (active < c->window && (!active || c->next_offset < c->file_size)) {
+        URingBlock *b = NULL;
+
+        for (i = 0; i < c->io_uring_depth && !b; i++)
+            if (c->blocks[i].state == BLOCK_FREE)
+                b = &c->blocks[i];
+        if (!b) {
+            /* all remaining slots are held by stale reads */
+            if (active)
+                break;
+            if ((ret = uring_reap(c, 1)) < 0)
+                return ret;
+            continue;
+        }
+        uring_queue(c, b, c->next_offset);
+        c->next_offset += c->io_uring_block_size;
+        active++;
+    }
+
+    ret = io_uring_submit(&c->ring);
+    return ret < 0 ? AVERROR(-ret) : 0;
+}
+
+static URingBlock *uring_find(FileContext *c)
+{
+    for (int i = 0; i < c->io_uring_depth; i++) {
+        URingBlock *b = &c->blocks[i];
+        int64_t end = b->offset + c->io_uring_block_size;
+
+        if (b->state == BLOCK_READY && b->size >= 0)
+            end = b->offset + b->size;
+        else if (b->state != BLOCK_READY && b->state != BLOCK_QUEUED)
+            continue;
+        if (b->offset <= c->pos && c->pos < end)
+            return b;
+    }
+    return NULL;
+}
+
+/**
+ * Drop blocks that lie entirely before the read position, e.g. after
+ * a forward seek within the read-ahead window.
+ */
+static void uring_drop_behind(FileContext *c)
+{
+    for (int i = 0; i < c->io_uring_depth; i++) {
+        URingBlock *b = &c->blocks[i];
+
+        if (b->offset + c->io_uring_block_size > c->pos)
+            continue;
+        if (b->state == BLOCK_QUEUED)
+            b->state = BLOCK_STALE;
+        else if (b->state == BLOCK_READY)
+            b->state = BLOCK_FREE;
+    }
+}
+
+/**
+ * The read position is not covered by the read-ahead, so the access
+ * pattern is not sequential: cancel the read-ahead and start over with a
+ * single block.
+ */
+static int uring_restart(FileContext *c)
+{
+    struct stat st;
+
+    if (!fstat(c->fd, &st))
+        c->file_size = st.st_size;
+    if (c->pos >= c->file_size)
+        return AVERROR_EOF;
+
+    for (int i = 0; i < c->io_uring_depth; i++) {
+        URingBlock *b = &c->blocks[i];
+        if (b->state == BLOCK_QUEUED)
+            b->state = BLOCK_STALE;
+        else if (b->state == BLOCK_READY)
+            b->state = BLOCK_FREE;
+    }
+
+    c->window      = 1;
+    c->next_offset = c->pos;
+    if (c->direct_io)
+        c->next_offset &= ~(int64_t)(DIRECT_IO_ALIGN - 1);
+    return uring_fill(c);
+}
+
+static int uring_read(FileContext *c, unsigned char *buf, int size)
+{
+    URingBlock *b;
+    int ret;
+
+    uring_drop_behind(c);
+    while (!(b = uring_find(c)) || b->state != BLOCK_READY) {
+        ret = b ? uring_reap(c, 1) : uring_restart(c);
+        if (ret < 0)
+            return ret;
+    }
+
+    if (b->size < 0) {
+        ret = b->size;
+        b->state = BLOCK_FREE;
+        return ret;
+    }
+
+    size = FFMIN(size, b->offset + b->size - c->pos);
+    memcpy(buf, b->data + (c->pos - b->offset), size);
+    c->pos += size;
+
+    if (c->pos == b->offset + b->size) {
+        /* the whole block was consumed, read further ahead */
+        b->state  = BLOCK_FREE;
+        c->window = FFMIN(2 * c->window, c->io_uring_depth);
+    }
+
+    if ((ret = uring_reap(c, 0)) < 0 || (ret = uring_fill(c)) < 0)
+        return ret;
+    return size;
+}
+
+static int uring_init(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    struct stat st;
+    uint8_t *data;
+    int ret;
+
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        av_log(h, AV_LOG_WARNING, "io_uring is only used for regular files\n");
+        return 0;
+    }
+    c->file_size = st.st_size;
+
+    if (c->direct_io)
+        c->io_uring_block_size = FFALIGN(c->io_uring_block_size, DIRECT_IO_ALIGN);
+
+    c->blocks   = av_calloc(c->io_uring_depth, sizeof(*c->blocks));
+    c->ring_mem = av_malloc((size_t)c->io_uring_depth * c->io_uring_block_size +
+                            DIRECT_IO_ALIGN);
+    if (!c->blocks || !c->ring_mem) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    ret = io_uring_queue_init(c->io_uring_depth, &c->ring, 0);
+    if (ret < 0) {
+        av_log(h, AV_LOG_WARNING, "io_uring unavailable (%s), using read()\n",
+               av_err2str(AVERROR(-ret)));
+        ret = 0;
+        goto fail;
+    }
+    c->ring_inited = 1;
+
+    data = (uint8_t *)FFALIGN((uintptr_t)c->ring_mem, DIRECT_IO_ALIGN);
+    for (int i = 0; i < c->io_uring_depth; i++)
+        c->blocks[i].data = data + (size_t)i * c->io_uring_block_size;
+
+    if (c->direct_io) {
+#ifdef O_DIRECT
+        int flags = fcntl(c->fd, F_GETFL);
+        if (flags < 0 || fcntl(c->fd, F_SETFL, flags | O_DIRECT) < 0)
+#endif
+            av_log(h, AV_LOG_WARNING, "Could not enable direct I/O\n");
+    }
+
+    c->pos    = 0;
+    c->window = 1;
+    return 0;
+fail:
+    av_freep(&c->blocks);
+    av_freep(&c->ring_mem);
+    return ret;
+}
+
+static void uring_close(FileContext *c)
+{
+    if (!c->ring_inited)
+        return;
+    for (int i = 0; i < c->io_uring_depth; i++)
+        if (c->blocks[i].state == BLOCK_QUEUED)
+            c->blocks[i].state = BLOCK_STALE;
+    while (c->nb_inflight && uring_reap(c, 1) >= 0);
+    io_uring_queue_exit(&c->ring);
+    c->ring_inited = 0;
+    av_freep(&c->blocks);
+    av_freep(&c->ring_mem);
+}
+#endif /* CONFIG_LIBURING */
+
+#if HAVE_MMAP
+static void unmap_file(void *opaque, uint8_t *data)
+{
+    munmap(data, (size_t)(uintptr_t)opaque);
+}
+
+static int mmap_init(URLContext *h)
+{
+    FileContext *c = h->priv_data;
+    struct stat st;
+    void *map;
+    int advice = -1;
+
+    if (fstat(c->fd, &st) < 0 || !S_ISREG(st.st_mode) || !st.st_size ||
+        st.st_size > SIZE_MAX) {
+        av_log(h, AV_LOG_WARNING, "mmap is only used for non-empty regular files\n");
+        return 0;
+    }
+
+    /* reading pages cut off by a later truncation raises SIGBUS, this is
+     * documented for the option rather than checked on every read */
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED) {
+        av_log(h, AV_LOG_WARNING, "mmap() failed (%s), using read()\n",
+               av_err2str(AVERROR(errno)));
+        return 0;
+    }
+    c->map = av_buffer_create(map, st.st_size, unmap_file,
+                              (void *)(uintptr_t)st.st_size,
+                              AV_BUFFER_FLAG_READONLY);
+    if (!c->map) {
+        munmap(map, st.st_size);
+        return AVERROR(ENOMEM);
+    }
+
+    switch (c->mmap_advice) {
+#ifdef POSIX_MADV_SEQUENTIAL
+    case MMAP_ADVICE_SEQUENTIAL: advice = POSIX_MADV_SEQUENTIAL; break;
+    case MMAP_ADVICE_RANDOM:     advice = POSIX_MADV_RANDOM;     break;
+    case MMAP_ADVICE_WILLNEED:   advice = POSIX_MADV_WILLNEED;   break;
+#endif
+    }
+#ifdef POSIX_MADV_SEQUENTIAL
+    if (advice >= 0)
+        posix_madvise(map, st.st_size, advice);
+#endif
+
+    c->pos = 0;
+    return 0;
+}
+#endif /* HAVE_MMAP */
+
+/* whether reads use c->pos instead of the file offset */
+static int positioned_reads(FileContext *c)
+{
+#if HAVE_MMAP
+    if (c->map)
+        return 1;
+#endif
+#if CONFIG_LIBURING
+    if (c->ring_inited)
+        return 1;
+#endif
+    return 0;
+}
+
 static int file_read(URLContext *h, unsigned char *buf, int size)
 {
     FileContext *c = h->priv_data;
     int ret;
+#if HAVE_MMAP
+    if (c->map) {
+        if (c->pos < c->map->size) {
+            size = FFMIN(size, c->map->size - c->pos);
+            memcpy(buf, c->map->data + c->pos, size);
+            c->pos += size;
+            return size;
+        }
+        /* the file grew after it was mapped */
+        if (lseek(c->fd, c->pos, SEEK_SET) < 0)
+            return AVERROR(errno);
+    }
+#endif
+#if CONFIG_LIBURING
+    if (c->ring_inited)
+        return uring_read(c, buf, size);
+#endif
     size = FFMIN(size, c->blocksize);
     ret = read(c->fd, buf, size);
+    if (ret > 0 && positioned_reads(c))
+        c->pos += ret;
     if (ret == 0 && c->follow)
         return AVERROR(EAGAIN);
     if (ret == 0)
@@ -242,6 +637,26 @@ static int file_open(URLContext *h, const char *filename, int flags)
     if (c->seekable >= 0)
         h->is_streamed = !c->seekable;
 
+#if HAVE_MMAP
+    if (c->mmap && !(flags & AVIO_FLAG_WRITE)) {
+        int ret = mmap_init(h);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+    }
+#endif
+#if CONFIG_LIBURING
+    if (c->io_uring && !positioned_reads(c) &&
+        !(flags & AVIO_FLAG_WRITE) && !c->follow) {
+        int ret = uring_init(h);
+        if (ret < 0) {
+            close(fd);
+            return ret;
+        }
+    }
+#endif
+
     return 0;
 }
 
@@ -257,6 +672,28 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
         return ret < 0 ? AVERROR(errno) : (S_ISFIFO(st.st_mode) ? 0 : st.st_size);
     }
 
+    if (positioned_reads(c)) {
+        /* only track the logical position */
+        struct stat st;
+        switch (whence) {
+        case SEEK_SET:
+            break;
+        case SEEK_CUR:
+            pos += c->pos;
+            break;
+        case SEEK_END:
+            if (fstat(c->fd, &st) < 0)
+                return AVERROR(errno);
+            pos += st.st_size;
+            break;
+        default:
+            return AVERROR(EINVAL);
+        }
+        if (pos < 0)
+            return AVERROR(EINVAL);
+        return c->pos = pos;
+    }
+
     ret = lseek(c->fd, pos, whence);
 
     return ret < 0 ? AVERROR(errno) : ret;
@@ -265,10 +702,33 @@ static int64_t file_seek(URLContext *h, int64_t pos, int whence)
 static int file_close(URLContext *h)
 {
     FileContext *c = h->priv_data;
-    int ret = close(c->fd);
+    int ret;
+#if HAVE_MMAP
+    av_buffer_unref(&c->map);
+#endif
+#if CONFIG_LIBURING
+    uring_close(c);
+#endif
+    ret = close(c->fd);
     return (ret == -1) ? AVERROR(errno) : 0;
 }
 
+static int file_map(URLContext *h, AVBufferRef **buf)
+{
+#if HAVE_MMAP
+    FileContext *c = h->priv_data;
+
+    if (!c->map || c->map->size > INT_MAX)
+        return AVERROR(ENOSYS);
+    if (!(*buf = av_buffer_ref(c->map)))
+        return AVERROR(ENOMEM);
+    c->pos = c->map->size;
+    return 0;
+#else
+    return AVERROR(ENOSYS);
+#endif
+}
+
 static int file_open_dir(URLContext *h)
 {
 #if HAVE_LSTAT
@@ -360,6 +820,7 @@ const URLProtocol ff_file_protocol = {
     .url_write           = file_write,
     .url_seek            = file_seek,
     .url_close           = file_close,
+    .url_map             = file_map,
     .url_get_file_handle = file_get_handle,
     .url_check           = file_check,
     .url_delete          = file_delete,
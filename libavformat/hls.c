@@ -33,10 +33,12 @@
 #include "libavutil/aes.h"
 #include "libavutil/avstring.h"
 #include "libavutil/avassert.h"
+#include "libavutil/bprint.h"
 #include "libavutil/intreadwrite.h"
 #include "libavutil/mathematics.h"
 #include "libavutil/opt.h"
 #include "libavutil/dict.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "avformat.h"
 #include "demux.h"
@@ -45,6 +47,7 @@
 #include "id3v2.h"
 
 #include "hls_sample_encryption.h"
+#include "segprefetch.h"
 
 #define INITIAL_BUFFER_SIZE 32768
 
@@ -171,6 +174,16 @@ struct playlist {
      * playlist, if any. */
     int n_init_sections;
     struct segment **init_sections;
+
+    /* Background downloads, see the prefetch_segments option. */
+    SegmentPrefetch prefetch;
+#if HAVE_THREADS
+    /* playlist downloaded by the last background reload,
+     * protected by prefetch.mutex */
+    char *reload_data;
+    int reload_size;
+    char *reload_url;
+#endif
 };
 
 /*
@@ -225,6 +238,8 @@ typedef struct HLSContext {
     int http_persistent;
     int http_multiple;
     int http_seekable;
+    int prefetch_segments;
+    int64_t prefetch_buffer_size;
     AVIOContext *playlist_pb;
     HLSCryptoContext  crypto_ctx;
 } HLSContext;
@@ -258,11 +273,23 @@ static void free_init_section_list(struct playlist *pls)
     pls->n_init_sections = 0;
 }
 
+#if HAVE_THREADS
+static void prefetch_stop(struct playlist *pls)
+{
+    ff_segment_prefetch_stop(&pls->prefetch);
+    av_freep(&pls->reload_data);
+    av_freep(&pls->reload_url);
+}
+#else
+static void prefetch_stop(struct playlist *pls) { }
+#endif
+
 static void free_playlist_list(HLSContext *c)
 {
     int i;
     for (i = 0; i < c->n_playlists; i++) {
         struct playlist *pls = c->playlists[i];
+        prefetch_stop(pls);
         free_segment_list(pls);
         free_init_section_list(pls);
         av_freep(&pls->main_streams);
@@ -1055,11 +1082,27 @@ static struct segment *next_segment(struct playlist *pls)
     return pls->segments[n];
 }
 
+static int prefetch_read(struct playlist *pls, uint8_t *buf, int buf_size);
+
 static int read_from_url(struct playlist *pls, struct segment *seg,
                          uint8_t *buf, int buf_size)
 {
     int ret;
 
+    /* the segment is being read from memory, only return less than
+     * requested at the end of it, like avio_read() */
+    if (pls->prefetch.cur) {
+        int len = 0;
+
+        while (len < buf_size) {
+            ret = prefetch_read(pls, buf + len, buf_size - len);
+            if (ret <= 0)
+                break;
+            len += ret;
+        }
+        return len > 0 ? len : ret;
+    }
+
      /* limit read if the segment was only a part of a file */
     if (seg->size >= 0)
         buf_size = FFMIN(buf_size, seg->size - pls->cur_seg_offset);
@@ -1272,22 +1315,56 @@ static void intercept_id3(struct playlist *pls, uint8_t *buf,
         pls->is_id3_timestamped = (pls->id3_mpegts_timestamp != AV_NOPTS_VALUE);
 }
 
-static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg, AVIOContext **in)
+static void set_segment_request_opts(HLSContext *c, const struct segment *seg,
+                                     AVDictionary **opts)
 {
-    AVDictionary *opts = NULL;
-    int ret;
-    int is_http = 0;
-
     if (c->http_persistent)
-        av_dict_set(&opts, "multiple_requests", "1", 0);
+        av_dict_set(opts, "multiple_requests", "1", 0);
 
     if (seg->size >= 0) {
         /* try to restrict the HTTP request to the part we want
          * (if this is in fact a HTTP request) */
-        av_dict_set_int(&opts, "offset", seg->url_offset, 0);
-        av_dict_set_int(&opts, "end_offset", seg->url_offset + seg->size, 0);
+        av_dict_set_int(opts, "offset", seg->url_offset, 0);
+        av_dict_set_int(opts, "end_offset", seg->url_offset + seg->size, 0);
+    }
+}
+
+static int open_segment_url(AVFormatContext *s, AVIOContext **in, const char *url,
+                            const struct segment *seg, AVDictionary **avio_opts,
+                            AVDictionary *opts)
+{
+    int is_http = 0;
+    int ret = open_url(s, in, url, avio_opts, opts, &is_http);
+
+    /* Seek to the requested position. If this was a HTTP request, the offset
+     * should already be where want it to, but this allows e.g. local testing
+     * without a HTTP server.
+     *
+     * This is not done for HTTP at all as avio_seek() does internal bookkeeping
+     * of file offset which is out-of-sync with the actual offset when "offset"
+     * AVOption is used with http protocol, causing the seek to not be a no-op
+     * as would be expected. Wrong offset received from the server will not be
+     * noticed without the call, though.
+     */
+    if (ret == 0 && !is_http && seg->url_offset) {
+        int64_t seekret = avio_seek(*in, seg->url_offset, SEEK_SET);
+        if (seekret < 0) {
+            av_log(s, AV_LOG_ERROR, "Unable to seek to offset %"PRId64" of HLS segment '%s'\n", seg->url_offset, seg->url);
+            ret = seekret;
+            ff_format_io_close(s, in);
+        }
     }
 
+    return ret;
+}
+
+static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg, AVIOContext **in)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    set_segment_request_opts(c, seg, &opts);
+
     av_log(pls->parent, AV_LOG_VERBOSE, "HLS request for url '%s', offset %"PRId64", playlist %d\n",
            seg->url, seg->url_offset, pls->index);
 
@@ -1321,35 +1398,11 @@ static int open_input(HLSContext *c, struct playlist *pls, struct segment *seg,
         av_dict_set(&opts, "key", key, 0);
         av_dict_set(&opts, "iv", iv, 0);
 
-        ret = open_url(pls->parent, in, url, &c->avio_opts, opts, &is_http);
-        if (ret < 0) {
-            goto cleanup;
-        }
-        ret = 0;
+        ret = open_segment_url(pls->parent, in, url, seg, &c->avio_opts, opts);
     } else {
-        ret = open_url(pls->parent, in, seg->url, &c->avio_opts, opts, &is_http);
-    }
-
-    /* Seek to the requested position. If this was a HTTP request, the offset
-     * should already be where want it to, but this allows e.g. local testing
-     * without a HTTP server.
-     *
-     * This is not done for HTTP at all as avio_seek() does internal bookkeeping
-     * of file offset which is out-of-sync with the actual offset when "offset"
-     * AVOption is used with http protocol, causing the seek to not be a no-op
-     * as would be expected. Wrong offset received from the server will not be
-     * noticed without the call, though.
-     */
-    if (ret == 0 && !is_http && seg->url_offset) {
-        int64_t seekret = avio_seek(*in, seg->url_offset, SEEK_SET);
-        if (seekret < 0) {
-            av_log(pls->parent, AV_LOG_ERROR, "Unable to seek to offset %"PRId64" of HLS segment '%s'\n", seg->url_offset, seg->url);
-            ret = seekret;
-            ff_format_io_close(pls->parent, in);
-        }
+        ret = open_segment_url(pls->parent, in, seg->url, seg, &c->avio_opts, opts);
     }
 
-cleanup:
     av_dict_free(&opts);
     pls->cur_seg_offset = 0;
     return ret;
@@ -1465,6 +1518,232 @@ static int playlist_needed(struct playlist *pls)
     return 0;
 }
 
+#if HAVE_THREADS
+/* Check that the i-th queued segment still is the i-th one after cur_seq_no. */
+static int prefetch_matches(const struct playlist *pls, int i)
+{
+    const PrefetchedSegment *ps = pls->prefetch.segs[i];
+    int64_t n = ps->seq_no - pls->start_seq_no;
+
+    return ps->seq_no == pls->cur_seq_no + i && n < pls->n_segments &&
+           !strcmp(ps->url, pls->segments[n]->url) &&
+           ps->url_offset == pls->segments[n]->url_offset &&
+           ps->size       == pls->segments[n]->size;
+}
+
+static int prefetch_open_segment(void *opaque, AVIOContext **in,
+                                 const PrefetchedSegment *ps, AVDictionary **avio_opts)
+{
+    struct playlist *pls = opaque;
+    AVFormatContext *s   = pls->parent;
+    HLSContext *c        = s->priv_data;
+    struct segment seg   = { .url_offset = ps->url_offset,
+                             .size       = ps->size,
+                             .url        = ps->url };
+    AVDictionary *opts = NULL;
+    int ret;
+
+    av_log(s, AV_LOG_VERBOSE, "HLS prefetch for url '%s', offset %"PRId64", playlist %d\n",
+           ps->url, ps->url_offset, pls->index);
+    set_segment_request_opts(c, &seg, &opts);
+    ret = open_segment_url(s, in, ps->url, &seg, avio_opts, opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+static int prefetch_fetch_playlist(struct playlist *pls, char **data, char **url)
+{
+    AVFormatContext *s = pls->parent;
+    AVIOContext *in = NULL;
+    AVDictionary *opts = NULL;
+    AVBPrint bp;
+    int ret;
+
+    av_dict_copy(&opts, pls->prefetch.opts, 0);
+    ret = s->io_open(s, &in, pls->url, AVIO_FLAG_READ, &opts);
+    av_dict_free(&opts);
+    if (ret < 0)
+        return ret;
+
+    if (av_opt_get(in, "location", AV_OPT_SEARCH_CHILDREN, (uint8_t **)url) < 0)
+        *url = NULL;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    ret = avio_read_to_bprint(in, &bp, INT_MAX);
+    ff_format_io_close(s, &in);
+    if (ret >= 0) {
+        ret = bp.len;
+        if (av_bprint_finalize(&bp, data) < 0)
+            ret = AVERROR(ENOMEM);
+    } else {
+        av_bprint_finalize(&bp, NULL);
+    }
+    if (ret < 0)
+        av_freep(url);
+    return ret;
+}
+
+static void prefetch_reload_playlist(void *opaque, int64_t reload_time)
+{
+    struct playlist *pls = opaque;
+    char *data = NULL, *url = NULL;
+    int ret = prefetch_fetch_playlist(pls, &data, &url);
+
+    pthread_mutex_lock(&pls->prefetch.mutex);
+    /* keep the result unless the playlist was reloaded meanwhile */
+    if (pls->prefetch.reload_time == reload_time) {
+        if (ret >= 0) {
+            av_free(pls->reload_data);
+            av_free(pls->reload_url);
+            pls->reload_data = data;
+            pls->reload_size = ret;
+            pls->reload_url  = url;
+            data = url = NULL;
+        } else if (ret != AVERROR_EXIT) {
+            av_log(pls->parent, AV_LOG_WARNING, "Failed to prefetch playlist %d\n",
+                   pls->index);
+        }
+    }
+    pthread_mutex_unlock(&pls->prefetch.mutex);
+    av_free(data);
+    av_free(url);
+}
+
+static void prefetch_schedule_reload(struct playlist *pls)
+{
+    if (!pls->prefetch.started)
+        return;
+
+    pthread_mutex_lock(&pls->prefetch.mutex);
+    pls->prefetch.reload_interval = default_reload_interval(pls);
+    pls->prefetch.reload_time     = pls->finished ? 0 :
+                                    pls->last_load_time + pls->prefetch.reload_interval;
+    av_freep(&pls->reload_data);
+    av_freep(&pls->reload_url);
+    pthread_cond_signal(&pls->prefetch.cond_background);
+    pthread_mutex_unlock(&pls->prefetch.mutex);
+}
+
+/*
+ * Queue the current segment and the following ones for download by the
+ * prefetch thread. Returns 1 if the current segment is then read from memory.
+ */
+static int prefetch_open(HLSContext *c, struct playlist *pls)
+{
+    SegmentPrefetch *p = &pls->prefetch;
+    int64_t seq_no;
+    int i, ret;
+
+    if (!c->prefetch_segments)
+        return 0;
+
+    if (!p->started) {
+        p->s           = pls->parent;
+        p->opaque      = pls;
+        p->thread_name = "hls-prefetch";
+        p->open        = prefetch_open_segment;
+        p->reload      = prefetch_reload_playlist;
+        p->buffer_size = c->prefetch_buffer_size;
+        p->keep_alive  = c->http_persistent;
+        ret = ff_segment_prefetch_start(p, c->avio_opts);
+        if (ret < 0) {
+            av_log(pls->parent, AV_LOG_WARNING,
+                   "Unable to start prefetching, reading segments on demand: %s\n",
+                   av_err2str(ret));
+            c->prefetch_segments = 0;
+            return 0;
+        }
+        prefetch_schedule_reload(pls);
+    }
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->nb_segs && p->segs[0]->seq_no < pls->cur_seq_no)
+        ff_segment_prefetch_remove(p, 0);
+    for (i = 0; i < p->nb_segs && prefetch_matches(pls, i); i++)
+        ;
+    while (p->nb_segs > i)
+        ff_segment_prefetch_remove(p, p->nb_segs - 1);
+
+    for (seq_no = pls->cur_seq_no + p->nb_segs;
+         seq_no <= pls->cur_seq_no + c->prefetch_segments; seq_no++) {
+        int64_t n = seq_no - pls->start_seq_no;
+        const struct segment *seg = n < pls->n_segments ? pls->segments[n] : NULL;
+        /* encrypted segments are read on demand, as the key is
+         * loaded when opening them */
+        if (!seg || seg->key_type != KEY_NONE ||
+            ff_segment_prefetch_add(p, seq_no, seg->url, seg->url_offset, seg->size) < 0)
+            break;
+    }
+
+    ret = ff_segment_prefetch_set_current(p, pls->cur_seq_no);
+    pthread_mutex_unlock(&p->mutex);
+
+    return ret;
+}
+
+static int prefetch_read(struct playlist *pls, uint8_t *buf, int buf_size)
+{
+    int ret = ff_segment_prefetch_read(&pls->prefetch, buf, buf_size);
+
+    if (ret > 0)
+        pls->cur_seg_offset += ret;
+    return ret;
+}
+
+/* Done with the current segment */
+static void prefetch_release(struct playlist *pls)
+{
+    ff_segment_prefetch_release(&pls->prefetch);
+}
+
+static void prefetch_flush(struct playlist *pls)
+{
+    ff_segment_prefetch_flush(&pls->prefetch);
+}
+
+/*
+ * Reload the playlist from the copy downloaded by the prefetch thread.
+ * Returns 0 if there is none.
+ */
+static int prefetch_reload(HLSContext *c, struct playlist *pls)
+{
+    FFIOContext pb;
+    char *data, *url;
+    int size, ret;
+
+    if (!pls->prefetch.started)
+        return 0;
+
+    pthread_mutex_lock(&pls->prefetch.mutex);
+    data = pls->reload_data;
+    size = pls->reload_size;
+    url  = pls->reload_url;
+    pls->reload_data = NULL;
+    pls->reload_url  = NULL;
+    pthread_mutex_unlock(&pls->prefetch.mutex);
+
+    if (!data)
+        return 0;
+
+    ffio_init_context(&pb, data, size, 0, NULL, NULL, NULL, NULL);
+    ret = parse_playlist(c, url ? url : pls->url, pls, &pb.pub);
+    av_free(data);
+    av_free(url);
+
+    return ret < 0 ? ret : 1;
+}
+#else
+static void prefetch_schedule_reload(struct playlist *pls) { }
+static int prefetch_open(HLSContext *c, struct playlist *pls) { return 0; }
+static int prefetch_read(struct playlist *pls, uint8_t *buf, int buf_size)
+{
+    return AVERROR_BUG;
+}
+static void prefetch_release(struct playlist *pls) { }
+static void prefetch_flush(struct playlist *pls) { }
+static int prefetch_reload(HLSContext *c, struct playlist *pls) { return 0; }
+#endif
+
 static int read_data(void *opaque, uint8_t *buf, int buf_size)
 {
     struct playlist *v = opaque;
@@ -1478,7 +1757,8 @@ restart:
     if (!v->needed)
         return AVERROR_EOF;
 
-    if (!v->input || (c->http_persistent && v->input_read_done)) {
+    if (!v->prefetch.cur &&
+        (!v->input || (c->http_persistent && v->input_read_done))) {
         int64_t reload_interval;
 
         /* Check that the playlist is still needed before opening a new
@@ -1486,6 +1766,7 @@ restart:
         v->needed = playlist_needed(v);
 
         if (!v->needed) {
+            prefetch_flush(v);
             av_log(v->parent, AV_LOG_INFO, "No longer receiving playlist %d ('%s')\n",
                    v->index, v->url);
             return AVERROR_EOF;
@@ -1501,12 +1782,15 @@ reload:
             return AVERROR_EOF;
         if (!v->finished &&
             av_gettime_relative() - v->last_load_time >= reload_interval) {
-            if ((ret = parse_playlist(c, v->url, v, NULL)) < 0) {
+            if (!(ret = prefetch_reload(c, v)))
+                ret = parse_playlist(c, v->url, v, NULL);
+            if (ret < 0) {
                 if (ret != AVERROR_EXIT)
                     av_log(v->parent, AV_LOG_WARNING, "Failed to reload playlist %d\n",
                            v->index);
                 return ret;
             }
+            prefetch_schedule_reload(v);
             /* If we need to reload the playlist again below (if
              * there's still no more segments), switch to a reload
              * interval of half the target duration. */
@@ -1549,7 +1833,15 @@ reload:
         if (ret)
             return ret;
 
-        if (c->http_multiple == 1 && v->input_next_requested) {
+        if (prefetch_open(c, v) > 0) {
+            /* connections kept open for on-demand reading are not needed
+             * while the segment is read from memory */
+            ff_format_io_close(v->parent, &v->input);
+            ff_format_io_close(v->parent, &v->input_next);
+            v->input_next_requested = 0;
+            v->cur_seg_offset = 0;
+            ret = 0;
+        } else if (c->http_multiple == 1 && v->input_next_requested) {
             FFSWAP(AVIOContext *, v->input, v->input_next);
             v->cur_seg_offset = 0;
             v->input_next_requested = 0;
@@ -1569,7 +1861,7 @@ reload:
         just_opened = 1;
     }
 
-    if (c->http_multiple == -1) {
+    if (c->http_multiple == -1 && v->input) {
         uint8_t *http_version_opt = NULL;
         int r = av_opt_get(v->input, "http_version", AV_OPT_SEARCH_CHILDREN, &http_version_opt);
         if (r >= 0) {
@@ -1579,7 +1871,7 @@ reload:
     }
 
     seg = next_segment(v);
-    if (c->http_multiple == 1 && !v->input_next_requested &&
+    if (c->http_multiple == 1 && !v->input_next_requested && !v->prefetch.cur &&
         seg && seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         ret = open_input(c, v, seg, &v->input_next);
         if (ret < 0) {
@@ -1602,7 +1894,10 @@ reload:
     }
 
     seg = current_segment(v);
-    ret = read_from_url(v, seg, buf, buf_size);
+    if (v->prefetch.cur)
+        ret = prefetch_read(v, buf, buf_size);
+    else
+        ret = read_from_url(v, seg, buf, buf_size);
     if (ret > 0) {
         if (just_opened && v->is_id3_timestamped != 0) {
             /* Intercept ID3 tags here, elementary audio streams are required
@@ -1612,7 +1907,9 @@ reload:
 
         return ret;
     }
-    if (c->http_persistent &&
+    if (v->prefetch.cur) {
+        prefetch_release(v);
+    } else if (c->http_persistent &&
         seg->key_type == KEY_NONE && av_strstart(seg->url, "http", NULL)) {
         v->input_read_done = 1;
     } else {
@@ -1716,9 +2013,11 @@ static int64_t select_cur_seq_no(HLSContext *c, struct playlist *pls)
     int64_t seq_no;
 
     if (!pls->finished && !c->first_packet &&
-        av_gettime_relative() - pls->last_load_time >= default_reload_interval(pls))
+        av_gettime_relative() - pls->last_load_time >= default_reload_interval(pls)) {
         /* reload the playlist since it was suspended */
-        parse_playlist(c, pls->url, pls, NULL);
+        if (parse_playlist(c, pls->url, pls, NULL) >= 0)
+            prefetch_schedule_reload(pls);
+    }
 
     /* If playback is already in progress (we are just selecting a new
      * playlist) and this is a complete file, find the matching segment
@@ -2484,6 +2783,7 @@ static int hls_read_seek(AVFormatContext *s, int stream_index,
         pls->input_read_done = 0;
         ff_format_io_close(pls->parent, &pls->input_next);
         pls->input_next_requested = 0;
+        prefetch_flush(pls);
         av_packet_unref(pls->pkt);
         pb->eof_reached = 0;
         /* Clear any buffered data */
@@ -2547,6 +2847,10 @@ static const AVOption hls_options[] = {
         OFFSET(http_multiple), AV_OPT_TYPE_BOOL, {.i64 = -1}, -1, 1, FLAGS},
     {"http_seekable", "Use HTTP partial requests, 0 = disable, 1 = enable, -1 = auto",
         OFFSET(http_seekable), AV_OPT_TYPE_BOOL, { .i64 = -1}, -1, 1, FLAGS},
+    {"prefetch_segments", "Number of segments to download in the background ahead of the one being read",
+        OFFSET(prefetch_segments), AV_OPT_TYPE_INT, {.i64 = 0}, 0, INT_MAX, FLAGS},
+    {"prefetch_buffer_size", "Maximum amount of prefetched data buffered per playlist",
+        OFFSET(prefetch_buffer_size), AV_OPT_TYPE_INT64, {.i64 = 32 * 1024 * 1024}, 1, INT64_MAX, FLAGS},
     {"seg_format_options", "Set options for segment demuxer",
         OFFSET(seg_format_opts), AV_OPT_TYPE_DICT, {.str = NULL}, 0, 0, FLAGS},
     {NULL}
@@ -46,6 +46,7 @@
 #include "libavcodec/avcodec.h"
 
 #include "avformat.h"
+#include "asyncwriter.h"
 #include "avio_internal.h"
 #include "avc.h"
 #if CONFIG_HTTP_PROTOCOL
@@ -255,6 +256,10 @@ typedef struct HLSContext {
     int64_t timeout;
     int ignore_io_errors;
     char *headers;
+    int async_io;
+    int async_io_queue_size;
+    int async_io_retries;
+    FFAsyncWriter *writer; /* performs all output in the background if async_io is set */
     int has_default_key; /* has DEFAULT field of var_stream_map */
     int has_video_m3u8; /* has video stream m3u8 list */
 } HLSContext;
@@ -288,6 +293,8 @@ static int hlsenc_io_open(AVFormatContext *s, AVIOContext **pb, const char *file
     HLSContext *hls = s->priv_data;
     int http_base_proto = filename ? ff_is_http_proto(filename) : 0;
     int err = AVERROR_MUXER_NOT_FOUND;
+    if (hls->writer)
+        return ff_async_writer_open(hls->writer, pb, filename, options);
     if (!*pb || !http_base_proto || !hls->http_persistent) {
         err = s->io_open(s, pb, filename, AVIO_FLAG_WRITE, options);
 #if CONFIG_HTTP_PROTOCOL
@@ -310,6 +317,11 @@ static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
     int ret = 0;
     if (!*pb)
         return ret;
+    if (hls->writer) {
+        /* upload failures are reported through ff_async_writer_error() */
+        ret = ff_async_writer_close(hls->writer, pb);
+        return ret == AVERROR(ENOMEM) ? ret : 0;
+    }
     if (!http_base_proto || !hls->http_persistent || hls->key_info_file || hls->encrypt) {
         ff_format_io_close(s, pb);
 #if CONFIG_HTTP_PROTOCOL
@@ -323,6 +335,15 @@ static int hlsenc_io_close(AVFormatContext *s, AVIOContext **pb, char *filename)
     return ret;
 }
 
+static int hlsenc_rename(AVFormatContext *s, const char *oldpath, const char *newpath)
+{
+    HLSContext *hls = s->priv_data;
+
+    if (hls->writer)
+        return ff_async_writer_rename(hls->writer, oldpath, newpath);
+    return ff_rename(oldpath, newpath, s);
+}
+
 static void set_http_options(AVFormatContext *s, AVDictionary **options, HLSContext *c)
 {
     int http_base_proto = ff_is_http_proto(s->url);
@@ -573,11 +594,18 @@ static int hls_delete_file(HLSContext *hls, AVFormatContext *avf,
         int ret;
         set_http_options(avf, &opt, hls);
         av_dict_set(&opt, "method", "DELETE", 0);
+        if (hls->writer) {
+            ret = ff_async_writer_delete(hls->writer, path, &opt);
+            av_dict_free(&opt);
+            return ret;
+        }
         ret = avf->io_open(avf, &out, path, AVIO_FLAG_WRITE, &opt);
         av_dict_free(&opt);
         if (ret < 0)
             return hls->ignore_io_errors ? 1 : ret;
         ff_format_io_close(avf, &out);
+    } else if (hls->writer) {
+        return ff_async_writer_delete(hls->writer, path, NULL);
     } else if (unlink(path) < 0) {
         av_log(hls, AV_LOG_ERROR, "failed to delete old segment %s: %s\n",
                path, strerror(errno));
@@ -1051,10 +1079,11 @@ static int sls_flag_check_duration_size(HLSContext *hls, VariantStream *vs)
     return ret;
 }
 
-static void sls_flag_file_rename(HLSContext *hls, VariantStream *vs, char *old_filename) {
+static void sls_flag_file_rename(AVFormatContext *s, VariantStream *vs, char *old_filename) {
+    HLSContext *hls = s->priv_data;
     if ((hls->flags & (HLS_SECOND_LEVEL_SEGMENT_SIZE | HLS_SECOND_LEVEL_SEGMENT_DURATION)) &&
         strlen(vs->current_segment_final_filename_fmt)) {
-        ff_rename(old_filename, vs->avf->url, hls);
+        hlsenc_rename(s, old_filename, vs->avf->url);
     }
 }
 
@@ -1324,7 +1353,7 @@ static int hls_rename_temp_file(AVFormatContext *s, AVFormatContext *oc)
     if (!final_filename)
         return AVERROR(ENOMEM);
     final_filename[len-4] = '\0';
-    ret = ff_rename(oc->url, final_filename, s);
+    ret = hlsenc_rename(s, oc->url, final_filename);
     oc->url[len-4] = '\0';
     av_freep(&final_filename);
     return ret;
@@ -1527,7 +1556,7 @@ fail:
         hls->master_m3u8_created = 1;
     hlsenc_io_close(s, &hls->m3u8_out, temp_filename);
     if (use_temp_file)
-        ff_rename(temp_filename, hls->master_m3u8_url, s);
+        hlsenc_rename(s, temp_filename, hls->master_m3u8_url);
 
     return ret;
 }
@@ -1664,9 +1693,9 @@ fail:
     }
     hlsenc_io_close(s, &hls->sub_m3u8_out, vs->vtt_m3u8_name);
     if (use_temp_file) {
-        ff_rename(temp_filename, vs->m3u8_name, s);
+        hlsenc_rename(s, temp_filename, vs->m3u8_name);
         if (vs->vtt_m3u8_name)
-            ff_rename(temp_vtt_filename, vs->vtt_m3u8_name, s);
+            hlsenc_rename(s, temp_vtt_filename, vs->vtt_m3u8_name);
     }
     if (ret >= 0 && hls->master_pl_name)
         if (create_master_playlist(s, vs) < 0)
@@ -2418,6 +2447,10 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
     VariantStream *vs = NULL;
     char *old_filename = NULL;
 
+    if (hls->writer && !hls->ignore_io_errors &&
+        (ret = ff_async_writer_error(hls->writer)) < 0)
+        return ret;
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
         for (j = 0; j < vs->nb_streams; j++) {
@@ -2643,7 +2676,7 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
         } else if (hls->max_seg_size > 0) {
             if (vs->size + vs->start_pos >= hls->max_seg_size) {
                 vs->sequence++;
-                sls_flag_file_rename(hls, vs, old_filename);
+                sls_flag_file_rename(s, vs, old_filename);
                 ret = hls_start(s, vs);
                 vs->start_pos = 0;
                 /* When split segment by byte, the duration is short than hls_time,
@@ -2653,7 +2686,7 @@ static int hls_write_packet(AVFormatContext *s, AVPacket *pkt)
             }
         } else {
             vs->start_pos = new_start_pos;
-            sls_flag_file_rename(hls, vs, old_filename);
+            sls_flag_file_rename(s, vs, old_filename);
             ret = hls_start(s, vs);
         }
         vs->number++;
@@ -2686,6 +2719,8 @@ static void hls_deinit(AVFormatContext *s)
     int i = 0;
     VariantStream *vs = NULL;
 
+    ff_async_writer_free(&hls->writer);
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -2765,7 +2800,8 @@ static int hls_write_trailer(struct AVFormatContext *s)
                 vs->start_pos = range_length;
                 byterange_mode = (hls->flags & HLS_SINGLE_FILE) || (hls->max_seg_size > 0);
                 if (!byterange_mode) {
-                    ff_format_io_close(s, &vs->out);
+                    if (!hls->writer)
+                        ff_format_io_close(s, &vs->out);
                     hlsenc_io_close(s, &vs->out, vs->base_output_dirname);
                 }
             }
@@ -2829,13 +2865,16 @@ failed:
         /* after av_write_trailer, then duration + 1 duration per packet */
         hls_append_segment(s, hls, vs, vs->duration + vs->dpp, vs->start_pos, vs->size);
 
-        sls_flag_file_rename(hls, vs, old_filename);
+        sls_flag_file_rename(s, vs, old_filename);
 
         if (vtt_oc) {
             if (vtt_oc->pb)
                 av_write_trailer(vtt_oc);
             vs->size = avio_tell(vs->vtt_avf->pb) - vs->start_pos;
-            ff_format_io_close(s, &vtt_oc->pb);
+            if (hls->writer)
+                hlsenc_io_close(s, &vtt_oc->pb, vtt_oc->url);
+            else
+                ff_format_io_close(s, &vtt_oc->pb);
         }
         ret = hls_window(s, 1, vs);
         if (ret < 0) {
@@ -2848,6 +2887,12 @@ failed:
         av_free(old_filename);
     }
 
+    if (hls->writer) {
+        ret = ff_async_writer_flush(hls->writer);
+        if (ret < 0 && !hls->ignore_io_errors)
+            return ret;
+    }
+
     return 0;
 }
 
@@ -2948,6 +2993,21 @@ static int hls_init(AVFormatContext *s)
                "enabled together. Disabling 'independent_segments' flag\n");
     }
 
+    if (hls->async_io) {
+        if ((hls->flags & HLS_SINGLE_FILE) || hls->max_seg_size > 0) {
+            av_log(s, AV_LOG_WARNING, "async_io is not supported in byterange mode, "
+                   "writing synchronously\n");
+        } else {
+            ret = ff_async_writer_alloc(&hls->writer, s, hls->async_io_queue_size,
+                                        hls->async_io_retries, hls->http_persistent);
+            if (ret == AVERROR(ENOSYS))
+                av_log(s, AV_LOG_WARNING, "async_io requires thread support, "
+                       "writing synchronously\n");
+            else if (ret < 0)
+                return ret;
+        }
+    }
+
     for (i = 0; i < hls->nb_varstreams; i++) {
         vs = &hls->var_streams[i];
 
@@ -3167,6 +3227,9 @@ static const AVOption options[] = {
     {"timeout", "set timeout for socket I/O operations", OFFSET(timeout), AV_OPT_TYPE_DURATION, { .i64 = -1 }, -1, INT_MAX, .flags = E },
     {"ignore_io_errors", "Ignore IO errors for stable long-duration runs with network output", OFFSET(ignore_io_errors), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
     {"headers", "set custom HTTP headers, can override built in default headers", OFFSET(headers), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
+    {"async_io", "Write segments and playlists from a background thread", OFFSET(async_io), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, E },
+    {"async_io_queue_size", "Maximum number of pending background writes", OFFSET(async_io_queue_size), AV_OPT_TYPE_INT, { .i64 = 32 }, 1, INT_MAX, E },
+    {"async_io_retries", "Number of times a failed background write is retried", OFFSET(async_io_retries), AV_OPT_TYPE_INT, { .i64 = 3 }, 0, INT_MAX, E },
     { NULL },
 };
 
@@ -25,12 +25,14 @@
 #if CONFIG_ZLIB
 #include <zlib.h>
 #endif /* CONFIG_ZLIB */
+#include <stdatomic.h>
 
 #include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
 #include "libavutil/bprint.h"
 #include "libavutil/getenv_utf8.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 #include "libavutil/time.h"
 #include "libavutil/parseutils.h"
 
@@ -80,6 +82,8 @@ typedef struct HTTPContext {
     char *http_proxy;
     char *headers;
     char *mime_type;
+    char *etag;
+    char *last_modified;
     char *http_version;
     char *user_agent;
     char *referer;
@@ -136,6 +140,11 @@ typedef struct HTTPContext {
     char *new_location;
     AVDictionary *redirect_cache;
     uint64_t filesize_from_content_range;
+    int parallel_connections;
+    int parallel_chunk_size;
+#if HAVE_THREADS
+    struct HTTPParallel *par;
+#endif
 } HTTPContext;
 
 #define OFFSET(x) offsetof(HTTPContext, x)
@@ -154,6 +163,8 @@ static const AVOption options[] = {
     { "multiple_requests", "use persistent connections", OFFSET(multiple_requests), AV_OPT_TYPE_BOOL, { .i64 = 0 }, 0, 1, D | E },
     { "post_data", "set custom HTTP post data", OFFSET(post_data), AV_OPT_TYPE_BINARY, .flags = D | E },
     { "mime_type", "export the MIME type", OFFSET(mime_type), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "etag", "export the entity tag of the resource", OFFSET(etag), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+    { "last_modified", "export the last modification date of the resource", OFFSET(last_modified), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "http_version", "export the http response version", OFFSET(http_version), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
     { "cookies", "set cookies to be sent in applicable future requests, use newline delimited Set-Cookie HTTP field value syntax", OFFSET(cookies), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, D },
     { "icy", "request ICY metadata", OFFSET(icy), AV_OPT_TYPE_BOOL, { .i64 = 1 }, 0, 1, D },
@@ -177,6 +188,8 @@ static const AVOption options[] = {
     { "listen", "listen on HTTP", OFFSET(listen), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 2, D | E },
     { "resource", "The resource requested by a client", OFFSET(resource), AV_OPT_TYPE_STRING, { .str = NULL }, 0, 0, E },
     { "reply_code", "The http status code to return to a client", OFFSET(reply_code), AV_OPT_TYPE_INT, { .i64 = 200}, INT_MIN, 599, E},
+    { "parallel_connections", "split sequential reads into range requests over this many connections", OFFSET(parallel_connections), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, 64, D },
+    { "parallel_chunk_size", "size of the range requests of parallel_connections", OFFSET(parallel_chunk_size), AV_OPT_TYPE_INT, { .i64 = 4 << 20 }, 65536, INT_MAX, D },
     { "short_seek_size", "Threshold to favor readahead over seek.", OFFSET(short_seek_size), AV_OPT_TYPE_INT, { .i64 = 0 }, 0, INT_MAX, D },
     { NULL }
 };
@@ -1206,6 +1219,12 @@ static int process_line(URLContext *h, char *line, int line_count)
         } else if (!av_strcasecmp(tag, "Content-Type")) {
             av_free(s->mime_type);
             s->mime_type = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "ETag")) {
+            av_free(s->etag);
+            s->etag = av_strdup(p);
+        } else if (!av_strcasecmp(tag, "Last-Modified")) {
+            av_free(s->last_modified);
+            s->last_modified = av_strdup(p);
         } else if (!av_strcasecmp(tag, "Set-Cookie")) {
             if (parse_cookie(s, p, &s->cookie_dict))
                 av_log(h, AV_LOG_WARNING, "Unable to parse '%s'\n", p);
@@ -1333,6 +1352,8 @@ static int http_read_header(URLContext *h)
     int err = 0;
 
     av_freep(&s->new_location);
+    av_freep(&s->etag);
+    av_freep(&s->last_modified);
     s->expires = 0;
     s->chunksize = UINT64_MAX;
     s->filesize_from_content_range = UINT64_MAX;
@@ -1799,10 +1820,416 @@ static int store_icy(URLContext *h, int size)
     return FFMIN(size, remaining);
 }
 
+#if HAVE_THREADS
+enum HTTPChunkState {
+    CHUNK_FREE,
+    CHUNK_FETCHING,
+    CHUNK_DONE,
+    CHUNK_ERROR,
+};
+
+typedef struct HTTPChunk {
+    uint8_t *buf;
+    unsigned gen;       ///< generation the chunk was requested in
+    int64_t index;      ///< index of the chunk within its generation
+    int size;
+    int filled;
+    int error;
+    enum HTTPChunkState state;
+} HTTPChunk;
+
+typedef struct HTTPWorker {
+    struct HTTPParallel *par;
+    URLContext *conn;
+    pthread_t thread;
+} HTTPWorker;
+
+/**
+ * Sequential reads split into range requests of chunk_size bytes, fetched
+ * by one worker thread per connection. Chunk i of the current generation
+ * starts at base + i * chunk_size and is stored in chunks[i % nb_chunks],
+ * so at most nb_chunks chunks are in flight or waiting to be read. Seeking
+ * outside of them starts a new generation.
+ */
+typedef struct HTTPParallel {
+    URLContext *h;
+    char *url;
+    AVDictionary *opts;         ///< options of the worker connections
+    HTTPWorker *workers;
+    int nb_workers;
+    HTTPChunk *chunks;
+    int nb_chunks;
+    int chunk_size;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    atomic_int abort;
+
+    unsigned gen;
+    int64_t base;
+    int64_t end;
+    int64_t next_fetch;         ///< index of the next chunk to request
+    int64_t read_chunk;         ///< index of the chunk being read
+    int read_off;               ///< read position within read_chunk
+} HTTPParallel;
+
+static int parallel_interrupt(void *opaque)
+{
+    HTTPParallel *p = opaque;
+    return atomic_load(&p->abort) || ff_check_interrupt(&p->h->interrupt_callback);
+}
+
+static int parallel_request(HTTPWorker *w, int64_t start, int64_t end)
+{
+    HTTPParallel *p = w->par;
+    AVIOInterruptCB int_cb = { parallel_interrupt, p };
+    AVDictionary *opts = NULL;
+    HTTPContext *cs;
+    int ret;
+
+    if (w->conn) {
+        /* send the next request on the keep-alive connection, if the
+         * server did not close it */
+        av_dict_set_int(&opts, "offset",     start, 0);
+        av_dict_set_int(&opts, "end_offset", end,   0);
+        ret = ff_http_do_new_request2(w->conn, p->url, &opts);
+        av_dict_free(&opts);
+        if (ret < 0)
+            ffurl_closep(&w->conn);
+    }
+    if (!w->conn) {
+        av_dict_copy(&opts, p->opts, 0);
+        av_dict_set_int(&opts, "offset",     start, 0);
+        av_dict_set_int(&opts, "end_offset", end,   0);
+        ret = ffurl_open_whitelist(&w->conn, p->url, AVIO_FLAG_READ, &int_cb,
+                                   &opts, p->h->protocol_whitelist,
+                                   p->h->protocol_blacklist, p->h);
+        av_dict_free(&opts);
+        if (ret < 0)
+            return ret;
+        ff_http_init_auth_state(w->conn, p->h);
+    }
+
+    cs = w->conn->priv_data;
+    if (cs->http_code != 206 || cs->off != start) {
+        av_log(p->h, AV_LOG_WARNING, "Range request for %"PRId64"-%"PRId64" failed\n",
+               start, end - 1);
+        ffurl_closep(&w->conn);
+        return AVERROR(ENOSYS);
+    }
+    return 0;
+}
+
+/**
+ * Fetch a chunk, making its data available to the reader as it arrives.
+ * Return 1 if the chunk became stale because of a seek.
+ */
+static int parallel_fetch(HTTPWorker *w, HTTPChunk *c, int64_t start, unsigned gen)
+{
+    HTTPParallel *p = w->par;
+    int ret = 0, stale;
+
+    if (!c->buf && !(c->buf = av_malloc(p->chunk_size)))
+        return AVERROR(ENOMEM);
+
+    for (int attempt = 0; attempt < 2 && c->filled < c->size; attempt++) {
+        if ((ret = parallel_request(w, start + c->filled, start + c->size)) < 0)
+            continue;
+        while (c->filled < c->size) {
+            ret = ffurl_read(w->conn, c->buf + c->filled, c->size - c->filled);
+            if (ret <= 0) {
+                ret = ret ? ret : AVERROR_EOF;
+                ffurl_closep(&w->conn);
+                break;
+            }
+            pthread_mutex_lock(&p->mutex);
+            c->filled += ret;
+            stale = gen != p->gen;
+            pthread_cond_broadcast(&p->cond);
+            pthread_mutex_unlock(&p->mutex);
+            if (stale) {
+                /* drop the rest of the response */
+                ffurl_closep(&w->conn);
+                return 1;
+            }
+        }
+        if (ret == AVERROR_EXIT)
+            break;
+    }
+    return c->filled == c->size ? 0 : ret;
+}
+
+static void *parallel_worker(void *arg)
+{
+    HTTPWorker *w = arg;
+    HTTPParallel *p = w->par;
+
+    ff_thread_setname("http-range");
+
+    pthread_mutex_lock(&p->mutex);
+    while (!atomic_load(&p->abort)) {
+        HTTPChunk *c = &p->chunks[p->next_fetch % p->nb_chunks];
+        int64_t start = p->base + p->next_fetch * p->chunk_size;
+        unsigned gen = p->gen;
+        int ret;
+
+        /* the slot may still be used by a stale request */
+        if (start >= p->end || c->state == CHUNK_FETCHING ||
+            p->next_fetch >= p->read_chunk + p->nb_chunks) {
+            pthread_cond_wait(&p->cond, &p->mutex);
+            continue;
+        }
+
+        c->gen    = gen;
+        c->index  = p->next_fetch++;
+        c->size   = FFMIN(p->chunk_size, p->end - start);
+        c->filled = 0;
+        c->state  = CHUNK_FETCHING;
+        pthread_mutex_unlock(&p->mutex);
+
+        ret = parallel_fetch(w, c, start, gen);
+
+        pthread_mutex_lock(&p->mutex);
+        c->state = ret < 0 ? CHUNK_ERROR : CHUNK_DONE;
+        c->error = ret;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    ffurl_closep(&w->conn);
+    return NULL;
+}
+
+static void parallel_stop(HTTPContext *s)
+{
+    HTTPParallel *p = s->par;
+
+    if (!p)
+        return;
+
+    atomic_store(&p->abort, 1);
+    pthread_mutex_lock(&p->mutex);
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+    for (int i = 0; i < p->nb_workers; i++)
+        pthread_join(p->workers[i].thread, NULL);
+
+    for (int i = 0; i < p->nb_chunks; i++)
+        av_freep(&p->chunks[i].buf);
+    av_freep(&p->chunks);
+    av_freep(&p->workers);
+    av_dict_free(&p->opts);
+    av_freep(&p->url);
+    pthread_cond_destroy(&p->cond);
+    pthread_mutex_destroy(&p->mutex);
+    av_freep(&s->par);
+}
+
+static int parallel_start(URLContext *h)
+{
+    static const char *const copy_opts[] = {
+        "headers", "user_agent", "referer", "cookies", "http_proxy",
+        "auth_type", "send_expect_100", "reconnect",
+        "reconnect_on_network_error", "reconnect_on_http_error",
+        "reconnect_delay_max", NULL
+    };
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p;
+    int ret;
+
+    if (!(p = av_mallocz(sizeof(*p))))
+        return AVERROR(ENOMEM);
+    if ((ret = pthread_mutex_init(&p->mutex, NULL))) {
+        av_free(p);
+        return AVERROR(ret);
+    }
+    if ((ret = pthread_cond_init(&p->cond, NULL))) {
+        pthread_mutex_destroy(&p->mutex);
+        av_free(p);
+        return AVERROR(ret);
+    }
+    s->par = p;
+
+    p->h          = h;
+    p->nb_workers = s->parallel_connections;
+    p->nb_chunks  = 2 * p->nb_workers;
+    p->chunk_size = s->parallel_chunk_size;
+    p->base       = s->off;
+    p->end        = s->end_off ? FFMIN(s->end_off, s->filesize) : s->filesize;
+    atomic_init(&p->abort, 0);
+
+    p->url     = av_strdup(s->location);
+    p->workers = av_calloc(p->nb_workers, sizeof(*p->workers));
+    p->chunks  = av_calloc(p->nb_chunks,  sizeof(*p->chunks));
+    if (!p->url || !p->workers || !p->chunks) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    av_dict_copy(&p->opts, s->chained_options, 0);
+    for (int i = 0; copy_opts[i]; i++) {
+        uint8_t *val = NULL;
+        if (av_opt_get(s, copy_opts[i], 0, &val) >= 0 && val && *val)
+            av_dict_set(&p->opts, copy_opts[i], val, AV_DICT_DONT_STRDUP_VAL);
+        else
+            av_free(val);
+    }
+    av_dict_set(&p->opts, "multiple_requests", "1", 0);
+    av_dict_set(&p->opts, "icy", "0", 0);
+    if (h->rw_timeout > 0)
+        av_dict_set_int(&p->opts, "rw_timeout", h->rw_timeout, 0);
+
+    for (int i = 0; i < p->nb_workers; i++) {
+        p->workers[i].par = p;
+        if ((ret = pthread_create(&p->workers[i].thread, NULL, parallel_worker,
+                                  &p->workers[i]))) {
+            p->nb_workers = i;
+            ret = AVERROR(ret);
+            goto fail;
+        }
+    }
+
+    /* the data is fetched by the workers from now on */
+    ffurl_closep(&s->hd);
+    s->buf_ptr = s->buf_end = s->buffer;
+    av_log(h, AV_LOG_VERBOSE, "Fetching with %d connections from %"PRIu64"\n",
+           p->nb_workers, s->off);
+    return 0;
+fail:
+    parallel_stop(s);
+    return ret;
+}
+
+static int parallel_read(URLContext *h, uint8_t *buf, int size)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p = s->par;
+    HTTPChunk *c = &p->chunks[p->read_chunk % p->nb_chunks];
+    int ret = 0, avail;
+
+    pthread_mutex_lock(&p->mutex);
+    if (p->base + p->read_chunk * p->chunk_size >= p->end) {
+        pthread_mutex_unlock(&p->mutex);
+        return AVERROR_EOF;
+    }
+    while (c->gen != p->gen || c->index != p->read_chunk ||
+           c->state == CHUNK_FREE ||
+           (c->state == CHUNK_FETCHING && c->filled <= p->read_off))
+        pthread_cond_wait(&p->cond, &p->mutex);
+    avail = c->filled - p->read_off;
+    if (avail <= 0)
+        ret = c->error;
+    pthread_mutex_unlock(&p->mutex);
+    if (ret < 0)
+        return ret;
+
+    /* the worker only writes after the avail bytes seen under the lock */
+    size = FFMIN(size, avail);
+    memcpy(buf, c->buf + p->read_off, size);
+
+    pthread_mutex_lock(&p->mutex);
+    p->read_off += size;
+    if (p->read_off == c->size) {
+        p->read_chunk++;
+        p->read_off = 0;
+        pthread_cond_broadcast(&p->cond);
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    s->off += size;
+    return size;
+}
+
+static int64_t parallel_seek(URLContext *h, int64_t off, int whence)
+{
+    HTTPContext *s = h->priv_data;
+    HTTPParallel *p = s->par;
+    int64_t chunk;
+
+    if (whence == AVSEEK_SIZE)
+        return s->filesize;
+    if (whence == SEEK_CUR)
+        off += s->off;
+    else if (whence == SEEK_END)
+        off += s->filesize;
+    else if (whence != SEEK_SET)
+        return AVERROR(EINVAL);
+    if (off < 0)
+        return AVERROR(EINVAL);
+
+    pthread_mutex_lock(&p->mutex);
+    chunk = (off - p->base) / p->chunk_size;
+    if (off >= p->base + p->read_chunk * p->chunk_size &&
+        chunk < p->next_fetch) {
+        /* within the chunks already requested */
+        p->read_chunk = chunk;
+        p->read_off   = off - p->base - chunk * p->chunk_size;
+    } else {
+        p->gen++;
+        p->base       = off;
+        p->next_fetch = 0;
+        p->read_chunk = 0;
+        p->read_off   = 0;
+    }
+    pthread_cond_broadcast(&p->cond);
+    pthread_mutex_unlock(&p->mutex);
+
+    s->off = off;
+    return off;
+}
+
+/**
+ * Stop the workers and continue reading at the current position over a
+ * single connection, used when the range requests fail.
+ */
+static int parallel_fallback(URLContext *h, int err)
+{
+    HTTPContext *s = h->priv_data;
+    int64_t ret;
+
+    av_log(h, AV_LOG_WARNING, "Parallel range requests failed (%s), "
+           "falling back to a single connection\n", av_err2str(err));
+    parallel_stop(s);
+    s->parallel_connections = 0;
+
+    ret = http_seek_internal(h, s->off, SEEK_SET, 1);
+    return ret < 0 ? ret : 0;
+}
+
+static int parallel_usable(URLContext *h)
+{
+    HTTPContext *s = h->priv_data;
+
+    return !h->is_streamed && s->filesize != UINT64_MAX && s->hd &&
+           !s->icy_metaint && !s->listen && !(h->flags & AVIO_FLAG_WRITE) &&
+#if CONFIG_ZLIB
+           !s->compressed &&
+#endif
+           s->off < s->filesize;
+}
+#endif /* HAVE_THREADS */
+
 static int http_read(URLContext *h, uint8_t *buf, int size)
 {
     HTTPContext *s = h->priv_data;
 
+#if HAVE_THREADS
+    if (s->parallel_connections > 0 && !s->par) {
+        int ret = AVERROR(ENOSYS);
+        if (!parallel_usable(h) || (ret = parallel_start(h)) < 0) {
+            av_log(h, AV_LOG_VERBOSE, "Not using parallel connections: %s\n",
+                   av_err2str(ret));
+            s->parallel_connections = 0;
+        }
+    }
+    if (s->par) {
+        int ret = parallel_read(h, buf, size);
+        if (ret >= 0 || ret == AVERROR_EOF || ret == AVERROR_EXIT ||
+            (ret = parallel_fallback(h, ret)) < 0)
+            return ret;
+    }
+#endif
+
     if (s->icy_metaint > 0) {
         size = store_icy(h, size);
         if (size < 0)
@@ -1871,11 +2298,37 @@ static int http_shutdown(URLContext *h, int flags)
     return ret;
 }
 
+int ff_http_read_response(URLContext *h)
+{
+    char footer[] = "0\r\n\r\n";
+    HTTPContext *s = h->priv_data;
+    uint8_t buf[1024];
+    int ret;
+
+    /* without chunked encoding the end of the body is only signalled by
+     * closing the connection, so there is no response to wait for */
+    if (!s->hd || !s->chunked_post || s->end_chunked_post)
+        return 0;
+
+    ret = ffurl_write(s->hd, footer, sizeof(footer) - 1);
+    if (ret < 0)
+        return ret;
+    s->end_chunked_post = 1;
+
+    ret = http_read_header(h);
+    while (ret >= 0)
+        ret = http_buf_read(h, buf, sizeof(buf));
+    return ret == AVERROR_EOF ? 0 : ret;
+}
+
 static int http_close(URLContext *h)
 {
     int ret = 0;
     HTTPContext *s = h->priv_data;
 
+#if HAVE_THREADS
+    parallel_stop(s);
+#endif
 #if CONFIG_ZLIB
     inflateEnd(&s->inflate_stream);
     av_freep(&s->inflate_buffer);
@@ -1965,6 +2418,11 @@ static int64_t http_seek_internal(URLContext *h, int64_t off, int whence, int fo
 
 static int64_t http_seek(URLContext *h, int64_t off, int whence)
 {
+#if HAVE_THREADS
+    HTTPContext *s = h->priv_data;
+    if (s->par)
+        return parallel_seek(h, off, whence);
+#endif
     return http_seek_internal(h, off, whence, 0);
 }
 
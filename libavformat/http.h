@@ -60,6 +60,17 @@ int ff_http_do_new_request(URLContext *h, const char *uri);
  */
 int ff_http_do_new_request2(URLContext *h, const char *uri, AVDictionary **options);
 
+/**
+ * Finish the body of a request sent on a write-only context and wait for the
+ * server's response, discarding its body. This replaces ffurl_shutdown() for
+ * callers which need to know whether the upload succeeded.
+ *
+ * @param h pointer to the resource
+ * @return a negative value if writing failed or the server answered with an
+ * error status, 0 otherwise
+ */
+int ff_http_read_response(URLContext *h);
+
 int ff_http_averror(int status_code, int default_averror);
 
 #endif /* AVFORMAT_HTTP_H */
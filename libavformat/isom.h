@@ -158,6 +158,42 @@ typedef struct MOVFragmentIndex {
     MOVFragmentIndexItem * item;
 } MOVFragmentIndex;
 
+/**
+ * Stream values accumulated while scanning all fragments, stored in the
+ * fragment index cache so that they do not depend on which fragments have
+ * been read when the header is exported.
+ */
+typedef struct MOVIndexCacheStream {
+    int64_t duration;
+    int64_t data_size;
+    int64_t duration_for_fps;
+    int nb_frames_for_fps;
+} MOVIndexCacheStream;
+
+/**
+ * Position in the sample tables of a track whose index is built on demand.
+ */
+typedef struct MOVIndexBuilder {
+    int per_chunk;              ///< uncompressed audio, one entry per run of samples in a chunk
+    unsigned int chunk;         ///< chunk holding the next sample
+    unsigned int chunk_sample;  ///< samples taken from that chunk, nonzero once it was entered if per_chunk
+    unsigned int chunk_left;    ///< samples left in that chunk if per_chunk
+    unsigned int total;         ///< number of entries if per_chunk
+    unsigned int stsc_index;
+    unsigned int stts_index;
+    unsigned int stts_sample;
+    unsigned int stss_index;
+    unsigned int stps_index;
+    unsigned int rap_group_index;
+    unsigned int rap_group_sample;
+    unsigned int current_sample;
+    unsigned int distance;
+    int key_off;
+    int64_t current_offset;
+    int64_t current_dts;
+    uint64_t stream_size;
+} MOVIndexBuilder;
+
 typedef struct MOVIndexRange {
     int64_t start;
     int64_t end;
@@ -185,6 +221,8 @@ typedef struct MOVStreamContext {
     unsigned *stps_data;  ///< partial sync sample for mpeg-2 open gop
     MOVElst *elst_data;
     unsigned int elst_count;
+    int lazy_index;       ///< index entries are still being added on demand
+    MOVIndexBuilder index_builder;
     int ctts_index;
     int ctts_sample;
     unsigned int sample_size; ///< may contain value calculated from stsd or value from stsz atom
@@ -326,6 +364,11 @@ typedef struct MOVContext {
         int64_t extent_offset;
     } *avif_info;
     int avif_info_size;
+    int lazy_index;
+    int64_t lazy_index_configured; ///< index entries seen by the last buffer configuration
+    char *index_cache;      ///< path of the fragment index cache
+    int has_looked_for_index_cache;
+    MOVIndexCacheStream *index_cache_streams; ///< set if the index was loaded from the cache
 } MOVContext;
 
 int ff_mp4_read_descr_len(AVIOContext *pb);
@@ -81,6 +81,7 @@ typedef struct MOVParseTableEntry {
 
 static int mov_read_default(MOVContext *c, AVIOContext *pb, MOVAtom atom);
 static int mov_read_mfra(MOVContext *c, AVIOContext *f);
+static int mov_read_index_cache(MOVContext *c, AVIOContext *f);
 static int64_t add_ctts_entry(MOVCtts** ctts_data, unsigned int* ctts_count, unsigned int* allocated_size,
                               int count, int duration);
 
@@ -1412,6 +1413,19 @@ static int mov_read_moof(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     // Set by mov_read_tfhd(). mov_read_trun() will reject files missing tfhd.
     c->fragment.found_tfhd = 0;
 
+    if (!c->has_looked_for_index_cache && c->index_cache) {
+        c->has_looked_for_index_cache = 1;
+        if ((pb->seekable & AVIO_SEEKABLE_NORMAL) && !c->frag_index.complete) {
+            int ret = mov_read_index_cache(c, pb);
+            if (ret < 0)
+                av_log(c->fc, AV_LOG_VERBOSE, "no usable fragment index in '%s'\n",
+                       c->index_cache);
+            else
+                av_log(c->fc, AV_LOG_VERBOSE, "loaded fragment index from '%s'\n",
+                       c->index_cache);
+        }
+    }
+
     if (!c->has_looked_for_mfra && c->use_mfra_for > 0) {
         c->has_looked_for_mfra = 1;
         if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
@@ -4020,20 +4034,270 @@ static int build_open_gop_key_points(AVStream *st)
     return 0;
 }
 
+/* number of index entries added at a time when building the index lazily */
+#define MOV_LAZY_INDEX_ENTRIES 4096
+
+/**
+ * Check whether the index of a track may be built on demand, i.e. whether
+ * nothing after mov_build_index() needs all of its entries at once.
+ */
+static int mov_index_can_be_lazy(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+    int64_t duration = 0;
+
+    if (!mov->lazy_index || sc->ctts_data ||
+        (st->codecpar->codec_type != AVMEDIA_TYPE_VIDEO &&
+         st->codecpar->codec_type != AVMEDIA_TYPE_AUDIO))
+        return 0;
+    if (!sc->elst_count || mov->ignore_editlist || !mov->advanced_editlist)
+        return 1;
+
+    /* only a single edit covering the whole media is handled */
+    if (sc->elst_count != 1 || sc->elst_data[0].time || sc->elst_data[0].rate != 1.0f ||
+        mov->time_scale <= 0)
+        return 0;
+    for (unsigned i = 0; i < sc->stts_count; i++)
+        duration += (int64_t)sc->stts_data[i].count * sc->stts_data[i].duration;
+    return av_rescale(sc->elst_data[0].duration, sc->time_scale, mov->time_scale) >= duration;
+}
+
+/**
+ * Equivalent of mov_fix_index() for the edit lists accepted by
+ * mov_index_can_be_lazy(), which leave the index itself untouched.
+ */
+static void mov_fix_lazy_index(MOVContext *mov, AVStream *st)
+{
+    MOVStreamContext *sc = st->priv_data;
+
+    if (!sc->elst_count)
+        return;
+
+    st->start_time = 0;
+    st->duration = FFMIN(st->duration,
+                         av_rescale(sc->elst_data[0].duration, sc->time_scale, mov->time_scale));
+    sc->start_pad = ffstream(st)->skip_samples;
+}
+
+static int mov_grow_index(FFStream *sti, unsigned int max_entries)
+{
+    AVIndexEntry *entries;
+    unsigned int nb_entries;
+
+    if (sti->nb_index_entries < sti->index_entries_allocated_size / sizeof(*sti->index_entries))
+        return 0;
+
+    nb_entries = FFMAX(sti->nb_index_entries + MOV_LAZY_INDEX_ENTRIES,
+                       sti->nb_index_entries + sti->nb_index_entries / 2U);
+    nb_entries = FFMIN(nb_entries, max_entries);
+    entries = av_fast_realloc(sti->index_entries, &sti->index_entries_allocated_size,
+                              nb_entries * sizeof(*entries));
+    if (!entries)
+        return AVERROR(ENOMEM);
+    sti->index_entries = entries;
+    return 0;
+}
+
+/**
+ * Add index entries from the sample tables until at least min_entries exist
+ * and a keyframe after min_dts has been added (any entry if min_dts is
+ * INT64_MIN), or until the tables are exhausted.
+ */
+static int mov_add_sample_entries(MOVContext *mov, AVStream *st,
+                                  unsigned int min_entries, int64_t min_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVIndexBuilder *b = &sc->index_builder;
+    int rap_group_present = sc->rap_group_count && sc->rap_group;
+    unsigned int sample_size;
+    int ret;
+
+    for (; b->chunk < sc->chunk_count; b->chunk++, b->chunk_sample = 0) {
+        if (!b->chunk_sample) {
+            int64_t next_offset = b->chunk + 1 < sc->chunk_count ? sc->chunk_offsets[b->chunk + 1] : INT64_MAX;
+            b->current_offset = sc->chunk_offsets[b->chunk];
+            while (mov_stsc_index_valid(b->stsc_index, sc->stsc_count) &&
+                b->chunk + 1 == sc->stsc_data[b->stsc_index + 1].first)
+                b->stsc_index++;
+
+            if (next_offset > b->current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
+                sc->stsc_data[b->stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - b->current_offset) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
+                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
+                sc->stsz_sample_size = sc->sample_size;
+            }
+        }
+
+        for (; b->chunk_sample < sc->stsc_data[b->stsc_index].count; b->chunk_sample++) {
+            AVIndexEntry *e = NULL;
+            int keyframe = 0;
+            if (b->current_sample >= sc->sample_count) {
+                av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
+                return AVERROR_INVALIDDATA;
+            }
+
+            if (!sc->keyframe_absent && (!sc->keyframe_count || b->current_sample+b->key_off == sc->keyframes[b->stss_index])) {
+                keyframe = 1;
+                if (b->stss_index + 1 < sc->keyframe_count)
+                    b->stss_index++;
+            } else if (sc->stps_count && b->current_sample+b->key_off == sc->stps_data[b->stps_index]) {
+                keyframe = 1;
+                if (b->stps_index + 1 < sc->stps_count)
+                    b->stps_index++;
+            }
+            if (rap_group_present && b->rap_group_index < sc->rap_group_count) {
+                if (sc->rap_group[b->rap_group_index].index > 0)
+                    keyframe = 1;
+                if (++b->rap_group_sample == sc->rap_group[b->rap_group_index].count) {
+                    b->rap_group_sample = 0;
+                    b->rap_group_index++;
+                }
+            }
+            if (sc->keyframe_absent
+                && !sc->stps_count
+                && !rap_group_present
+                && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (b->chunk == 0 && b->chunk_sample == 0)))
+                 keyframe = 1;
+            if (keyframe)
+                b->distance = 0;
+            sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[b->current_sample];
+            if (sc->pseudo_stream_id == -1 ||
+               sc->stsc_data[b->stsc_index].id - 1 == sc->pseudo_stream_id) {
+                if (sample_size > 0x3FFFFFFF) {
+                    av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
+                    return AVERROR_INVALIDDATA;
+                }
+                if ((ret = mov_grow_index(sti, sc->sample_count)) < 0)
+                    return ret;
+                e = &sti->index_entries[sti->nb_index_entries++];
+                e->pos = b->current_offset;
+                e->timestamp = b->current_dts;
+                e->size = sample_size;
+                e->min_distance = b->distance;
+                e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
+                av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
+                        "size %u, distance %u, keyframe %d\n", st->index, b->current_sample,
+                        b->current_offset, b->current_dts, sample_size, b->distance, keyframe);
+                if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
+                    ff_rfps_add_frame(mov->fc, st, b->current_dts);
+            }
+
+            b->current_offset += sample_size;
+            b->stream_size += sample_size;
+
+            b->current_dts += sc->stts_data[b->stts_index].duration;
+
+            b->distance++;
+            b->stts_sample++;
+            b->current_sample++;
+            if (b->stts_index + 1 < sc->stts_count && b->stts_sample == sc->stts_data[b->stts_index].count) {
+                b->stts_sample = 0;
+                b->stts_index++;
+            }
+
+            if (e && sti->nb_index_entries >= min_entries && e->timestamp > min_dts &&
+                (keyframe || min_dts == INT64_MIN)) {
+                b->chunk_sample++;
+                return 0;
+            }
+        }
+    }
+    return 0;
+}
+
+/**
+ * Same as mov_add_sample_entries() for uncompressed audio, which is indexed
+ * in chunks of up to 1024 samples.
+ */
+static int mov_add_chunk_entries(MOVContext *mov, AVStream *st,
+                                 unsigned int min_entries, int64_t min_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    FFStream *const sti = ffstream(st);
+    MOVIndexBuilder *b = &sc->index_builder;
+    int ret;
+
+    for (; b->chunk < sc->chunk_count; b->chunk++, b->chunk_sample = 0) {
+        if (!b->chunk_sample) {
+            b->current_offset = sc->chunk_offsets[b->chunk];
+            if (mov_stsc_index_valid(b->stsc_index, sc->stsc_count) &&
+                b->chunk + 1 == sc->stsc_data[b->stsc_index + 1].first)
+                b->stsc_index++;
+            b->chunk_left = sc->stsc_data[b->stsc_index].count;
+            b->chunk_sample = 1;
+        }
+
+        while (b->chunk_left > 0) {
+            AVIndexEntry *e;
+            unsigned size, samples;
+
+            if (sc->samples_per_frame > 1 && !sc->bytes_per_frame) {
+                avpriv_request_sample(mov->fc,
+                       "Zero bytes per frame, but %d samples per frame",
+                       sc->samples_per_frame);
+                return AVERROR_PATCHWELCOME;
+            }
+
+            if (sc->samples_per_frame >= 160) { // gsm
+                samples = sc->samples_per_frame;
+                size = sc->bytes_per_frame;
+            } else {
+                if (sc->samples_per_frame > 1) {
+                    samples = FFMIN((1024 / sc->samples_per_frame)*
+                                    sc->samples_per_frame, b->chunk_left);
+                    size = (samples / sc->samples_per_frame) * sc->bytes_per_frame;
+                } else {
+                    samples = FFMIN(1024, b->chunk_left);
+                    size = samples * sc->sample_size;
+                }
+            }
+
+            if (sti->nb_index_entries >= b->total) {
+                av_log(mov->fc, AV_LOG_ERROR, "wrong chunk count %u\n", b->total);
+                return AVERROR_INVALIDDATA;
+            }
+            if (size > 0x3FFFFFFF) {
+                av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", size);
+                return AVERROR_INVALIDDATA;
+            }
+            if ((ret = mov_grow_index(sti, b->total)) < 0)
+                return ret;
+            e = &sti->index_entries[sti->nb_index_entries++];
+            e->pos = b->current_offset;
+            e->timestamp = b->current_dts;
+            e->size = size;
+            e->min_distance = 0;
+            e->flags = AVINDEX_KEYFRAME;
+            av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, chunk %u, offset %"PRIx64", dts %"PRId64", "
+                   "size %u, duration %u\n", st->index, b->chunk, b->current_offset, b->current_dts,
+                   size, samples);
+
+            b->current_offset += size;
+            b->current_dts += samples;
+            b->chunk_left -= samples;
+
+            if (sti->nb_index_entries >= min_entries && e->timestamp > min_dts)
+                return 0;
+        }
+    }
+    return 0;
+}
+
 static void mov_build_index(MOVContext *mov, AVStream *st)
 {
     MOVStreamContext *sc = st->priv_data;
     FFStream *const sti = ffstream(st);
-    int64_t current_offset;
     int64_t current_dts = 0;
-    unsigned int stts_index = 0;
-    unsigned int stsc_index = 0;
-    unsigned int stss_index = 0;
-    unsigned int stps_index = 0;
     unsigned int i, j;
     uint64_t stream_size = 0;
     MOVCtts *ctts_data_old = sc->ctts_data;
     unsigned int ctts_count_old = sc->ctts_count;
+    MOVIndexBuilder *b = &sc->index_builder;
+    int lazy = mov_index_can_be_lazy(mov, st);
 
     int ret = build_open_gop_key_points(st);
     if (ret < 0)
@@ -4085,28 +4349,21 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     /* only use old uncompressed audio chunk demuxing when stts specifies it */
     if (!(st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO &&
           sc->stts_count == 1 && sc->stts_data[0].duration == 1)) {
-        unsigned int current_sample = 0;
-        unsigned int stts_sample = 0;
-        unsigned int sample_size;
-        unsigned int distance = 0;
-        unsigned int rap_group_index = 0;
-        unsigned int rap_group_sample = 0;
-        int rap_group_present = sc->rap_group_count && sc->rap_group;
-        int key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
-
         current_dts -= sc->dts_shift;
 
         if (!sc->sample_count || sti->nb_index_entries)
             return;
         if (sc->sample_count >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
-        if (av_reallocp_array(&sti->index_entries,
-                              sti->nb_index_entries + sc->sample_count,
-                              sizeof(*sti->index_entries)) < 0) {
-            sti->nb_index_entries = 0;
-            return;
+        if (!lazy) {
+            if (av_reallocp_array(&sti->index_entries,
+                                  sti->nb_index_entries + sc->sample_count,
+                                  sizeof(*sti->index_entries)) < 0) {
+                sti->nb_index_entries = 0;
+                return;
+            }
+            sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
         }
-        sti->index_entries_allocated_size = (sti->nb_index_entries + sc->sample_count) * sizeof(*sti->index_entries);
 
         if (ctts_data_old) {
             // Expand ctts entries such that we have a 1-1 mapping with samples
@@ -4133,89 +4390,22 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
             av_free(ctts_data_old);
         }
 
-        for (i = 0; i < sc->chunk_count; i++) {
-            int64_t next_offset = i+1 < sc->chunk_count ? sc->chunk_offsets[i+1] : INT64_MAX;
-            current_offset = sc->chunk_offsets[i];
-            while (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-
-            if (next_offset > current_offset && sc->sample_size>0 && sc->sample_size < sc->stsz_sample_size &&
-                sc->stsc_data[stsc_index].count * (int64_t)sc->stsz_sample_size > next_offset - current_offset) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too large), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-            if (sc->stsz_sample_size>0 && sc->stsz_sample_size < sc->sample_size) {
-                av_log(mov->fc, AV_LOG_WARNING, "STSZ sample size %d invalid (too small), ignoring\n", sc->stsz_sample_size);
-                sc->stsz_sample_size = sc->sample_size;
-            }
-
-            for (j = 0; j < sc->stsc_data[stsc_index].count; j++) {
-                int keyframe = 0;
-                if (current_sample >= sc->sample_count) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong sample count\n");
-                    return;
-                }
-
-                if (!sc->keyframe_absent && (!sc->keyframe_count || current_sample+key_off == sc->keyframes[stss_index])) {
-                    keyframe = 1;
-                    if (stss_index + 1 < sc->keyframe_count)
-                        stss_index++;
-                } else if (sc->stps_count && current_sample+key_off == sc->stps_data[stps_index]) {
-                    keyframe = 1;
-                    if (stps_index + 1 < sc->stps_count)
-                        stps_index++;
-                }
-                if (rap_group_present && rap_group_index < sc->rap_group_count) {
-                    if (sc->rap_group[rap_group_index].index > 0)
-                        keyframe = 1;
-                    if (++rap_group_sample == sc->rap_group[rap_group_index].count) {
-                        rap_group_sample = 0;
-                        rap_group_index++;
-                    }
-                }
-                if (sc->keyframe_absent
-                    && !sc->stps_count
-                    && !rap_group_present
-                    && (st->codecpar->codec_type == AVMEDIA_TYPE_AUDIO || (i==0 && j==0)))
-                     keyframe = 1;
-                if (keyframe)
-                    distance = 0;
-                sample_size = sc->stsz_sample_size > 0 ? sc->stsz_sample_size : sc->sample_sizes[current_sample];
-                if (sc->pseudo_stream_id == -1 ||
-                   sc->stsc_data[stsc_index].id - 1 == sc->pseudo_stream_id) {
-                    AVIndexEntry *e;
-                    if (sample_size > 0x3FFFFFFF) {
-                        av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", sample_size);
-                        return;
-                    }
-                    e = &sti->index_entries[sti->nb_index_entries++];
-                    e->pos = current_offset;
-                    e->timestamp = current_dts;
-                    e->size = sample_size;
-                    e->min_distance = distance;
-                    e->flags = keyframe ? AVINDEX_KEYFRAME : 0;
-                    av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, sample %u, offset %"PRIx64", dts %"PRId64", "
-                            "size %u, distance %u, keyframe %d\n", st->index, current_sample,
-                            current_offset, current_dts, sample_size, distance, keyframe);
-                    if (st->codecpar->codec_type == AVMEDIA_TYPE_VIDEO && sti->nb_index_entries < 100)
-                        ff_rfps_add_frame(mov->fc, st, current_dts);
-                }
-
-                current_offset += sample_size;
-                stream_size += sample_size;
-
-                current_dts += sc->stts_data[stts_index].duration;
-
-                distance++;
-                stts_sample++;
-                current_sample++;
-                if (stts_index + 1 < sc->stts_count && stts_sample == sc->stts_data[stts_index].count) {
-                    stts_sample = 0;
-                    stts_index++;
-                }
+        b->current_dts = current_dts;
+        b->key_off = (sc->keyframe_count && sc->keyframes[0] > 0) || (sc->stps_count && sc->stps_data[0] > 0);
+        if (lazy) {
+            if (sc->stsz_sample_size > 0) {
+                stream_size = (uint64_t)sc->stsz_sample_size * sc->sample_count;
+            } else {
+                for (i = 0; i < sc->sample_count; i++)
+                    stream_size += sc->sample_sizes[i];
             }
+            ret = mov_add_sample_entries(mov, st, MOV_LAZY_INDEX_ENTRIES, INT64_MIN);
+        } else {
+            ret = mov_add_sample_entries(mov, st, UINT_MAX, INT64_MAX);
+            stream_size = b->stream_size;
         }
+        if (ret < 0)
+            return;
         if (st->duration > 0)
             st->codecpar->bit_rate = stream_size*8*sc->time_scale/st->duration;
     } else {
@@ -4254,75 +4444,35 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
         av_log(mov->fc, AV_LOG_TRACE, "chunk count %u\n", total);
         if (total >= UINT_MAX / sizeof(*sti->index_entries) - sti->nb_index_entries)
             return;
-        if (av_reallocp_array(&sti->index_entries,
-                              sti->nb_index_entries + total,
-                              sizeof(*sti->index_entries)) < 0) {
-            sti->nb_index_entries = 0;
-            return;
+        if (!lazy) {
+            if (av_reallocp_array(&sti->index_entries,
+                                  sti->nb_index_entries + total,
+                                  sizeof(*sti->index_entries)) < 0) {
+                sti->nb_index_entries = 0;
+                return;
+            }
+            sti->index_entries_allocated_size = (sti->nb_index_entries + total) * sizeof(*sti->index_entries);
         }
-        sti->index_entries_allocated_size = (sti->nb_index_entries + total) * sizeof(*sti->index_entries);
 
         // populate index
-        for (i = 0; i < sc->chunk_count; i++) {
-            current_offset = sc->chunk_offsets[i];
-            if (mov_stsc_index_valid(stsc_index, sc->stsc_count) &&
-                i + 1 == sc->stsc_data[stsc_index + 1].first)
-                stsc_index++;
-            chunk_samples = sc->stsc_data[stsc_index].count;
-
-            while (chunk_samples > 0) {
-                AVIndexEntry *e;
-                unsigned size, samples;
-
-                if (sc->samples_per_frame > 1 && !sc->bytes_per_frame) {
-                    avpriv_request_sample(mov->fc,
-                           "Zero bytes per frame, but %d samples per frame",
-                           sc->samples_per_frame);
-                    return;
-                }
-
-                if (sc->samples_per_frame >= 160) { // gsm
-                    samples = sc->samples_per_frame;
-                    size = sc->bytes_per_frame;
-                } else {
-                    if (sc->samples_per_frame > 1) {
-                        samples = FFMIN((1024 / sc->samples_per_frame)*
-                                        sc->samples_per_frame, chunk_samples);
-                        size = (samples / sc->samples_per_frame) * sc->bytes_per_frame;
-                    } else {
-                        samples = FFMIN(1024, chunk_samples);
-                        size = samples * sc->sample_size;
-                    }
-                }
-
-                if (sti->nb_index_entries >= total) {
-                    av_log(mov->fc, AV_LOG_ERROR, "wrong chunk count %u\n", total);
-                    return;
-                }
-                if (size > 0x3FFFFFFF) {
-                    av_log(mov->fc, AV_LOG_ERROR, "Sample size %u is too large\n", size);
-                    return;
-                }
-                e = &sti->index_entries[sti->nb_index_entries++];
-                e->pos = current_offset;
-                e->timestamp = current_dts;
-                e->size = size;
-                e->min_distance = 0;
-                e->flags = AVINDEX_KEYFRAME;
-                av_log(mov->fc, AV_LOG_TRACE, "AVIndex stream %d, chunk %u, offset %"PRIx64", dts %"PRId64", "
-                       "size %u, duration %u\n", st->index, i, current_offset, current_dts,
-                       size, samples);
-
-                current_offset += size;
-                current_dts += samples;
-                chunk_samples -= samples;
-            }
-        }
+        b->per_chunk   = 1;
+        b->total       = total;
+        b->current_dts = current_dts;
+        if (lazy)
+            ret = mov_add_chunk_entries(mov, st, MOV_LAZY_INDEX_ENTRIES, INT64_MIN);
+        else
+            ret = mov_add_chunk_entries(mov, st, UINT_MAX, INT64_MAX);
+        if (ret < 0)
+            return;
     }
+    sc->lazy_index = lazy && b->chunk < sc->chunk_count;
 
     if (!mov->ignore_editlist && mov->advanced_editlist) {
         // Fix index according to edit lists.
-        mov_fix_index(mov, st);
+        if (lazy)
+            mov_fix_lazy_index(mov, st);
+        else
+            mov_fix_index(mov, st);
     }
 
     // Update start time of the stream.
@@ -4336,6 +4486,57 @@ static void mov_build_index(MOVContext *mov, AVStream *st)
     mov_estimate_video_delay(mov, st);
 }
 
+/**
+ * The I/O buffers are configured from the index entries existing when the
+ * header is read. Reconfigure them from the lazily built index each time
+ * it doubled in size, which bounds the total cost of the scans.
+ */
+static void mov_configure_buffers(MOVContext *mov)
+{
+    int64_t nb_entries = 0;
+
+    for (int i = 0; i < mov->fc->nb_streams; i++)
+        nb_entries += ffstream(mov->fc->streams[i])->nb_index_entries;
+
+    if (nb_entries >= 2 * mov->lazy_index_configured) {
+        ff_configure_buffers_for_index(mov->fc, AV_TIME_BASE);
+        mov->lazy_index_configured = nb_entries;
+    }
+}
+
+/**
+ * Continue building a lazily built index, see mov_add_sample_entries().
+ * The sample tables are freed once the index is complete.
+ */
+static int mov_extend_index(MOVContext *mov, AVStream *st,
+                            unsigned int min_entries, int64_t min_dts)
+{
+    MOVStreamContext *sc = st->priv_data;
+    MOVIndexBuilder *b = &sc->index_builder;
+    int ret;
+
+    if (!sc->lazy_index)
+        return 0;
+
+    if (b->per_chunk)
+        ret = mov_add_chunk_entries(mov, st, min_entries, min_dts);
+    else
+        ret = mov_add_sample_entries(mov, st, min_entries, min_dts);
+
+    if (ret < 0 || b->chunk >= sc->chunk_count) {
+        sc->lazy_index = 0;
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
+    if (ret >= 0)
+        mov_configure_buffers(mov);
+    return ret;
+}
+
 static int test_same_origin(const char *src, const char *ref) {
     char src_proto[64];
     char ref_proto[64];
@@ -4564,14 +4765,16 @@ static int mov_read_trak(MOVContext *c, AVIOContext *pb, MOVAtom atom)
         && sc->time_scale == st->codecpar->sample_rate) {
             ffstream(st)->need_parsing = AVSTREAM_PARSE_FULL;
     }
-    /* Do not need those anymore. */
-    av_freep(&sc->chunk_offsets);
-    av_freep(&sc->sample_sizes);
-    av_freep(&sc->keyframes);
-    av_freep(&sc->stts_data);
-    av_freep(&sc->stps_data);
+    /* Do not need those anymore, unless the index is still being built. */
+    if (!sc->lazy_index) {
+        av_freep(&sc->chunk_offsets);
+        av_freep(&sc->sample_sizes);
+        av_freep(&sc->keyframes);
+        av_freep(&sc->stts_data);
+        av_freep(&sc->stps_data);
+        av_freep(&sc->rap_group);
+    }
     av_freep(&sc->elst_data);
-    av_freep(&sc->rap_group);
     av_freep(&sc->sync_group);
     av_freep(&sc->sgpd_sync);
 
@@ -5089,6 +5292,9 @@ static int mov_read_trun(MOVContext *c, AVIOContext *pb, MOVAtom atom)
     if (sc->pseudo_stream_id+1 != frag->stsd_id && sc->pseudo_stream_id != -1)
         return 0;
 
+    // Samples from the moov precede all fragments, index them first.
+    mov_extend_index(c, st, UINT_MAX, INT64_MAX);
+
     // Find the next frag_index index that has a valid index_entry for
     // the current track_id.
     //
@@ -8254,6 +8460,7 @@ static int mov_read_close(AVFormatContext *s)
         av_freep(&mov->frag_index.item[i].stream_info);
     }
     av_freep(&mov->frag_index.item);
+    av_freep(&mov->index_cache_streams);
 
     av_freep(&mov->aes_decrypt);
     av_freep(&mov->chapter_tracks);
@@ -8397,6 +8604,238 @@ fail:
     return ret;
 }
 
+#define MOV_INDEX_CACHE_VERSION 1
+#define MOV_INDEX_CACHE_PROBE   65536
+
+/**
+ * Identify the file an index cache belongs to by hashing the data at its
+ * start and end, which covers the moov atom of fragmented files and changes
+ * when fragments are appended.
+ */
+static int mov_index_cache_hash(AVIOContext *f, int64_t size, uint8_t *hash)
+{
+    int64_t original_pos = avio_tell(f);
+    int64_t offsets[2] = { 0, FFMAX(size - MOV_INDEX_CACHE_PROBE, 0) };
+    int64_t seek_ret;
+    struct AVSHA *sha;
+    uint8_t *buf;
+    int i, ret = 0;
+
+    sha = av_sha_alloc();
+    buf = av_malloc(MOV_INDEX_CACHE_PROBE);
+    if (!sha || !buf) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+
+    av_sha_init(sha, 160);
+    for (i = 0; i < 2; i++) {
+        int len = FFMIN(size - offsets[i], MOV_INDEX_CACHE_PROBE);
+        if ((seek_ret = avio_seek(f, offsets[i], SEEK_SET)) < 0) {
+            ret = seek_ret;
+            goto fail;
+        }
+        if ((ret = ffio_read_size(f, buf, len)) < 0)
+            goto fail;
+        av_sha_update(sha, buf, len);
+    }
+    av_sha_final(sha, hash);
+    ret = 0;
+fail:
+    av_free(buf);
+    av_free(sha);
+    seek_ret = avio_seek(f, original_pos, SEEK_SET);
+    if (seek_ret < 0 && ret >= 0)
+        ret = seek_ret;
+    return ret;
+}
+
+static int mov_read_index_cache(MOVContext *c, AVIOContext *f)
+{
+    AVFormatContext *s = c->fc;
+    AVIOContext *pb = NULL;
+    MOVIndexCacheStream *streams = NULL;
+    int64_t *offsets = NULL, *times = NULL;
+    int64_t size = avio_size(f);
+    uint8_t hash[20], file_hash[20];
+    unsigned nb_items, i, j;
+    int ret;
+
+    if (size <= 0 || !s->nb_streams)
+        return AVERROR(EINVAL);
+    for (i = 0; i < s->nb_streams; i++)
+        if (s->streams[i]->id < 0)
+            return AVERROR_INVALIDDATA;
+
+    // The cache is chosen by the caller, not referenced by the file, so it is
+    // not subject to the protocol whitelist of the input.
+    ret = avio_open2(&pb, c->index_cache, AVIO_FLAG_READ, &s->interrupt_callback, NULL);
+    if (ret < 0)
+        return ret;
+
+    if (avio_rb32(pb) != MKBETAG('F','F','M','I') ||
+        avio_rb32(pb) != MOV_INDEX_CACHE_VERSION ||
+        avio_rb64(pb) != size ||
+        ffio_read_size(pb, hash, sizeof(hash)) < 0 ||
+        avio_rb32(pb) != s->nb_streams) {
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+
+    streams = av_calloc(s->nb_streams, sizeof(*streams));
+    if (!streams) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < s->nb_streams; i++) {
+        if (avio_rb32(pb) != s->streams[i]->id) {
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+        streams[i].duration          = avio_rb64(pb);
+        streams[i].data_size         = avio_rb64(pb);
+        streams[i].duration_for_fps  = avio_rb64(pb);
+        streams[i].nb_frames_for_fps = avio_rb32(pb);
+    }
+
+    nb_items = avio_rb32(pb);
+    if (!nb_items || nb_items > INT_MAX / (3 * s->nb_streams)) {
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+    offsets = av_malloc_array(nb_items, sizeof(*offsets));
+    times   = av_malloc_array(nb_items, 3 * s->nb_streams * sizeof(*times));
+    if (!offsets || !times) {
+        ret = AVERROR(ENOMEM);
+        goto fail;
+    }
+    for (i = 0; i < nb_items; i++) {
+        offsets[i] = avio_rb64(pb);
+        if (offsets[i] < 0 || offsets[i] >= size ||
+            (i && offsets[i] <= offsets[i - 1])) {
+            ret = AVERROR_INVALIDDATA;
+            goto fail;
+        }
+        for (j = 0; j < 3 * s->nb_streams; j++)
+            times[3 * s->nb_streams * i + j] = avio_rb64(pb);
+    }
+    if (pb->eof_reached) {
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+
+    if ((ret = mov_index_cache_hash(f, size, file_hash)) < 0)
+        goto fail;
+    if (memcmp(hash, file_hash, sizeof(hash))) {
+        av_log(s, AV_LOG_VERBOSE, "fragment index in '%s' belongs to a different file\n",
+               c->index_cache);
+        ret = AVERROR_INVALIDDATA;
+        goto fail;
+    }
+
+    for (i = 0; i < nb_items; i++) {
+        const int64_t *t = &times[3 * s->nb_streams * i];
+        int index = update_frag_index(c, offsets[i]);
+        if (index < 0) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        for (j = 0; j < s->nb_streams; j++, t += 3) {
+            MOVFragmentStreamInfo *frag_stream_info =
+                get_frag_stream_info(&c->frag_index, index, s->streams[j]->id);
+            if (!frag_stream_info)
+                continue;
+            if (frag_stream_info->sidx_pts == AV_NOPTS_VALUE)
+                frag_stream_info->sidx_pts = t[0];
+            if (frag_stream_info->first_tfra_pts == AV_NOPTS_VALUE)
+                frag_stream_info->first_tfra_pts = t[1];
+            if (frag_stream_info->tfdt_dts == AV_NOPTS_VALUE)
+                frag_stream_info->tfdt_dts = t[2];
+        }
+    }
+    c->frag_index.complete = 1;
+    c->index_cache_streams = streams;
+    streams = NULL;
+
+fail:
+    av_free(streams);
+    av_free(offsets);
+    av_free(times);
+    avio_closep(&pb);
+    return ret;
+}
+
+/**
+ * Store the fragment index built by scanning the whole file, provided every
+ * fragment carries a timestamp for each of its tracks. Without one the
+ * timestamps of a fragment depend on all fragments before it, which are not
+ * read when it is seeked to.
+ */
+static int mov_write_index_cache(MOVContext *c, AVIOContext *f)
+{
+    AVFormatContext *s = c->fc;
+    AVIOContext *pb = NULL;
+    int64_t size = avio_size(f);
+    uint8_t hash[20];
+    int i, j, ret, err;
+
+    if (size <= 0)
+        return AVERROR(EINVAL);
+    for (i = 0; i < c->frag_index.nb_items; i++) {
+        const MOVFragmentIndexItem *item = &c->frag_index.item[i];
+        if (item->nb_stream_info != s->nb_streams)
+            return AVERROR_PATCHWELCOME;
+        for (j = 0; j < item->nb_stream_info; j++) {
+            const MOVFragmentStreamInfo *si = &item->stream_info[j];
+            if (si->index_entry >= 0 &&
+                si->sidx_pts == AV_NOPTS_VALUE && si->tfdt_dts == AV_NOPTS_VALUE) {
+                av_log(s, AV_LOG_VERBOSE, "fragment at 0x%"PRIx64" has no "
+                       "timestamp, not caching the fragment index\n", item->moof_offset);
+                return AVERROR_PATCHWELCOME;
+            }
+        }
+    }
+
+    if ((ret = mov_index_cache_hash(f, size, hash)) < 0)
+        return ret;
+
+    ret = avio_open2(&pb, c->index_cache, AVIO_FLAG_WRITE, &s->interrupt_callback, NULL);
+    if (ret < 0)
+        return ret;
+
+    avio_wb32(pb, MKBETAG('F','F','M','I'));
+    avio_wb32(pb, MOV_INDEX_CACHE_VERSION);
+    avio_wb64(pb, size);
+    avio_write(pb, hash, sizeof(hash));
+    avio_wb32(pb, s->nb_streams);
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *st = s->streams[i];
+        MOVStreamContext *sc = st->priv_data;
+        avio_wb32(pb, st->id);
+        avio_wb64(pb, st->duration);
+        avio_wb64(pb, sc->data_size);
+        avio_wb64(pb, sc->duration_for_fps);
+        avio_wb32(pb, sc->nb_frames_for_fps);
+    }
+    avio_wb32(pb, c->frag_index.nb_items);
+    for (i = 0; i < c->frag_index.nb_items; i++) {
+        const MOVFragmentIndexItem *item = &c->frag_index.item[i];
+        avio_wb64(pb, item->moof_offset);
+        for (j = 0; j < s->nb_streams; j++) {
+            const MOVFragmentStreamInfo *si =
+                get_frag_stream_info(&c->frag_index, i, s->streams[j]->id);
+            avio_wb64(pb, si ? si->sidx_pts       : AV_NOPTS_VALUE);
+            avio_wb64(pb, si ? si->first_tfra_pts : AV_NOPTS_VALUE);
+            avio_wb64(pb, si ? si->tfdt_dts       : AV_NOPTS_VALUE);
+        }
+    }
+    avio_flush(pb);
+    ret = pb->error;
+    err = avio_closep(&pb);
+
+    return ret < 0 ? ret : err;
+}
+
 static int mov_read_header(AVFormatContext *s)
 {
     MOVContext *mov = s->priv_data;
@@ -8434,6 +8873,24 @@ static int mov_read_header(AVFormatContext *s)
     }
     av_log(mov->fc, AV_LOG_TRACE, "on_parse_exit_offset=%"PRId64"\n", avio_tell(pb));
 
+    if (mov->index_cache_streams) {
+        for (i = 0; i < s->nb_streams; i++) {
+            AVStream *st = s->streams[i];
+            MOVStreamContext *sc = st->priv_data;
+            const MOVIndexCacheStream *cs = &mov->index_cache_streams[i];
+            st->duration          = cs->duration;
+            sc->data_size         = cs->data_size;
+            sc->duration_for_fps  = cs->duration_for_fps;
+            sc->nb_frames_for_fps = cs->nb_frames_for_fps;
+        }
+    } else if (mov->index_cache && mov->frag_index.nb_items &&
+               !mov->frag_index.complete && (pb->seekable & AVIO_SEEKABLE_NORMAL) &&
+               !(s->flags & AVFMT_FLAG_IGNIDX)) {
+        if ((err = mov_write_index_cache(mov, pb)) < 0 && err != AVERROR_PATCHWELCOME)
+            av_log(s, AV_LOG_WARNING, "Failed to write the fragment index to '%s': %s\n",
+                   mov->index_cache, av_err2str(err));
+    }
+
     if (pb->seekable & AVIO_SEEKABLE_NORMAL) {
         if (mov->nb_chapter_tracks > 0 && !mov->ignore_chapters)
             mov_read_chapters(s);
@@ -8598,7 +9055,8 @@ static int mov_read_header(AVFormatContext *s)
             break;
         }
     }
-    ff_configure_buffers_for_index(s, AV_TIME_BASE);
+    mov->lazy_index_configured = 0;
+    mov_configure_buffers(mov);
 
     for (i = 0; i < mov->frag_index.nb_items; i++)
         if (mov->frag_index.item[i].moof_offset <= mov->fragment.moof_offset)
@@ -8612,6 +9070,14 @@ static AVIndexEntry *mov_find_next_sample(AVFormatContext *s, AVStream **st)
     AVIndexEntry *sample = NULL;
     int64_t best_dts = INT64_MAX;
     int i;
+    for (i = 0; i < s->nb_streams; i++) {
+        AVStream *avst = s->streams[i];
+        FFStream *const avsti = ffstream(avst);
+        MOVStreamContext *msc = avst->priv_data;
+        /* the entry after the returned one is needed for its duration */
+        if (msc->lazy_index && msc->current_sample + 1 >= avsti->nb_index_entries)
+            mov_extend_index(s->priv_data, avst, msc->current_sample + 1 + MOV_LAZY_INDEX_ENTRIES, INT64_MIN);
+    }
     for (i = 0; i < s->nb_streams; i++) {
         AVStream *avst = s->streams[i];
         FFStream *const avsti = ffstream(avst);
@@ -8769,6 +9235,8 @@ static int mov_read_packet(AVFormatContext *s, AVPacket *pkt)
 
         if (st->codecpar->codec_id == AV_CODEC_ID_EIA_608 && sample->size > 8)
             ret = get_eia608_packet(sc->pb, pkt, sample->size);
+        else if (!mov->aax_mode && !mov->decryption_key) /* both decrypt in place */
+            ret = ff_get_packet(sc->pb, pkt, sample->size, st->codecpar->codec_id);
         else
             ret = av_get_packet(sc->pb, pkt, sample->size);
         if (ret < 0) {
@@ -8944,6 +9412,10 @@ static int mov_seek_stream(AVFormatContext *s, AVStream *st, int64_t timestamp,
     if (ret < 0)
         return ret;
 
+    ret = mov_extend_index(s->priv_data, st, 0, timestamp);
+    if (ret < 0)
+        return ret;
+
     for (;;) {
         sample = av_index_search_timestamp(st, timestamp, flags);
         av_log(s, AV_LOG_TRACE, "stream %d, timestamp %"PRId64", sample %d\n", st->index, timestamp, sample);
@@ -9113,6 +9585,10 @@ static const AVOption mov_options[] = {
     { "decryption_key", "The media decryption key (hex)", OFFSET(decryption_key), AV_OPT_TYPE_BINARY, .flags = AV_OPT_FLAG_DECODING_PARAM },
     { "enable_drefs", "Enable external track support.", OFFSET(enable_drefs), AV_OPT_TYPE_BOOL,
         {.i64 = 0}, 0, 1, FLAGS },
+    { "index_cache", "Fragment index cache file for fragmented files without a complete index",
+        OFFSET(index_cache), AV_OPT_TYPE_STRING, .flags = AV_OPT_FLAG_DECODING_PARAM },
+    { "lazy_index", "Build the sample index on demand instead of when opening the file",
+        OFFSET(lazy_index), AV_OPT_TYPE_BOOL, {.i64 = 0}, 0, 1, FLAGS },
     { "max_stts_delta", "treat offsets above this value as invalid", OFFSET(max_stts_delta), AV_OPT_TYPE_INT, {.i64 = UINT_MAX-48000*10 }, 0, UINT_MAX, .flags = AV_OPT_FLAG_DECODING_PARAM },
 
     { NULL },
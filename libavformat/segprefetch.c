@@ -0,0 +1,307 @@
+/*
+ * Background download of media segments for the HLS and DASH demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+#include "internal.h"
+#include "segprefetch.h"
+
+#if HAVE_THREADS
+
+#define CHUNK_SIZE 65536
+
+static void free_segment(PrefetchedSegment **pps)
+{
+    PrefetchedSegment *ps = *pps;
+
+    if (!ps)
+        return;
+    av_freep(&ps->url);
+    av_fifo_freep2(&ps->fifo);
+    av_freep(pps);
+}
+
+void ff_segment_prefetch_remove(SegmentPrefetch *p, int i)
+{
+    PrefetchedSegment *ps = p->segs[i];
+
+    p->buffered -= av_fifo_can_read(ps->fifo);
+    if (ps->started && !ps->ret)
+        ps->discarded = 1;
+    else
+        free_segment(&ps);
+
+    p->nb_segs--;
+    memmove(&p->segs[i], &p->segs[i + 1], (p->nb_segs - i) * sizeof(*p->segs));
+    pthread_cond_signal(&p->cond_background);
+}
+
+int ff_segment_prefetch_add(SegmentPrefetch *p, int64_t seq_no, const char *url,
+                            int64_t url_offset, int64_t size)
+{
+    PrefetchedSegment *ps = av_mallocz(sizeof(*ps));
+    int ret;
+
+    if (!ps)
+        return AVERROR(ENOMEM);
+    ps->seq_no     = seq_no;
+    ps->url_offset = url_offset;
+    ps->size       = size;
+    ps->url        = av_strdup(url);
+    ps->fifo       = av_fifo_alloc2(CHUNK_SIZE, 1, 0);
+    if (!ps->url || !ps->fifo) {
+        free_segment(&ps);
+        return AVERROR(ENOMEM);
+    }
+
+    ret = av_dynarray_add_nofree(&p->segs, &p->nb_segs, ps);
+    if (ret < 0)
+        free_segment(&ps);
+    return ret;
+}
+
+static void *prefetch_task(void *arg)
+{
+    SegmentPrefetch *p    = arg;
+    AVFormatContext *s    = p->s;
+    PrefetchedSegment *ps = NULL;
+    AVIOContext *in       = NULL;
+    int64_t remaining     = 0;
+    int opened            = 0;
+
+    ff_thread_setname(p->thread_name);
+
+    pthread_mutex_lock(&p->mutex);
+    while (!p->abort) {
+        int64_t now         = av_gettime_relative();
+        int64_t reload_time = p->reload_time;
+        int i, ret;
+
+        if (ps && ps->discarded) {
+            free_segment(&ps);
+            ff_format_io_close(s, &in);
+            continue;
+        }
+
+        if (reload_time && now >= reload_time) {
+            pthread_mutex_unlock(&p->mutex);
+            p->reload(p->opaque, reload_time);
+            pthread_mutex_lock(&p->mutex);
+
+            /* unless the playlist was reloaded meanwhile */
+            if (p->reload_time == reload_time)
+                p->reload_time = av_gettime_relative() + p->reload_interval;
+            continue;
+        }
+
+        for (i = 0; !ps && i < p->nb_segs; i++) {
+            if (!p->segs[i]->started) {
+                ps          = p->segs[i];
+                ps->started = 1;
+                remaining   = ps->size;
+                opened      = 0;
+            }
+        }
+
+        if (!ps || p->buffered >= p->buffer_size) {
+            if (reload_time) {
+                int64_t t = av_gettime() + reload_time - now;
+                struct timespec ts = { .tv_sec  =  t / 1000000,
+                                       .tv_nsec = (t % 1000000) * 1000 };
+                pthread_cond_timedwait(&p->cond_background, &p->mutex, &ts);
+            } else {
+                pthread_cond_wait(&p->cond_background, &p->mutex);
+            }
+            continue;
+        }
+        pthread_mutex_unlock(&p->mutex);
+
+        ret = 0;
+        if (!opened) {
+            ret = p->open(p->opaque, &in, ps, &p->opts);
+            opened = ret >= 0;
+        }
+        if (ret >= 0) {
+            int size = CHUNK_SIZE;
+            if (ps->size >= 0)
+                size = FFMIN(size, remaining);
+            ret = size > 0 ? avio_read_partial(in, p->buf, size) : AVERROR_EOF;
+        }
+
+        pthread_mutex_lock(&p->mutex);
+        if (ps->discarded)
+            continue;
+
+        if (ret > 0 && av_fifo_can_write(ps->fifo) < ret &&
+            av_fifo_grow2(ps->fifo, ret - av_fifo_can_write(ps->fifo)) < 0)
+            ret = AVERROR(ENOMEM);
+        if (ret > 0) {
+            av_fifo_write(ps->fifo, p->buf, ret);
+            p->buffered += ret;
+            remaining   -= ret;
+        } else if (ret < 0) {
+            if (ret != AVERROR_EOF && ret != AVERROR_EXIT)
+                av_log(s, AV_LOG_WARNING, "Failed to prefetch segment %"PRId64" from '%s'\n",
+                       ps->seq_no, ps->url);
+            /* only a completely read response leaves the connection reusable */
+            if (ret != AVERROR_EOF || !p->keep_alive ||
+                !av_strstart(ps->url, "http", NULL))
+                ff_format_io_close(s, &in);
+            ps->ret = ret;
+            ps      = NULL;
+        }
+        pthread_cond_signal(&p->cond_main);
+    }
+    if (ps && ps->discarded)
+        free_segment(&ps);
+    pthread_mutex_unlock(&p->mutex);
+
+    ff_format_io_close(s, &in);
+
+    return NULL;
+}
+
+int ff_segment_prefetch_start(SegmentPrefetch *p, const AVDictionary *opts)
+{
+    int ret;
+
+    p->buf = av_malloc(CHUNK_SIZE);
+    if (!p->buf)
+        return AVERROR(ENOMEM);
+    ret = av_dict_copy(&p->opts, opts, 0);
+    if (ret < 0)
+        goto fail;
+
+    ret = pthread_mutex_init(&p->mutex, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto fail;
+    }
+    ret = pthread_cond_init(&p->cond_main, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto cond_main_fail;
+    }
+    ret = pthread_cond_init(&p->cond_background, NULL);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto cond_background_fail;
+    }
+    ret = pthread_create(&p->thread, NULL, prefetch_task, p);
+    if (ret) {
+        ret = AVERROR(ret);
+        goto thread_fail;
+    }
+    p->started = 1;
+
+    return 0;
+
+thread_fail:
+    pthread_cond_destroy(&p->cond_background);
+cond_background_fail:
+    pthread_cond_destroy(&p->cond_main);
+cond_main_fail:
+    pthread_mutex_destroy(&p->mutex);
+fail:
+    av_dict_free(&p->opts);
+    av_freep(&p->buf);
+    return ret;
+}
+
+void ff_segment_prefetch_stop(SegmentPrefetch *p)
+{
+    if (!p->started)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    p->abort = 1;
+    pthread_cond_signal(&p->cond_background);
+    pthread_mutex_unlock(&p->mutex);
+    pthread_join(p->thread, NULL);
+
+    while (p->nb_segs)
+        free_segment(&p->segs[--p->nb_segs]);
+    av_freep(&p->segs);
+    p->cur = NULL;
+
+    pthread_cond_destroy(&p->cond_background);
+    pthread_cond_destroy(&p->cond_main);
+    pthread_mutex_destroy(&p->mutex);
+    av_dict_free(&p->opts);
+    av_freep(&p->buf);
+    p->started = 0;
+}
+
+int ff_segment_prefetch_set_current(SegmentPrefetch *p, int64_t seq_no)
+{
+    p->cur = p->nb_segs && p->segs[0]->seq_no == seq_no ? p->segs[0] : NULL;
+    pthread_cond_signal(&p->cond_background);
+    return !!p->cur;
+}
+
+int ff_segment_prefetch_read(SegmentPrefetch *p, uint8_t *buf, int buf_size)
+{
+    PrefetchedSegment *ps = p->cur;
+    int ret;
+
+    pthread_mutex_lock(&p->mutex);
+    while (!av_fifo_can_read(ps->fifo) && !ps->ret)
+        pthread_cond_wait(&p->cond_main, &p->mutex);
+
+    ret = FFMIN(buf_size, av_fifo_can_read(ps->fifo));
+    if (ret > 0) {
+        av_fifo_read(ps->fifo, buf, ret);
+        p->buffered -= ret;
+        pthread_cond_signal(&p->cond_background);
+    } else {
+        ret = ps->ret;
+    }
+    pthread_mutex_unlock(&p->mutex);
+
+    return ret;
+}
+
+void ff_segment_prefetch_release(SegmentPrefetch *p)
+{
+    if (!p->cur)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    ff_segment_prefetch_remove(p, 0);
+    pthread_mutex_unlock(&p->mutex);
+    p->cur = NULL;
+}
+
+void ff_segment_prefetch_flush(SegmentPrefetch *p)
+{
+    if (!p->started)
+        return;
+
+    pthread_mutex_lock(&p->mutex);
+    while (p->nb_segs)
+        ff_segment_prefetch_remove(p, p->nb_segs - 1);
+    pthread_mutex_unlock(&p->mutex);
+    p->cur = NULL;
+}
+
+#endif /* HAVE_THREADS */
@@ -0,0 +1,150 @@
+/*
+ * Background download of media segments for the HLS and DASH demuxers
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#ifndef AVFORMAT_SEGPREFETCH_H
+#define AVFORMAT_SEGPREFETCH_H
+
+#include <stdint.h>
+
+#include "config.h"
+
+#include "libavutil/dict.h"
+#include "libavutil/fifo.h"
+#include "libavutil/thread.h"
+
+#include "avformat.h"
+
+/**
+ * A media segment downloaded into memory ahead of time by the prefetch
+ * thread of its playlist.
+ */
+typedef struct PrefetchedSegment {
+    int64_t seq_no;
+    char *url;          ///< absolute url, owned
+    int64_t url_offset;
+    int64_t size;       ///< -1 if the whole resource is the segment
+    AVFifo *fifo;       ///< data downloaded and not read yet
+    int started;        ///< picked by the prefetch thread
+    int ret;            ///< 0 until the download ends, then AVERROR_EOF or an error
+    int discarded;      ///< dropped while downloading, freed by the prefetch thread
+} PrefetchedSegment;
+
+/**
+ * Downloads the queued segments of one playlist in a background thread.
+ *
+ * The fields up to buffer_size are set by the demuxer before
+ * ff_segment_prefetch_start(). The queue and the reload fields are
+ * protected by mutex.
+ */
+typedef struct SegmentPrefetch {
+    AVFormatContext *s;
+    void *opaque;
+    const char *thread_name;
+    /**
+     * Open the given segment, called from the prefetch thread.
+     * opts are the options to use and update for all requests.
+     */
+    int (*open)(void *opaque, AVIOContext **pb, const PrefetchedSegment *seg,
+                AVDictionary **opts);
+    /**
+     * Optional, reload the playlist. Called from the prefetch thread without
+     * the mutex held once reload_time is reached, the next reload is then
+     * scheduled reload_interval later unless reload_time was changed.
+     */
+    void (*reload)(void *opaque, int64_t reload_time);
+    /** maximum amount of data downloaded and not read yet */
+    int64_t buffer_size;
+    /** keep HTTP connections open across completely read segments */
+    int keep_alive;
+
+    /** segment being read from memory, if any; only used by the demuxer */
+    PrefetchedSegment *cur;
+
+#if HAVE_THREADS
+    pthread_t thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond_main;
+    pthread_cond_t cond_background;
+    int started;
+    int abort;
+    uint8_t *buf;
+    AVDictionary *opts;
+    /** segments following the current one, in order */
+    PrefetchedSegment **segs;
+    int nb_segs;
+    int64_t buffered;
+    /** time of the next playlist reload, 0 for none */
+    int64_t reload_time;
+    int64_t reload_interval;
+#endif
+} SegmentPrefetch;
+
+#if HAVE_THREADS
+/**
+ * Start the prefetch thread.
+ *
+ * @param opts options copied for the requests of the thread
+ */
+int ff_segment_prefetch_start(SegmentPrefetch *p, const AVDictionary *opts);
+
+/**
+ * Stop the prefetch thread, if started, and free the queue.
+ */
+void ff_segment_prefetch_stop(SegmentPrefetch *p);
+
+/**
+ * Append a segment to the download queue; called with mutex locked.
+ */
+int ff_segment_prefetch_add(SegmentPrefetch *p, int64_t seq_no, const char *url,
+                            int64_t url_offset, int64_t size);
+
+/**
+ * Remove the i-th queued segment; called with mutex locked.
+ */
+void ff_segment_prefetch_remove(SegmentPrefetch *p, int i);
+
+/**
+ * Make the first queued segment the current one if it is seq_no, and wake
+ * up the prefetch thread; called with mutex locked.
+ *
+ * @return 1 if the current segment is read from memory, 0 otherwise
+ */
+int ff_segment_prefetch_set_current(SegmentPrefetch *p, int64_t seq_no);
+
+/**
+ * Read from the current segment, waiting for the prefetch thread if needed.
+ *
+ * @return the number of bytes read, AVERROR_EOF at the end of the segment
+ *         or another negative error code
+ */
+int ff_segment_prefetch_read(SegmentPrefetch *p, uint8_t *buf, int buf_size);
+
+/**
+ * Done with the current segment.
+ */
+void ff_segment_prefetch_release(SegmentPrefetch *p);
+
+/**
+ * Drop all queued segments, e.g. after seeking.
+ */
+void ff_segment_prefetch_flush(SegmentPrefetch *p);
+#endif
+
+#endif /* AVFORMAT_SEGPREFETCH_H */
@@ -0,0 +1,259 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Read a resource served by a local HTTP server with parallel_connections,
+ * sequentially and with seeks, and compare the data with what is served.
+ */
+
+#include <inttypes.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/avstring.h"
+#include "libavutil/dict.h"
+#include "libavutil/log.h"
+#include "libavutil/mem.h"
+#include "libavutil/thread.h"
+#include "libavformat/avio.h"
+#include "libavformat/network.h"
+
+#define DATA_SIZE (1024 * 1024 + 12345)
+
+enum ServerMode {
+    RANGES,         ///< honour all range requests
+    OPEN_RANGES,    ///< reply 200 with the whole resource to bounded ranges
+};
+
+typedef struct Server {
+    int fd;
+    int port;
+    enum ServerMode mode;
+    pthread_t thread;
+} Server;
+
+typedef struct Connection {
+    int fd;
+    enum ServerMode mode;
+} Connection;
+
+static uint8_t data[DATA_SIZE];
+
+static int send_all(int fd, const void *buf, int size)
+{
+    const uint8_t *p = buf;
+
+    while (size > 0) {
+        int ret = send(fd, p, size, 0);
+        if (ret <= 0)
+            return -1;
+        p    += ret;
+        size -= ret;
+    }
+    return 0;
+}
+
+/* read a request header, return 0 when the client closed the connection */
+static int read_request(int fd, char *buf, int size)
+{
+    int len = 0;
+
+    while (len < size - 1) {
+        int ret = recv(fd, buf + len, 1, 0);
+        if (ret <= 0)
+            return 0;
+        buf[++len] = 0;
+        if (len >= 4 && !strcmp(buf + len - 4, "\r\n\r\n"))
+            return len;
+    }
+    return -1;
+}
+
+static void *connection_thread(void *arg)
+{
+    Connection *c = arg;
+    char req[4096], hdr[512];
+
+    while (read_request(c->fd, req, sizeof(req)) > 0) {
+        int64_t start = 0, end = DATA_SIZE - 1;
+        const char *range = av_stristr(req, "\r\nRange: bytes=");
+        int partial = 0, n = 0;
+
+        if (range) {
+            char *p;
+            start = strtoll(range + 15, &p, 10);
+            if (*p == '-' && p[1] >= '0' && p[1] <= '9') {
+                if (c->mode == RANGES)
+                    end = FFMIN(strtoll(p + 1, NULL, 10), DATA_SIZE - 1);
+                else
+                    start = 0;
+            }
+            partial = start > 0 || end < DATA_SIZE - 1 || c->mode == RANGES;
+        }
+
+        if (partial)
+            n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 206 Partial Content\r\n"
+                         "Content-Range: bytes %"PRId64"-%"PRId64"/%d\r\n",
+                         start, end, DATA_SIZE);
+        else
+            n = snprintf(hdr, sizeof(hdr), "HTTP/1.1 200 OK\r\n");
+        snprintf(hdr + n, sizeof(hdr) - n, "Accept-Ranges: bytes\r\n"
+                 "Content-Length: %"PRId64"\r\n\r\n", end - start + 1);
+        if (send_all(c->fd, hdr, strlen(hdr)) < 0 ||
+            send_all(c->fd, data + start, end - start + 1) < 0 ||
+            av_stristr(req, "\r\nConnection: close"))
+            break;
+    }
+
+    closesocket(c->fd);
+    av_free(c);
+    return NULL;
+}
+
+static void *server_thread(void *arg)
+{
+    Server *s = arg;
+    int fd;
+
+    while ((fd = accept(s->fd, NULL, NULL)) >= 0) {
+        Connection *c = av_mallocz(sizeof(*c));
+        pthread_t thread;
+
+        if (!c) {
+            closesocket(fd);
+            continue;
+        }
+        c->fd   = fd;
+        c->mode = s->mode;
+        if (pthread_create(&thread, NULL, connection_thread, c)) {
+            closesocket(fd);
+            av_free(c);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+    return NULL;
+}
+
+static int server_start(Server *s, enum ServerMode mode)
+{
+    struct sockaddr_in addr = { 0 };
+    socklen_t addr_len = sizeof(addr);
+
+    s->mode = mode;
+    s->fd   = ff_socket(AF_INET, SOCK_STREAM, 0, NULL);
+    if (s->fd < 0)
+        return -1;
+
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(s->fd, (struct sockaddr *)&addr, sizeof(addr)) ||
+        listen(s->fd, 16) ||
+        getsockname(s->fd, (struct sockaddr *)&addr, &addr_len) ||
+        pthread_create(&s->thread, NULL, server_thread, s)) {
+        closesocket(s->fd);
+        return -1;
+    }
+    s->port = ntohs(addr.sin_port);
+    return 0;
+}
+
+static void server_stop(Server *s)
+{
+    shutdown(s->fd, SHUT_RDWR);
+    closesocket(s->fd);
+    pthread_join(s->thread, NULL);
+}
+
+static int check_read(AVIOContext *pb, int64_t pos, int size, uint8_t *buf)
+{
+    int ret;
+
+    if (avio_seek(pb, pos, SEEK_SET) != pos)
+        return -1;
+    ret = avio_read(pb, buf, size);
+    if (ret != FFMIN(size, DATA_SIZE - pos))
+        return -1;
+    return memcmp(buf, data + pos, ret) ? -1 : 0;
+}
+
+static void test(const Server *srv, int connections, int chunk_size)
+{
+    static const int64_t seeks[] = {
+        DATA_SIZE / 2, 1000, 1000 + 65536, DATA_SIZE - 100, 300000, 0,
+    };
+    AVDictionary *opts = NULL;
+    AVIOContext *pb = NULL;
+    uint8_t *buf = av_malloc(DATA_SIZE);
+    char url[64];
+    int seq = -1, seek = -1;
+
+    snprintf(url, sizeof(url), "http://127.0.0.1:%d/data", srv->port);
+    av_dict_set_int(&opts, "parallel_connections", connections, 0);
+    av_dict_set_int(&opts, "parallel_chunk_size", chunk_size, 0);
+
+    if (buf && avio_open2(&pb, url, AVIO_FLAG_READ, NULL, &opts) >= 0) {
+        seq = check_read(pb, 0, DATA_SIZE, buf);
+        seek = 0;
+        for (int i = 0; i < FF_ARRAY_ELEMS(seeks) && !seek; i++)
+            seek = check_read(pb, seeks[i], 70000, buf);
+        avio_closep(&pb);
+    }
+
+    printf("%s, %d connections, chunk size %d: sequential %s, seeks %s\n",
+           srv->mode == RANGES ? "ranges" : "open-ended ranges only",
+           connections, chunk_size, seq ? "FAILED" : "ok", seek ? "FAILED" : "ok");
+    av_dict_free(&opts);
+    av_free(buf);
+}
+
+int main(void)
+{
+    static const enum ServerMode modes[] = { RANGES, OPEN_RANGES };
+    uint32_t state = 1;
+
+    av_log_set_level(AV_LOG_WARNING);
+#ifdef SIGPIPE
+    signal(SIGPIPE, SIG_IGN);
+#endif
+
+    for (int i = 0; i < DATA_SIZE; i++) {
+        state   = state * 1664525 + 1013904223;
+        data[i] = state >> 24;
+    }
+
+    ff_network_init();
+    for (int i = 0; i < FF_ARRAY_ELEMS(modes); i++) {
+        Server srv;
+
+        if (server_start(&srv, modes[i]) < 0) {
+            fprintf(stderr, "Could not start the server\n");
+            return 1;
+        }
+        test(&srv, 0, 65536);
+        test(&srv, 1, 65536);
+        test(&srv, 4, 65536);
+        test(&srv, 3, 100000);
+        server_stop(&srv);
+    }
+    ff_network_close();
+
+    return 0;
+}
@@ -26,6 +26,7 @@
 
 #include "avio.h"
 
+#include "libavutil/buffer.h"
 #include "libavutil/dict.h"
 #include "libavutil/log.h"
 
@@ -85,6 +86,11 @@ typedef struct URLProtocol {
     int (*url_get_multi_file_handle)(URLContext *h, int **handles,
                                      int *numhandles);
     int (*url_get_short_seek)(URLContext *h);
+    /**
+     * Return a read-only reference to the whole resource mapped in memory,
+     * at most INT_MAX bytes, and move the read position to its end.
+     */
+    int (*url_map)(URLContext *h, AVBufferRef **buf);
     int (*url_shutdown)(URLContext *h, int flags);
     const AVClass *priv_data_class;
     int priv_data_size;
@@ -253,6 +259,15 @@ int ffurl_get_multi_file_handle(URLContext *h, int **handles, int *numhandles);
  */
 int ffurl_get_short_seek(URLContext *h);
 
+/**
+ * Get a read-only reference to the whole resource mapped in memory.
+ * On success, the read position is moved to the end of the mapping.
+ *
+ * @return 0 on success or <0 on error, AVERROR(ENOSYS) if the resource
+ * cannot be mapped.
+ */
+int ffurl_map(URLContext *h, AVBufferRef **buf);
+
 /**
  * Signal the URLContext that we are done reading or writing the stream.
  *
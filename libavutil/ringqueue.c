@@ -0,0 +1,450 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "error.h"
+#include "macros.h"
+#include "mem.h"
+#include "ringqueue.h"
+#include "thread.h"
+
+#define CACHE_LINE_SIZE 64
+
+/*
+ * The compat atomics emulate every atomic type with intptr_t, which cannot
+ * hold the 64-bit positions and sequences on 32-bit targets. Those are then
+ * accessed under a lock instead.
+ */
+#if (defined(COMPAT_ATOMICS_DUMMY_STDATOMIC_H)   || \
+     defined(COMPAT_ATOMICS_PTHREAD_STDATOMIC_H) || \
+     defined(COMPAT_ATOMICS_SUNCC_STDATOMIC_H)   || \
+     defined(COMPAT_ATOMICS_WIN32_STDATOMIC_H)) && UINTPTR_MAX < UINT64_MAX
+#define POS_LOCKFREE 0
+typedef uint64_t ring_pos;
+#else
+#define POS_LOCKFREE 1
+typedef atomic_uint_least64_t ring_pos;
+#endif
+
+/*
+ * Bounded MPMC queue after Dmitry Vyukov's design: every cell carries a
+ * sequence number telling whether it is free for the writer at a given
+ * position or holds data for the reader at that position.
+ *
+ * For position pos mapping to a cell, the cell sequence is
+ *   2 * pos      when the cell is free for the writer at pos,
+ *   2 * pos + 1  when it holds the element written at pos,
+ * and reading it hands it over to the writer at pos + nb_elems. Doubling the
+ * positions keeps the two states apart even for single-element queues.
+ */
+struct AVRingQueue {
+    ring_pos write_pos;
+    uint8_t pad0[CACHE_LINE_SIZE - sizeof(ring_pos)];
+    ring_pos read_pos;
+    uint8_t pad1[CACHE_LINE_SIZE - sizeof(ring_pos)];
+
+    ring_pos              *seq;
+    uint8_t               *buf;
+    size_t            nb_elems;
+    size_t           elem_size;
+    unsigned        spin_count;
+
+    atomic_int err_write;
+    atomic_int err_read;
+
+    /* number of threads sleeping on the conditions below */
+    atomic_int nb_waiting_write;
+    atomic_int nb_waiting_read;
+#if HAVE_THREADS
+    pthread_mutex_t lock;
+    pthread_cond_t  cond_write;
+    pthread_cond_t  cond_read;
+#if !POS_LOCKFREE
+    pthread_mutex_t pos_lock;
+#endif
+#endif
+};
+
+#if POS_LOCKFREE
+#define pos_init(q, p, val)         atomic_init(p, val)
+#define pos_load(q, p, order)       atomic_load_explicit(p, order)
+#define pos_store(q, p, val, order) atomic_store_explicit(p, val, order)
+#define pos_cas(q, p, expected, desired)                                  \
+    atomic_compare_exchange_weak_explicit(p, expected, desired,           \
+                                          memory_order_relaxed,           \
+                                          memory_order_relaxed)
+#else
+static void pos_lock(AVRingQueue *q)
+{
+#if HAVE_THREADS
+    pthread_mutex_lock(&q->pos_lock);
+#endif
+}
+
+static void pos_unlock(AVRingQueue *q)
+{
+#if HAVE_THREADS
+    pthread_mutex_unlock(&q->pos_lock);
+#endif
+}
+
+static uint64_t pos_load_locked(AVRingQueue *q, ring_pos *p)
+{
+    uint64_t val;
+
+    pos_lock(q);
+    val = *p;
+    pos_unlock(q);
+    return val;
+}
+
+static void pos_store_locked(AVRingQueue *q, ring_pos *p, uint64_t val)
+{
+    pos_lock(q);
+    *p = val;
+    pos_unlock(q);
+}
+
+static int pos_cas_locked(AVRingQueue *q, ring_pos *p, uint64_t *expected,
+                          uint64_t desired)
+{
+    int ret;
+
+    pos_lock(q);
+    ret = *p == *expected;
+    if (ret)
+        *p = desired;
+    else
+        *expected = *p;
+    pos_unlock(q);
+    return ret;
+}
+
+#define pos_init(q, p, val)              (*(p) = (val))
+#define pos_load(q, p, order)            pos_load_locked(q, p)
+#define pos_store(q, p, val, order)      pos_store_locked(q, p, val)
+#define pos_cas(q, p, expected, desired) pos_cas_locked(q, p, expected, desired)
+#endif
+
+AVRingQueue *av_ring_queue_alloc(size_t nb_elems, size_t elem_size,
+                                 unsigned spin_count)
+{
+    AVRingQueue *q;
+
+    if (!nb_elems || !elem_size || nb_elems > SIZE_MAX / elem_size)
+        return NULL;
+
+    q = av_mallocz(sizeof(*q));
+    if (!q)
+        return NULL;
+
+    q->seq = av_malloc_array(nb_elems, sizeof(*q->seq));
+    q->buf = av_malloc_array(nb_elems, elem_size);
+    if (!q->seq || !q->buf)
+        goto fail;
+
+    for (size_t i = 0; i < nb_elems; i++)
+        pos_init(q, &q->seq[i], 2 * (uint64_t)i);
+
+    pos_init(q, &q->write_pos, 0);
+    pos_init(q, &q->read_pos,  0);
+    atomic_init(&q->err_write, 0);
+    atomic_init(&q->err_read,  0);
+    atomic_init(&q->nb_waiting_write, 0);
+    atomic_init(&q->nb_waiting_read,  0);
+
+    q->nb_elems   = nb_elems;
+    q->elem_size  = elem_size;
+    q->spin_count = spin_count;
+
+#if HAVE_THREADS
+    if (pthread_mutex_init(&q->lock, NULL))
+        goto fail;
+    if (pthread_cond_init(&q->cond_write, NULL)) {
+        pthread_mutex_destroy(&q->lock);
+        goto fail;
+    }
+    if (pthread_cond_init(&q->cond_read, NULL)) {
+        pthread_cond_destroy(&q->cond_write);
+        pthread_mutex_destroy(&q->lock);
+        goto fail;
+    }
+#if !POS_LOCKFREE
+    if (pthread_mutex_init(&q->pos_lock, NULL)) {
+        pthread_cond_destroy(&q->cond_read);
+        pthread_cond_destroy(&q->cond_write);
+        pthread_mutex_destroy(&q->lock);
+        goto fail;
+    }
+#endif
+#endif
+
+    return q;
+fail:
+    av_freep(&q->seq);
+    av_freep(&q->buf);
+    av_freep(&q);
+    return NULL;
+}
+
+void av_ring_queue_freep(AVRingQueue **pq)
+{
+    AVRingQueue *q = *pq;
+
+    if (!q)
+        return;
+
+#if HAVE_THREADS
+#if !POS_LOCKFREE
+    pthread_mutex_destroy(&q->pos_lock);
+#endif
+    pthread_cond_destroy(&q->cond_read);
+    pthread_cond_destroy(&q->cond_write);
+    pthread_mutex_destroy(&q->lock);
+#endif
+    av_freep(&q->seq);
+    av_freep(&q->buf);
+    av_freep(pq);
+}
+
+static int try_write(AVRingQueue *q, const uint8_t *elem)
+{
+    uint64_t pos = pos_load(q, &q->write_pos, memory_order_relaxed);
+
+    while (1) {
+        size_t           idx = pos % q->nb_elems;
+        uint64_t         seq = pos_load(q, &q->seq[idx], memory_order_acquire);
+        int64_t         diff = (int64_t)(seq - 2 * pos);
+
+        if (diff < 0)
+            return 0;                   // full
+        if (diff > 0) {
+            // another writer took this position
+            pos = pos_load(q, &q->write_pos, memory_order_relaxed);
+            continue;
+        }
+        if (pos_cas(q, &q->write_pos, &pos, pos + 1)) {
+            memcpy(q->buf + idx * q->elem_size, elem, q->elem_size);
+            pos_store(q, &q->seq[idx], 2 * pos + 1, memory_order_release);
+            return 1;
+        }
+    }
+}
+
+static int try_read(AVRingQueue *q, uint8_t *elem)
+{
+    uint64_t pos = pos_load(q, &q->read_pos, memory_order_relaxed);
+
+    while (1) {
+        size_t           idx = pos % q->nb_elems;
+        uint64_t         seq = pos_load(q, &q->seq[idx], memory_order_acquire);
+        int64_t         diff = (int64_t)(seq - (2 * pos + 1));
+
+        if (diff < 0)
+            return 0;                   // empty
+        if (diff > 0) {
+            // another reader took this position
+            pos = pos_load(q, &q->read_pos, memory_order_relaxed);
+            continue;
+        }
+        if (pos_cas(q, &q->read_pos, &pos, pos + 1)) {
+            memcpy(elem, q->buf + idx * q->elem_size, q->elem_size);
+            pos_store(q, &q->seq[idx], 2 * (pos + q->nb_elems),
+                      memory_order_release);
+            return 1;
+        }
+    }
+}
+
+static int can_proceed(AVRingQueue *q, int write)
+{
+    ring_pos *ppos = write ? &q->write_pos : &q->read_pos;
+    uint64_t  pos  = pos_load(q, ppos, memory_order_seq_cst);
+    uint64_t  seq  = pos_load(q, &q->seq[pos % q->nb_elems], memory_order_seq_cst);
+
+    return (int64_t)(seq - (2 * pos + !write)) >= 0;
+}
+
+/**
+ * Wait until the queue is likely writable (or readable) or the respective
+ * error is set. Spurious returns are harmless, the caller simply retries.
+ */
+static int wait_for(AVRingQueue *q, int write)
+{
+    atomic_int *err = write ? &q->err_write : &q->err_read;
+
+    for (unsigned i = 0; i < q->spin_count; i++)
+        if (can_proceed(q, write) || atomic_load_explicit(err, memory_order_relaxed))
+            return 0;
+
+#if HAVE_THREADS
+    {
+        atomic_int  *nb_waiting = write ? &q->nb_waiting_write : &q->nb_waiting_read;
+        pthread_cond_t    *cond = write ? &q->cond_write       : &q->cond_read;
+
+        pthread_mutex_lock(&q->lock);
+        /* Announce ourselves before re-checking the state; pairs with the
+         * fence in wake(), so either we see the change or the other side
+         * sees us waiting. */
+        atomic_fetch_add(nb_waiting, 1);
+        atomic_thread_fence(memory_order_seq_cst);
+        while (!can_proceed(q, write) && !atomic_load(err))
+            pthread_cond_wait(cond, &q->lock);
+        atomic_fetch_sub(nb_waiting, 1);
+        pthread_mutex_unlock(&q->lock);
+        return 0;
+    }
+#else
+    // there is nobody to wait for
+    return AVERROR(EAGAIN);
+#endif
+}
+
+static void wake(AVRingQueue *q, int write)
+{
+#if HAVE_THREADS
+    atomic_int  *nb_waiting = write ? &q->nb_waiting_write : &q->nb_waiting_read;
+    pthread_cond_t    *cond = write ? &q->cond_write       : &q->cond_read;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_load_explicit(nb_waiting, memory_order_relaxed)) {
+        pthread_mutex_lock(&q->lock);
+        pthread_cond_broadcast(cond);
+        pthread_mutex_unlock(&q->lock);
+    }
+#endif
+}
+
+int av_ring_queue_write(AVRingQueue *q, const void *buf, size_t nb_elems,
+                        unsigned flags)
+{
+    const uint8_t *src = buf;
+    size_t nb_written = 0;
+    int ret = 0;
+
+    nb_elems = FFMIN(nb_elems, INT_MAX);
+
+    while (nb_written < nb_elems) {
+        ret = atomic_load_explicit(&q->err_write, memory_order_acquire);
+        if (ret)
+            break;
+
+        if (try_write(q, src + nb_written * q->elem_size)) {
+            nb_written++;
+            continue;
+        }
+
+        if (flags & AV_RING_QUEUE_FLAG_NONBLOCK) {
+            ret = AVERROR(EAGAIN);
+            break;
+        }
+
+        // let readers drain what we wrote so far before we go to sleep
+        if (nb_written)
+            wake(q, 0);
+
+        ret = wait_for(q, 1);
+        if (ret < 0)
+            break;
+    }
+
+    if (nb_written)
+        wake(q, 0);
+
+    return nb_written ? nb_written : ret;
+}
+
+int av_ring_queue_read(AVRingQueue *q, void *buf, size_t nb_elems,
+                       unsigned flags)
+{
+    uint8_t *dst = buf;
+    size_t nb_read = 0;
+    int ret;
+
+    if (!nb_elems)
+        return 0;
+    nb_elems = FFMIN(nb_elems, INT_MAX);
+
+    while (1) {
+        while (nb_read < nb_elems && try_read(q, dst + nb_read * q->elem_size))
+            nb_read++;
+        if (nb_read)
+            break;
+
+        ret = atomic_load_explicit(&q->err_read, memory_order_acquire);
+        if (ret) {
+            /* elements written before the error was set are visible now */
+            while (nb_read < nb_elems && try_read(q, dst + nb_read * q->elem_size))
+                nb_read++;
+            if (nb_read)
+                break;
+            return ret;
+        }
+
+        if (flags & AV_RING_QUEUE_FLAG_NONBLOCK)
+            return AVERROR(EAGAIN);
+
+        ret = wait_for(q, 0);
+        if (ret < 0)
+            return ret;
+    }
+
+    wake(q, 1);
+
+    return nb_read;
+}
+
+size_t av_ring_queue_can_read(AVRingQueue *q)
+{
+    uint64_t read_pos  = pos_load(q, &q->read_pos,  memory_order_relaxed);
+    uint64_t write_pos = pos_load(q, &q->write_pos, memory_order_relaxed);
+
+    if (write_pos <= read_pos)
+        return 0;
+    return FFMIN(write_pos - read_pos, q->nb_elems);
+}
+
+size_t av_ring_queue_can_write(AVRingQueue *q)
+{
+    return q->nb_elems - av_ring_queue_can_read(q);
+}
+
+static void set_err(AVRingQueue *q, atomic_int *err, int val)
+{
+    atomic_store_explicit(err, val, memory_order_release);
+#if HAVE_THREADS
+    pthread_mutex_lock(&q->lock);
+    pthread_cond_broadcast(&q->cond_write);
+    pthread_cond_broadcast(&q->cond_read);
+    pthread_mutex_unlock(&q->lock);
+#endif
+}
+
+void av_ring_queue_set_err_write(AVRingQueue *q, int err)
+{
+    set_err(q, &q->err_write, err);
+}
+
+void av_ring_queue_set_err_read(AVRingQueue *q, int err)
+{
+    set_err(q, &q->err_read, err);
+}
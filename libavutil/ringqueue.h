@@ -0,0 +1,145 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file
+ * @ingroup lavu_ring_queue
+ * A bounded lock-free queue for passing data between threads
+ */
+
+#ifndef AVUTIL_RINGQUEUE_H
+#define AVUTIL_RINGQUEUE_H
+
+#include <stddef.h>
+
+/**
+ * @defgroup lavu_ring_queue AVRingQueue
+ * @ingroup lavu_data
+ *
+ * @{
+ * A bounded, lock-free, multi-producer multi-consumer queue of fixed-size
+ * elements.
+ *
+ * Writing and reading never take a lock as long as the operation can proceed.
+ * Blocking operations that cannot proceed first retry for a configurable
+ * number of iterations and then sleep until woken by the other side; waking
+ * costs a lock only when somebody is actually sleeping.
+ */
+
+typedef struct AVRingQueue AVRingQueue;
+
+enum AVRingQueueFlags {
+    /**
+     * Do not wait. If nothing can be written or read, the operation returns
+     * AVERROR(EAGAIN) immediately.
+     */
+    AV_RING_QUEUE_FLAG_NONBLOCK = (1 << 0),
+};
+
+/**
+ * Allocate a ring queue.
+ *
+ * @param nb_elems   maximum number of elements the queue can hold, must be
+ *                   positive
+ * @param elem_size  size in bytes of a single element, must be positive
+ * @param spin_count number of times a blocking operation retries before going
+ *                   to sleep; 0 makes it sleep immediately
+ *
+ * @return newly-allocated queue on success, NULL on failure
+ */
+AVRingQueue *av_ring_queue_alloc(size_t nb_elems, size_t elem_size,
+                                 unsigned spin_count);
+
+/**
+ * Free a ring queue and set the pointer to NULL. Any elements still in the
+ * queue are discarded.
+ *
+ * The queue must no longer be in use by another thread.
+ */
+void av_ring_queue_freep(AVRingQueue **q);
+
+/**
+ * Write elements into the queue.
+ *
+ * Unless AV_RING_QUEUE_FLAG_NONBLOCK is set, the call waits until all the
+ * elements have been written. Waiting readers are woken once per call rather
+ * than once per element.
+ *
+ * @param buf      elements to write
+ * @param nb_elems number of elements in buf
+ * @param flags    a combination of AVRingQueueFlags
+ *
+ * @return number of elements written, which is smaller than nb_elems only in
+ *         non-blocking mode or when the write error was set during the call;
+ *         AVERROR(EAGAIN) if nothing could be written in non-blocking mode;
+ *         the write error code set with av_ring_queue_set_err_write()
+ */
+int av_ring_queue_write(AVRingQueue *q, const void *buf, size_t nb_elems,
+                        unsigned flags);
+
+/**
+ * Read elements from the queue.
+ *
+ * Unless AV_RING_QUEUE_FLAG_NONBLOCK is set, the call waits until at least one
+ * element is available, then reads as many as are available, up to nb_elems.
+ *
+ * @param buf      buffer to write the elements into
+ * @param nb_elems maximum number of elements to read
+ * @param flags    a combination of AVRingQueueFlags
+ *
+ * @return number of elements read;
+ *         AVERROR(EAGAIN) if nothing could be read in non-blocking mode;
+ *         the read error code set with av_ring_queue_set_err_read() if the
+ *         queue is empty
+ */
+int av_ring_queue_read(AVRingQueue *q, void *buf, size_t nb_elems,
+                       unsigned flags);
+
+/**
+ * @return approximate number of elements in the queue; other threads may be
+ *         writing or reading concurrently
+ */
+size_t av_ring_queue_can_read(AVRingQueue *q);
+
+/**
+ * @return approximate number of elements that can be written to the queue;
+ *         other threads may be writing or reading concurrently
+ */
+size_t av_ring_queue_can_write(AVRingQueue *q);
+
+/**
+ * Set the write error code.
+ *
+ * If the error code is non-zero, av_ring_queue_write() returns it immediately
+ * and writers waiting on a full queue are woken up.
+ */
+void av_ring_queue_set_err_write(AVRingQueue *q, int err);
+
+/**
+ * Set the read error code.
+ *
+ * If the error code is non-zero, av_ring_queue_read() returns it once the
+ * queue is empty and readers waiting on an empty queue are woken up.
+ */
+void av_ring_queue_set_err_read(AVRingQueue *q, int err);
+
+/**
+ * @}
+ */
+
+#endif /* AVUTIL_RINGQUEUE_H */
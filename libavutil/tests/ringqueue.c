@@ -0,0 +1,299 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Without arguments, check that messages passed through AVRingQueue by
+ * several writer and reader threads all arrive exactly once and in order.
+ *
+ * With -b [nb_msgs], additionally benchmark single-producer single-consumer
+ * throughput against a mutex + condition variable FIFO, which is how
+ * AVThreadMessageQueue used to be implemented.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libavutil/error.h"
+#include "libavutil/fifo.h"
+#include "libavutil/macros.h"
+#include "libavutil/mem.h"
+#include "libavutil/ringqueue.h"
+#include "libavutil/thread.h"
+#include "libavutil/time.h"
+
+#define MAX_THREADS 4
+#define MAX_BATCH   32
+
+typedef struct Msg {
+    unsigned writer;
+    unsigned seq;
+} Msg;
+
+typedef struct TestContext {
+    AVRingQueue *q;
+    unsigned nb_msgs;
+    unsigned batch;
+
+    /* fallback FIFO for the benchmark */
+    AVFifo         *fifo;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+} TestContext;
+
+typedef struct ThreadContext {
+    TestContext *t;
+    unsigned     idx;
+    unsigned     nb_received[MAX_THREADS];
+    int          error;
+} ThreadContext;
+
+static void *writer_main(void *arg)
+{
+    ThreadContext *tc = arg;
+    TestContext    *t = tc->t;
+    Msg msgs[MAX_BATCH];
+
+    for (unsigned seq = 0; seq < t->nb_msgs; seq += t->batch) {
+        unsigned nb = FFMIN(t->batch, t->nb_msgs - seq);
+        int ret;
+
+        for (unsigned i = 0; i < nb; i++)
+            msgs[i] = (Msg){ .writer = tc->idx, .seq = seq + i };
+
+        ret = av_ring_queue_write(t->q, msgs, nb, 0);
+        if (ret != nb) {
+            tc->error = ret < 0 ? ret : AVERROR_BUG;
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static void *reader_main(void *arg)
+{
+    ThreadContext *tc = arg;
+    TestContext    *t = tc->t;
+    Msg msgs[MAX_BATCH];
+    unsigned next[MAX_THREADS] = { 0 };
+
+    while (1) {
+        int ret = av_ring_queue_read(t->q, msgs, t->batch, 0);
+        if (ret == AVERROR_EOF)
+            break;
+        if (ret <= 0) {
+            tc->error = ret < 0 ? ret : AVERROR_BUG;
+            break;
+        }
+
+        for (int i = 0; i < ret; i++) {
+            /* each reader must see a given writer's messages in order */
+            if (msgs[i].writer >= MAX_THREADS || msgs[i].seq < next[msgs[i].writer]) {
+                tc->error = AVERROR_BUG;
+                return NULL;
+            }
+            next[msgs[i].writer] = msgs[i].seq + 1;
+            tc->nb_received[msgs[i].writer]++;
+        }
+    }
+
+    return NULL;
+}
+
+static int run_test(unsigned nb_writers, unsigned nb_readers, size_t size,
+                    unsigned spin_count, unsigned batch, unsigned nb_msgs)
+{
+    TestContext t = { .nb_msgs = nb_msgs, .batch = batch };
+    ThreadContext writers[MAX_THREADS] = { { 0 } }, readers[MAX_THREADS] = { { 0 } };
+    pthread_t writer_threads[MAX_THREADS], reader_threads[MAX_THREADS];
+    int ret = 0;
+
+    t.q = av_ring_queue_alloc(size, sizeof(Msg), spin_count);
+    if (!t.q)
+        return AVERROR(ENOMEM);
+
+    for (unsigned i = 0; i < nb_readers; i++) {
+        readers[i] = (ThreadContext){ .t = &t, .idx = i };
+        if (pthread_create(&reader_threads[i], NULL, reader_main, &readers[i]))
+            abort();
+    }
+    for (unsigned i = 0; i < nb_writers; i++) {
+        writers[i] = (ThreadContext){ .t = &t, .idx = i };
+        if (pthread_create(&writer_threads[i], NULL, writer_main, &writers[i]))
+            abort();
+    }
+
+    for (unsigned i = 0; i < nb_writers; i++) {
+        pthread_join(writer_threads[i], NULL);
+        if (writers[i].error < 0)
+            ret = writers[i].error;
+    }
+    av_ring_queue_set_err_read(t.q, AVERROR_EOF);
+    for (unsigned i = 0; i < nb_readers; i++) {
+        pthread_join(reader_threads[i], NULL);
+        if (readers[i].error < 0)
+            ret = readers[i].error;
+    }
+
+    for (unsigned w = 0; w < nb_writers; w++) {
+        unsigned total = 0;
+        for (unsigned r = 0; r < nb_readers; r++)
+            total += readers[r].nb_received[w];
+        if (total != nb_msgs)
+            ret = AVERROR_BUG;
+    }
+
+    if (ret < 0)
+        fprintf(stderr, "%u writers, %u readers, size %zu, spin %u, batch %u: %s\n",
+                nb_writers, nb_readers, size, spin_count, batch, av_err2str(ret));
+
+    av_ring_queue_freep(&t.q);
+    return ret;
+}
+
+static int test_nonblock(void)
+{
+    AVRingQueue *q = av_ring_queue_alloc(3, sizeof(int), 0);
+    int in[4] = { 1, 2, 3, 4 }, out[4];
+    int ret = 0;
+
+    if (!q)
+        return AVERROR(ENOMEM);
+
+    if (av_ring_queue_read(q, out, 1, AV_RING_QUEUE_FLAG_NONBLOCK) != AVERROR(EAGAIN) ||
+        av_ring_queue_write(q, in, 4, AV_RING_QUEUE_FLAG_NONBLOCK) != 3           ||
+        av_ring_queue_can_read(q) != 3 || av_ring_queue_can_write(q) != 0          ||
+        av_ring_queue_write(q, in, 1, AV_RING_QUEUE_FLAG_NONBLOCK) != AVERROR(EAGAIN) ||
+        av_ring_queue_read(q, out, 4, AV_RING_QUEUE_FLAG_NONBLOCK) != 3           ||
+        memcmp(in, out, 3 * sizeof(*in)))
+        ret = AVERROR_BUG;
+
+    av_ring_queue_set_err_write(q, AVERROR_EOF);
+    if (av_ring_queue_write(q, in, 1, 0) != AVERROR_EOF)
+        ret = AVERROR_BUG;
+
+    if (ret < 0)
+        fprintf(stderr, "non-blocking test failed\n");
+
+    av_ring_queue_freep(&q);
+    return ret;
+}
+
+static void *fifo_writer_main(void *arg)
+{
+    TestContext *t = arg;
+
+    for (unsigned seq = 0; seq < t->nb_msgs; seq++) {
+        Msg msg = { .seq = seq };
+
+        pthread_mutex_lock(&t->lock);
+        while (!av_fifo_can_write(t->fifo))
+            pthread_cond_wait(&t->cond, &t->lock);
+        av_fifo_write(t->fifo, &msg, 1);
+        pthread_cond_signal(&t->cond);
+        pthread_mutex_unlock(&t->lock);
+    }
+
+    return NULL;
+}
+
+static int64_t bench_fifo(unsigned nb_msgs, size_t size)
+{
+    TestContext t = { .nb_msgs = nb_msgs };
+    pthread_t writer;
+    int64_t start;
+
+    t.fifo = av_fifo_alloc2(size, sizeof(Msg), 0);
+    if (!t.fifo)
+        return AVERROR(ENOMEM);
+    pthread_mutex_init(&t.lock, NULL);
+    pthread_cond_init(&t.cond, NULL);
+
+    start = av_gettime_relative();
+    pthread_create(&writer, NULL, fifo_writer_main, &t);
+    for (unsigned i = 0; i < nb_msgs; i++) {
+        Msg msg;
+
+        pthread_mutex_lock(&t.lock);
+        while (!av_fifo_can_read(t.fifo))
+            pthread_cond_wait(&t.cond, &t.lock);
+        av_fifo_read(t.fifo, &msg, 1);
+        pthread_cond_signal(&t.cond);
+        pthread_mutex_unlock(&t.lock);
+    }
+    pthread_join(writer, NULL);
+
+    pthread_cond_destroy(&t.cond);
+    pthread_mutex_destroy(&t.lock);
+    av_fifo_freep2(&t.fifo);
+
+    return av_gettime_relative() - start;
+}
+
+static int64_t bench_ring_queue(unsigned nb_msgs, size_t size,
+                                unsigned spin_count, unsigned batch)
+{
+    int64_t start = av_gettime_relative();
+    int ret = run_test(1, 1, size, spin_count, batch, nb_msgs);
+
+    return ret < 0 ? ret : av_gettime_relative() - start;
+}
+
+static void print_result(const char *name, unsigned nb_msgs, int64_t us)
+{
+    if (us < 0)
+        printf("%-40s failed\n", name);
+    else
+        printf("%-40s %8.3f Mmsg/s\n", name, nb_msgs / (double)FFMAX(us, 1));
+}
+
+int main(int argc, char **argv)
+{
+    static const unsigned sizes[]   = { 1, 2, 7, 64 };
+    static const unsigned batches[] = { 1, 5, MAX_BATCH };
+    int ret = 0;
+
+    if (test_nonblock() < 0)
+        ret = 1;
+
+    for (int s = 0; s < FF_ARRAY_ELEMS(sizes); s++)
+        for (int b = 0; b < FF_ARRAY_ELEMS(batches); b++)
+            for (unsigned spin = 0; spin <= 100; spin += 100) {
+                if (run_test(1, 1, sizes[s], spin, batches[b], 10000) < 0 ||
+                    run_test(MAX_THREADS, MAX_THREADS - 1, sizes[s], spin,
+                             batches[b], 2000) < 0)
+                    ret = 1;
+            }
+
+    if (argc > 1 && !strcmp(argv[1], "-b")) {
+        unsigned nb_msgs = argc > 2 ? strtoul(argv[2], NULL, 0) : 1000000;
+        char name[64];
+
+        print_result("mutex+cond fifo, size 8", nb_msgs, bench_fifo(nb_msgs, 8));
+        for (int b = 0; b < FF_ARRAY_ELEMS(batches); b++)
+            for (unsigned spin = 0; spin <= 1000; spin += 1000) {
+                snprintf(name, sizeof(name), "ring queue, size 8, batch %u, spin %u",
+                         batches[b], spin);
+                print_result(name, nb_msgs,
+                             bench_ring_queue(nb_msgs, 8, spin, batches[b]));
+            }
+    }
+
+    return ret;
+}
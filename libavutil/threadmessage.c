@@ -19,21 +19,21 @@
  */
 
 #include <limits.h>
-#include "fifo.h"
+#include "common.h"
 #include "mem.h"
+#include "ringqueue.h"
 #include "threadmessage.h"
 #include "thread.h"
 
 struct AVThreadMessageQueue {
 #if HAVE_THREADS
-    AVFifo *fifo;
-    pthread_mutex_t lock;
-    pthread_cond_t cond_recv;
-    pthread_cond_t cond_send;
-    int err_send;
-    int err_recv;
+    AVRingQueue *rq;
     unsigned elsize;
     void (*free_func)(void *msg);
+    /* flushing reads the messages one at a time into flush_buf, allocated
+     * upfront so that flushing cannot fail */
+    AVMutex flush_lock;
+    void *flush_buf;
 #else
     int dummy;
 #endif
@@ -45,34 +45,24 @@ int av_thread_message_queue_alloc(AVThreadMessageQueue **mq,
 {
 #if HAVE_THREADS
     AVThreadMessageQueue *rmq;
-    int ret = 0;
+    int ret;
 
     if (nelem > INT_MAX / elsize)
         return AVERROR(EINVAL);
     if (!(rmq = av_mallocz(sizeof(*rmq))))
         return AVERROR(ENOMEM);
-    if ((ret = pthread_mutex_init(&rmq->lock, NULL))) {
+    if (!(rmq->rq = av_ring_queue_alloc(nelem, elsize, 0)) ||
+        !(rmq->flush_buf = av_malloc(elsize))) {
+        av_ring_queue_freep(&rmq->rq);
         av_free(rmq);
-        return AVERROR(ret);
-    }
-    if ((ret = pthread_cond_init(&rmq->cond_recv, NULL))) {
-        pthread_mutex_destroy(&rmq->lock);
-        av_free(rmq);
-        return AVERROR(ret);
+        return AVERROR(ENOMEM);
     }
-    if ((ret = pthread_cond_init(&rmq->cond_send, NULL))) {
-        pthread_cond_destroy(&rmq->cond_recv);
-        pthread_mutex_destroy(&rmq->lock);
+    if ((ret = ff_mutex_init(&rmq->flush_lock, NULL))) {
+        av_ring_queue_freep(&rmq->rq);
+        av_free(rmq->flush_buf);
         av_free(rmq);
         return AVERROR(ret);
     }
-    if (!(rmq->fifo = av_fifo_alloc2(nelem, elsize, 0))) {
-        pthread_cond_destroy(&rmq->cond_send);
-        pthread_cond_destroy(&rmq->cond_recv);
-        pthread_mutex_destroy(&rmq->lock);
-        av_free(rmq);
-        return AVERROR(ENOMEM);
-    }
     rmq->elsize = elsize;
     *mq = rmq;
     return 0;
@@ -95,10 +85,9 @@ void av_thread_message_queue_free(AVThreadMessageQueue **mq)
 #if HAVE_THREADS
     if (*mq) {
         av_thread_message_flush(*mq);
-        av_fifo_freep2(&(*mq)->fifo);
-        pthread_cond_destroy(&(*mq)->cond_send);
-        pthread_cond_destroy(&(*mq)->cond_recv);
-        pthread_mutex_destroy(&(*mq)->lock);
+        av_ring_queue_freep(&(*mq)->rq);
+        ff_mutex_destroy(&(*mq)->flush_lock);
+        av_freep(&(*mq)->flush_buf);
         av_freep(mq);
     }
 #endif
@@ -107,65 +96,21 @@ void av_thread_message_queue_free(AVThreadMessageQueue **mq)
 int av_thread_message_queue_nb_elems(AVThreadMessageQueue *mq)
 {
 #if HAVE_THREADS
-    int ret;
-    pthread_mutex_lock(&mq->lock);
-    ret = av_fifo_can_read(mq->fifo);
-    pthread_mutex_unlock(&mq->lock);
-    return ret;
+    return (int)av_ring_queue_can_read(mq->rq);
 #else
     return AVERROR(ENOSYS);
 #endif
 }
 
-#if HAVE_THREADS
-
-static int av_thread_message_queue_send_locked(AVThreadMessageQueue *mq,
-                                               void *msg,
-                                               unsigned flags)
-{
-    while (!mq->err_send && !av_fifo_can_write(mq->fifo)) {
-        if ((flags & AV_THREAD_MESSAGE_NONBLOCK))
-            return AVERROR(EAGAIN);
-        pthread_cond_wait(&mq->cond_send, &mq->lock);
-    }
-    if (mq->err_send)
-        return mq->err_send;
-    av_fifo_write(mq->fifo, msg, 1);
-    /* one message is sent, signal one receiver */
-    pthread_cond_signal(&mq->cond_recv);
-    return 0;
-}
-
-static int av_thread_message_queue_recv_locked(AVThreadMessageQueue *mq,
-                                               void *msg,
-                                               unsigned flags)
-{
-    while (!mq->err_recv && !av_fifo_can_read(mq->fifo)) {
-        if ((flags & AV_THREAD_MESSAGE_NONBLOCK))
-            return AVERROR(EAGAIN);
-        pthread_cond_wait(&mq->cond_recv, &mq->lock);
-    }
-    if (!av_fifo_can_read(mq->fifo))
-        return mq->err_recv;
-    av_fifo_read(mq->fifo, msg, 1);
-    /* one message space appeared, signal one sender */
-    pthread_cond_signal(&mq->cond_send);
-    return 0;
-}
-
-#endif /* HAVE_THREADS */
-
 int av_thread_message_queue_send(AVThreadMessageQueue *mq,
                                  void *msg,
                                  unsigned flags)
 {
 #if HAVE_THREADS
-    int ret;
-
-    pthread_mutex_lock(&mq->lock);
-    ret = av_thread_message_queue_send_locked(mq, msg, flags);
-    pthread_mutex_unlock(&mq->lock);
-    return ret;
+    int ret = av_ring_queue_write(mq->rq, msg, 1,
+                                  (flags & AV_THREAD_MESSAGE_NONBLOCK) ?
+                                  AV_RING_QUEUE_FLAG_NONBLOCK : 0);
+    return FFMIN(ret, 0);
 #else
     return AVERROR(ENOSYS);
 #endif /* HAVE_THREADS */
@@ -176,12 +121,10 @@ int av_thread_message_queue_recv(AVThreadMessageQueue *mq,
                                  unsigned flags)
 {
 #if HAVE_THREADS
-    int ret;
-
-    pthread_mutex_lock(&mq->lock);
-    ret = av_thread_message_queue_recv_locked(mq, msg, flags);
-    pthread_mutex_unlock(&mq->lock);
-    return ret;
+    int ret = av_ring_queue_read(mq->rq, msg, 1,
+                                 (flags & AV_THREAD_MESSAGE_NONBLOCK) ?
+                                 AV_RING_QUEUE_FLAG_NONBLOCK : 0);
+    return FFMIN(ret, 0);
 #else
     return AVERROR(ENOSYS);
 #endif /* HAVE_THREADS */
@@ -191,10 +134,7 @@ void av_thread_message_queue_set_err_send(AVThreadMessageQueue *mq,
                                           int err)
 {
 #if HAVE_THREADS
-    pthread_mutex_lock(&mq->lock);
-    mq->err_send = err;
-    pthread_cond_broadcast(&mq->cond_send);
-    pthread_mutex_unlock(&mq->lock);
+    av_ring_queue_set_err_write(mq->rq, err);
 #endif /* HAVE_THREADS */
 }
 
@@ -202,36 +142,22 @@ void av_thread_message_queue_set_err_recv(AVThreadMessageQueue *mq,
                                           int err)
 {
 #if HAVE_THREADS
-    pthread_mutex_lock(&mq->lock);
-    mq->err_recv = err;
-    pthread_cond_broadcast(&mq->cond_recv);
-    pthread_mutex_unlock(&mq->lock);
+    av_ring_queue_set_err_read(mq->rq, err);
 #endif /* HAVE_THREADS */
 }
 
-#if HAVE_THREADS
-static int free_func_wrap(void *arg, void *buf, size_t *nb_elems)
-{
-    AVThreadMessageQueue *mq = arg;
-    uint8_t *msg = buf;
-    for (size_t i = 0; i < *nb_elems; i++)
-        mq->free_func(msg + i * mq->elsize);
-    return 0;
-}
-#endif
-
 void av_thread_message_flush(AVThreadMessageQueue *mq)
 {
 #if HAVE_THREADS
-    size_t used;
+    ff_mutex_lock(&mq->flush_lock);
+
+    /* reading also wakes up the senders as the queue empties */
+    while (av_ring_queue_read(mq->rq, mq->flush_buf, 1,
+                              AV_RING_QUEUE_FLAG_NONBLOCK) > 0) {
+        if (mq->free_func)
+            mq->free_func(mq->flush_buf);
+    }
 
-    pthread_mutex_lock(&mq->lock);
-    used = av_fifo_can_read(mq->fifo);
-    if (mq->free_func)
-        av_fifo_read_to_cb(mq->fifo, free_func_wrap, mq, &used);
-    /* only the senders need to be notified since the queue is empty and there
-     * is nothing to read */
-    pthread_cond_broadcast(&mq->cond_send);
-    pthread_mutex_unlock(&mq->lock);
+    ff_mutex_unlock(&mq->flush_lock);
 #endif /* HAVE_THREADS */
 }
@@ -182,9 +182,17 @@ static int chr_h_scale(SwsContext *c, SwsFilterDescriptor *desc, int sliceY, int
     int dst_pos2 = sliceY - desc->dst->plane[2].sliceY;
 
     int i;
+
+    if (c->hcScaleNV && isSwappedChroma(c->srcFormat)) {
+        FFSWAP(uint8_t **, dst1, dst2);
+        FFSWAP(int, dst_pos1, dst_pos2);
+    }
+
     for (i = 0; i < sliceH; ++i) {
         if (c->hcscale_fast) {
             c->hcscale_fast(c, (uint16_t*)dst1[dst_pos1+i], (uint16_t*)dst2[dst_pos2+i], dstW, src1[src_pos1+i], src2[src_pos2+i], srcW, xInc);
+        } else if (c->hcScaleNV) {
+            c->hcScaleNV(c, (int16_t*)dst1[dst_pos1+i], (int16_t*)dst2[dst_pos2+i], dstW, src1[src_pos1+i], instance->filter, instance->filter_pos, instance->filter_size);
         } else {
             c->hcScale(c, (uint16_t*)dst1[dst_pos1+i], dstW, src1[src_pos1+i], instance->filter, instance->filter_pos, instance->filter_size);
             c->hcScale(c, (uint16_t*)dst2[dst_pos2+i], dstW, src2[src_pos2+i], instance->filter, instance->filter_pos, instance->filter_size);
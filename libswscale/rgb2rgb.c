@@ -57,6 +57,17 @@ void (*shuffle_bytes_1230)(const uint8_t *src, uint8_t *dst, int src_size);
 void (*shuffle_bytes_3012)(const uint8_t *src, uint8_t *dst, int src_size);
 void (*shuffle_bytes_3210)(const uint8_t *src, uint8_t *dst, int src_size);
 
+void (*rgb64tobgr48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void   (*rgb64tobgr48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void (*rgb48tobgr48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void   (*rgb48tobgr48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void    (*rgb64to48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void      (*rgb64to48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void (*rgb48tobgr64_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void   (*rgb48tobgr64_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void    (*rgb48to64_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+void      (*rgb48to64_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+
 
 void (*yv12toyuy2)(const uint8_t *ysrc, const uint8_t *usrc,
                    const uint8_t *vsrc, uint8_t *dst,
@@ -329,95 +340,3 @@ void rgb12tobgr12(const uint8_t *src, uint8_t *dst, int src_size)
         d[i]         = (rgb << 8 | rgb & 0xF0 | rgb >> 8) & 0xFFF;
     }
 }
-
-#define DEFINE_RGB48TOBGR48(need_bswap, swap)                           \
-void rgb48tobgr48_ ## need_bswap(const uint8_t *src,                    \
-                                 uint8_t *dst, int src_size)            \
-{                                                                       \
-    uint16_t *d = (uint16_t *)dst;                                      \
-    const uint16_t *s = (const uint16_t *)src;                          \
-    int i, num_pixels = src_size >> 1;                                  \
-                                                                        \
-    for (i = 0; i < num_pixels; i += 3) {                               \
-        d[i    ] = swap ? av_bswap16(s[i + 2]) : s[i + 2];              \
-        d[i + 1] = swap ? av_bswap16(s[i + 1]) : s[i + 1];              \
-        d[i + 2] = swap ? av_bswap16(s[i    ]) : s[i    ];              \
-    }                                                                   \
-}
-
-DEFINE_RGB48TOBGR48(nobswap, 0)
-DEFINE_RGB48TOBGR48(bswap, 1)
-
-#define DEFINE_RGB64TOBGR48(need_bswap, swap)                           \
-void rgb64tobgr48_ ## need_bswap(const uint8_t *src,                    \
-                                 uint8_t *dst, int src_size)            \
-{                                                                       \
-    uint16_t *d = (uint16_t *)dst;                                      \
-    const uint16_t *s = (const uint16_t *)src;                          \
-    int i, num_pixels = src_size >> 3;                                  \
-                                                                        \
-    for (i = 0; i < num_pixels; i++) {                                  \
-        d[3 * i    ] = swap ? av_bswap16(s[4 * i + 2]) : s[4 * i + 2];  \
-        d[3 * i + 1] = swap ? av_bswap16(s[4 * i + 1]) : s[4 * i + 1];  \
-        d[3 * i + 2] = swap ? av_bswap16(s[4 * i    ]) : s[4 * i    ];  \
-    }                                                                   \
-}
-
-DEFINE_RGB64TOBGR48(nobswap, 0)
-DEFINE_RGB64TOBGR48(bswap, 1)
-
-#define DEFINE_RGB64TO48(need_bswap, swap)                              \
-void rgb64to48_ ## need_bswap(const uint8_t *src,                       \
-                              uint8_t *dst, int src_size)               \
-{                                                                       \
-    uint16_t *d = (uint16_t *)dst;                                      \
-    const uint16_t *s = (const uint16_t *)src;                          \
-    int i, num_pixels = src_size >> 3;                                  \
-                                                                        \
-    for (i = 0; i < num_pixels; i++) {                                  \
-        d[3 * i    ] = swap ? av_bswap16(s[4 * i    ]) : s[4 * i    ];  \
-        d[3 * i + 1] = swap ? av_bswap16(s[4 * i + 1]) : s[4 * i + 1];  \
-        d[3 * i + 2] = swap ? av_bswap16(s[4 * i + 2]) : s[4 * i + 2];  \
-    }                                                                   \
-}
-
-DEFINE_RGB64TO48(nobswap, 0)
-DEFINE_RGB64TO48(bswap, 1)
-
-#define DEFINE_RGB48TOBGR64(need_bswap, swap)                           \
-void rgb48tobgr64_ ## need_bswap(const uint8_t *src,                    \
-                                 uint8_t *dst, int src_size)            \
-{                                                                       \
-    uint16_t *d = (uint16_t *)dst;                                      \
-    const uint16_t *s = (const uint16_t *)src;                          \
-    int i, num_pixels = src_size / 6;                                   \
-                                                                        \
-    for (i = 0; i < num_pixels; i++) {                                  \
-        d[4 * i    ] = swap ? av_bswap16(s[3 * i + 2]) : s[3 * i + 2];  \
-        d[4 * i + 1] = swap ? av_bswap16(s[3 * i + 1]) : s[3 * i + 1];  \
-        d[4 * i + 2] = swap ? av_bswap16(s[3 * i    ]) : s[3 * i    ];  \
-        d[4 * i + 3] = 0xFFFF;                                          \
-    }                                                                   \
-}
-
-DEFINE_RGB48TOBGR64(nobswap, 0)
-DEFINE_RGB48TOBGR64(bswap, 1)
-
-#define DEFINE_RGB48TO64(need_bswap, swap)                              \
-void rgb48to64_ ## need_bswap(const uint8_t *src,                       \
-                              uint8_t *dst, int src_size)               \
-{                                                                       \
-    uint16_t *d = (uint16_t *)dst;                                      \
-    const uint16_t *s = (const uint16_t *)src;                          \
-    int i, num_pixels = src_size / 6;                                   \
-                                                                        \
-    for (i = 0; i < num_pixels; i++) {                                  \
-        d[4 * i    ] = swap ? av_bswap16(s[3 * i    ]) : s[3 * i    ];  \
-        d[4 * i + 1] = swap ? av_bswap16(s[3 * i + 1]) : s[3 * i + 1];  \
-        d[4 * i + 2] = swap ? av_bswap16(s[3 * i + 2]) : s[3 * i + 2];  \
-        d[4 * i + 3] = 0xFFFF;                                          \
-    }                                                                   \
-}
-
-DEFINE_RGB48TO64(nobswap, 0)
-DEFINE_RGB48TO64(bswap, 1)
@@ -53,16 +53,17 @@ extern void (*shuffle_bytes_1230)(const uint8_t *src, uint8_t *dst, int src_size
 extern void (*shuffle_bytes_3012)(const uint8_t *src, uint8_t *dst, int src_size);
 extern void (*shuffle_bytes_3210)(const uint8_t *src, uint8_t *dst, int src_size);
 
-void rgb64tobgr48_nobswap(const uint8_t *src, uint8_t *dst, int src_size);
-void   rgb64tobgr48_bswap(const uint8_t *src, uint8_t *dst, int src_size);
-void rgb48tobgr48_nobswap(const uint8_t *src, uint8_t *dst, int src_size);
-void   rgb48tobgr48_bswap(const uint8_t *src, uint8_t *dst, int src_size);
-void    rgb64to48_nobswap(const uint8_t *src, uint8_t *dst, int src_size);
-void      rgb64to48_bswap(const uint8_t *src, uint8_t *dst, int src_size);
-void rgb48tobgr64_nobswap(const uint8_t *src, uint8_t *dst, int src_size);
-void   rgb48tobgr64_bswap(const uint8_t *src, uint8_t *dst, int src_size);
-void    rgb48to64_nobswap(const uint8_t *src, uint8_t *dst, int src_size);
-void      rgb48to64_bswap(const uint8_t *src, uint8_t *dst, int src_size);
+extern void (*rgb64tobgr48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void   (*rgb64tobgr48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void (*rgb48tobgr48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void   (*rgb48tobgr48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void    (*rgb64to48_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void      (*rgb64to48_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void (*rgb48tobgr64_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void   (*rgb48tobgr64_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void    (*rgb48to64_nobswap)(const uint8_t *src, uint8_t *dst, int src_size);
+extern void      (*rgb48to64_bswap)(const uint8_t *src, uint8_t *dst, int src_size);
+
 void    rgb24to32(const uint8_t *src, uint8_t *dst, int src_size);
 void    rgb32to24(const uint8_t *src, uint8_t *dst, int src_size);
 void rgb16tobgr32(const uint8_t *src, uint8_t *dst, int src_size);
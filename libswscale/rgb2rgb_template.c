@@ -360,6 +360,98 @@ DEFINE_SHUFFLE_BYTES(1230_c, 1, 2, 3, 0)
 DEFINE_SHUFFLE_BYTES(3012_c, 3, 0, 1, 2)
 DEFINE_SHUFFLE_BYTES(3210_c, 3, 2, 1, 0)
 
+#define DEFINE_RGB48TOBGR48(need_bswap, swap)                           \
+static void rgb48tobgr48_ ## need_bswap ## _c(const uint8_t *src,       \
+                                            uint8_t *dst, int src_size) \
+{                                                                       \
+    uint16_t *d = (uint16_t *)dst;                                      \
+    const uint16_t *s = (const uint16_t *)src;                          \
+    int i, num_pixels = src_size >> 1;                                  \
+                                                                        \
+    for (i = 0; i < num_pixels; i += 3) {                               \
+        d[i    ] = swap ? av_bswap16(s[i + 2]) : s[i + 2];              \
+        d[i + 1] = swap ? av_bswap16(s[i + 1]) : s[i + 1];              \
+        d[i + 2] = swap ? av_bswap16(s[i    ]) : s[i    ];              \
+    }                                                                   \
+}
+
+DEFINE_RGB48TOBGR48(nobswap, 0)
+DEFINE_RGB48TOBGR48(bswap, 1)
+
+#define DEFINE_RGB64TOBGR48(need_bswap, swap)                           \
+static void rgb64tobgr48_ ## need_bswap ## _c(const uint8_t *src,       \
+                                            uint8_t *dst, int src_size) \
+{                                                                       \
+    uint16_t *d = (uint16_t *)dst;                                      \
+    const uint16_t *s = (const uint16_t *)src;                          \
+    int i, num_pixels = src_size >> 3;                                  \
+                                                                        \
+    for (i = 0; i < num_pixels; i++) {                                  \
+        d[3 * i    ] = swap ? av_bswap16(s[4 * i + 2]) : s[4 * i + 2];  \
+        d[3 * i + 1] = swap ? av_bswap16(s[4 * i + 1]) : s[4 * i + 1];  \
+        d[3 * i + 2] = swap ? av_bswap16(s[4 * i    ]) : s[4 * i    ];  \
+    }                                                                   \
+}
+
+DEFINE_RGB64TOBGR48(nobswap, 0)
+DEFINE_RGB64TOBGR48(bswap, 1)
+
+#define DEFINE_RGB64TO48(need_bswap, swap)                              \
+static void rgb64to48_ ## need_bswap ## _c(const uint8_t *src,          \
+                                           uint8_t *dst, int src_size)  \
+{                                                                       \
+    uint16_t *d = (uint16_t *)dst;                                      \
+    const uint16_t *s = (const uint16_t *)src;                          \
+    int i, num_pixels = src_size >> 3;                                  \
+                                                                        \
+    for (i = 0; i < num_pixels; i++) {                                  \
+        d[3 * i    ] = swap ? av_bswap16(s[4 * i    ]) : s[4 * i    ];  \
+        d[3 * i + 1] = swap ? av_bswap16(s[4 * i + 1]) : s[4 * i + 1];  \
+        d[3 * i + 2] = swap ? av_bswap16(s[4 * i + 2]) : s[4 * i + 2];  \
+    }                                                                   \
+}
+
+DEFINE_RGB64TO48(nobswap, 0)
+DEFINE_RGB64TO48(bswap, 1)
+
+#define DEFINE_RGB48TOBGR64(need_bswap, swap)                           \
+static void rgb48tobgr64_ ## need_bswap ## _c(const uint8_t *src,       \
+                                            uint8_t *dst, int src_size) \
+{                                                                       \
+    uint16_t *d = (uint16_t *)dst;                                      \
+    const uint16_t *s = (const uint16_t *)src;                          \
+    int i, num_pixels = src_size / 6;                                   \
+                                                                        \
+    for (i = 0; i < num_pixels; i++) {                                  \
+        d[4 * i    ] = swap ? av_bswap16(s[3 * i + 2]) : s[3 * i + 2];  \
+        d[4 * i + 1] = swap ? av_bswap16(s[3 * i + 1]) : s[3 * i + 1];  \
+        d[4 * i + 2] = swap ? av_bswap16(s[3 * i    ]) : s[3 * i    ];  \
+        d[4 * i + 3] = 0xFFFF;                                          \
+    }                                                                   \
+}
+
+DEFINE_RGB48TOBGR64(nobswap, 0)
+DEFINE_RGB48TOBGR64(bswap, 1)
+
+#define DEFINE_RGB48TO64(need_bswap, swap)                              \
+static void rgb48to64_ ## need_bswap ## _c(const uint8_t *src,          \
+                                           uint8_t *dst, int src_size)  \
+{                                                                       \
+    uint16_t *d = (uint16_t *)dst;                                      \
+    const uint16_t *s = (const uint16_t *)src;                          \
+    int i, num_pixels = src_size / 6;                                   \
+                                                                        \
+    for (i = 0; i < num_pixels; i++) {                                  \
+        d[4 * i    ] = swap ? av_bswap16(s[3 * i    ]) : s[3 * i    ];  \
+        d[4 * i + 1] = swap ? av_bswap16(s[3 * i + 1]) : s[3 * i + 1];  \
+        d[4 * i + 2] = swap ? av_bswap16(s[3 * i + 2]) : s[3 * i + 2];  \
+        d[4 * i + 3] = 0xFFFF;                                          \
+    }                                                                   \
+}
+
+DEFINE_RGB48TO64(nobswap, 0)
+DEFINE_RGB48TO64(bswap, 1)
+
 static inline void rgb24tobgr24_c(const uint8_t *src, uint8_t *dst, int src_size)
 {
     unsigned i;
@@ -971,6 +1063,16 @@ static av_cold void rgb2rgb_init_c(void)
     shuffle_bytes_1230 = shuffle_bytes_1230_c;
     shuffle_bytes_3012 = shuffle_bytes_3012_c;
     shuffle_bytes_3210 = shuffle_bytes_3210_c;
+    rgb64tobgr48_nobswap = rgb64tobgr48_nobswap_c;
+    rgb64tobgr48_bswap   = rgb64tobgr48_bswap_c;
+    rgb48tobgr48_nobswap = rgb48tobgr48_nobswap_c;
+    rgb48tobgr48_bswap   = rgb48tobgr48_bswap_c;
+    rgb64to48_nobswap    = rgb64to48_nobswap_c;
+    rgb64to48_bswap      = rgb64to48_bswap_c;
+    rgb48tobgr64_nobswap = rgb48tobgr64_nobswap_c;
+    rgb48tobgr64_bswap   = rgb48tobgr64_bswap_c;
+    rgb48to64_nobswap    = rgb48to64_nobswap_c;
+    rgb48to64_bswap      = rgb48to64_bswap_c;
     rgb32tobgr16       = rgb32tobgr16_c;
     rgb32tobgr15       = rgb32tobgr15_c;
     yv12toyuy2         = yv12toyuy2_c;
@@ -232,7 +232,9 @@ static void get_min_buffer_size(SwsContext *c, int *out_lum_size, int *out_chr_s
 
     for (lumY = 0; lumY < dstH; lumY++) {
         int chrY      = (int64_t)lumY * chrDstH / dstH;
-        int nextSlice = FFMAX(lumFilterPos[lumY] + lumFilterSize - 1,
+        // the scaler waits for the last luma line of the chroma line pair
+        int lastLumY  = FFMIN(lumY | ((1 << c->chrDstVSubSample) - 1), dstH - 1);
+        int nextSlice = FFMAX(lumFilterPos[lastLumY] + lumFilterSize - 1,
                               ((chrFilterPos[chrY] + chrFilterSize - 1)
                                << chrSubSample));
 
@@ -253,7 +255,7 @@ int ff_init_filters(SwsContext * c)
     int num_cdesc;
     int num_vdesc = isPlanarYUV(c->dstFormat) && !isGray(c->dstFormat) ? 2 : 1;
     int need_lum_conv = c->lumToYV12 || c->readLumPlanar || c->alpToYV12 || c->readAlpPlanar;
-    int need_chr_conv = c->chrToYV12 || c->readChrPlanar;
+    int need_chr_conv = (c->chrToYV12 || c->readChrPlanar) && !c->hcScaleNV;
     int need_gamma = c->is_internal_gamma;
     int srcIdx, dstIdx;
     int dst_stride = FFALIGN(c->dstW * sizeof(int16_t) + 66, 16);
@@ -402,3 +404,71 @@ int ff_free_filters(SwsContext *c)
     av_freep(&c->h2f_tables);
     return 0;
 }
+
+int ff_init_shared_input(SwsSharedInput *s, SwsContext *c, int lumLines, int chrLines)
+{
+    int need_lum_conv = c->lumToYV12 || c->readLumPlanar || c->alpToYV12 || c->readAlpPlanar;
+    int need_chr_conv = (c->chrToYV12 || c->readChrPlanar) && !c->hcScaleNV;
+    uint32_t *pal = (uint32_t*)c->input_rgb2yuv_table;
+    int res;
+
+    memset(s, 0, sizeof(*s));
+    s->c = c;
+
+    res = alloc_slice(&s->src, c->srcFormat, lumLines, chrLines, c->chrSrcHSubSample, c->chrSrcVSubSample, 0);
+    if (res < 0) goto cleanup;
+    // converted lines are kept in a ring, as the scalers may still need lines of the previous band
+    res = alloc_slice(&s->dst, c->srcFormat, lumLines, chrLines, c->chrSrcHSubSample, c->chrSrcVSubSample, 1);
+    if (res < 0) goto cleanup;
+    res = alloc_lines(&s->dst, FFALIGN(c->srcW*2+78, 16), c->srcW);
+    if (res < 0) goto cleanup;
+    s->conv = s->dst;
+
+    if (need_lum_conv) {
+        res = ff_init_desc_fmt_convert(&s->desc[0], &s->src, &s->conv, pal);
+        if (res < 0) goto cleanup;
+        s->desc[0].alpha = c->needAlpha;
+    }
+    if (need_chr_conv) {
+        res = ff_init_desc_cfmt_convert(&s->desc[1], &s->src, &s->conv, pal);
+        if (res < 0) goto cleanup;
+    }
+
+    return 0;
+
+cleanup:
+    ff_free_shared_input(s);
+    return res;
+}
+
+void ff_shared_input_add_lines(SwsSharedInput *s, int lumY, int lumH, int chrY, int chrH)
+{
+    const int start[4] = { lumY, chrY, chrY, lumY };
+    const int end[4]   = { lumY + lumH, chrY + chrH, chrY + chrH, lumY + lumH };
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        SwsPlane *p = &s->dst.plane[i];
+        if (start[i] != p->sliceY + p->sliceH) {
+            p->sliceY = start[i];
+            p->sliceH = 0;
+        }
+    }
+
+    ff_rotate_slice(&s->dst, end[0] - 1, end[1] - 1);
+
+    for (i = 0; i < 4; ++i) {
+        SwsPlane *p = &s->dst.plane[i];
+        s->conv.plane[i].line = p->line + start[i] - p->sliceY;
+        p->sliceH = end[i] - p->sliceY;
+    }
+}
+
+void ff_free_shared_input(SwsSharedInput *s)
+{
+    int i;
+    for (i = 0; i < FF_ARRAY_ELEMS(s->desc); ++i)
+        av_freep(&s->desc[i].instance);
+    free_slice(&s->src);
+    free_slice(&s->dst);
+}
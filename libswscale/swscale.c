@@ -152,6 +152,101 @@ static void hScale8To19_c(SwsContext *c, int16_t *_dst, int dstW,
     }
 }
 
+// semi-planar chroma, U and V interleaved in src
+static void hScale8To15NV_c(SwsContext *c, int16_t *dst1, int16_t *dst2, int dstW,
+                            const uint8_t *src, const int16_t *filter,
+                            const int32_t *filterPos, int filterSize)
+{
+    int i;
+    for (i = 0; i < dstW; i++) {
+        int j;
+        const uint8_t *s = src + 2 * filterPos[i];
+        int val1 = 0, val2 = 0;
+        for (j = 0; j < filterSize; j++) {
+            val1 += ((int)s[2 * j    ]) * filter[filterSize * i + j];
+            val2 += ((int)s[2 * j + 1]) * filter[filterSize * i + j];
+        }
+        dst1[i] = FFMIN(val1 >> 7, (1 << 15) - 1);
+        dst2[i] = FFMIN(val2 >> 7, (1 << 15) - 1);
+    }
+}
+
+static void hScale8To19NV_c(SwsContext *c, int16_t *_dst1, int16_t *_dst2, int dstW,
+                            const uint8_t *src, const int16_t *filter,
+                            const int32_t *filterPos, int filterSize)
+{
+    int i;
+    int32_t *dst1 = (int32_t *) _dst1;
+    int32_t *dst2 = (int32_t *) _dst2;
+    for (i = 0; i < dstW; i++) {
+        int j;
+        const uint8_t *s = src + 2 * filterPos[i];
+        int val1 = 0, val2 = 0;
+        for (j = 0; j < filterSize; j++) {
+            val1 += ((int)s[2 * j    ]) * filter[filterSize * i + j];
+            val2 += ((int)s[2 * j + 1]) * filter[filterSize * i + j];
+        }
+        dst1[i] = FFMIN(val1 >> 3, (1 << 19) - 1);
+        dst2[i] = FFMIN(val2 >> 3, (1 << 19) - 1);
+    }
+}
+
+#define HSCALE16_NV(endian, rb)                                                 \
+static void hScale16To15NV_ ## endian ## _c(SwsContext *c, int16_t *dst1,       \
+                                            int16_t *dst2, int dstW,            \
+                                            const uint8_t *src,                 \
+                                            const int16_t *filter,              \
+                                            const int32_t *filterPos,           \
+                                            int filterSize)                     \
+{                                                                               \
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c->srcFormat);         \
+    int shift = desc->comp[1].shift;                                            \
+    int sh    = desc->comp[1].depth - 1;                                        \
+    int i;                                                                      \
+                                                                                \
+    for (i = 0; i < dstW; i++) {                                                \
+        int j;                                                                  \
+        const uint8_t *s = src + 4 * filterPos[i];                              \
+        int val1 = 0, val2 = 0;                                                 \
+        for (j = 0; j < filterSize; j++) {                                      \
+            val1 += (rb(s + 4 * j    ) >> shift) * filter[filterSize * i + j];  \
+            val2 += (rb(s + 4 * j + 2) >> shift) * filter[filterSize * i + j];  \
+        }                                                                       \
+        dst1[i] = FFMIN(val1 >> sh, (1 << 15) - 1);                             \
+        dst2[i] = FFMIN(val2 >> sh, (1 << 15) - 1);                             \
+    }                                                                           \
+}                                                                               \
+                                                                                \
+static void hScale16To19NV_ ## endian ## _c(SwsContext *c, int16_t *_dst1,      \
+                                            int16_t *_dst2, int dstW,           \
+                                            const uint8_t *src,                 \
+                                            const int16_t *filter,              \
+                                            const int32_t *filterPos,           \
+                                            int filterSize)                     \
+{                                                                               \
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(c->srcFormat);         \
+    int32_t *dst1 = (int32_t *) _dst1;                                          \
+    int32_t *dst2 = (int32_t *) _dst2;                                          \
+    int shift = desc->comp[1].shift;                                            \
+    int sh    = desc->comp[1].depth - 1 - 4;                                    \
+    int i;                                                                      \
+                                                                                \
+    for (i = 0; i < dstW; i++) {                                                \
+        int j;                                                                  \
+        const uint8_t *s = src + 4 * filterPos[i];                              \
+        int val1 = 0, val2 = 0;                                                 \
+        for (j = 0; j < filterSize; j++) {                                      \
+            val1 += (rb(s + 4 * j    ) >> shift) * filter[filterSize * i + j];  \
+            val2 += (rb(s + 4 * j + 2) >> shift) * filter[filterSize * i + j];  \
+        }                                                                       \
+        dst1[i] = FFMIN(val1 >> sh, (1 << 19) - 1);                             \
+        dst2[i] = FFMIN(val2 >> sh, (1 << 19) - 1);                             \
+    }                                                                           \
+}
+
+HSCALE16_NV(LE, AV_RL16)
+HSCALE16_NV(BE, AV_RB16)
+
 // FIXME all pal and rgb srcFormats could do this conversion as well
 // FIXME all scalers more complex than bilinear could do half of this transform
 static void chrRangeToJpeg_c(int16_t *dstU, int16_t *dstV, int width)
@@ -285,6 +380,12 @@ static int swscale(SwsContext *c, const uint8_t *src[],
     int hasLumHoles = 1;
     int hasChrHoles = 1;
 
+    if (c->shared_input) {
+        /* the input lines have already been converted, only scale them */
+        lumStart = lumEnd - 1;
+        chrStart = chrEnd - 1;
+    }
+
     if (isPacked(c->srcFormat)) {
         src[1] =
         src[2] =
@@ -579,6 +680,15 @@ static av_cold void sws_init_swscale(SwsContext *c)
                                                  : hScale16To15_c;
     }
 
+    if (isSemiPlanarYUV(srcFormat)) {
+        if (c->srcBpc == 8)
+            c->hcScaleNV = c->dstBpc > 14 ? hScale8To19NV_c : hScale8To15NV_c;
+        else if (isBE(srcFormat))
+            c->hcScaleNV = c->dstBpc > 14 ? hScale16To19NV_BE_c : hScale16To15NV_BE_c;
+        else
+            c->hcScaleNV = c->dstBpc > 14 ? hScale16To19NV_LE_c : hScale16To15NV_LE_c;
+    }
+
     ff_sws_init_range_convert(c);
 
     if (!(isGray(srcFormat) || isGray(c->dstFormat) ||
@@ -588,7 +698,16 @@ static av_cold void sws_init_swscale(SwsContext *c)
 
 void ff_sws_init_scale(SwsContext *c)
 {
+    void (*hcScale_c)(struct SwsContext *c, int16_t *dst, int dstW,
+                      const uint8_t *src, const int16_t *filter,
+                      const int32_t *filterPos, int filterSize);
+    void (*hcScaleNV_c)(struct SwsContext *c, int16_t *dst1, int16_t *dst2,
+                        int dstW, const uint8_t *src, const int16_t *filter,
+                        const int32_t *filterPos, int filterSize);
+
     sws_init_swscale(c);
+    hcScale_c   = c->hcScale;
+    hcScaleNV_c = c->hcScaleNV;
 
 #if ARCH_PPC
     ff_sws_init_swscale_ppc(c);
@@ -601,6 +720,14 @@ void ff_sws_init_scale(SwsContext *c)
 #elif ARCH_LOONGARCH64
     ff_sws_init_swscale_loongarch(c);
 #endif
+
+    /* the fast bilinear scalers only take planar chroma */
+    if (c->hcscale_fast)
+        c->hcScaleNV = NULL;
+    /* the C semi-planar scaler is slower than the SIMD chroma conversion
+     * followed by two SIMD hcScale() calls */
+    if (c->hcScaleNV == hcScaleNV_c && c->hcScale != hcScale_c)
+        c->hcScaleNV = NULL;
 }
 
 static void reset_ptr(const uint8_t *src[], enum AVPixelFormat format)
@@ -1141,7 +1268,8 @@ int sws_receive_slice(struct SwsContext *c, unsigned int slice_start,
         return AVERROR(EAGAIN);
 
     if ((slice_start > 0 || slice_height < c->dstH) &&
-        (slice_start % align || slice_height % align)) {
+        (slice_start % align ||
+         (slice_height % align && slice_start + slice_height != c->dstH))) {
         av_log(c, AV_LOG_ERROR,
                "Incorrectly aligned output: %u/%u not multiples of %u\n",
                slice_start, slice_height, align);
@@ -1170,7 +1298,8 @@ int sws_receive_slice(struct SwsContext *c, unsigned int slice_start,
     }
 
     for (int i = 0; i < FF_ARRAY_ELEMS(dst); i++) {
-        ptrdiff_t offset = c->frame_dst->linesize[i] * (slice_start >> c->chrDstVSubSample);
+        const int vshift = (i == 1 || i == 2) ? c->chrDstVSubSample : 0;
+        ptrdiff_t offset = c->frame_dst->linesize[i] * (slice_start >> vshift);
         dst[i] = FF_PTR_ADD(c->frame_dst->data[i], offset);
     }
 
@@ -1196,6 +1325,201 @@ int sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src)
     return ret;
 }
 
+#define MULTI_BAND_LINES 16
+
+/* contexts which can be fed the source in bands of lines, some of the
+ * unscaled converters treat each slice as a separate image */
+static int scale_banded(const SwsContext *c, const AVFrame *src)
+{
+    return !c->slicethread && !c->cascaded_context[0] && !c->convert_unscaled &&
+           c->srcH == src->height;
+}
+
+static int can_share_input(const SwsContext *c)
+{
+    return !usePal(c->srcFormat) && !c->srcXYZ &&
+           !(c->src0Alpha && !c->dst0Alpha && isALPHA(c->dstFormat)) &&
+           !c->vChrDrop && !c->is_internal_gamma &&
+           (c->lumToYV12 || c->readLumPlanar || c->alpToYV12 || c->readAlpPlanar ||
+            ((c->chrToYV12 || c->readChrPlanar) && !c->hcScaleNV));
+}
+
+/* whether both contexts convert the input lines in the same way */
+static int same_input_conversion(const SwsContext *a, const SwsContext *b)
+{
+    return a->srcFormat        == b->srcFormat        &&
+           a->srcW             == b->srcW             &&
+           a->chrSrcHSubSample == b->chrSrcHSubSample &&
+           a->chrSrcVSubSample == b->chrSrcVSubSample &&
+           a->needAlpha        == b->needAlpha        &&
+           a->lumToYV12        == b->lumToYV12        &&
+           a->chrToYV12        == b->chrToYV12        &&
+           a->alpToYV12        == b->alpToYV12        &&
+           a->readLumPlanar    == b->readLumPlanar    &&
+           a->readChrPlanar    == b->readChrPlanar    &&
+           a->readAlpPlanar    == b->readAlpPlanar    &&
+           !a->hcScaleNV       == !b->hcScaleNV       &&
+           !memcmp(a->input_rgb2yuv_table, b->input_rgb2yuv_table,
+                   sizeof(a->input_rgb2yuv_table));
+}
+
+/* make the horizontal scalers of c read the lines converted by s instead of
+ * the output of its own input conversion, or restore the latter if s is NULL */
+static void set_shared_input(SwsContext *c, SwsSharedInput *s)
+{
+    for (int i = 0; i < 2; i++) {
+        SwsFilterDescriptor *desc = &c->desc[c->descIndex[i] - 1];
+        if (desc->src != &c->slice[0])
+            desc->src = s ? &s->dst : &c->slice[1];
+    }
+    c->shared_input = !!s;
+}
+
+static void convert_shared_input(SwsSharedInput *s, const uint8_t *const data[4],
+                                 const int linesize[4], int srcSliceY, int srcSliceH)
+{
+    SwsContext *c = s->c;
+    const int chrSrcSliceY = srcSliceY >> c->chrSrcVSubSample;
+    const int chrSrcSliceH = AV_CEIL_RSHIFT(srcSliceH, c->chrSrcVSubSample);
+    uint8_t *src[4];
+    int stride[4];
+
+    for (int i = 0; i < 4; i++) {
+        src[i]    = (uint8_t *)(isPacked(c->srcFormat) ? data[0]     : data[i]);
+        stride[i] =             isPacked(c->srcFormat) ? linesize[0] : linesize[i];
+    }
+
+    ff_init_slice_from_src(&s->src, src, stride, c->srcW, srcSliceY, srcSliceH,
+                           chrSrcSliceY, chrSrcSliceH, 1);
+    ff_shared_input_add_lines(s, srcSliceY, srcSliceH, chrSrcSliceY, chrSrcSliceH);
+
+    if (s->desc[0].process)
+        s->desc[0].process(c, &s->desc[0], srcSliceY, srcSliceH);
+    if (s->desc[1].process)
+        s->desc[1].process(c, &s->desc[1], chrSrcSliceY, chrSrcSliceH);
+
+    emms_c();
+}
+
+int sws_scale_frame_multi(struct SwsContext **c, AVFrame **dst, int nb_dst,
+                          const AVFrame *src)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(src->format);
+    SwsSharedInput *shared = NULL;
+    int *group = NULL;
+    int nb_started = 0, nb_shared = 0;
+    int band = MULTI_BAND_LINES, lum_history = 0, chr_history = 0;
+    int ret = 0;
+
+    if (!desc || nb_dst <= 0)
+        return AVERROR(EINVAL);
+
+    for (; nb_started < nb_dst; nb_started++) {
+        ret = sws_frame_start(c[nb_started], dst[nb_started], src);
+        if (ret < 0)
+            goto end;
+    }
+
+    group  = av_malloc_array(nb_dst, sizeof(*group));
+    shared = av_calloc(nb_dst, sizeof(*shared));
+    if (!group || !shared) {
+        av_freep(&group);
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    for (int i = 0; i < nb_dst; i++) {
+        group[i] = -1;
+        if (!scale_banded(c[i], src))
+            continue;
+
+        band = FFMAX(band, isBayer(c[i]->srcFormat) ? 2 : 1 << c[i]->chrSrcVSubSample);
+        if (can_share_input(c[i])) {
+            /* a scaler may need the input lines its ring can hold again */
+            const SwsSlice *hout = &c[i]->slice[c[i]->numSlice - 2];
+            lum_history = FFMAX(lum_history, hout->plane[0].available_lines);
+            chr_history = FFMAX(chr_history, hout->plane[1].available_lines);
+        }
+    }
+
+    /* group the contexts which can share the conversion of the input lines */
+    for (int i = 0; i < nb_dst; i++) {
+        if (!scale_banded(c[i], src) || !can_share_input(c[i]))
+            continue;
+
+        for (int j = 0; j < i; j++) {
+            if (!scale_banded(c[j], src) || !can_share_input(c[j]) ||
+                !same_input_conversion(c[i], c[j]))
+                continue;
+
+            if (group[j] < 0) {
+                ret = ff_init_shared_input(&shared[nb_shared], c[j], band + lum_history,
+                                           AV_CEIL_RSHIFT(band, c[j]->chrSrcVSubSample) + chr_history);
+                if (ret < 0)
+                    goto end;
+                group[j] = nb_shared++;
+                set_shared_input(c[j], &shared[group[j]]);
+            }
+            group[i] = group[j];
+            set_shared_input(c[i], &shared[group[i]]);
+            break;
+        }
+    }
+
+    /* pass each band of the source to all contexts while it is in the cache */
+    for (int y = 0; y < src->height; y += band) {
+        const int h = FFMIN(band, src->height - y);
+        const uint8_t *data[4];
+
+        for (int i = 0; i < 4; i++) {
+            const int vshift = (i == 1 || i == 2) ? desc->log2_chroma_h : 0;
+            data[i] = src->data[i];
+            if (data[i] && !(i == 1 && (desc->flags & AV_PIX_FMT_FLAG_PAL)))
+                data[i] += (y >> vshift) * src->linesize[i];
+        }
+
+        for (int i = 0; i < nb_shared; i++)
+            convert_shared_input(&shared[i], data, src->linesize, y, h);
+
+        for (int i = 0; i < nb_dst; i++) {
+            if (!scale_banded(c[i], src))
+                continue;
+
+            ret = scale_internal(c[i], data, src->linesize, y, h,
+                                 dst[i]->data, dst[i]->linesize, 0, c[i]->dstH);
+            if (ret < 0)
+                goto end;
+        }
+    }
+
+    for (int i = 0; i < nb_dst; i++) {
+        if (scale_banded(c[i], src))
+            continue;
+
+        ret = sws_send_slice(c[i], 0, src->height);
+        if (ret >= 0)
+            ret = sws_receive_slice(c[i], 0, dst[i]->height);
+        if (ret < 0)
+            goto end;
+    }
+    ret = 0;
+
+end:
+    for (int i = 0; i < nb_started; i++) {
+        if (group && group[i] >= 0)
+            set_shared_input(c[i], NULL);
+        if (ret < 0 && scale_banded(c[i], src))
+            c[i]->sliceDir = 0;
+        sws_frame_end(c[i]);
+    }
+    for (int i = 0; i < nb_shared; i++)
+        ff_free_shared_input(&shared[i]);
+    av_freep(&shared);
+    av_freep(&group);
+
+    return ret;
+}
+
 /**
  * swscale wrapper, so we don't need to export the SwsContext.
  * Assumes planar YUV to be in YUV order instead of YVU.
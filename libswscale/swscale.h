@@ -163,6 +163,19 @@ struct SwsContext *sws_alloc_context(void);
 av_warn_unused_result
 int sws_init_context(struct SwsContext *sws_context, SwsFilter *srcFilter, SwsFilter *dstFilter);
 
+/**
+ * Allocate a new context with the same settings as an initialized one,
+ * including the filters and colorspace details it was set up with.
+ * Filter coefficients are shared process-wide between contexts with the same
+ * geometry, so this is much cheaper than the initialization of the original
+ * context. The shared coefficients, at most 16 MiB, stay allocated until the
+ * process exits.
+ *
+ * @param sws_context the context to clone, initialized with sws_init_context()
+ * @return the new, initialized context or NULL on failure
+ */
+struct SwsContext *sws_clone_context(const struct SwsContext *sws_context);
+
 /**
  * Free the swscaler context swsContext.
  * If swsContext is NULL, then does nothing.
@@ -243,6 +256,31 @@ int sws_scale(struct SwsContext *c, const uint8_t *const srcSlice[],
  */
 int sws_scale_frame(struct SwsContext *c, AVFrame *dst, const AVFrame *src);
 
+/**
+ * Scale the source frame to several destination frames at once, e.g. for
+ * the renditions of an adaptive bitrate ladder.
+ *
+ * The source is passed to all contexts in bands of a few lines, so that it is
+ * read from memory once instead of once per destination. Contexts which
+ * convert the source in the same way (same source format, width, colorspace
+ * and alpha handling) also share this input conversion, which is then done
+ * once per band. Contexts using multiple threads, or converting the source
+ * without scaling it, process the whole frame after the others.
+ *
+ * The output is identical to calling sws_scale_frame() with each context.
+ *
+ * @param c      array of nb_dst scaling contexts, all initialized for the
+ *               dimensions and pixel format of src
+ * @param dst    array of nb_dst destination frames, dst[i] is written by c[i].
+ *               See documentation for sws_frame_start() for more details.
+ * @param nb_dst number of contexts and destination frames
+ * @param src    the source frame
+ *
+ * @return 0 on success, a negative AVERROR code on failure
+ */
+int sws_scale_frame_multi(struct SwsContext **c, AVFrame **dst, int nb_dst,
+                          const AVFrame *src);
+
 /**
  * Initialize the scaling process for a given pair of source/destination frames.
  * Must be called before any calls to sws_send_slice() and sws_receive_slice().
@@ -654,6 +654,20 @@ typedef struct SwsContext {
                     const int32_t *filterPos, int filterSize);
     /** @} */
 
+    /**
+     * Scale one horizontal line of semi-planar chroma (U and V interleaved
+     * in one plane) straight from the input, writing the first component
+     * of each pair to dst1 and the second to dst2. Set for semi-planar
+     * input formats, where it replaces chrToYV12() followed by two
+     * hcScale() calls, so the chroma lines are read only once.
+     * Same parameters and output format as hcScale(), except that src is
+     * the input line as stored, i.e. above 8 bits in the byte order and
+     * bit position of the input format.
+     */
+    void (*hcScaleNV)(struct SwsContext *c, int16_t *dst1, int16_t *dst2,
+                      int dstW, const uint8_t *src, const int16_t *filter,
+                      const int32_t *filterPos, int filterSize);
+
     /// Color range conversion function for luma plane if needed.
     void (*lumConvertRange)(int16_t *dst, int width);
     /// Color range conversion function for chroma planes if needed.
@@ -682,6 +696,13 @@ typedef struct SwsContext {
     atomic_int   data_unaligned_warned;
 
     Half2FloatTables *h2f_tables;
+
+    // copies of the filters passed to sws_init_context(), for sws_clone_context()
+    struct SwsFilter *src_filter;
+    struct SwsFilter *dst_filter;
+
+    // the input lines are converted once for several contexts by sws_scale_frame_multi()
+    int shared_input;
 } SwsContext;
 //FIXME check init (where 0)
 
@@ -1109,6 +1130,19 @@ typedef struct SwsFilterDescriptor
     int (*process)(SwsContext *c, struct SwsFilterDescriptor *desc, int sliceY, int sliceH);
 } SwsFilterDescriptor;
 
+/**
+ * Input conversion shared by several contexts with the same source format,
+ * see sws_scale_frame_multi().
+ */
+typedef struct SwsSharedInput
+{
+    SwsContext *c;                  ///< Context whose input readers are used
+    SwsSlice src;                   ///< Current band of the source frame
+    SwsSlice dst;                   ///< Ring of the last converted lines, read by the scalers
+    SwsSlice conv;                  ///< Lines of dst the current band is converted into
+    SwsFilterDescriptor desc[2];    ///< Lum and chr conversion, process is NULL if unused
+} SwsSharedInput;
+
 // warp input lines in the form (src + width*i + j) to slice format (line[i][j])
 // relative=true means first line src[x][0] otherwise first line is src[x][lum/crh Y]
 int ff_init_slice_from_src(SwsSlice * s, uint8_t *src[4], int stride[4], int srcW, int lumY, int lumH, int chrY, int chrH, int relative);
@@ -1119,6 +1153,15 @@ int ff_init_filters(SwsContext *c);
 // Free all filter data
 int ff_free_filters(SwsContext *c);
 
+// Initialize the conversion of the input of c, keeping up to @lumLines/@chrLines converted lines
+int ff_init_shared_input(SwsSharedInput *s, SwsContext *c, int lumLines, int chrLines);
+
+// Make room for the conversion of the given input lines, which follow the previously converted ones
+void ff_shared_input_add_lines(SwsSharedInput *s, int lumY, int lumH, int chrY, int chrH);
+
+// Free all shared input data
+void ff_free_shared_input(SwsSharedInput *s);
+
 /*
  function for applying ring buffer logic into slice s
  It checks if the slice can hold more @lum lines, if yes
@@ -0,0 +1,241 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Check that filter tables taken from the process-wide filter cache match
+ * freshly computed ones, and that sws_clone_context() gives a context
+ * producing the same output as the original.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+
+#include "libswscale/swscale.h"
+#include "libswscale/swscale_internal.h"
+
+/* more distinct tables than the cache holds */
+#define FLUSH_CONTEXTS 40
+
+static const struct {
+    int src_w, src_h, dst_w, dst_h;
+    enum AVPixelFormat src_fmt, dst_fmt;
+    int flags;
+} tests[] = {
+    { 352, 288, 176, 144, AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV420P, SWS_BICUBIC  },
+    { 352, 288, 640, 480, AV_PIX_FMT_YUV420P, AV_PIX_FMT_YUV422P, SWS_LANCZOS  },
+    { 320, 240, 100,  75, AV_PIX_FMT_NV12,    AV_PIX_FMT_YUV420P, SWS_BILINEAR },
+    { 320, 240, 200, 100, AV_PIX_FMT_RGB24,   AV_PIX_FMT_YUV420P, SWS_SPLINE   },
+    { 160, 120, 320, 240, AV_PIX_FMT_YUV444P, AV_PIX_FMT_BGRA,    SWS_GAUSS    },
+};
+
+static SwsContext *alloc_context(int i, int threads)
+{
+    SwsContext *c = sws_alloc_context();
+
+    if (!c)
+        return NULL;
+    av_opt_set_int(c, "srcw",       tests[i].src_w,   0);
+    av_opt_set_int(c, "srch",       tests[i].src_h,   0);
+    av_opt_set_int(c, "src_format", tests[i].src_fmt, 0);
+    av_opt_set_int(c, "dstw",       tests[i].dst_w,   0);
+    av_opt_set_int(c, "dsth",       tests[i].dst_h,   0);
+    av_opt_set_int(c, "dst_format", tests[i].dst_fmt, 0);
+    av_opt_set_int(c, "sws_flags",  tests[i].flags | SWS_ACCURATE_RND, 0);
+    av_opt_set_int(c, "threads",    threads,          0);
+    return c;
+}
+
+static SwsContext *get_context(int i, int threads, SwsFilter *filter)
+{
+    SwsContext *c = alloc_context(i, threads);
+
+    if (c && sws_init_context(c, filter, NULL) < 0) {
+        sws_freeContext(c);
+        return NULL;
+    }
+    return c;
+}
+
+/* fill the cache with tables for other geometries, evicting all others */
+static void flush_cache(void)
+{
+    for (int i = 0; i < FLUSH_CONTEXTS; i++)
+        sws_freeContext(sws_getContext(64 + i, 64 + i, AV_PIX_FMT_YUV444P,
+                                       40, 40, AV_PIX_FMT_YUV444P,
+                                       SWS_BICUBIC, NULL, NULL, NULL));
+}
+
+static int cmp_table(const void *a, const void *b, int size_a, int size_b,
+                     int dst_w, int elem_size)
+{
+    return size_a != size_b || memcmp(a, b, (size_t)dst_w * size_a * elem_size);
+}
+
+static int cmp_tables(const SwsContext *a, const SwsContext *b)
+{
+    return cmp_table(a->hLumFilter,    b->hLumFilter,    a->hLumFilterSize, b->hLumFilterSize, a->dstW,    2) ||
+           cmp_table(a->hChrFilter,    b->hChrFilter,    a->hChrFilterSize, b->hChrFilterSize, a->chrDstW, 2) ||
+           cmp_table(a->vLumFilter,    b->vLumFilter,    a->vLumFilterSize, b->vLumFilterSize, a->dstH,    2) ||
+           cmp_table(a->vChrFilter,    b->vChrFilter,    a->vChrFilterSize, b->vChrFilterSize, a->chrDstH, 2) ||
+           cmp_table(a->hLumFilterPos, b->hLumFilterPos, 1, 1, a->dstW,    4) ||
+           cmp_table(a->hChrFilterPos, b->hChrFilterPos, 1, 1, a->chrDstW, 4) ||
+           cmp_table(a->vLumFilterPos, b->vLumFilterPos, 1, 1, a->dstH,    4) ||
+           cmp_table(a->vChrFilterPos, b->vChrFilterPos, 1, 1, a->chrDstH, 4);
+}
+
+static AVFrame *alloc_frame(enum AVPixelFormat format, int w, int h)
+{
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+    frame->format = format;
+    frame->width  = w;
+    frame->height = h;
+    if (av_frame_get_buffer(frame, 0) < 0)
+        av_frame_free(&frame);
+    return frame;
+}
+
+static int cmp_frames(const AVFrame *a, const AVFrame *b)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+
+    for (int p = 0; p < 4 && a->data[p]; p++) {
+        int w = av_image_get_linesize(a->format, a->width, p);
+        int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(a->height, desc->log2_chroma_h)
+                                 : a->height;
+
+        for (int y = 0; y < h; y++)
+            if (memcmp(a->data[p] + y * a->linesize[p],
+                       b->data[p] + y * b->linesize[p], w))
+                return 1;
+    }
+    return 0;
+}
+
+/* scale the same random input with both contexts and compare the output */
+static int cmp_output(int i, SwsContext *a, SwsContext *b, AVLFG *lfg)
+{
+    AVFrame *src  = alloc_frame(tests[i].src_fmt, tests[i].src_w, tests[i].src_h);
+    AVFrame *dst0 = alloc_frame(tests[i].dst_fmt, tests[i].dst_w, tests[i].dst_h);
+    AVFrame *dst1 = alloc_frame(tests[i].dst_fmt, tests[i].dst_w, tests[i].dst_h);
+    int ret = -1;
+
+    if (!src || !dst0 || !dst1)
+        goto end;
+
+    for (int p = 0; p < 4 && src->buf[p]; p++)
+        for (int j = 0; j < src->buf[p]->size; j++)
+            src->buf[p]->data[j] = av_lfg_get(lfg);
+
+    if (sws_scale_frame(a, dst0, src) < 0 ||
+        sws_scale_frame(b, dst1, src) < 0)
+        goto end;
+    ret = cmp_frames(dst0, dst1);
+
+end:
+    av_frame_free(&src);
+    av_frame_free(&dst0);
+    av_frame_free(&dst1);
+    return ret;
+}
+
+static const char *result(int ret)
+{
+    return ret ? "FAILED" : "ok";
+}
+
+static void test_cache(int i)
+{
+    SwsContext *fresh, *cached;
+    int ret = -1;
+
+    flush_cache();
+    fresh  = get_context(i, 1, NULL);
+    cached = get_context(i, 1, NULL);
+    if (fresh && cached)
+        ret = cmp_tables(fresh, cached);
+
+    printf("cache %s %dx%d -> %s %dx%d: %s\n",
+           av_get_pix_fmt_name(tests[i].src_fmt), tests[i].src_w, tests[i].src_h,
+           av_get_pix_fmt_name(tests[i].dst_fmt), tests[i].dst_w, tests[i].dst_h,
+           result(ret));
+    sws_freeContext(fresh);
+    sws_freeContext(cached);
+}
+
+static void test_clone(int i, int threads, int filter, int colorspace, AVLFG *lfg)
+{
+    SwsFilter *src_filter = NULL;
+    SwsContext *c, *clone = NULL;
+    int ret = -1;
+
+    if (filter)
+        src_filter = sws_getDefaultFilter(1.0, 1.0, 0.5, 0.5, 0.0, 0.0, 0);
+    c = get_context(i, threads, src_filter);
+    sws_freeFilter(src_filter);
+
+    if (c && colorspace) {
+        const int *table = sws_getCoefficients(SWS_CS_ITU709);
+
+        if (sws_setColorspaceDetails(c, table, 0, table, 1,
+                                     -(1 << 12), (1 << 16) + 5000,
+                                     (1 << 16) - 3000) < 0)
+            goto end;
+    }
+    if (c && (clone = sws_clone_context(c))) {
+        ret = cmp_output(i, c, clone, lfg);
+        if (!ret && threads == 1)
+            ret = cmp_tables(c, clone);
+    }
+
+end:
+    printf("clone %s -> %s, %d threads%s%s: %s\n",
+           av_get_pix_fmt_name(tests[i].src_fmt),
+           av_get_pix_fmt_name(tests[i].dst_fmt), threads,
+           filter ? ", filter" : "", colorspace ? ", colorspace" : "",
+           result(ret));
+    sws_freeContext(c);
+    sws_freeContext(clone);
+}
+
+int main(void)
+{
+    AVLFG lfg;
+
+    av_lfg_init(&lfg, 0xdeadbeef);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++)
+        test_cache(i);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(tests); i++) {
+        test_clone(i, 1, 0, 0, &lfg);
+        test_clone(i, 1, 1, 0, &lfg);
+        test_clone(i, 1, 0, 1, &lfg);
+        test_clone(i, 3, 0, 0, &lfg);
+    }
+
+    return 0;
+}
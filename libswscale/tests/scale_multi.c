@@ -0,0 +1,194 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Scale sources of various formats to a mixed ladder of outputs with
+ * sws_scale_frame_multi() and compare the result with sws_scale_frame()
+ * called separately for each output.
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "libavutil/frame.h"
+#include "libavutil/imgutils.h"
+#include "libavutil/lfg.h"
+#include "libavutil/opt.h"
+#include "libavutil/pixdesc.h"
+
+#include "libswscale/swscale.h"
+
+#define SRC_W 320
+#define SRC_H 241
+
+static const enum AVPixelFormat src_fmts[] = {
+    AV_PIX_FMT_YUV420P, AV_PIX_FMT_NV12,    AV_PIX_FMT_NV21,
+    AV_PIX_FMT_P010LE,  AV_PIX_FMT_RGB24,   AV_PIX_FMT_BGRA,
+    AV_PIX_FMT_YUYV422, AV_PIX_FMT_RGBA64LE, AV_PIX_FMT_PAL8,
+    AV_PIX_FMT_GBRP,    AV_PIX_FMT_YUVA420P, AV_PIX_FMT_GRAY8,
+};
+
+static const struct {
+    int w, h;
+    enum AVPixelFormat format;
+    int flags, threads, range;
+} ladder[] = {
+    { SRC_W, SRC_H, AV_PIX_FMT_YUV420P, SWS_BICUBIC,       1, 0 }, // unscaled for yuv420p
+    { SRC_W, SRC_H, AV_PIX_FMT_NV12,    SWS_BICUBIC,       1, 0 }, // unscaled for nv12
+    {   200,   150, AV_PIX_FMT_YUV420P, SWS_BICUBIC,       1, 0 },
+    {   200,   150, AV_PIX_FMT_YUV420P, SWS_BICUBIC,       1, 0 },
+    {   160,    90, AV_PIX_FMT_NV12,    SWS_LANCZOS,       1, 0 },
+    {   100,    60, AV_PIX_FMT_YUV420P, SWS_FAST_BILINEAR, 1, 0 },
+    {   256,   144, AV_PIX_FMT_RGB24,   SWS_BILINEAR,      1, 0 },
+    {   176,   100, AV_PIX_FMT_YUV420P, SWS_BICUBIC,       3, 0 },
+    {   160,    90, AV_PIX_FMT_YUV420P, SWS_BICUBIC,       1, 1 },
+    {   480,   360, AV_PIX_FMT_YUV444P, SWS_SPLINE,        1, 0 },
+    {    40,    23, AV_PIX_FMT_YUV420P, SWS_AREA,          1, 0 },
+};
+
+#define NB_OUTPUTS FF_ARRAY_ELEMS(ladder)
+
+static struct SwsContext *get_context(enum AVPixelFormat src_fmt, int i)
+{
+    struct SwsContext *c = sws_alloc_context();
+
+    if (!c)
+        return NULL;
+    av_opt_set_int(c, "srcw",       SRC_W,              0);
+    av_opt_set_int(c, "srch",       SRC_H,              0);
+    av_opt_set_int(c, "src_format", src_fmt,            0);
+    av_opt_set_int(c, "dstw",       ladder[i].w,        0);
+    av_opt_set_int(c, "dsth",       ladder[i].h,        0);
+    av_opt_set_int(c, "dst_format", ladder[i].format,   0);
+    av_opt_set_int(c, "sws_flags",  ladder[i].flags | SWS_ACCURATE_RND, 0);
+    av_opt_set_int(c, "threads",    ladder[i].threads,  0);
+    av_opt_set_int(c, "dst_range",  ladder[i].range,    0);
+    if (sws_init_context(c, NULL, NULL) < 0) {
+        sws_freeContext(c);
+        return NULL;
+    }
+    return c;
+}
+
+/* some unscaled converters leave parts of the output untouched, so start
+ * from the same contents */
+static AVFrame *alloc_frame(int i)
+{
+    AVFrame *frame = av_frame_alloc();
+
+    if (!frame)
+        return NULL;
+    frame->format = ladder[i].format;
+    frame->width  = ladder[i].w;
+    frame->height = ladder[i].h;
+    if (av_frame_get_buffer(frame, 0) < 0) {
+        av_frame_free(&frame);
+        return NULL;
+    }
+    for (int p = 0; p < 4 && frame->buf[p]; p++)
+        memset(frame->buf[p]->data, 0, frame->buf[p]->size);
+    return frame;
+}
+
+static int cmp_frames(const AVFrame *a, const AVFrame *b)
+{
+    const AVPixFmtDescriptor *desc = av_pix_fmt_desc_get(a->format);
+
+    if (a->format != b->format || a->width != b->width || a->height != b->height)
+        return 1;
+
+    for (int p = 0; p < 4 && a->data[p]; p++) {
+        int w = av_image_get_linesize(a->format, a->width, p);
+        int h = p == 1 || p == 2 ? AV_CEIL_RSHIFT(a->height, desc->log2_chroma_h)
+                                 : a->height;
+
+        for (int y = 0; y < h; y++)
+            if (memcmp(a->data[p] + y * a->linesize[p],
+                       b->data[p] + y * b->linesize[p], w))
+                return 1;
+    }
+    return 0;
+}
+
+static int test(enum AVPixelFormat src_fmt, AVLFG *lfg)
+{
+    struct SwsContext *multi[NB_OUTPUTS] = { NULL }, *single[NB_OUTPUTS] = { NULL };
+    AVFrame *dst_multi[NB_OUTPUTS] = { NULL }, *dst_single[NB_OUTPUTS] = { NULL };
+    AVFrame *src = av_frame_alloc();
+    int ret = -1;
+
+    if (!src)
+        return -1;
+    src->format = src_fmt;
+    src->width  = SRC_W;
+    src->height = SRC_H;
+    if (av_frame_get_buffer(src, 0) < 0)
+        goto end;
+    for (int p = 0; p < 4 && src->buf[p]; p++)
+        for (int j = 0; j < src->buf[p]->size; j++)
+            src->buf[p]->data[j] = av_lfg_get(lfg);
+
+    for (int i = 0; i < NB_OUTPUTS; i++) {
+        multi[i]      = get_context(src_fmt, i);
+        single[i]     = get_context(src_fmt, i);
+        dst_multi[i]  = alloc_frame(i);
+        dst_single[i] = alloc_frame(i);
+        if (!multi[i] || !single[i] || !dst_multi[i] || !dst_single[i])
+            goto end;
+        if (sws_scale_frame(single[i], dst_single[i], src) < 0)
+            goto end;
+    }
+
+    if (sws_scale_frame_multi(multi, dst_multi, NB_OUTPUTS, src) < 0)
+        goto end;
+
+    ret = 0;
+    for (int i = 0; i < NB_OUTPUTS; i++) {
+        if (cmp_frames(dst_multi[i], dst_single[i])) {
+            printf("%s: output %d differs\n", av_get_pix_fmt_name(src_fmt), i);
+            ret = -1;
+        }
+    }
+
+end:
+    for (int i = 0; i < NB_OUTPUTS; i++) {
+        sws_freeContext(multi[i]);
+        sws_freeContext(single[i]);
+        av_frame_free(&dst_multi[i]);
+        av_frame_free(&dst_single[i]);
+    }
+    av_frame_free(&src);
+    return ret;
+}
+
+int main(void)
+{
+    AVLFG lfg;
+    int ret = 0;
+
+    av_lfg_init(&lfg, 1);
+
+    for (int i = 0; i < FF_ARRAY_ELEMS(src_fmts); i++) {
+        int err = test(src_fmts[i], &lfg);
+
+        printf("%s: %s\n", av_get_pix_fmt_name(src_fmts[i]), err ? "FAILED" : "ok");
+        ret |= err;
+    }
+
+    return !!ret;
+}
@@ -380,6 +380,140 @@ static const ScaleAlgorithm scale_algorithms[] = {
     { SWS_X,             "experimental",                    8 },
 };
 
+/*
+ * Process-wide cache of the tables computed by initFilter(), so that
+ * creating many contexts with the same geometry only computes them once.
+ * Only filters without user supplied vectors are cached. The cache is bounded
+ * by FILTER_CACHE_ENTRIES and FILTER_CACHE_MAX_BYTES. Entries are only freed
+ * on eviction; whatever remains is released at process exit.
+ */
+#define FILTER_CACHE_ENTRIES   32
+#define FILTER_CACHE_MAX_BYTES (16 << 20)
+
+typedef struct FilterCacheKey {
+    int xInc, srcW, dstW, filterAlign, one, flags, cpu_flags, srcPos, dstPos;
+    double param[2];
+} FilterCacheKey;
+
+typedef struct FilterCacheEntry {
+    FilterCacheKey key;
+    int16_t *filter;
+    int32_t *filterPos;
+    int      filterSize;
+    size_t   size;
+    unsigned last_use;
+} FilterCacheEntry;
+
+static AVMutex filter_cache_lock = AV_MUTEX_INITIALIZER;
+static FilterCacheEntry filter_cache[FILTER_CACHE_ENTRIES];
+static size_t   filter_cache_bytes;
+static unsigned filter_cache_clock;
+
+static int filter_cache_key_equal(const FilterCacheKey *a, const FilterCacheKey *b)
+{
+    return a->xInc        == b->xInc        && a->srcW     == b->srcW     &&
+           a->dstW        == b->dstW        && a->one      == b->one      &&
+           a->filterAlign == b->filterAlign && a->flags    == b->flags    &&
+           a->cpu_flags   == b->cpu_flags   && a->srcPos   == b->srcPos   &&
+           a->dstPos      == b->dstPos      &&
+           a->param[0]    == b->param[0]    && a->param[1] == b->param[1];
+}
+
+static void filter_cache_evict(FilterCacheEntry *e)
+{
+    filter_cache_bytes -= e->size;
+    av_freep(&e->filter);
+    av_freep(&e->filterPos);
+    e->size = 0;
+}
+
+/**
+ * @return 1 if the tables were found and copied, 0 if not found, a negative
+ *         error code on failure
+ */
+static int filter_cache_get(const FilterCacheKey *key, int16_t **outFilter,
+                            int32_t **filterPos, int *outFilterSize)
+{
+    int ret = 0;
+
+    ff_mutex_lock(&filter_cache_lock);
+    for (int i = 0; i < FILTER_CACHE_ENTRIES; i++) {
+        FilterCacheEntry *e = &filter_cache[i];
+
+        if (!e->filter || !filter_cache_key_equal(&e->key, key))
+            continue;
+
+        *filterPos = av_memdup(e->filterPos, (key->dstW + 3) * sizeof(**filterPos));
+        *outFilter = av_memdup(e->filter, (key->dstW + 3) * e->filterSize * sizeof(**outFilter));
+        if (!*filterPos || !*outFilter) {
+            av_freep(filterPos);
+            av_freep(outFilter);
+            ret = AVERROR(ENOMEM);
+            break;
+        }
+        *outFilterSize = e->filterSize;
+        e->last_use    = ++filter_cache_clock;
+        ret = 1;
+        break;
+    }
+    ff_mutex_unlock(&filter_cache_lock);
+
+    return ret;
+}
+
+static void filter_cache_add(const FilterCacheKey *key, const int16_t *filter,
+                             const int32_t *filterPos, int filterSize)
+{
+    size_t pos_size    = (key->dstW + 3) * sizeof(*filterPos);
+    size_t filter_size = (key->dstW + 3) * filterSize * sizeof(*filter);
+    FilterCacheEntry *e;
+
+    if (pos_size + filter_size > FILTER_CACHE_MAX_BYTES / 4)
+        return;
+
+    ff_mutex_lock(&filter_cache_lock);
+    for (int i = 0; i < FILTER_CACHE_ENTRIES; i++) {
+        // another thread may have computed the same tables meanwhile
+        if (filter_cache[i].filter && filter_cache_key_equal(&filter_cache[i].key, key))
+            goto end;
+    }
+
+    // evict the least recently used entries until the new one fits
+    while (filter_cache_bytes + pos_size + filter_size > FILTER_CACHE_MAX_BYTES) {
+        e = NULL;
+        for (int i = 0; i < FILTER_CACHE_ENTRIES; i++) {
+            if (filter_cache[i].filter &&
+                (!e || filter_cache[i].last_use < e->last_use))
+                e = &filter_cache[i];
+        }
+        filter_cache_evict(e);
+    }
+
+    e = &filter_cache[0];
+    for (int i = 0; i < FILTER_CACHE_ENTRIES && e->filter; i++) {
+        if (!filter_cache[i].filter || filter_cache[i].last_use < e->last_use)
+            e = &filter_cache[i];
+    }
+    if (e->filter)
+        filter_cache_evict(e);
+
+    e->filter    = av_memdup(filter,    filter_size);
+    e->filterPos = av_memdup(filterPos, pos_size);
+    if (!e->filter || !e->filterPos) {
+        av_freep(&e->filter);
+        av_freep(&e->filterPos);
+        goto end;
+    }
+    e->key        = *key;
+    e->filterSize = filterSize;
+    e->size       = pos_size + filter_size;
+    e->last_use   = ++filter_cache_clock;
+    filter_cache_bytes += e->size;
+
+end:
+    ff_mutex_unlock(&filter_cache_lock);
+}
+
 static av_cold int initFilter(int16_t **outFilter, int32_t **filterPos,
                               int *outFilterSize, int xInc, int srcW,
                               int dstW, int filterAlign, int one,
@@ -395,6 +529,20 @@ static av_cold int initFilter(int16_t **outFilter, int32_t **filterPos,
     int64_t *filter2   = NULL;
     const int64_t fone = 1LL << (54 - FFMIN(av_log2(srcW/dstW), 8));
     int ret            = -1;
+    const int cached   = !srcFilter && !dstFilter;
+    const FilterCacheKey key = {
+        .xInc      = xInc,      .srcW   = srcW,   .dstW   = dstW,
+        .one       = one,       .flags  = flags,  .filterAlign = filterAlign,
+        .cpu_flags = cpu_flags, .srcPos = srcPos, .dstPos = dstPos,
+        .param     = { param[0], param[1] },
+    };
+
+    if (cached) {
+        ret = filter_cache_get(&key, outFilter, filterPos, outFilterSize);
+        if (ret)
+            return FFMIN(ret, 0);
+        ret = -1;
+    }
 
     emms_c(); // FIXME should not be required but IS (even for non-MMX versions)
 
@@ -776,6 +924,9 @@ static av_cold int initFilter(int16_t **outFilter, int32_t **filterPos,
         (*outFilter)[k + 3 * (*outFilterSize)] = (*outFilter)[k];
     }
 
+    if (cached)
+        filter_cache_add(&key, *outFilter, *filterPos, *outFilterSize);
+
     ret = 0;
     goto done;
 nomem:
@@ -2023,6 +2174,46 @@ static int context_init_threaded(SwsContext *c,
     return 0;
 }
 
+static SwsVector *clone_vec(const SwsVector *a)
+{
+    SwsVector *vec;
+
+    if (!a)
+        return NULL;
+
+    vec = sws_allocVec(a->length);
+    if (vec)
+        memcpy(vec->coeff, a->coeff, a->length * sizeof(*a->coeff));
+
+    return vec;
+}
+
+static int copy_filter(SwsFilter **dst, const SwsFilter *src)
+{
+    SwsFilter *f;
+
+    sws_freeFilter(*dst);
+    *dst = NULL;
+
+    if (!src || (!src->lumH && !src->lumV && !src->chrH && !src->chrV))
+        return 0;
+
+    f = av_mallocz(sizeof(*f));
+    if (!f)
+        return AVERROR(ENOMEM);
+    *dst = f;
+
+    f->lumH = clone_vec(src->lumH);
+    f->lumV = clone_vec(src->lumV);
+    f->chrH = clone_vec(src->chrH);
+    f->chrV = clone_vec(src->chrV);
+    if (!!f->lumH != !!src->lumH || !!f->lumV != !!src->lumV ||
+        !!f->chrH != !!src->chrH || !!f->chrV != !!src->chrV)
+        return AVERROR(ENOMEM);
+
+    return 0;
+}
+
 av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
                              SwsFilter *dstFilter)
 {
@@ -2046,6 +2237,10 @@ av_cold int sws_init_context(SwsContext *c, SwsFilter *srcFilter,
     if (src_format != c->srcFormat || dst_format != c->dstFormat)
         av_log(c, AV_LOG_WARNING, "deprecated pixel format used, make sure you did set range correctly\n");
 
+    if ((ret = copy_filter(&c->src_filter, srcFilter)) < 0 ||
+        (ret = copy_filter(&c->dst_filter, dstFilter)) < 0)
+        return ret;
+
     if (c->nb_threads != 1) {
         ret = context_init_threaded(c, srcFilter, dstFilter);
         if (ret < 0 || c->nb_threads > 1)
@@ -2102,6 +2297,45 @@ SwsContext *sws_getContext(int srcW, int srcH, enum AVPixelFormat srcFormat,
     return c;
 }
 
+SwsContext *sws_clone_context(const SwsContext *c)
+{
+    SwsContext *clone;
+    int *inv_table, *table, src_range, dst_range, brightness, contrast, saturation;
+    int *clone_inv_table, *clone_table, clone_src_range, clone_dst_range;
+    int clone_brightness, clone_contrast, clone_saturation;
+
+    if (!(clone = sws_alloc_context()))
+        return NULL;
+
+    if (av_opt_copy(clone, c) < 0 ||
+        sws_init_context(clone, c->src_filter, c->dst_filter) < 0)
+        goto fail;
+
+    /* carry over changes made with sws_setColorspaceDetails() */
+    if (!sws_getColorspaceDetails((SwsContext *)c, &inv_table, &src_range,
+                                  &table, &dst_range, &brightness,
+                                  &contrast, &saturation) &&
+        !sws_getColorspaceDetails(clone, &clone_inv_table, &clone_src_range,
+                                  &clone_table, &clone_dst_range,
+                                  &clone_brightness, &clone_contrast,
+                                  &clone_saturation) &&
+        (src_range  != clone_src_range  || dst_range  != clone_dst_range ||
+         brightness != clone_brightness || contrast   != clone_contrast  ||
+         saturation != clone_saturation ||
+         memcmp(inv_table, clone_inv_table, 4 * sizeof(*inv_table)) ||
+         memcmp(table,     clone_table,     4 * sizeof(*table)))) {
+        if (sws_setColorspaceDetails(clone, inv_table, src_range, table,
+                                     dst_range, brightness, contrast,
+                                     saturation) < 0)
+            goto fail;
+    }
+
+    return clone;
+fail:
+    sws_freeContext(clone);
+    return NULL;
+}
+
 static int isnan_vec(SwsVector *a)
 {
     int i;
@@ -2423,6 +2657,9 @@ void sws_freeContext(SwsContext *c)
     av_freep(&c->slice_ctx);
     av_freep(&c->slice_err);
 
+    sws_freeFilter(c->src_filter);
+    sws_freeFilter(c->dst_filter);
+
     avpriv_slicethread_free(&c->slicethread);
 
     for (i = 0; i < 4; i++)
@@ -23,21 +23,28 @@
 
 %include "libavutil/x86/x86util.asm"
 
-SECTION_RODATA 32
-
-minshort:      times 8 dw 0x8000
-yuv2yuvX_16_start:  times 4 dd 0x4000 - 0x40000000
-yuv2yuvX_10_start:  times 4 dd 0x10000
-yuv2yuvX_9_start:   times 4 dd 0x20000
-yuv2yuvX_10_upper:  times 8 dw 0x3ff
-yuv2yuvX_9_upper:   times 8 dw 0x1ff
-pd_4:          times 4 dd 4
-pd_4min0x40000:times 4 dd 4 - (0x40000)
-pw_16:         times 8 dw 16
-pw_32:         times 8 dw 32
+SECTION_RODATA 64
+
+; the vertical scaler constants are loaded with mova at up to zmm width
+minshort:      times 32 dw 0x8000
+yuv2yuvX_16_start:  times 16 dd 0x4000 - 0x40000000
+yuv2yuvX_14_start:  times 16 dd 0x1000
+yuv2yuvX_12_start:  times 16 dd 0x4000
+yuv2yuvX_10_start:  times 16 dd 0x10000
+yuv2yuvX_9_start:   times 16 dd 0x20000
+yuv2yuvX_14_upper:  times 32 dw 0x3fff
+yuv2yuvX_12_upper:  times 32 dw 0xfff
+yuv2yuvX_10_upper:  times 32 dw 0x3ff
+yuv2yuvX_9_upper:   times 32 dw 0x1ff
+pd_4:          times 16 dd 4
+pd_4min0x40000:times 16 dd 4 - (0x40000)
+pw_1:          times 32 dw 1
+pw_4:          times 32 dw 4
+pw_16:         times 32 dw 16
+pw_32:         times 32 dw 32
+pw_512:        times 32 dw 512
+pw_1024:       times 32 dw 1024
 pd_255:        times 8 dd 255
-pw_512:        times 8 dw 512
-pw_1024:       times 8 dw 1024
 pd_65535_invf:             times 8 dd 0x37800080 ;1.0/65535.0
 pd_yuv2gbrp16_start:       times 8 dd -0x40000000
 pd_yuv2gbrp_y_start:       times 8 dd  (1 << 9)
@@ -106,11 +113,15 @@ SECTION .text
 ;                                     const uint8_t *dither, int offset)
 ;
 ; Scale one or $filterSize lines of source data to generate one line of output
-; data. The input is 15 bits in int16_t if $output_size is [8,10] and 19 bits in
+; data. The input is 15 bits in int16_t if $output_size is [8,14] and 19 bits in
 ; int32_t if $output_size is 16. $filter is 12 bits. $filterSize is a multiple
 ; of 2. $offset is either 0 or 3. $dither holds 8 values.
+;
+; The p010/p012 variants (<output_size> prefixed with p0) produce the luma
+; plane of the P01x formats, i.e. 10/12-bit output stored in the MSBs.
 ;-----------------------------------------------------------------------------
-%macro yuv2planeX_mainloop 2
+; %1=output-bpc, %2=alignment (u/a), %3=p0 for output stored in the MSBs
+%macro yuv2planeX_mainloop 2-3
 .pixelloop_%2:
 %assign %%i 0
     ; the rep here is for the 8-bit output MMX case, where dither covers
@@ -133,35 +144,42 @@ SECTION .text
     mova            m2,  m8
     mova            m1,  m_dith
 %endif ; x86-32/64
-%else ; %1 == 9/10/16
+%else ; %1 == 9/10/12/14/16
     mova            m1, [yuv2yuvX_%1_start]
     mova            m2,  m1
-%endif ; %1 == 8/9/10/16
+%endif ; %1 == 8/9/10/12/14/16
     movsx     cntr_reg,  fltsizem
 .filterloop_%2_ %+ %%i:
     ; input pixels
     mov             r6, [srcq+gprsize*cntr_reg-2*gprsize]
 %if %1 == 16
-    mova            m3, [r6+r5*4]
-    mova            m5, [r6+r5*4+mmsize]
-%else ; %1 == 8/9/10
-    mova            m3, [r6+r5*2]
-%endif ; %1 == 8/9/10/16
+    mov_src         m3, [r6+r5*4]
+    mov_src         m5, [r6+r5*4+mmsize]
+%else ; %1 == 8/9/10/12/14
+    mov_src         m3, [r6+r5*2]
+%endif ; %1 == 8/9/10/12/14/16
     mov             r6, [srcq+gprsize*cntr_reg-gprsize]
 %if %1 == 16
-    mova            m4, [r6+r5*4]
-    mova            m6, [r6+r5*4+mmsize]
-%else ; %1 == 8/9/10
-    mova            m4, [r6+r5*2]
-%endif ; %1 == 8/9/10/16
+    mov_src         m4, [r6+r5*4]
+    mov_src         m6, [r6+r5*4+mmsize]
+%else ; %1 == 8/9/10/12/14
+    mov_src         m4, [r6+r5*2]
+%endif ; %1 == 8/9/10/12/14/16
 
     ; coefficients
-    movd            m0, [filterq+2*cntr_reg-4] ; coeff[0], coeff[1]
 %if %1 == 16
+%if cpuflag(avx2)
+    vpbroadcastd    m0, [filterq+2*cntr_reg-4] ; coeff[0], coeff[1]
+    pslld           m7,  m0,  16
+    psrad           m7,  16                    ; coeff[0]
+    psrad           m0,  16                    ; coeff[1]
+%else ; sse4/avx
+    movd            m0, [filterq+2*cntr_reg-4] ; coeff[0], coeff[1]
     pshuflw         m7,  m0,  0          ; coeff[0]
     pshuflw         m0,  m0,  0x55       ; coeff[1]
     pmovsxwd        m7,  m7              ; word -> dword
     pmovsxwd        m0,  m0              ; word -> dword
+%endif ; avx2
 
     pmulld          m3,  m7
     pmulld          m5,  m7
@@ -172,17 +190,22 @@ SECTION .text
     paddd           m1,  m5
     paddd           m2,  m4
     paddd           m1,  m6
-%else ; %1 == 10/9/8
+%else ; %1 == 14/12/10/9/8
+%if cpuflag(avx2)
+    vpbroadcastd    m0, [filterq+2*cntr_reg-4] ; coeff[0], coeff[1]
+%else
+    movd            m0, [filterq+2*cntr_reg-4] ; coeff[0], coeff[1]
+    SPLATD          m0
+%endif ; avx2
     punpcklwd       m5,  m3,  m4
     punpckhwd       m3,  m4
-    SPLATD          m0
 
     pmaddwd         m5,  m0
     pmaddwd         m3,  m0
 
     paddd           m2,  m5
     paddd           m1,  m3
-%endif ; %1 == 8/9/10/16
+%endif ; %1 == 8/9/10/12/14/16
 
     sub       cntr_reg,  2
     jg .filterloop_%2_ %+ %%i
@@ -190,30 +213,37 @@ SECTION .text
 %if %1 == 16
     psrad           m2,  31 - %1
     psrad           m1,  31 - %1
-%else ; %1 == 10/9/8
+%else ; %1 == 14/12/10/9/8
     psrad           m2,  27 - %1
     psrad           m1,  27 - %1
-%endif ; %1 == 8/9/10/16
+%endif ; %1 == 8/9/10/12/14/16
 
 %if %1 == 8
     packssdw        m2,  m1
     packuswb        m2,  m2
     movh   [dstq+r5*1],  m2
-%else ; %1 == 9/10/16
+%else ; %1 == 9/10/12/14/16
 %if %1 == 16
     packssdw        m2,  m1
+%if mmsize == 32
+    vpermq          m2,  m2,  q3120
+%endif
     paddw           m2, [minshort]
-%else ; %1 == 9/10
+%else ; %1 == 9/10/12/14
 %if cpuflag(sse4)
     packusdw        m2,  m1
+    pminuw          m2, [yuv2yuvX_%1_upper]
 %else ; mmxext/sse2
     packssdw        m2,  m1
     pmaxsw          m2,  m6
-%endif ; mmxext/sse2/sse4/avx
     pminsw          m2, [yuv2yuvX_%1_upper]
-%endif ; %1 == 9/10/16
+%endif ; mmxext/sse2/sse4/avx/avx2/avx512
+%ifidn %3, p0
+    psllw           m2,  16 - %1
+%endif
+%endif ; %1 == 9/10/12/14/16
     mov%2   [dstq+r5*2],  m2
-%endif ; %1 == 8/9/10/16
+%endif ; %1 == 8/9/10/12/14/16
 
     add             r5,  mmsize/2
     sub             wd,  mmsize/2
@@ -223,7 +253,9 @@ SECTION .text
     jg .pixelloop_%2
 %endmacro
 
-%macro yuv2planeX_fn 3
+; %1=output-bpc, %2=number of xmm registers, %3=number of arguments,
+; %4=p0 for output stored in the MSBs
+%macro yuv2planeX_fn 3-4
 
 %if ARCH_X86_32
 %define cntr_reg fltsizeq
@@ -233,10 +265,17 @@ SECTION .text
 %define movsx movsxd
 %endif
 
-cglobal yuv2planeX_%1, %3, 8, %2, filter, fltsize, src, dst, w, dither, offset
-%if %1 == 8 || %1 == 9 || %1 == 10
+; the source lines of the V plane are only 16-byte aligned
+%if mmsize > 16
+%define mov_src movu
+%else
+%define mov_src mova
+%endif
+
+cglobal yuv2planeX_%4%1, %3, 8, %2, filter, fltsize, src, dst, w, dither, offset
+%if %1 == 8 || %1 == 9 || %1 == 10 || %1 == 12 || %1 == 14
     pxor            m6,  m6
-%endif ; %1 == 8/9/10
+%endif ; %1 == 8/9/10/12/14
 
 %if %1 == 8
 %if ARCH_X86_32
@@ -293,14 +332,14 @@ cglobal yuv2planeX_%1, %3, 8, %2, filter, fltsize, src, dst, w, dither, offset
 
 %if mmsize == 8 || %1 == 8
     yuv2planeX_mainloop %1, a
-%else ; mmsize == 16
-    test          dstq, 15
+%else ; mmsize == 16/32/64
+    test          dstq, mmsize - 1
     jnz .unaligned
-    yuv2planeX_mainloop %1, a
+    yuv2planeX_mainloop %1, a, %4
     REP_RET
 .unaligned:
-    yuv2planeX_mainloop %1, u
-%endif ; mmsize == 8/16
+    yuv2planeX_mainloop %1, u, %4
+%endif ; mmsize == 8/16/32/64
 
 %if %1 == 8
 %if ARCH_X86_32
@@ -309,9 +348,9 @@ cglobal yuv2planeX_%1, %3, 8, %2, filter, fltsize, src, dst, w, dither, offset
 %else ; x86-64
     REP_RET
 %endif ; x86-32/64
-%else ; %1 == 9/10/16
+%else ; %1 == 9/10/12/14/16
     REP_RET
-%endif ; %1 == 8/9/10/16
+%endif ; %1 == 8/9/10/12/14/16
 %endmacro
 
 %if ARCH_X86_32 && HAVE_ALIGNED_STACK == 0
@@ -323,11 +362,15 @@ INIT_XMM sse2
 yuv2planeX_fn  8, 10, 7
 yuv2planeX_fn  9,  7, 5
 yuv2planeX_fn 10,  7, 5
+yuv2planeX_fn 12,  7, 5
+yuv2planeX_fn 14,  7, 5
 
 INIT_XMM sse4
 yuv2planeX_fn  8, 10, 7
 yuv2planeX_fn  9,  7, 5
 yuv2planeX_fn 10,  7, 5
+yuv2planeX_fn 12,  7, 5
+yuv2planeX_fn 14,  7, 5
 yuv2planeX_fn 16,  8, 5
 
 %if HAVE_AVX_EXTERNAL
@@ -335,10 +378,33 @@ INIT_XMM avx
 yuv2planeX_fn  8, 10, 7
 yuv2planeX_fn  9,  7, 5
 yuv2planeX_fn 10,  7, 5
+yuv2planeX_fn 12,  7, 5
+yuv2planeX_fn 14,  7, 5
 %endif
 
-; %1=outout-bpc, %2=alignment (u/a)
-%macro yuv2plane1_mainloop 2
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+yuv2planeX_fn  9,  7, 5
+yuv2planeX_fn 10,  7, 5
+yuv2planeX_fn 12,  7, 5
+yuv2planeX_fn 14,  7, 5
+yuv2planeX_fn 16,  8, 5
+yuv2planeX_fn 10,  7, 5, p0
+yuv2planeX_fn 12,  7, 5, p0
+%endif
+
+%if HAVE_AVX512_EXTERNAL
+INIT_ZMM avx512
+yuv2planeX_fn  9,  7, 5
+yuv2planeX_fn 10,  7, 5
+yuv2planeX_fn 12,  7, 5
+yuv2planeX_fn 14,  7, 5
+yuv2planeX_fn 10,  7, 5, p0
+yuv2planeX_fn 12,  7, 5, p0
+%endif
+
+; %1=outout-bpc, %2=alignment (u/a), %3=p0 for output stored in the MSBs
+%macro yuv2plane1_mainloop 2-3
 .loop_%2:
 %if %1 == 8
     paddsw          m0, m2, [srcq+wq*2+mmsize*0]
@@ -356,18 +422,22 @@ yuv2planeX_fn 10,  7, 5
     psrad           m1, 3
     psrad           m2, 3
     psrad           m3, 3
-%if cpuflag(sse4) ; avx/sse4
+%if cpuflag(sse4) ; avx2/avx/sse4
     packusdw        m0, m1
     packusdw        m2, m3
+%if mmsize == 32
+    vpermq          m0, m0, q3120
+    vpermq          m2, m2, q3120
+%endif
 %else ; mmx/sse2
     packssdw        m0, m1
     packssdw        m2, m3
     paddw           m0, m5
     paddw           m2, m5
-%endif ; mmx/sse2/sse4/avx
+%endif ; mmx/sse2/sse4/avx/avx2
     mov%2    [dstq+wq*2+mmsize*0], m0
     mov%2    [dstq+wq*2+mmsize*1], m2
-%else ; %1 == 9/10
+%else ; %1 == 9/10/12/14
     paddsw          m0, m2, [srcq+wq*2+mmsize*0]
     paddsw          m1, m2, [srcq+wq*2+mmsize*1]
     psraw           m0, 15 - %1
@@ -376,6 +446,10 @@ yuv2planeX_fn 10,  7, 5
     pmaxsw          m1, m4
     pminsw          m0, m3
     pminsw          m1, m3
+%ifidn %3, p0
+    psllw           m0, 16 - %1
+    psllw           m1, 16 - %1
+%endif
     mov%2    [dstq+wq*2+mmsize*0], m0
     mov%2    [dstq+wq*2+mmsize*1], m1
 %endif
@@ -383,8 +457,10 @@ yuv2planeX_fn 10,  7, 5
     jl .loop_%2
 %endmacro
 
-%macro yuv2plane1_fn 3
-cglobal yuv2plane1_%1, %3, %3, %2, src, dst, w, dither, offset
+; %1=output-bpc, %2=number of xmm registers, %3=number of arguments,
+; %4=p0 for output stored in the MSBs
+%macro yuv2plane1_fn 3-4
+cglobal yuv2plane1_%4%1, %3, %3, %2, src, dst, w, dither, offset
     movsxdifnidn    wq, wd
     add             wq, mmsize - 1
     and             wq, ~(mmsize - 1)
@@ -420,22 +496,30 @@ cglobal yuv2plane1_%1, %3, %3, %2, src, dst, w, dither, offset
     pxor            m4, m4
     mova            m3, [pw_1024]
     mova            m2, [pw_16]
+%elif %1 == 12
+    pxor            m4, m4
+    mova            m3, [yuv2yuvX_12_upper]
+    mova            m2, [pw_4]
+%elif %1 == 14
+    pxor            m4, m4
+    mova            m3, [yuv2yuvX_14_upper]
+    mova            m2, [pw_1]
 %else ; %1 == 16
-%if cpuflag(sse4) ; sse4/avx
+%if cpuflag(sse4) ; sse4/avx/avx2
     mova            m4, [pd_4]
 %else ; sse2
     mova            m4, [pd_4min0x40000]
     mova            m5, [minshort]
-%endif ; sse2/sse4/avx
+%endif ; sse2/sse4/avx/avx2
 %endif ; %1 == ..
 
     ; actual pixel scaling
-    test          dstq, 15
+    test          dstq, mmsize - 1
     jnz .unaligned
-    yuv2plane1_mainloop %1, a
+    yuv2plane1_mainloop %1, a, %4
     REP_RET
 .unaligned:
-    yuv2plane1_mainloop %1, u
+    yuv2plane1_mainloop %1, u, %4
     REP_RET
 %endmacro
 
@@ -443,6 +527,8 @@ INIT_XMM sse2
 yuv2plane1_fn  8, 5, 5
 yuv2plane1_fn  9, 5, 3
 yuv2plane1_fn 10, 5, 3
+yuv2plane1_fn 12, 5, 3
+yuv2plane1_fn 14, 5, 3
 yuv2plane1_fn 16, 6, 3
 
 INIT_XMM sse4
@@ -453,10 +539,34 @@ INIT_XMM avx
 yuv2plane1_fn  8, 5, 5
 yuv2plane1_fn  9, 5, 3
 yuv2plane1_fn 10, 5, 3
+yuv2plane1_fn 12, 5, 3
+yuv2plane1_fn 14, 5, 3
+yuv2plane1_fn 16, 5, 3
+%endif
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+yuv2plane1_fn  9, 5, 3
+yuv2plane1_fn 10, 5, 3
+yuv2plane1_fn 12, 5, 3
+yuv2plane1_fn 14, 5, 3
 yuv2plane1_fn 16, 5, 3
+yuv2plane1_fn 10, 5, 3, p0
+yuv2plane1_fn 12, 5, 3, p0
+%endif
+
+%if HAVE_AVX512_EXTERNAL
+INIT_ZMM avx512
+yuv2plane1_fn  9, 5, 3
+yuv2plane1_fn 10, 5, 3
+yuv2plane1_fn 12, 5, 3
+yuv2plane1_fn 14, 5, 3
+yuv2plane1_fn 10, 5, 3, p0
+yuv2plane1_fn 12, 5, 3, p0
 %endif
 
 %undef movsx
+%undef mov_src
 
 ;-----------------------------------------------------------------------------
 ; AVX2 yuv2nv12cX implementation
@@ -568,6 +678,137 @@ INIT_YMM avx2
 yuv2nv12cX_fn yuv2nv12
 yuv2nv12cX_fn yuv2nv21
 %endif
+
+;-----------------------------------------------------------------------------
+; AVX2 yuv2p01xcX implementation
+;
+; void ff_yuv2p010cX_avx2(enum AVPixelFormat format, const uint8_t *dither,
+;                         const int16_t *filter, int filterSize,
+;                         const int16_t **u, const int16_t **v,
+;                         uint8_t *dst, int dstWidth)
+;
+; void ff_yuv2p012cX_avx2(enum AVPixelFormat format, const uint8_t *dither,
+;                         const int16_t *filter, int filterSize,
+;                         const int16_t **u, const int16_t **v,
+;                         uint8_t *dst, int dstWidth)
+;
+; Two taps are applied per iteration with pmaddwd, an odd last tap is paired
+; with a zero coefficient.
+;-----------------------------------------------------------------------------
+
+; %1 = output bits
+%macro yuv2p01xcX_fn 1
+cglobal yuv2p0%1cX, 8, 11, 11, tmp1, dither, filter, filterSize, u, v, dst, dstWidth
+    mova m8, [yuv2yuvX_%1_start]            ; rounding
+    mova m9, [yuv2yuvX_%1_upper]            ; (1 << %1) - 1 words
+    pxor m10, m10
+
+    DEFINE_ARGS tmp1, tmp2, filter, filterSize, u, v, dst, dstWidth
+
+    mov r10d, filterSized
+    and r10d, ~1                            ; number of paired taps
+    xor r8q, r8q
+
+.outer:
+    mova m0, m8                             ; uLo
+    mova m1, m8                             ; uHi
+    mova m2, m8                             ; vLo
+    mova m3, m8                             ; vHi
+    xor r9q, r9q
+    cmp r9d, r10d
+    jge .tail
+
+.inner:
+    vpbroadcastd m7, [filterq + 2 * r9q]    ; filter[j], filter[j + 1]
+
+    mov tmp1q, [uq + gprsize * r9q]
+    mov tmp2q, [uq + gprsize * r9q + gprsize]
+    movu m4, [tmp1q + 2 * r8q]
+    movu m5, [tmp2q + 2 * r8q]
+    punpcklwd m6, m4, m5
+    punpckhwd m4, m4, m5
+    pmaddwd m6, m6, m7
+    pmaddwd m4, m4, m7
+    paddd m0, m0, m6
+    paddd m1, m1, m4
+
+    mov tmp1q, [vq + gprsize * r9q]
+    mov tmp2q, [vq + gprsize * r9q + gprsize]
+    movu m4, [tmp1q + 2 * r8q]
+    movu m5, [tmp2q + 2 * r8q]
+    punpcklwd m6, m4, m5
+    punpckhwd m4, m4, m5
+    pmaddwd m6, m6, m7
+    pmaddwd m4, m4, m7
+    paddd m2, m2, m6
+    paddd m3, m3, m4
+
+    add r9d, 2
+    cmp r9d, r10d
+    jl .inner
+
+.tail:
+    cmp r9d, filterSized
+    jge .store
+    movzx tmp1d, word [filterq + 2 * r9q]
+    movd xm7, tmp1d
+    vpbroadcastd m7, xm7                    ; filter[j], 0
+
+    mov tmp1q, [uq + gprsize * r9q]
+    movu m4, [tmp1q + 2 * r8q]
+    punpcklwd m6, m4, m10
+    punpckhwd m4, m4, m10
+    pmaddwd m6, m6, m7
+    pmaddwd m4, m4, m7
+    paddd m0, m0, m6
+    paddd m1, m1, m4
+
+    mov tmp1q, [vq + gprsize * r9q]
+    movu m4, [tmp1q + 2 * r8q]
+    punpcklwd m6, m4, m10
+    punpckhwd m4, m4, m10
+    pmaddwd m6, m6, m7
+    pmaddwd m4, m4, m7
+    paddd m2, m2, m6
+    paddd m3, m3, m4
+
+.store:
+    psrad m0, m0, 27 - %1
+    psrad m1, m1, 27 - %1
+    psrad m2, m2, 27 - %1
+    psrad m3, m3, 27 - %1
+
+    ; av_clip_uintp2(), the pixels stay in order as both the unpack and
+    ; the pack work within lanes
+    packusdw m0, m0, m1                     ; u0 .. u15
+    packusdw m2, m2, m3                     ; v0 .. v15
+    pminuw m0, m0, m9
+    pminuw m2, m2, m9
+    psllw m0, m0, 16 - %1
+    psllw m2, m2, 16 - %1
+
+    ; interleave, giving u0 v0 .. u3 v3 | u8 v8 .. u11 v11 in m1 and
+    ; u4 v4 .. u7 v7 | u12 v12 .. u15 v15 in m0, then fix up the lanes
+    punpcklwd m1, m0, m2
+    punpckhwd m0, m0, m2
+    vperm2i128 m2, m1, m0, 0x20
+    vperm2i128 m1, m1, m0, 0x31
+    movu [dstq], m2
+    movu [dstq + mmsize], m1
+
+    add r8d, mmsize / 2
+    add dstq, mmsize * 2
+
+    cmp r8d, dstWidthd
+    jl .outer
+    RET
+%endmacro
+
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+yuv2p01xcX_fn 10
+yuv2p01xcX_fn 12
+%endif
 %endif ; ARCH_X86_64
 
 ;-----------------------------------------------------------------------------
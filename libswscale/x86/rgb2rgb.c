@@ -123,6 +123,36 @@ void ff_shuffle_bytes_1230_ssse3(const uint8_t *src, uint8_t *dst, int src_size)
 void ff_shuffle_bytes_3012_ssse3(const uint8_t *src, uint8_t *dst, int src_size);
 void ff_shuffle_bytes_3210_ssse3(const uint8_t *src, uint8_t *dst, int src_size);
 
+#define RGB48_64_FUNCS(opt) \
+void ff_rgb64tobgr48_nobswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void   ff_rgb64tobgr48_bswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void ff_rgb48tobgr48_nobswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void   ff_rgb48tobgr48_bswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void    ff_rgb64to48_nobswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void      ff_rgb64to48_bswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void ff_rgb48tobgr64_nobswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void   ff_rgb48tobgr64_bswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void    ff_rgb48to64_nobswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size); \
+void      ff_rgb48to64_bswap_ ## opt(const uint8_t *src, uint8_t *dst, int src_size)
+
+RGB48_64_FUNCS(ssse3);
+#if ARCH_X86_64
+RGB48_64_FUNCS(avx2);
+#endif
+
+#define ASSIGN_RGB48_64_FUNCS(opt) do { \
+    rgb64tobgr48_nobswap = ff_rgb64tobgr48_nobswap_ ## opt; \
+    rgb64tobgr48_bswap   = ff_rgb64tobgr48_bswap_   ## opt; \
+    rgb48tobgr48_nobswap = ff_rgb48tobgr48_nobswap_ ## opt; \
+    rgb48tobgr48_bswap   = ff_rgb48tobgr48_bswap_   ## opt; \
+    rgb64to48_nobswap    = ff_rgb64to48_nobswap_    ## opt; \
+    rgb64to48_bswap      = ff_rgb64to48_bswap_      ## opt; \
+    rgb48tobgr64_nobswap = ff_rgb48tobgr64_nobswap_ ## opt; \
+    rgb48tobgr64_bswap   = ff_rgb48tobgr64_bswap_   ## opt; \
+    rgb48to64_nobswap    = ff_rgb48to64_nobswap_    ## opt; \
+    rgb48to64_bswap      = ff_rgb48to64_bswap_      ## opt; \
+} while (0)
+
 #if ARCH_X86_64
 void ff_shuffle_bytes_2103_avx2(const uint8_t *src, uint8_t *dst, int src_size);
 void ff_shuffle_bytes_0321_avx2(const uint8_t *src, uint8_t *dst, int src_size);
@@ -165,6 +195,7 @@ av_cold void rgb2rgb_init_x86(void)
         shuffle_bytes_1230 = ff_shuffle_bytes_1230_ssse3;
         shuffle_bytes_3012 = ff_shuffle_bytes_3012_ssse3;
         shuffle_bytes_3210 = ff_shuffle_bytes_3210_ssse3;
+        ASSIGN_RGB48_64_FUNCS(ssse3);
     }
 #if ARCH_X86_64
     if (EXTERNAL_AVX2_FAST(cpu_flags)) {
@@ -173,6 +204,7 @@ av_cold void rgb2rgb_init_x86(void)
         shuffle_bytes_1230 = ff_shuffle_bytes_1230_avx2;
         shuffle_bytes_3012 = ff_shuffle_bytes_3012_avx2;
         shuffle_bytes_3210 = ff_shuffle_bytes_3210_avx2;
+        ASSIGN_RGB48_64_FUNCS(avx2);
     }
     if (EXTERNAL_AVX(cpu_flags)) {
         uyvytoyuv422 = ff_uyvytoyuv422_avx;
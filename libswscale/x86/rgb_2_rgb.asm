@@ -32,6 +32,21 @@ pb_shuffle1230: db 1, 2, 3, 0, 5, 6, 7, 4, 9, 10, 11, 8, 13, 14, 15, 12
 pb_shuffle3012: db 3, 0, 1, 2, 7, 4, 5, 6, 11, 8, 9, 10, 15, 12, 13, 14
 pb_shuffle3210: db 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
 
+pb_rgb48tobgr48_nobswap: db  4,  5,  2,  3,  0,  1, 10, 11,  8,  9,  6,  7, 12, 13, 14, 15
+pb_rgb48tobgr48_bswap:   db  5,  4,  3,  2,  1,  0, 11, 10,  9,  8,  7,  6, 12, 13, 14, 15
+pb_rgb64tobgr48_nobswap: db  4,  5,  2,  3,  0,  1, 12, 13, 10, 11,  8,  9, -1, -1, -1, -1
+pb_rgb64tobgr48_bswap:   db  5,  4,  3,  2,  1,  0, 13, 12, 11, 10,  9,  8, -1, -1, -1, -1
+pb_rgb64to48_nobswap:    db  0,  1,  2,  3,  4,  5,  8,  9, 10, 11, 12, 13, -1, -1, -1, -1
+pb_rgb64to48_bswap:      db  1,  0,  3,  2,  5,  4,  9,  8, 11, 10, 13, 12, -1, -1, -1, -1
+pb_rgb48tobgr64_nobswap: db  4,  5,  2,  3,  0,  1, -1, -1, 10, 11,  8,  9,  6,  7, -1, -1
+pb_rgb48tobgr64_bswap:   db  5,  4,  3,  2,  1,  0, -1, -1, 11, 10,  9,  8,  7,  6, -1, -1
+pb_rgb48to64_nobswap:    db  0,  1,  2,  3,  4,  5, -1, -1,  6,  7,  8,  9, 10, 11, -1, -1
+pb_rgb48to64_bswap:      db  1,  0,  3,  2,  5,  4, -1, -1,  7,  6,  9,  8, 11, 10, -1, -1
+pw_rgb64_alpha: times 2 dw 0, 0, 0, 0xffff
+; spread two 12-byte pixel pairs over the two lanes and back
+pd_rgb48_lanes:   dd 0, 1, 2, 6, 3, 4, 5, 7
+pd_rgb48_unlanes: dd 0, 1, 2, 4, 5, 6, 3, 7
+
 SECTION .text
 
 %macro RSHIFT_COPY 3
@@ -171,6 +186,104 @@ SHUFFLE_BYTES 3, 2, 1, 0
 %endif
 %endif
 
+;------------------------------------------------------------------------------
+; rgb48/rgb64 (const uint8_t *src, uint8_t *dst, int src_size)
+;------------------------------------------------------------------------------
+; Each lane converts two pixels. Full vectors are loaded and stored, so the
+; main loop leaves enough pixels for the over-read and the over-write of the
+; 6-byte pixel formats to stay within the buffers; those are done one by one.
+; %1 name, %2 source bytes per pixel, %3 destination bytes per pixel
+%macro RGB48_64_SHUFFLE 3
+%define px (mmsize / 8)
+cglobal %1, 3, 4, 5, src, dst, w, tmp
+    VBROADCASTI128  m0, [pb_%1]
+%if %3 == 8
+    VBROADCASTI128  m3, [pw_rgb64_alpha]
+%endif
+%if mmsize == 32
+%if %2 == 6
+    movu            m2, [pd_rgb48_lanes]
+%endif
+%if %3 == 6
+    movu            m4, [pd_rgb48_unlanes]
+%endif
+%endif
+    movsxdifnidn    wq, wd
+
+    sub             wq, (px + px / 2) * %2
+    jl .tail
+
+.loop_simd:
+%if mmsize == 32 && %2 == 6
+    vpermd          m1, m2, [srcq]
+%else
+    movu            m1, [srcq]
+%endif
+    pshufb          m1, m0
+%if %3 == 8
+    por             m1, m3
+%elif mmsize == 32
+    vpermd          m1, m4, m1
+%endif
+    movu        [dstq], m1
+    add           srcq, px * %2
+    add           dstq, px * %3
+    sub             wq, px * %2
+    jge .loop_simd
+
+.tail:
+    add             wq, (px + px / 2 - 1) * %2
+    jl .end
+
+.loop_scalar:
+%if %2 == 6
+    movd           xm1, [srcq]
+    pinsrw         xm1, [srcq + 4], 2
+%else
+    movq           xm1, [srcq]
+%endif
+    pshufb         xm1, xm0
+%if %3 == 8
+    por            xm1, xm3
+    movq        [dstq], xm1
+%else
+    movd        [dstq], xm1
+    pextrw        tmpd, xm1, 2
+    mov     [dstq + 4], tmpw
+%endif
+    add           srcq, %2
+    add           dstq, %3
+    sub             wq, %2
+    jge .loop_scalar
+
+.end:
+    RET
+%undef px
+%endmacro
+
+%macro RGB48_64_FUNCS 0
+RGB48_64_SHUFFLE rgb48tobgr48_nobswap, 6, 6
+RGB48_64_SHUFFLE rgb48tobgr48_bswap,   6, 6
+RGB48_64_SHUFFLE rgb64tobgr48_nobswap, 8, 6
+RGB48_64_SHUFFLE rgb64tobgr48_bswap,   8, 6
+RGB48_64_SHUFFLE rgb64to48_nobswap,    8, 6
+RGB48_64_SHUFFLE rgb64to48_bswap,      8, 6
+RGB48_64_SHUFFLE rgb48tobgr64_nobswap, 6, 8
+RGB48_64_SHUFFLE rgb48tobgr64_bswap,   6, 8
+RGB48_64_SHUFFLE rgb48to64_nobswap,    6, 8
+RGB48_64_SHUFFLE rgb48to64_bswap,      6, 8
+%endmacro
+
+INIT_XMM ssse3
+RGB48_64_FUNCS
+
+%if ARCH_X86_64
+%if HAVE_AVX2_EXTERNAL
+INIT_YMM avx2
+RGB48_64_FUNCS
+%endif
+%endif
+
 ;-----------------------------------------------------------------------------------------------
 ; uyvytoyuv422(uint8_t *ydst, uint8_t *udst, uint8_t *vdst,
 ;              const uint8_t *src, int width, int height,
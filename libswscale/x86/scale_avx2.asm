@@ -26,6 +26,7 @@ SECTION_RODATA 32
 
 swizzle: dd 0, 4, 1, 5, 2, 6, 3, 7
 four: times 8 dd 4
+deinterleave: times 2 db 0, 2, 1, 3, 4, 6, 5, 7, 8, 10, 9, 11, 12, 14, 13, 15
 
 SECTION .text
 
@@ -147,10 +148,154 @@ cglobal hscale8to15_%1, 7, 9, 16, pos0, dst, w, srcmem, filter, fltpos, fltsize,
 REP_RET
 %endmacro
 
+;-----------------------------------------------------------------------------
+; void hscale8to15_nv_<opt>(SwsContext *c, int16_t *dst1, int16_t *dst2,
+;                           int dstW, const uint8_t *src,
+;                           const int16_t *filter,
+;                           const int32_t *filterPos, int filterSize);
+;
+; Same as hscale8to15_X4 for semi-planar chroma: src contains interleaved
+; pairs of bytes, the first of each pair is scaled into dst1 and the second
+; into dst2. Each gather loads two pairs, which are split into the first and
+; second components of four consecutive pairs before filtering, so the
+; filter and filterPos layout is the same as for the planar functions.
+;-----------------------------------------------------------------------------
+
+; gather and split four pairs of bytes at each position in %1
+; out: %2 first components, %3 second components; clobbers %4, %6
+; %5: deinterleave shuffle, %6: gather mask
+%macro NV_GATHER 6
+    vpcmpeqd       %6, %6
+    vpgatherdd     %2, [srcmemq + %1 * 2], %6
+    vpcmpeqd       %6, %6
+    vpgatherdd     %4, [srcmemq + %1 * 2 + 4], %6
+    pshufb         %2, %5
+    pshufb         %4, %5
+    psrld          %3, %2, 16
+    pblendw        %3, %3, %4, 0xAA
+    pslld          %4, 16
+    pblendw        %2, %2, %4, 0xAA
+%endmacro
+
+; filter 8 output pixels of each component
+; %1: filterPos offset, %2: filter offset
+; out: m6 first component, m8 second component
+%macro NV_FILTER8 2
+    movu           m1, [fltposq + %1]
+    pxor           m6, m6
+    pxor           m7, m7
+    pxor           m8, m8
+    pxor           m9, m9
+    xor        innerq, innerq
+%%innerloop:
+    NV_GATHER      m1, m2, m3, m4, m12, m13
+    punpcklbw      m4, m2, m0
+    punpckhbw      m2, m0
+    punpcklbw      m5, m3, m0
+    punpckhbw      m3, m0
+    pmaddwd        m4, [filterq + innerq + %2]
+    pmaddwd        m2, [filterq + innerq + %2 + 32]
+    pmaddwd        m5, [filterq + innerq + %2]
+    pmaddwd        m3, [filterq + innerq + %2 + 32]
+    paddd          m6, m4
+    paddd          m7, m2
+    paddd          m8, m5
+    paddd          m9, m3
+    paddd          m1, m14
+    add        innerq, 0x80
+    cmp        innerq, fltsizeq
+    jl %%innerloop
+    vphaddd        m6, m6, m7
+    vphaddd        m8, m8, m9
+    vpsrad         m6, 7
+    vpsrad         m8, 7
+%endmacro
+
+%macro SCALE_NV_FUNC 0
+cglobal hscale8to15_nv, 8, 10, 16, pos0, dst1, dst2, w, srcmem, filter, fltpos, fltsize, count, inner
+    pxor m0, m0
+    mova m12, [deinterleave]
+    mova m14, [four]
+    mova m15, [swizzle]
+    xor countq, countq
+    movsxd wq, wd
+    movsxd fltsizeq, fltsized
+    ; bytes of coefficients per group of 16 output pixels and 4 taps
+    shl fltsizeq, 5
+    cmp wq, 0x10
+    jl .tail
+    sub wq, 0x10
+.loop:
+    NV_FILTER8     0, 0
+    mova          m10, m6
+    mova          m11, m8
+    NV_FILTER8  0x20, 0x40
+    vpackssdw     m10, m10, m6
+    vpackssdw     m11, m11, m8
+    vpermd        m10, m15, m10
+    vpermd        m11, m15, m11
+    movu [dst1q + countq * 2], m10
+    movu [dst2q + countq * 2], m11
+    add       filterq, fltsizeq
+    add       fltposq, 0x40
+    add        countq, 0x10
+    cmp        countq, wq
+    jle .loop
+
+    add wq, 0x10
+    cmp countq, wq
+    jge .end
+
+.tail:
+    ; the tail is filtered 4 output pixels at a time
+    shr fltsizeq, 2
+.tail_loop:
+    movu          xm1, [fltposq]
+    pxor          xm6, xm6
+    pxor          xm7, xm7
+    pxor          xm8, xm8
+    pxor          xm9, xm9
+    xor        innerq, innerq
+.tail_innerloop:
+    NV_GATHER     xm1, xm2, xm3, xm4, xm12, xm13
+    punpcklbw     xm4, xm2, xm0
+    punpckhbw     xm2, xm0
+    punpcklbw     xm5, xm3, xm0
+    punpckhbw     xm3, xm0
+    pmaddwd       xm4, [filterq + innerq]
+    pmaddwd       xm2, [filterq + innerq + 0x10]
+    pmaddwd       xm5, [filterq + innerq]
+    pmaddwd       xm3, [filterq + innerq + 0x10]
+    paddd         xm6, xm4
+    paddd         xm7, xm2
+    paddd         xm8, xm5
+    paddd         xm9, xm3
+    paddd         xm1, xm14
+    add        innerq, 0x20
+    cmp        innerq, fltsizeq
+    jl .tail_innerloop
+    vphaddd       xm6, xm6, xm7
+    vphaddd       xm8, xm8, xm9
+    vpsrad        xm6, 7
+    vpsrad        xm8, 7
+    vpackssdw     xm6, xm6, xm6
+    vpackssdw     xm8, xm8, xm8
+    vmovq [dst1q + countq * 2], xm6
+    vmovq [dst2q + countq * 2], xm8
+    add       filterq, fltsizeq
+    add       fltposq, 0x10
+    add        countq, 0x4
+    cmp        countq, wq
+    jl .tail_loop
+.end:
+    RET
+%endmacro
+
 %if ARCH_X86_64
 %if HAVE_AVX2_EXTERNAL
 INIT_YMM avx2
 SCALE_FUNC 4
 SCALE_FUNC X4
+SCALE_NV_FUNC
 %endif
 %endif
@@ -265,33 +265,59 @@ SCALE_FUNCS_SSE(sse4);
 SCALE_FUNC(4, 8, 15, avx2);
 SCALE_FUNC(X4, 8, 15, avx2);
 
+void ff_hscale8to15_nv_avx2(SwsContext *c, int16_t *dst1, int16_t *dst2,
+                            int dstW, const uint8_t *src, const int16_t *filter,
+                            const int32_t *filterPos, int filterSize);
+
 #define VSCALEX_FUNC(size, opt) \
 void ff_yuv2planeX_ ## size ## _ ## opt(const int16_t *filter, int filterSize, \
                                         const int16_t **src, uint8_t *dest, int dstW, \
                                         const uint8_t *dither, int offset)
+#define VSCALEX_HBD_FUNCS(opt) \
+    VSCALEX_FUNC(9,  opt); \
+    VSCALEX_FUNC(10, opt); \
+    VSCALEX_FUNC(12, opt); \
+    VSCALEX_FUNC(14, opt)
 #define VSCALEX_FUNCS(opt) \
     VSCALEX_FUNC(8,  opt); \
-    VSCALEX_FUNC(9,  opt); \
-    VSCALEX_FUNC(10, opt)
+    VSCALEX_HBD_FUNCS(opt)
 
 VSCALEX_FUNC(8, mmxext);
 VSCALEX_FUNCS(sse2);
 VSCALEX_FUNCS(sse4);
 VSCALEX_FUNC(16, sse4);
 VSCALEX_FUNCS(avx);
+VSCALEX_HBD_FUNCS(avx2);
+VSCALEX_FUNC(16, avx2);
+VSCALEX_FUNC(p010, avx2);
+VSCALEX_FUNC(p012, avx2);
+VSCALEX_HBD_FUNCS(avx512);
+VSCALEX_FUNC(p010, avx512);
+VSCALEX_FUNC(p012, avx512);
 
 #define VSCALE_FUNC(size, opt) \
 void ff_yuv2plane1_ ## size ## _ ## opt(const int16_t *src, uint8_t *dst, int dstW, \
                                         const uint8_t *dither, int offset)
+#define VSCALE_HBD_FUNCS(opt) \
+    VSCALE_FUNC(9,  opt); \
+    VSCALE_FUNC(10, opt); \
+    VSCALE_FUNC(12, opt); \
+    VSCALE_FUNC(14, opt)
 #define VSCALE_FUNCS(opt1, opt2) \
     VSCALE_FUNC(8,  opt1); \
-    VSCALE_FUNC(9,  opt2); \
-    VSCALE_FUNC(10, opt2); \
+    VSCALE_HBD_FUNCS(opt2); \
     VSCALE_FUNC(16, opt1)
 
 VSCALE_FUNCS(sse2, sse2);
 VSCALE_FUNC(16, sse4);
 VSCALE_FUNCS(avx, avx);
+VSCALE_HBD_FUNCS(avx2);
+VSCALE_FUNC(16, avx2);
+VSCALE_FUNC(p010, avx2);
+VSCALE_FUNC(p012, avx2);
+VSCALE_HBD_FUNCS(avx512);
+VSCALE_FUNC(p010, avx512);
+VSCALE_FUNC(p012, avx512);
 
 #define INPUT_Y_FUNC(fmt, opt) \
 void ff_ ## fmt ## ToY_  ## opt(uint8_t *dst, const uint8_t *src, \
@@ -331,6 +357,8 @@ void ff_yuv2 ## fmt ## cX_ ## opt(enum AVPixelFormat format, const uint8_t *dith
 
 YUV2NV_DECL(nv12, avx2);
 YUV2NV_DECL(nv21, avx2);
+YUV2NV_DECL(p010, avx2);
+YUV2NV_DECL(p012, avx2);
 
 #define YUV2GBRP_FN_DECL(fmt, opt)                                                      \
 void ff_yuv2##fmt##_full_X_ ##opt(SwsContext *c, const int16_t *lumFilter,           \
@@ -503,6 +531,8 @@ av_cold void ff_sws_init_swscale_x86(SwsContext *c)
 #define ASSIGN_VSCALEX_FUNC(vscalefn, opt, do_16_case, condition_8bit) \
 switch(c->dstBpc){ \
     case 16:                          do_16_case;                          break; \
+    case 14: if (!isBE(c->dstFormat)) vscalefn = ff_yuv2planeX_14_ ## opt; break; \
+    case 12: if (!isBE(c->dstFormat) && !isSemiPlanarYUV(c->dstFormat)) vscalefn = ff_yuv2planeX_12_ ## opt; break; \
     case 10: if (!isBE(c->dstFormat) && !isSemiPlanarYUV(c->dstFormat)) vscalefn = ff_yuv2planeX_10_ ## opt; break; \
     case 9:  if (!isBE(c->dstFormat)) vscalefn = ff_yuv2planeX_9_  ## opt; break; \
     case 8: if ((condition_8bit) && !c->use_mmx_vfilter) vscalefn = ff_yuv2planeX_8_  ## opt; break; \
@@ -510,11 +540,47 @@ switch(c->dstBpc){ \
 #define ASSIGN_VSCALE_FUNC(vscalefn, opt) \
     switch(c->dstBpc){ \
     case 16: if (!isBE(c->dstFormat)) vscalefn = ff_yuv2plane1_16_ ## opt; break; \
+    case 14: if (!isBE(c->dstFormat)) vscalefn = ff_yuv2plane1_14_ ## opt; break; \
+    case 12: if (!isBE(c->dstFormat) && !isSemiPlanarYUV(c->dstFormat)) vscalefn = ff_yuv2plane1_12_ ## opt; break; \
     case 10: if (!isBE(c->dstFormat) && !isSemiPlanarYUV(c->dstFormat)) vscalefn = ff_yuv2plane1_10_ ## opt; break; \
     case 9:  if (!isBE(c->dstFormat)) vscalefn = ff_yuv2plane1_9_  ## opt;  break; \
     case 8:                           vscalefn = ff_yuv2plane1_8_  ## opt;  break; \
     default: av_assert0(c->dstBpc>8); \
     }
+#define ASSIGN_VSCALE_PAIR(size, opt) do { \
+    c->yuv2planeX = ff_yuv2planeX_ ## size ## _ ## opt; \
+    if (!(c->flags & SWS_ACCURATE_RND)) \
+        c->yuv2plane1 = ff_yuv2plane1_ ## size ## _ ## opt; \
+} while (0)
+/* 9 to 16 bit output only, including the luma plane of the P01x formats */
+#define ASSIGN_VSCALE_HBD_FUNCS(opt, do_16_case) \
+    if (!isBE(c->dstFormat)) { \
+        int semi_planar = isSemiPlanarYUV(c->dstFormat); \
+        int p01x = semi_planar && isDataInHighBits(c->dstFormat); \
+        switch (c->dstBpc) { \
+        case 16: \
+            do_16_case; \
+            break; \
+        case 14: \
+            ASSIGN_VSCALE_PAIR(14, opt); \
+            break; \
+        case 12: \
+            if (p01x) \
+                ASSIGN_VSCALE_PAIR(p012, opt); \
+            else if (!semi_planar) \
+                ASSIGN_VSCALE_PAIR(12, opt); \
+            break; \
+        case 10: \
+            if (p01x) \
+                ASSIGN_VSCALE_PAIR(p010, opt); \
+            else if (!semi_planar) \
+                ASSIGN_VSCALE_PAIR(10, opt); \
+            break; \
+        case 9: \
+            ASSIGN_VSCALE_PAIR(9, opt); \
+            break; \
+        } \
+    }
 #define case_rgb(x, X, opt) \
         case AV_PIX_FMT_ ## X: \
             c->lumToYV12 = ff_ ## x ## ToY_ ## opt; \
@@ -618,6 +684,12 @@ switch(c->dstBpc){ \
         }
     }
 
+    if (EXTERNAL_AVX2_FAST(cpu_flags))
+        ASSIGN_VSCALE_HBD_FUNCS(avx2, ASSIGN_VSCALE_PAIR(16, avx2));
+
+    if (EXTERNAL_AVX512(cpu_flags))
+        ASSIGN_VSCALE_HBD_FUNCS(avx512, );
+
 #if ARCH_X86_64
 #define ASSIGN_AVX2_SCALE_FUNC(hscalefn, filtersize) \
     switch (filtersize) { \
@@ -630,6 +702,10 @@ switch(c->dstBpc){ \
         if ((c->srcBpc == 8) && (c->dstBpc <= 14)) {
             ASSIGN_AVX2_SCALE_FUNC(c->hcScale, c->hChrFilterSize);
             ASSIGN_AVX2_SCALE_FUNC(c->hyScale, c->hLumFilterSize);
+            /* high bit depth semi-planar input keeps the SIMD conversion
+             * and hcScale() pair, ff_sws_init_scale() drops the C version */
+            if (c->hcScaleNV)
+                c->hcScaleNV = ff_hscale8to15_nv_avx2;
         }
     }
 
@@ -643,6 +719,14 @@ switch(c->dstBpc){ \
         case AV_PIX_FMT_NV42:
             c->yuv2nv12cX = ff_yuv2nv21cX_avx2;
             break;
+        case AV_PIX_FMT_P010LE:
+        case AV_PIX_FMT_P210LE:
+        case AV_PIX_FMT_P410LE:
+            c->yuv2nv12cX = ff_yuv2p010cX_avx2;
+            break;
+        case AV_PIX_FMT_P012LE:
+            c->yuv2nv12cX = ff_yuv2p012cX_avx2;
+            break;
         default:
             break;
         }
@@ -68,6 +68,37 @@ static void check_shuffle_bytes(void * func, const char * report)
     }
 }
 
+#define MAX_PIXELS 64
+
+static void check_rgb48_64(void *func, const char *report, int src_bpp, int dst_bpp)
+{
+    LOCAL_ALIGNED_32(uint8_t, src0, [MAX_PIXELS * 8]);
+    LOCAL_ALIGNED_32(uint8_t, src1, [MAX_PIXELS * 8]);
+    LOCAL_ALIGNED_32(uint8_t, dst0, [MAX_PIXELS * 8]);
+    LOCAL_ALIGNED_32(uint8_t, dst1, [MAX_PIXELS * 8]);
+
+    declare_func(void, const uint8_t *src, uint8_t *dst, int src_size);
+
+    randomize_buffers(src0, MAX_PIXELS * 8);
+    memcpy(src1, src0, MAX_PIXELS * 8);
+
+    if (check_func(func, "%s", report)) {
+        for (int i = 0; i <= 16; i++) {
+            // Try all widths [1,16], and try one random width.
+            int w = i > 0 ? i : 1 + rnd() % MAX_PIXELS;
+
+            memset(dst0, 0, MAX_PIXELS * 8);
+            memset(dst1, 0, MAX_PIXELS * 8);
+            call_ref(src0, dst0, w * src_bpp);
+            call_new(src1, dst1, w * src_bpp);
+            // Compare the whole buffer to catch overwrites past the end.
+            if (memcmp(dst0, dst1, MAX_PIXELS * 8))
+                fail();
+        }
+        bench_new(src0, dst0, MAX_PIXELS * src_bpp);
+    }
+}
+
 static void check_uyvy_to_422p(void)
 {
     int i;
@@ -198,6 +229,18 @@ void checkasm_check_sw_rgb(void)
     check_shuffle_bytes(shuffle_bytes_3210, "shuffle_bytes_3210");
     report("shuffle_bytes_3210");
 
+    check_rgb48_64(rgb48tobgr48_nobswap, "rgb48tobgr48_nobswap", 6, 6);
+    check_rgb48_64(rgb48tobgr48_bswap,   "rgb48tobgr48_bswap",   6, 6);
+    check_rgb48_64(rgb64tobgr48_nobswap, "rgb64tobgr48_nobswap", 8, 6);
+    check_rgb48_64(rgb64tobgr48_bswap,   "rgb64tobgr48_bswap",   8, 6);
+    check_rgb48_64(rgb64to48_nobswap,    "rgb64to48_nobswap",    8, 6);
+    check_rgb48_64(rgb64to48_bswap,      "rgb64to48_bswap",      8, 6);
+    check_rgb48_64(rgb48tobgr64_nobswap, "rgb48tobgr64_nobswap", 6, 8);
+    check_rgb48_64(rgb48tobgr64_bswap,   "rgb48tobgr64_bswap",   6, 8);
+    check_rgb48_64(rgb48to64_nobswap,    "rgb48to64_nobswap",    6, 8);
+    check_rgb48_64(rgb48to64_bswap,      "rgb48to64_bswap",      6, 8);
+    report("rgb48_64");
+
     check_uyvy_to_422p();
     report("uyvytoyuv422");
 
@@ -253,6 +253,214 @@ static void check_yuv2yuvX(int accurate)
 #undef FILTER_SIZES
 }
 
+static const enum AVPixelFormat hbd_formats[] = {
+    AV_PIX_FMT_YUV420P9LE,  AV_PIX_FMT_YUV420P10LE, AV_PIX_FMT_YUV420P12LE,
+    AV_PIX_FMT_YUV420P14LE, AV_PIX_FMT_YUV420P16LE,
+    AV_PIX_FMT_P010LE,      AV_PIX_FMT_P012LE,
+};
+
+static void init_hbd_context(struct SwsContext *ctx, enum AVPixelFormat format)
+{
+    ctx->dstFormat = format;
+    ctx->dstBpc    = av_pix_fmt_desc_get(format)->comp[0].depth;
+    ff_sws_init_scale(ctx);
+}
+
+static void randomize_hbd_input(int16_t *src, int n, int bits)
+{
+    int i;
+    if (bits == 16) {
+        // 19 bit input, exceeding the output range on both sides
+        int32_t *src32 = (int32_t*)src;
+        for (i = 0; i < n; i++)
+            src32[i] = (int)(rnd() & 0xfffff) - 0x40000;
+    } else {
+        randomize_buffers((uint8_t*)src, n * sizeof(int16_t));
+    }
+}
+
+static void check_yuv2yuv1_hbd(void)
+{
+    struct SwsContext *ctx;
+    int fi, isi, dstW, bits;
+    static const int input_sizes[] = {8, 24, 128, 144, 256, 512};
+    const int INPUT_SIZES = FF_ARRAY_ELEMS(input_sizes);
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void,
+                      const int16_t *src, uint8_t *dest,
+                      int dstW, const uint8_t *dither, int offset);
+
+    // int32_t for 16 bit output
+    LOCAL_ALIGNED_32(int32_t, src_pixels, [LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(uint16_t, dst0, [LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(uint16_t, dst1, [LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_8(uint8_t, dither, [8]);
+
+    randomize_buffers(dither, 8);
+    ctx = sws_alloc_context();
+    if (sws_init_context(ctx, NULL, NULL) < 0)
+        fail();
+
+    for (fi = 0; fi < FF_ARRAY_ELEMS(hbd_formats); fi++) {
+        const char *name = av_get_pix_fmt_name(hbd_formats[fi]);
+        init_hbd_context(ctx, hbd_formats[fi]);
+        bits = ctx->dstBpc;
+        randomize_hbd_input((int16_t*)src_pixels, LARGEST_INPUT_SIZE, bits);
+
+        for (isi = 0; isi < INPUT_SIZES; isi++) {
+            dstW = input_sizes[isi];
+            if (check_func(ctx->yuv2plane1, "yuv2yuv1_%s_%d", name, dstW)) {
+                memset(dst0, 0, LARGEST_INPUT_SIZE * sizeof(dst0[0]));
+                memset(dst1, 0, LARGEST_INPUT_SIZE * sizeof(dst1[0]));
+
+                call_ref((const int16_t*)src_pixels, (uint8_t*)dst0, dstW, dither, 0);
+                call_new((const int16_t*)src_pixels, (uint8_t*)dst1, dstW, dither, 0);
+                if (memcmp(dst0, dst1, dstW * sizeof(dst0[0]))) {
+                    fail();
+                    printf("failed: yuv2yuv1_%s_%d\n", name, dstW);
+                    show_differences((uint8_t*)dst0, (uint8_t*)dst1, dstW * sizeof(dst0[0]));
+                }
+                if (dstW == LARGEST_INPUT_SIZE)
+                    bench_new((const int16_t*)src_pixels, (uint8_t*)dst1, dstW, dither, 0);
+            }
+        }
+    }
+    sws_freeContext(ctx);
+}
+
+static void check_yuv2yuvX_hbd(void)
+{
+    struct SwsContext *ctx;
+    int fi, fsi, isi, i, dstW, bits;
+    static const int filter_sizes[] = {2, 4, 8, 16};
+    static const int input_sizes[] = {8, 24, 128, 144, 256, 512};
+    const int INPUT_SIZES = FF_ARRAY_ELEMS(input_sizes);
+    const int16_t *src[LARGEST_FILTER];
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void, const int16_t *filter,
+                      int filterSize, const int16_t **src, uint8_t *dest,
+                      int dstW, const uint8_t *dither, int offset);
+
+    // int32_t for 16 bit output
+    LOCAL_ALIGNED_32(int32_t, src_pixels, [LARGEST_FILTER * LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(int16_t, filter_coeff, [LARGEST_FILTER]);
+    LOCAL_ALIGNED_32(uint16_t, dst0, [LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(uint16_t, dst1, [LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_8(uint8_t, dither, [8]);
+
+    randomize_buffers(dither, 8);
+    ctx = sws_alloc_context();
+    if (sws_init_context(ctx, NULL, NULL) < 0)
+        fail();
+
+    for (fi = 0; fi < FF_ARRAY_ELEMS(hbd_formats); fi++) {
+        const char *name = av_get_pix_fmt_name(hbd_formats[fi]);
+        init_hbd_context(ctx, hbd_formats[fi]);
+        bits = ctx->dstBpc;
+        randomize_hbd_input((int16_t*)src_pixels, LARGEST_FILTER * LARGEST_INPUT_SIZE, bits);
+        for (i = 0; i < LARGEST_FILTER; i++)
+            src[i] = bits == 16 ? (const int16_t*)&src_pixels[i * LARGEST_INPUT_SIZE] :
+                                  (const int16_t*)src_pixels + i * LARGEST_INPUT_SIZE;
+
+        for (fsi = 0; fsi < FF_ARRAY_ELEMS(filter_sizes); fsi++) {
+            // same coefficients as in check_yuv2yuvX()
+            for (i = 0; i < filter_sizes[fsi]; i++)
+                filter_coeff[i] = -((1 << 12) / (filter_sizes[fsi] - 1));
+            filter_coeff[rnd() % filter_sizes[fsi]] = (1 << 13) - 1;
+
+            for (isi = 0; isi < INPUT_SIZES; isi++) {
+                dstW = input_sizes[isi];
+                if (check_func(ctx->yuv2planeX, "yuv2yuvX_%s_%d_%d", name, filter_sizes[fsi], dstW)) {
+                    memset(dst0, 0, LARGEST_INPUT_SIZE * sizeof(dst0[0]));
+                    memset(dst1, 0, LARGEST_INPUT_SIZE * sizeof(dst1[0]));
+
+                    call_ref(filter_coeff, filter_sizes[fsi], src, (uint8_t*)dst0, dstW, dither, 0);
+                    call_new(filter_coeff, filter_sizes[fsi], src, (uint8_t*)dst1, dstW, dither, 0);
+                    if (memcmp(dst0, dst1, dstW * sizeof(dst0[0]))) {
+                        fail();
+                        printf("failed: yuv2yuvX_%s_%d_%d\n", name, filter_sizes[fsi], dstW);
+                        show_differences((uint8_t*)dst0, (uint8_t*)dst1, dstW * sizeof(dst0[0]));
+                    }
+                    if (dstW == LARGEST_INPUT_SIZE)
+                        bench_new(filter_coeff, filter_sizes[fsi], src, (uint8_t*)dst1, dstW, dither, 0);
+                }
+            }
+        }
+    }
+    sws_freeContext(ctx);
+}
+
+static void check_yuv2p01xcX(void)
+{
+    struct SwsContext *ctx;
+    int fi, fsi, isi, i, dstW;
+    static const enum AVPixelFormat formats[] = { AV_PIX_FMT_P010LE, AV_PIX_FMT_P012LE };
+    // odd sizes happen for unscaled chroma
+    static const int filter_sizes[] = {1, 2, 3, 4, 8, 16};
+    static const int input_sizes[] = {8, 24, 128, 144, 256, 512};
+    const int INPUT_SIZES = FF_ARRAY_ELEMS(input_sizes);
+    const int16_t *srcU[LARGEST_FILTER], *srcV[LARGEST_FILTER];
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void, enum AVPixelFormat format,
+                      const uint8_t *dither, const int16_t *filter,
+                      int filterSize, const int16_t **u, const int16_t **v,
+                      uint8_t *dst, int dstWidth);
+
+    LOCAL_ALIGNED_32(int16_t, src_pixels, [2 * LARGEST_FILTER * LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(int16_t, filter_coeff, [LARGEST_FILTER]);
+    LOCAL_ALIGNED_32(uint16_t, dst0, [2 * LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_32(uint16_t, dst1, [2 * LARGEST_INPUT_SIZE]);
+    LOCAL_ALIGNED_8(uint8_t, dither, [8]);
+
+    randomize_buffers(dither, 8);
+    randomize_buffers((uint8_t*)src_pixels, 2 * LARGEST_FILTER * LARGEST_INPUT_SIZE * sizeof(int16_t));
+    for (i = 0; i < LARGEST_FILTER; i++) {
+        srcU[i] = src_pixels + i * LARGEST_INPUT_SIZE;
+        srcV[i] = src_pixels + (LARGEST_FILTER + i) * LARGEST_INPUT_SIZE;
+    }
+
+    ctx = sws_alloc_context();
+    if (sws_init_context(ctx, NULL, NULL) < 0)
+        fail();
+
+    for (fi = 0; fi < FF_ARRAY_ELEMS(formats); fi++) {
+        const char *name = av_get_pix_fmt_name(formats[fi]);
+        init_hbd_context(ctx, formats[fi]);
+
+        for (fsi = 0; fsi < FF_ARRAY_ELEMS(filter_sizes); fsi++) {
+            if (filter_sizes[fsi] == 1) {
+                filter_coeff[0] = 1 << 12;
+            } else {
+                for (i = 0; i < filter_sizes[fsi]; i++)
+                    filter_coeff[i] = -((1 << 12) / (filter_sizes[fsi] - 1));
+                filter_coeff[rnd() % filter_sizes[fsi]] = (1 << 13) - 1;
+            }
+
+            for (isi = 0; isi < INPUT_SIZES; isi++) {
+                dstW = input_sizes[isi];
+                if (check_func(ctx->yuv2nv12cX, "yuv2nv12cX_%s_%d_%d", name, filter_sizes[fsi], dstW)) {
+                    memset(dst0, 0, 2 * LARGEST_INPUT_SIZE * sizeof(dst0[0]));
+                    memset(dst1, 0, 2 * LARGEST_INPUT_SIZE * sizeof(dst1[0]));
+
+                    call_ref(formats[fi], dither, filter_coeff, filter_sizes[fsi],
+                             srcU, srcV, (uint8_t*)dst0, dstW);
+                    call_new(formats[fi], dither, filter_coeff, filter_sizes[fsi],
+                             srcU, srcV, (uint8_t*)dst1, dstW);
+                    if (memcmp(dst0, dst1, 2 * dstW * sizeof(dst0[0]))) {
+                        fail();
+                        printf("failed: yuv2nv12cX_%s_%d_%d\n", name, filter_sizes[fsi], dstW);
+                        show_differences((uint8_t*)dst0, (uint8_t*)dst1, 2 * dstW * sizeof(dst0[0]));
+                    }
+                    if (dstW == LARGEST_INPUT_SIZE)
+                        bench_new(formats[fi], dither, filter_coeff, filter_sizes[fsi],
+                                  srcU, srcV, (uint8_t*)dst1, dstW);
+                }
+            }
+        }
+    }
+    sws_freeContext(ctx);
+}
+
 #undef SRC_PIXELS
 #define SRC_PIXELS 512
 
@@ -358,14 +566,105 @@ static void check_hscale(void)
     sws_freeContext(ctx);
 }
 
+static void check_hscale_nv(void)
+{
+    static const int filter_sizes[FILTER_SIZES] = { 4, 8, 12, 16, 32, 40 };
+    static const int hscale_pairs[HSCALE_PAIRS][2] = {
+        { 8, 14 },
+        { 8, 18 },
+    };
+    static const int input_sizes[INPUT_SIZES] = {8, 24, 128, 144, 256, 512};
+
+    int i, j, fsi, hpi, width, dstWi;
+    struct SwsContext *ctx;
+
+    // padded, U and V interleaved
+    LOCAL_ALIGNED_32(uint8_t, src, [2 * FFALIGN(SRC_PIXELS + MAX_FILTER_WIDTH - 1, 4)]);
+    LOCAL_ALIGNED_32(uint32_t, dstU0, [SRC_PIXELS]);
+    LOCAL_ALIGNED_32(uint32_t, dstV0, [SRC_PIXELS]);
+    LOCAL_ALIGNED_32(uint32_t, dstU1, [SRC_PIXELS]);
+    LOCAL_ALIGNED_32(uint32_t, dstV1, [SRC_PIXELS]);
+
+    // padded
+    LOCAL_ALIGNED_32(int16_t, filter, [SRC_PIXELS * MAX_FILTER_WIDTH + MAX_FILTER_WIDTH]);
+    LOCAL_ALIGNED_32(int32_t, filterPos, [SRC_PIXELS]);
+    LOCAL_ALIGNED_32(int16_t, filterAvx2, [SRC_PIXELS * MAX_FILTER_WIDTH + MAX_FILTER_WIDTH]);
+    LOCAL_ALIGNED_32(int32_t, filterPosAvx, [SRC_PIXELS]);
+
+    declare_func_emms(AV_CPU_FLAG_MMX, void, void *c, void *dst1, void *dst2,
+                      int dstW, const uint8_t *src, const int16_t *filter,
+                      const int32_t *filterPos, int filterSize);
+
+    ctx = sws_alloc_context();
+    if (sws_init_context(ctx, NULL, NULL) < 0)
+        fail();
+    ctx->srcFormat = AV_PIX_FMT_NV12;
+
+    randomize_buffers(src, 2 * (SRC_PIXELS + MAX_FILTER_WIDTH - 1));
+
+    for (hpi = 0; hpi < HSCALE_PAIRS; hpi++) {
+        for (fsi = 0; fsi < FILTER_SIZES; fsi++) {
+            for (dstWi = 0; dstWi < INPUT_SIZES; dstWi++) {
+                width = filter_sizes[fsi];
+
+                ctx->srcBpc = hscale_pairs[hpi][0];
+                ctx->dstBpc = hscale_pairs[hpi][1];
+                ctx->hLumFilterSize = ctx->hChrFilterSize = width;
+
+                for (i = 0; i < SRC_PIXELS; i++) {
+                    filterPos[i] = i;
+                    filterPosAvx[i] = i;
+
+                    // same coefficients as in check_hscale()
+                    for (j = 0; j < width; j++) {
+                        filter[i * width + j] = -((1 << 14) / (width - 1));
+                    }
+                    filter[i * width + (rnd() % width)] = ((1 << 15) - 1);
+                }
+
+                for (i = 0; i < MAX_FILTER_WIDTH; i++)
+                    filter[SRC_PIXELS * width + i] = rnd();
+
+                ctx->dstW = ctx->chrDstW = input_sizes[dstWi];
+                ff_sws_init_scale(ctx);
+                memcpy(filterAvx2, filter, sizeof(uint16_t) * (SRC_PIXELS * MAX_FILTER_WIDTH + MAX_FILTER_WIDTH));
+                ff_shuffle_filter_coefficients(ctx, filterPosAvx, width, filterAvx2, ctx->dstW);
+
+                if (check_func(ctx->hcScaleNV, "hscale_nv_%d_to_%d__fs_%d_dstW_%d", ctx->srcBpc, ctx->dstBpc + 1, width, ctx->dstW)) {
+                    memset(dstU0, 0, SRC_PIXELS * sizeof(dstU0[0]));
+                    memset(dstV0, 0, SRC_PIXELS * sizeof(dstV0[0]));
+                    memset(dstU1, 0, SRC_PIXELS * sizeof(dstU1[0]));
+                    memset(dstV1, 0, SRC_PIXELS * sizeof(dstV1[0]));
+
+                    call_ref(NULL, dstU0, dstV0, ctx->dstW, src, filter, filterPos, width);
+                    call_new(NULL, dstU1, dstV1, ctx->dstW, src, filterAvx2, filterPosAvx, width);
+                    if (memcmp(dstU0, dstU1, ctx->dstW * sizeof(dstU0[0])) ||
+                        memcmp(dstV0, dstV1, ctx->dstW * sizeof(dstV0[0])))
+                        fail();
+                    bench_new(NULL, dstU0, dstV0, ctx->dstW, src, filter, filterPosAvx, width);
+                }
+            }
+        }
+    }
+    sws_freeContext(ctx);
+}
+
 void checkasm_check_sw_scale(void)
 {
     check_hscale();
     report("hscale");
+    check_hscale_nv();
+    report("hscale_nv");
     check_yuv2yuv1(0);
     check_yuv2yuv1(1);
     report("yuv2yuv1");
     check_yuv2yuvX(0);
     check_yuv2yuvX(1);
     report("yuv2yuvX");
+    check_yuv2yuv1_hbd();
+    report("yuv2yuv1_hbd");
+    check_yuv2yuvX_hbd();
+    report("yuv2yuvX_hbd");
+    check_yuv2p01xcX();
+    report("yuv2p01xcX");
 }
@@ -0,0 +1,22 @@
+tests/data/cache_dir: | tests/data
+	$(Q)mkdir -p $@
+
+FATE_CACHE-$(call DEMMUX, WAV, FRAMECRC, CACHE_PROTOCOL FILE_PROTOCOL) += fate-cache fate-cache-dir fate-cache-dir-unvalidated fate-cache-dir-reuse
+fate-cache: tests/data/asynth-44100-1.wav
+fate-cache: CMD = framecrc -i cache:$(TARGET_PATH)/tests/data/asynth-44100-1.wav -c copy
+
+# local files have no validator, so this falls back to the temporary file
+fate-cache-dir: tests/data/asynth-44100-1.wav tests/data/cache_dir
+fate-cache-dir: CMD = framecrc -cache_dir $(TARGET_PATH)/tests/data/cache_dir -cache_block_size 4096 -i cache:file:$(TARGET_PATH)/tests/data/asynth-44100-1.wav -c copy
+fate-cache-dir: REF = $(SRC_PATH)/tests/ref/fate/cache
+
+# the first run stores the blocks, the second one reads them back
+fate-cache-dir-unvalidated: tests/data/asynth-44100-1.wav tests/data/cache_dir
+fate-cache-dir-unvalidated: CMD = framecrc -cache_dir $(TARGET_PATH)/tests/data/cache_dir -cache_unvalidated 1 -cache_block_size 4096 -i cache:file:$(TARGET_PATH)/tests/data/asynth-44100-1.wav -c copy
+fate-cache-dir-unvalidated: REF = $(SRC_PATH)/tests/ref/fate/cache
+
+fate-cache-dir-reuse: fate-cache-dir-unvalidated
+fate-cache-dir-reuse: CMD = framecrc -cache_dir $(TARGET_PATH)/tests/data/cache_dir -cache_unvalidated 1 -cache_block_size 4096 -i cache:file:$(TARGET_PATH)/tests/data/asynth-44100-1.wav -c copy
+fate-cache-dir-reuse: REF = $(SRC_PATH)/tests/ref/fate/cache
+
+FATE_FFMPEG += $(FATE_CACHE-yes)
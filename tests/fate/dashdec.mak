@@ -0,0 +1,25 @@
+tests/data/dashdec.mpd: TAG = GEN
+tests/data/dashdec.mpd: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "testsrc2=d=6:s=160x120:r=25" -f lavfi -i "sine=d=6" -map 0 -map 1 \
+        -flags +bitexact -fflags +bitexact -threads 1 -dct fastint -codec:v mpeg2video -g 25 -codec:a mp2fixed \
+        -seg_duration 2 -use_template 1 -use_timeline 0 \
+        -init_seg_name 'dashdec_init_$$RepresentationID$$.m4s' \
+        -media_seg_name 'dashdec_chunk_$$RepresentationID$$_$$Number%03d$$.m4s' \
+        -f dash $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_DASHDEC-$(call ALLYES, DASH_DEMUXER MOV_DEMUXER DASH_MUXER MP4_MUXER      \
+                            TESTSRC2_FILTER SINE_FILTER LAVFI_INDEV            \
+                            MPEG2VIDEO_ENCODER MP2FIXED_ENCODER                \
+                            MPEG2VIDEO_DECODER MP3_DECODER EXTRACT_EXTRADATA_BSF) \
+                            += fate-dashdec fate-dashdec-prefetch
+fate-dashdec: tests/data/dashdec.mpd
+fate-dashdec: CMD = framecrc -i $(TARGET_PATH)/tests/data/dashdec.mpd -map 0 -c copy
+
+# each representation is read from its own prefetch thread,
+# this must not change the output
+fate-dashdec-prefetch: tests/data/dashdec.mpd
+fate-dashdec-prefetch: CMD = framecrc -prefetch_fragments 2 -prefetch_buffer_size 4096 -i $(TARGET_PATH)/tests/data/dashdec.mpd -map 0 -c copy
+fate-dashdec-prefetch: REF = $(SRC_PATH)/tests/ref/fate/dashdec
+
+FATE_FFMPEG += $(FATE_DASHDEC-yes)
@@ -85,6 +85,18 @@ FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILT
 fate-hls-list-size: tests/data/hls_list_size.m3u8
 fate-hls-list-size: CMD = framecrc -auto_conversion_filters -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_list_size.m3u8 -vf setpts=N*23
 
+tests/data/hls_async_io.m3u8: TAG = GEN
+tests/data/hls_async_io.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+	-f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=20" -f hls -hls_time 4 -map 0 \
+	-hls_list_size 4 -hls_flags delete_segments+temp_file -async_io 1 -async_io_queue_size 2 \
+	-codec:a mp2fixed -hls_segment_filename $(TARGET_PATH)/tests/data/hls_async_io_%d.ts \
+	$(TARGET_PATH)/tests/data/hls_async_io.m3u8 2>/dev/null
+
+FATE_HLSENC-$(call ALLYES, HLS_DEMUXER MPEGTS_MUXER MPEGTS_DEMUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER) += fate-hls-async-io
+fate-hls-async-io: tests/data/hls_async_io.m3u8
+fate-hls-async-io: CMD = framecrc -auto_conversion_filters -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_async_io.m3u8 -vf setpts=N*23
+
 tests/data/hls_fmp4.m3u8: TAG = GEN
 tests/data/hls_fmp4.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
 	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
@@ -109,6 +121,29 @@ FATE_HLSENC_PROBE-$(call ALLYES, HLS_DEMUXER EAC3_DEMUXER) += fate-hls-fmp4_ac3
 fate-hls-fmp4_ac3: tests/data/hls_fmp4_ac3.m3u8
 fate-hls-fmp4_ac3: CMD = probeaudiostream $(TARGET_PATH)/tests/data/now_ac3.mp4
 
+# each segment starts with an ID3 tag carrying an HLS timestamp, larger than
+# the first read of the demuxer
+tests/data/hls_id3.m3u8: TAG = GEN
+tests/data/hls_id3.m3u8: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "aevalsrc=cos(2*PI*t)*sin(2*PI*(440+4*t)*t):d=6" -f segment -segment_time 2 -map 0 \
+        -flags +bitexact -codec:a mp2fixed -segment_format mp2 \
+        -segment_list $(TARGET_PATH)/$@ -y $(TARGET_PATH)/tests/data/hls_id3-%03d.mp2 2>/dev/null
+	$(Q)for f in tests/data/hls_id3-*.mp2; do \
+        { printf 'ID3\004\000\000\000\002\071\011TIT2\000\002\070\100\000\000\000'; printf '%039999d' 0; \
+          printf 'PRIV\000\000\000\065\000\000com.apple.streaming.transportStreamTimestamp\000\000\000\000\000\000\000\000\000'; \
+          cat $$f; } > $$f.tmp && mv $$f.tmp $$f || exit 1; done
+
+FATE_HLSDEC-$(call ALLYES, HLS_DEMUXER MP3_DEMUXER SEGMENT_MUXER MP2_MUXER AEVALSRC_FILTER LAVFI_INDEV MP2FIXED_ENCODER MP2_DECODER) += fate-hls-id3 fate-hls-prefetch-id3
+fate-hls-id3: tests/data/hls_id3.m3u8
+fate-hls-id3: CMD = framecrc -auto_conversion_filters -flags +bitexact -i $(TARGET_PATH)/tests/data/hls_id3.m3u8
+
+# reading the segments from memory must not change the output
+fate-hls-prefetch-id3: tests/data/hls_id3.m3u8
+fate-hls-prefetch-id3: CMD = framecrc -auto_conversion_filters -flags +bitexact -prefetch_segments 2 -i $(TARGET_PATH)/tests/data/hls_id3.m3u8
+fate-hls-prefetch-id3: REF = $(SRC_PATH)/tests/ref/fate/hls-id3
+
+FATE_FFMPEG += $(FATE_HLSDEC-yes)
 FATE_SAMPLES_FFMPEG += $(FATE_HLSENC-yes)
 FATE_SAMPLES_FFMPEG_FFPROBE += $(FATE_HLSENC_PROBE-yes)
 fate-hlsenc: $(FATE_HLSENC-yes) $(FATE_HLSENC_PROBE-yes)
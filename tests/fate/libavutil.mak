@@ -136,6 +136,11 @@ FATE_LIBAVUTIL += fate-random_seed
 fate-random_seed: libavutil/tests/random_seed$(EXESUF)
 fate-random_seed: CMD = run libavutil/tests/random_seed$(EXESUF)
 
+FATE_LIBAVUTIL-$(HAVE_THREADS) += fate-ringqueue
+fate-ringqueue: libavutil/tests/ringqueue$(EXESUF)
+fate-ringqueue: CMD = run libavutil/tests/ringqueue$(EXESUF)
+fate-ringqueue: CMP = null
+
 FATE_LIBAVUTIL += fate-ripemd
 fate-ripemd: libavutil/tests/ripemd$(EXESUF)
 fate-ripemd: CMD = run libavutil/tests/ripemd$(EXESUF)
@@ -2,6 +2,7 @@ FATE_MOV = fate-mov-3elist \
            fate-mov-3elist-1ctts \
            fate-mov-1elist-1ctts \
            fate-mov-1elist-noctts \
+           fate-mov-1elist-noctts-lazy-index \
            fate-mov-elist-starts-ctts-2ndsample \
            fate-mov-1elist-ends-last-bframe \
            fate-mov-2elist-elist1-ends-bframe \
@@ -47,6 +48,10 @@ fate-mov-1elist-1ctts: CMD = framemd5 -i $(TARGET_SAMPLES)/mov/mov-1elist-1ctts.
 fate-mov-3elist: CMD = framemd5 -i $(TARGET_SAMPLES)/mov/mov-3elist.mov
 fate-mov-3elist-1ctts: CMD = framemd5 -i $(TARGET_SAMPLES)/mov/mov-3elist-1ctts.mov
 
+# A lazily built index must give the same packets as the fully built one.
+fate-mov-1elist-noctts-lazy-index: CMD = framemd5 -lazy_index 1 -i $(TARGET_SAMPLES)/mov/mov-1elist-noctts.mov
+fate-mov-1elist-noctts-lazy-index: REF = $(SRC_PATH)/tests/ref/fate/mov-1elist-noctts
+
 # Edit list with encryption
 fate-mov-3elist-encrypted: CMD = framemd5 -decryption_key 12345678901234567890123456789012 -i $(TARGET_SAMPLES)/mov/mov-3elist-encrypted.mov
 
@@ -165,6 +170,30 @@ FATE_MOV_FFMPEG-$(call TRANSCODE, PCM_S16LE, MOV, WAV_DEMUXER PAN_FILTER) \
 fate-mov-channel-description: tests/data/asynth-44100-1.wav tests/data/filtergraphs/mov-channel-description
 fate-mov-channel-description: CMD = transcode wav $(TARGET_PATH)/tests/data/asynth-44100-1.wav mov "-filter_complex_script $(TARGET_PATH)/tests/data/filtergraphs/mov-channel-description -map [outFL] -map [outFR] -map [outFC] -map [outLFE] -map [outBL] -map [outBR] -map [outDL] -map [outDR] -c:a pcm_s16le" "-map 0 -c copy -frames:a 0"
 
+# every other second is silent, so half of the packets are followed by zeroes
+# in the I/O buffer and are read as references to it
+tests/data/mov-pcm-ref.mov: TAG = GEN
+tests/data/mov-pcm-ref.mov: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "aevalsrc=if(lt(mod(t\,1)\,0.5)\,sin(2*PI*440*t)\,0):d=4" \
+        -flags +bitexact -fflags +bitexact -c:a pcm_s16le -y $(TARGET_PATH)/$@ 2>/dev/null
+
+FATE_MOV_PCM-$(HAVE_MMAP) += fate-mov-pcm-mmap
+FATE_MOV_FFMPEG-$(call ALLYES, MOV_MUXER MOV_DEMUXER AEVALSRC_FILTER LAVFI_INDEV PCM_S16LE_ENCODER) \
+                          += fate-mov-pcm-ref fate-mov-pcm-direct $(FATE_MOV_PCM-yes)
+fate-mov-pcm-ref: tests/data/mov-pcm-ref.mov
+fate-mov-pcm-ref: CMD = framecrc -i $(TARGET_PATH)/tests/data/mov-pcm-ref.mov -c copy
+
+# all packets are copied when reading without buffering
+fate-mov-pcm-direct: tests/data/mov-pcm-ref.mov
+fate-mov-pcm-direct: CMD = framecrc -avioflags direct -i $(TARGET_PATH)/tests/data/mov-pcm-ref.mov -c copy
+fate-mov-pcm-direct: REF = $(SRC_PATH)/tests/ref/fate/mov-pcm-ref
+
+# the I/O buffer is a mapping of the whole file
+fate-mov-pcm-mmap: tests/data/mov-pcm-ref.mov
+fate-mov-pcm-mmap: CMD = framecrc -mmap 1 -i $(TARGET_PATH)/tests/data/mov-pcm-ref.mov -c copy
+fate-mov-pcm-mmap: REF = $(SRC_PATH)/tests/ref/fate/mov-pcm-ref
+
 FATE_FFMPEG += $(FATE_MOV_FFMPEG-yes)
 
 fate-mov: $(FATE_MOV) $(FATE_MOV_FFMPEG-yes) $(FATE_MOV_FFPROBE) $(FATE_MOV_FASTSTART) $(FATE_MOV_FFMPEG_FFPROBE-yes)
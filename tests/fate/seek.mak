@@ -198,13 +198,48 @@ fate-seek-mkv-codec-delay:   CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_
 
 FATE_SEEK_EXTRA += $(FATE_SEEK_EXTRA-yes)
 
+# lazily built mov index, must match the refs of the fully built index
 
-$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA): libavformat/tests/seek$(EXESUF)
+FATE_SEEK_LAZY_INDEX-$(CONFIG_MOV_DEMUXER) += fate-seek-extra-mp4-lazy-index
+FATE_SEEK_LAZY_INDEX := $(FATE_SEEK_LAZY_INDEX-yes)
+
+fate-seek-extra-mp4-lazy-index: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_SAMPLES)/mov/buck480p30_na.mp4 -duration 180 -frames 4 -lazy_index 1
+
+FATE_SEEK_LAZY_INDEX_ACODEC := $(filter fate-seek-acodec-pcm-s16be, $(FATE_SEEK_ACODEC))
+FATE_SEEK_LAZY_INDEX_ACODEC := $(FATE_SEEK_LAZY_INDEX_ACODEC:%=%-lazy-index)
+$(FATE_SEEK_LAZY_INDEX_ACODEC): fate-seek-%-lazy-index: fate-%
+$(FATE_SEEK_LAZY_INDEX_ACODEC:fate-seek-%-lazy-index=fate-%): KEEP_FILES ?= 1
+$(FATE_SEEK_LAZY_INDEX_ACODEC): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/fate/$(@:fate-seek-%-lazy-index=%).mov -lazy_index 1
+
+$(FATE_SEEK_LAZY_INDEX) $(FATE_SEEK_LAZY_INDEX_ACODEC): REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%-lazy-index=%)
+
+# fragment index cache of a fragmented file without sidx or mfra, the first
+# open writes the cache and the second one loads it instead of the moof boxes
+
+tests/data/mov-frag.mp4: TAG = GEN
+tests/data/mov-frag.mp4: ffmpeg$(PROGSSUF)$(EXESUF) | tests/data
+	$(M)$(TARGET_EXEC) $(TARGET_PATH)/$< -nostdin \
+        -f lavfi -i "testsrc2=d=10:s=160x120:r=25" -flags +bitexact -fflags +bitexact \
+        -threads 1 -dct fastint -codec:v mpeg2video -g 25 -movflags frag_keyframe+empty_moov+skip_trailer \
+        -y $(TARGET_PATH)/$@ 2>/dev/null
+	$(Q)rm -f tests/data/mov-frag.idx
+
+FATE_SEEK_INDEX_CACHE-$(call ENCMUX, MPEG2VIDEO, MP4, MOV_DEMUXER TESTSRC2_FILTER LAVFI_INDEV) += fate-seek-mov-frag fate-seek-mov-frag-index-cache-write fate-seek-mov-frag-index-cache-read
+FATE_SEEK_INDEX_CACHE := $(FATE_SEEK_INDEX_CACHE-yes)
+
+$(FATE_SEEK_INDEX_CACHE): tests/data/mov-frag.mp4
+fate-seek-mov-frag: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-frag.mp4 -duration 10
+fate-seek-mov-frag-index-cache-write: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-frag.mp4 -duration 10 -index_cache $(TARGET_PATH)/tests/data/mov-frag.idx
+fate-seek-mov-frag-index-cache-read: fate-seek-mov-frag-index-cache-write
+fate-seek-mov-frag-index-cache-read: CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/mov-frag.mp4 -duration 10 -index_cache $(TARGET_PATH)/tests/data/mov-frag.idx
+$(FATE_SEEK_INDEX_CACHE): REF = $(SRC_PATH)/tests/ref/seek/mov-frag
+
+$(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAZY_INDEX) $(FATE_SEEK_LAZY_INDEX_ACODEC) $(FATE_SEEK_INDEX_CACHE): libavformat/tests/seek$(EXESUF)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): CMD = run libavformat/tests/seek$(EXESUF) $(TARGET_PATH)/tests/data/$(SRC)
 $(FATE_SEEK) $(FATE_SAMPLES_SEEK): fate-seek-%: fate-%
 $(subst fate-seek-,fate-,$(FATE_SAMPLES_SEEK) $(FATE_SEEK)): KEEP_FILES ?= 1
 fate-seek-%: REF = $(SRC_PATH)/tests/ref/seek/$(@:fate-seek-%=%)
 
-FATE_AVCONV += $(FATE_SEEK)
-FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
-fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA)
+FATE_AVCONV += $(FATE_SEEK) $(FATE_SEEK_LAZY_INDEX_ACODEC) $(FATE_SEEK_INDEX_CACHE)
+FATE_SAMPLES_AVCONV += $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAZY_INDEX)
+fate-seek:     $(FATE_SEEK) $(FATE_SAMPLES_SEEK) $(FATE_SEEK_EXTRA) $(FATE_SEEK_LAZY_INDEX) $(FATE_SEEK_LAZY_INDEX_ACODEC) $(FATE_SEEK_INDEX_CACHE)